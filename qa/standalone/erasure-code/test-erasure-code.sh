@@ -326,6 +326,53 @@ function TEST_chunk_mapping() {
     ceph osd erasure-code-profile rm remap-profile
 }
 
+function TEST_rados_overwrite_parity_delta() {
+    local dir=$1
+    local poolname=pool-delta
+    local objname=SOMETHING
+    local stripe_unit=$(chunk_size)
+    local stripe_width=$(($stripe_unit * 4))
+
+    # k=4 m=2: a write within one data chunk reads that chunk and the two
+    # coding chunks, fewer than the four needed to decode the stripe
+    ceph osd erasure-code-profile set delta-profile \
+        plugin=jerasure technique=reed_sol_van k=4 m=2 \
+        crush-failure-domain=osd || return 1
+    create_pool $poolname 1 1 erasure delta-profile || return 1
+    ceph osd pool set $poolname allow_ec_overwrites true || return 1
+    wait_for_clean || return 1
+
+    dd if=/dev/urandom of=$dir/ORIGINAL bs=$stripe_width count=4 || return 1
+    rados --pool $poolname put $objname $dir/ORIGINAL || return 1
+
+    # overwrite part of data chunk 1 of the third stripe
+    local offset=$(($stripe_width * 2 + $stripe_unit + 512))
+    dd if=/dev/urandom of=$dir/PATCH bs=1024 count=1 || return 1
+    rados --pool $poolname put $objname $dir/PATCH --offset $offset || return 1
+    dd if=$dir/PATCH of=$dir/ORIGINAL bs=1 seek=$offset conv=notrunc || return 1
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    cmp $dir/ORIGINAL $dir/COPY || return 1
+    rm $dir/COPY
+
+    local -a osds=($(get_osds $poolname $objname))
+    CEPH_ARGS='' ceph --admin-daemon $(get_asok_path osd.${osds[0]}) log flush || return 1
+    grep -q 'encode_delta_and_write' $dir/osd.${osds[0]}.log || return 1
+
+    # without the modified data shard the stripe is decoded from the
+    # coding chunks, which only hold the write if the deltas were right
+    kill_daemons $dir KILL osd.${osds[1]} || return 1
+    ceph osd down ${osds[1]} || return 1
+    rados --pool $poolname get $objname $dir/COPY || return 1
+    cmp $dir/ORIGINAL $dir/COPY || return 1
+    rm $dir/COPY
+    activate_osd $dir ${osds[1]} || return 1
+    wait_for_clean || return 1
+
+    rm $dir/ORIGINAL $dir/PATCH
+    delete_pool $poolname
+    ceph osd erasure-code-profile rm delta-profile
+}
+
 main test-erasure-code "$@"
 
 # Local Variables:
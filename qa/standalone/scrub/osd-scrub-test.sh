@@ -389,6 +389,76 @@ function TEST_scrub_permit_time() {
     teardown $dir || return 1
 }
 
+# A periodic deep scrub with osd_deep_scrub_incremental only reads the
+# objects written since the previous deep scrub; one requested by the
+# operator reads them all.
+function TEST_deep_scrub_incremental() {
+    local dir=$1
+    local poolname=test
+    local OSDS=3
+    local objects=10
+
+    TESTDATA="testdata.$$"
+
+    setup $dir || return 1
+    run_mon $dir a --osd_pool_default_size=3 || return 1
+    run_mgr $dir x || return 1
+    ceph config set osd osd_deep_scrub_incremental true || return 1
+    # no sampling: unchanged objects are never read
+    ceph config set osd osd_deep_scrub_incremental_sample 0 || return 1
+    ceph config set osd osd_deep_scrub_randomize_ratio 0 || return 1
+    ceph config set osd osd_scrub_interval_randomize_ratio 0 || return 1
+    for osd in $(seq 0 $(expr $OSDS - 1))
+    do
+      run_osd $dir $osd || return 1
+    done
+
+    # Create a pool with a single pg
+    create_pool $poolname 1 1
+    wait_for_clean || return 1
+    poolid=$(ceph osd dump | grep "^pool.*[']${poolname}[']" | awk '{ print $2 }')
+    local pgid="${poolid}.0"
+
+    dd if=/dev/urandom of=$TESTDATA bs=1032 count=1
+    for i in `seq 1 $objects`
+    do
+        rados -p $poolname put obj${i} $TESTDATA || return 1
+    done
+
+    # a full deep scrub sets the baseline
+    pg_deep_scrub "$pgid" || return 1
+    test "$(ceph pg $pgid query | jq '.info.stats.stat_sum.num_scrub_errors')" = "0" || return 1
+
+    # damage the data of obj1 behind the OSD's back, keeping its size, so
+    # only reading it can tell; its version is unchanged
+    local primary=$(get_primary $poolname obj1)
+    local otherosd=$(get_not_primary $poolname obj1)
+    dd if=/dev/urandom of=$TESTDATA.bad bs=1032 count=1
+    objectstore_tool $dir $otherosd obj1 set-bytes $TESTDATA.bad || return 1
+    rados -p $poolname put obj2 $TESTDATA || return 1
+    rm -f $TESTDATA $TESTDATA.bad
+
+    # make the next periodic scrub a deep one and schedule it
+    local last_deep_scrub=$(get_last_scrub_stamp $pgid last_deep_scrub_stamp)
+    ceph tell $pgid deep_scrub || return 1
+    ceph tell $pgid scrub || return 1
+    wait_for_scrub $pgid "$last_deep_scrub" last_deep_scrub_stamp || return 1
+
+    # obj1 was not read, obj2 was
+    grep -q "obj1:head not written since" $dir/osd.${primary}.log || return 1
+    grep -q "obj1:head not written since" $dir/osd.${otherosd}.log || return 1
+    ! grep -q "obj2:head not written since" $dir/osd.${primary}.log || return 1
+    test "$(ceph pg $pgid query | jq '.info.stats.stat_sum.num_scrub_errors')" = "0" || return 1
+    ceph pg dump pgs | grep ^${pgid} | grep -vq -- +inconsistent || return 1
+
+    # an operator deep scrub reads everything and finds the damage
+    pg_deep_scrub "$pgid" || return 1
+    ceph pg dump pgs | grep ^${pgid} | grep -q -- +inconsistent || return 1
+    test "$(ceph pg $pgid query | jq '.info.stats.stat_sum.num_scrub_errors')" -gt "0" || return 1
+
+    teardown $dir || return 1
+}
+
 main osd-scrub-test "$@"
 
 # Local Variables:
@@ -2202,6 +2202,14 @@ function test_mon_osd_pool_set()
   check_response 'not change the size'
   set -e
   ceph osd pool get pool_erasure erasure_code_profile
+  ceph osd pool get pool_erasure ec_read_hedge | expect_false grep '.'
+  ceph osd pool set pool_erasure ec_read_hedge 1
+  ceph osd pool get pool_erasure ec_read_hedge | grep 'ec_read_hedge: 1'
+  expect_false ceph osd pool set pool_erasure ec_read_hedge -1
+  expect_false ceph osd pool set pool_erasure ec_read_hedge 4444
+  ceph osd pool set pool_erasure ec_read_hedge 0
+  ceph osd pool get pool_erasure ec_read_hedge | expect_false grep '.'
+  expect_false ceph osd pool set $TEST_POOL_GETSET ec_read_hedge 1
   ceph osd pool rm pool_erasure pool_erasure --yes-i-really-really-mean-it
 
   for flag in nodelete nopgchange nosizechange write_fadvise_dontneed noscrub nodeep-scrub; do
@@ -2292,6 +2300,8 @@ function test_mon_osd_pool_set()
   ceph osd pool get $TEST_POOL_GETSET compression_mode | expect_false grep '.'
   ceph osd pool set $TEST_POOL_GETSET compression_mode aggressive
   ceph osd pool get $TEST_POOL_GETSET compression_mode | grep 'aggressive'
+  ceph osd pool set $TEST_POOL_GETSET compression_mode adaptive
+  ceph osd pool get $TEST_POOL_GETSET compression_mode | grep 'adaptive'
   ceph osd pool set $TEST_POOL_GETSET compression_mode unset
   ceph osd pool get $TEST_POOL_GETSET compression_mode | expect_false grep '.'
 
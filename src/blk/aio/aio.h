@@ -103,6 +103,12 @@ struct io_queue_t {
   virtual int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
 			   void *priv, int *retries) = 0;
   virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+
+  /// get a buffer pinned and registered with the kernel for fixed-buffer
+  /// io, or an empty ptr if the backend has none (left) of size len
+  virtual ceph::bufferptr get_registered_buffer(unsigned len) {
+    return ceph::bufferptr();
+  }
 };
 
 struct aio_queue_t final : public io_queue_t {
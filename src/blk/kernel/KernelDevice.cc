@@ -70,7 +70,15 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
   unsigned int iodepth = cct->_conf->bdev_aio_max_queue_depth;
 
   if (use_ioring && ioring_queue_t::supported()) {
-    io_queue = std::make_unique<ioring_queue_t>(iodepth);
+    bool use_ioring_hipri = cct->_conf.get_val<bool>("bdev_ioring_hipri");
+    unsigned hipri_spin_us = cct->_conf.get_val<uint64_t>("bdev_ioring_hipri_spin_us");
+    bool use_ioring_sqthread_poll = cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll");
+    unsigned nr_buffers = cct->_conf.get_val<uint64_t>("bdev_ioring_registered_buffers");
+    size_t buffer_size = cct->_conf.get_val<Option::size_t>("bdev_ioring_registered_buffer_size");
+    io_queue = std::make_unique<ioring_queue_t>(iodepth, use_ioring_hipri,
+						hipri_spin_us,
+						use_ioring_sqthread_poll,
+						nr_buffers, buffer_size);
   } else {
     static bool once;
     if (use_ioring && !once) {
@@ -231,6 +239,9 @@ int KernelDevice::open(const string& p)
       rotational = blkdev_buffered.is_rotational();
       support_discard = blkdev_buffered.support_discard();
       this->devname = devname;
+      if (blkdev_buffered.get_numa_node(&numa_node) < 0) {
+	numa_node = -1;
+      }
       _detect_vdo();
     }
   }
@@ -538,9 +549,29 @@ static bool is_expected_ioerr(const int r)
 	  );
 }
 
+void KernelDevice::_set_numa_affinity()
+{
+  if (!cct->_conf.get_val<bool>("bdev_numa_affinity")) {
+    return;
+  }
+  if (numa_node < 0) {
+    dout(1) << __func__ << " unable to determine numa node of " << path
+	    << dendl;
+    return;
+  }
+  int r = set_numa_affinity_this_thread(numa_node);
+  if (r < 0) {
+    derr << __func__ << " failed to bind to numa node " << numa_node << ": "
+	 << cpp_strerror(r) << dendl;
+    return;
+  }
+  dout(1) << __func__ << " bound to numa node " << numa_node << dendl;
+}
+
 void KernelDevice::_aio_thread()
 {
   dout(10) << __func__ << " start" << dendl;
+  _set_numa_affinity();
   int inject_crash_count = 0;
   while (!aio_stop) {
     dout(40) << __func__ << " polling" << dendl;
@@ -663,6 +694,7 @@ void KernelDevice::_aio_thread()
 
 void KernelDevice::_discard_thread()
 {
+  _set_numa_affinity();
   std::unique_lock l(discard_lock);
   ceph_assert(!discard_started);
   discard_started = true;
@@ -931,6 +963,19 @@ int KernelDevice::aio_write(
     return 0;
   }
 
+  if (aio && dio && !buffered &&
+      !bl.is_aligned_size_and_memory(block_size, block_size)) {
+    // we have to copy to align anyway; if the backend has pinned,
+    // pre-registered memory, copy there so the kernel can skip mapping
+    // the pages for this io.
+    bufferptr p = io_queue->get_registered_buffer(len);
+    if (p.have_raw()) {
+      bl.begin().copy(len, p.c_str());
+      bl.clear();
+      bl.append(std::move(p));
+      dout(20) << __func__ << " copied to registered buffer" << dendl;
+    }
+  }
   if ((!buffered || bl.get_num_buffers() >= IOV_MAX) &&
       bl.rebuild_aligned_size_and_memory(block_size, block_size, IOV_MAX)) {
     dout(20) << __func__ << " rebuilding buffer to be aligned" << dendl;
@@ -38,6 +38,7 @@ class KernelDevice : public BlockDevice {
   std::string vdo_name;
 
   std::string devname;  ///< kernel dev name (/sys/block/$devname), if any
+  int numa_node = -1;   ///< numa node the device is attached to, if known
 
   ceph::mutex debug_lock = ceph::make_mutex("KernelDevice::debug_lock");
   interval_set<uint64_t> debug_inflight;
@@ -80,6 +81,7 @@ class KernelDevice : public BlockDevice {
 
   void _aio_thread();
   void _discard_thread();
+  void _set_numa_affinity();
   int queue_discard(interval_set<uint64_t> &to_release) override;
 
   int _aio_start();
@@ -7,18 +7,27 @@
 
 #include "liburing.h"
 #include <sys/epoll.h>
+#include <sys/mman.h>
 
-/* Options */
-
-static bool hipri = false;      /* use IO polling */
-static bool sq_thread = false;  /* use kernel submission/poller thread */
+#include "common/ceph_time.h"
+#include "common/deleter.h"
 
 struct ioring_data {
   struct io_uring io_uring;
   pthread_mutex_t cq_mutex;
   pthread_mutex_t sq_mutex;
+  // with IOPOLL, signalled under sq_mutex when ios are submitted
+  pthread_cond_t sq_cond;
+  unsigned inflight = 0;  ///< submitted and not reaped yet, under sq_mutex
   int epoll_fd = -1;
   std::map<int, int> fixed_fds_map;
+
+  // pool of buffers registered with io_uring_register_buffers()
+  pthread_mutex_t buf_mutex;
+  char *buf_base = nullptr;
+  size_t buf_size = 0;
+  unsigned buf_count = 0;
+  std::vector<unsigned> buf_free;  ///< indexes of unused buffers
 };
 
 static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
@@ -52,20 +61,47 @@ static int find_fixed_fd(struct ioring_data *d, int real_fd)
   return it->second;
 }
 
+// index of the registered buffer covering the single iovec of io, or -1
+static int find_fixed_buffer(struct ioring_data *d, struct aio_t *io)
+{
+  if (!d->buf_base || io->iov.size() != 1)
+    return -1;
+
+  char *base = (char *)io->iov[0].iov_base;
+  if (base < d->buf_base ||
+      base >= d->buf_base + d->buf_size * d->buf_count)
+    return -1;
+
+  unsigned idx = (base - d->buf_base) / d->buf_size;
+  if (base + io->iov[0].iov_len > d->buf_base + d->buf_size * (idx + 1))
+    return -1;
+
+  return idx;
+}
+
 static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 		     struct aio_t *io)
 {
   int fixed_fd = find_fixed_fd(d, io->fd);
+  int fixed_buf = find_fixed_buffer(d, io);
 
   ceph_assert(fixed_fd != -1);
 
-  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
-    io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
-			 io->iov.size(), io->offset);
-  else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
-    io_uring_prep_readv(sqe, fixed_fd, &io->iov[0],
-			io->iov.size(), io->offset);
-  else
+  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV) {
+    if (fixed_buf >= 0)
+      io_uring_prep_write_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+				io->iov[0].iov_len, io->offset, fixed_buf);
+    else
+      io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
+			   io->iov.size(), io->offset);
+  } else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV) {
+    if (fixed_buf >= 0)
+      io_uring_prep_read_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+			       io->iov[0].iov_len, io->offset, fixed_buf);
+    else
+      io_uring_prep_readv(sqe, fixed_fd, &io->iov[0],
+			  io->iov.size(), io->offset);
+  } else
     ceph_assert(0);
 
   io_uring_sqe_set_data(sqe, io);
@@ -73,30 +109,53 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 }
 
 static int ioring_queue(struct ioring_data *d, void *priv,
-			list<aio_t>::iterator beg, list<aio_t>::iterator end)
+			list<aio_t>::iterator beg, list<aio_t>::iterator end,
+			int *retries)
 {
   struct io_uring *ring = &d->io_uring;
-  struct aio_t *io = nullptr;
+  // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
+  int attempts = 16;
+  int delay = 125;
+  int done = 0;
+  int queued = 0;
 
   ceph_assert(beg != end);
 
-  do {
-    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
-    if (!sqe)
-      break;
-
-    io = &*beg;
-    io->priv = priv;
-
-    init_sqe(d, sqe, io);
-
-  } while (++beg != end);
-
-  if (!io)
-    /* Queue is full, go and reap something first */
-    return 0;
+  // fill as many sqes as the ring takes and submit them with a single
+  // io_uring_enter(); only go back to the kernel early when the
+  // submission ring is full.
+  while (beg != end || queued) {
+    struct io_uring_sqe *sqe = beg != end ? io_uring_get_sqe(ring) : nullptr;
+    if (sqe) {
+      struct aio_t *io = &*beg;
+      io->priv = priv;
+      init_sqe(d, sqe, io);
+      ++queued;
+      ++beg;
+      continue;
+    }
+
+    int r = io_uring_submit(ring);
+    if (r == 0)
+      r = -EAGAIN;
+    if (r < 0) {
+      if ((r == -EAGAIN || r == -EBUSY) && attempts-- > 0) {
+	/* completion ring is full, let the reaper catch up */
+	usleep(delay);
+	delay *= 2;
+	(*retries)++;
+	continue;
+      }
+      return r;
+    }
+    done += r;
+    queued -= r;
+    d->inflight += r;
+    attempts = 16;
+    delay = 125;
+  }
 
-  return io_uring_submit(ring);
+  return done;
 }
 
 static void build_fixed_fds_map(struct ioring_data *d,
@@ -108,9 +167,59 @@ static void build_fixed_fds_map(struct ioring_data *d,
   }
 }
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_) :
+static int register_buffers(struct ioring_data *d, unsigned count,
+			    size_t size)
+{
+  size_t total = count * size;
+  void *p = mmap(nullptr, total, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return -errno;
+
+  std::vector<struct iovec> iovs(count);
+  for (unsigned i = 0; i < count; ++i) {
+    iovs[i].iov_base = (char *)p + i * size;
+    iovs[i].iov_len = size;
+  }
+  int ret = io_uring_register_buffers(&d->io_uring, &iovs[0], count);
+  if (ret < 0) {
+    munmap(p, total);
+    return ret;
+  }
+
+  d->buf_base = (char *)p;
+  d->buf_size = size;
+  d->buf_count = count;
+  d->buf_free.reserve(count);
+  for (unsigned i = count; i > 0; --i) {
+    d->buf_free.push_back(i - 1);
+  }
+  return 0;
+}
+
+static void unregister_buffers(struct ioring_data *d)
+{
+  if (!d->buf_base)
+    return;
+
+  ceph_assert(d->buf_free.size() == d->buf_count);  // all returned?
+  io_uring_unregister_buffers(&d->io_uring);
+  munmap(d->buf_base, d->buf_size * d->buf_count);
+  d->buf_base = nullptr;
+  d->buf_free.clear();
+  d->buf_count = 0;
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_,
+			       unsigned hipri_spin_us_, bool sq_thread_,
+			       unsigned nr_buffers_, size_t buffer_size_) :
   d(make_unique<ioring_data>()),
-  iodepth(iodepth_)
+  iodepth(iodepth_),
+  hipri(hipri_),
+  hipri_spin_us(hipri_spin_us_),
+  sq_thread(sq_thread_),
+  nr_buffers(nr_buffers_),
+  buffer_size(buffer_size_)
 {
 }
 
@@ -124,6 +233,12 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
   pthread_mutex_init(&d->cq_mutex, NULL);
   pthread_mutex_init(&d->sq_mutex, NULL);
+  pthread_mutex_init(&d->buf_mutex, NULL);
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&d->sq_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
 
   if (hipri)
     flags |= IORING_SETUP_IOPOLL;
@@ -143,10 +258,16 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
   build_fixed_fds_map(d.get(), fds);
 
+  if (nr_buffers && buffer_size) {
+    ret = register_buffers(d.get(), nr_buffers, buffer_size);
+    if (ret < 0)
+      goto close_ring_fd;
+  }
+
   d->epoll_fd = epoll_create1(0);
   if (d->epoll_fd < 0) {
     ret = -errno;
-    goto close_ring_fd;
+    goto unregister_buffers;
   }
 
   struct epoll_event ev;
@@ -161,6 +282,8 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
 close_epoll_fd:
   close(d->epoll_fd);
+unregister_buffers:
+  unregister_buffers(d.get());
 close_ring_fd:
   io_uring_queue_exit(&d->io_uring);
 
@@ -172,6 +295,7 @@ void ioring_queue_t::shutdown()
   d->fixed_fds_map.clear();
   close(d->epoll_fd);
   d->epoll_fd = -1;
+  unregister_buffers(d.get());
   io_uring_queue_exit(&d->io_uring);
 }
 
@@ -180,23 +304,95 @@ int ioring_queue_t::submit_batch(aio_iter beg, aio_iter end,
                                  int *retries)
 {
   (void)aios_size;
-  (void)retries;
 
   pthread_mutex_lock(&d->sq_mutex);
-  int rc = ioring_queue(d.get(), priv, beg, end);
+  int rc = ioring_queue(d.get(), priv, beg, end, retries);
+  if (d->inflight)
+    pthread_cond_signal(&d->sq_cond);
   pthread_mutex_unlock(&d->sq_mutex);
 
   return rc;
 }
 
+/*
+ * With IOPOLL the ring fd never becomes readable and completions are only
+ * found by polling the device from io_uring_enter().  Poll for up to
+ * hipri_spin_us, then wait in the kernel for a completion, but no longer
+ * than the caller's deadline, like epoll_wait() does for interrupt rings.
+ * Nothing is polled while no io is in flight: sleep until one is
+ * submitted instead.
+ */
+static int ioring_wait_polled(struct ioring_data *d,
+			      ceph::mono_clock::time_point deadline,
+			      ceph::mono_clock::time_point spin_deadline)
+{
+  pthread_mutex_lock(&d->sq_mutex);
+  while (d->inflight == 0) {
+    if (ceph::mono_clock::now() >= deadline) {
+      pthread_mutex_unlock(&d->sq_mutex);
+      return 0;
+    }
+    // sq_cond waits on CLOCK_MONOTONIC, which mono_clock reads
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      deadline.time_since_epoch()).count();
+    struct timespec ts = { (time_t)(ns / 1000000000), (long)(ns % 1000000000) };
+    pthread_cond_timedwait(&d->sq_cond, &d->sq_mutex, &ts);
+  }
+  int ret;
+  if (ceph::mono_clock::now() < spin_deadline) {
+    ret = io_uring_submit(&d->io_uring);
+    pthread_mutex_unlock(&d->sq_mutex);
+  } else {
+    auto now = ceph::mono_clock::now();
+    if (now >= deadline) {
+      pthread_mutex_unlock(&d->sq_mutex);
+      return 0;
+    }
+#ifdef IORING_FEAT_EXT_ARG
+    if (d->io_uring.features & IORING_FEAT_EXT_ARG) {
+      pthread_mutex_unlock(&d->sq_mutex);
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+	deadline - now).count();
+      struct __kernel_timespec ts = { ns / 1000000000, ns % 1000000000 };
+      struct io_uring_cqe *cqe;
+      ret = io_uring_wait_cqe_timeout(&d->io_uring, &cqe, &ts);
+      if (ret == -ETIME)
+	return 0;
+      if (ret == -EINTR || ret == -EAGAIN)
+	ret = 0;
+      return ret < 0 ? ret : 1;
+    }
+#endif
+    // without IORING_FEAT_EXT_ARG the timeout is passed as an sqe, which
+    // IOPOLL rings reject; keep polling until the caller's deadline instead
+    ret = io_uring_submit(&d->io_uring);
+    pthread_mutex_unlock(&d->sq_mutex);
+  }
+  return ret < 0 ? ret : 1;
+}
+
 int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
 {
+  auto now = ceph::mono_clock::now();
+  auto deadline = now + std::chrono::milliseconds(timeout_ms);
+  auto spin_deadline = now + std::chrono::microseconds(hipri_spin_us);
+
 get_cqe:
   pthread_mutex_lock(&d->cq_mutex);
   int events = ioring_get_cqe(d.get(), max, paio);
   pthread_mutex_unlock(&d->cq_mutex);
 
-  if (events == 0) {
+  if (events > 0 && hipri) {
+    pthread_mutex_lock(&d->sq_mutex);
+    d->inflight -= events;
+    pthread_mutex_unlock(&d->sq_mutex);
+  } else if (events == 0 && hipri) {
+    int ret = ioring_wait_polled(d.get(), deadline, spin_deadline);
+    if (ret < 0)
+      return ret;
+    if (ret > 0)
+      goto get_cqe;
+  } else if (events == 0) {
     struct epoll_event ev;
     int ret = epoll_wait(d->epoll_fd, &ev, 1, timeout_ms);
     if (ret < 0)
@@ -209,6 +405,30 @@ get_cqe:
   return events;
 }
 
+ceph::bufferptr ioring_queue_t::get_registered_buffer(unsigned len)
+{
+  struct ioring_data *dd = d.get();
+  if (!dd->buf_base || len > dd->buf_size)
+    return ceph::bufferptr();
+
+  pthread_mutex_lock(&dd->buf_mutex);
+  if (dd->buf_free.empty()) {
+    pthread_mutex_unlock(&dd->buf_mutex);
+    return ceph::bufferptr();
+  }
+  unsigned idx = dd->buf_free.back();
+  dd->buf_free.pop_back();
+  pthread_mutex_unlock(&dd->buf_mutex);
+
+  return ceph::bufferptr(ceph::buffer::claim_buffer(
+    len, dd->buf_base + idx * dd->buf_size,
+    make_deleter([dd, idx] {
+      pthread_mutex_lock(&dd->buf_mutex);
+      dd->buf_free.push_back(idx);
+      pthread_mutex_unlock(&dd->buf_mutex);
+    })));
+}
+
 bool ioring_queue_t::supported()
 {
   struct io_uring ring;
@@ -224,7 +444,9 @@ bool ioring_queue_t::supported()
 
 struct ioring_data {};
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_)
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_,
+			       unsigned hipri_spin_us_, bool sq_thread_,
+			       unsigned nr_buffers_, size_t buffer_size_)
 {
   ceph_assert(0);
 }
@@ -256,6 +478,11 @@ int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
   ceph_assert(0);
 }
 
+ceph::bufferptr ioring_queue_t::get_registered_buffer(unsigned len)
+{
+  ceph_assert(0);
+}
+
 bool ioring_queue_t::supported()
 {
   return false;
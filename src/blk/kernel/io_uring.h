@@ -6,20 +6,26 @@
 #include "acconfig.h"
 
 #include "include/types.h"
-#include "aio/aio.h"
+#include "blk/aio/aio.h"
 
 struct ioring_data;
 
 struct ioring_queue_t final : public io_queue_t {
   std::unique_ptr<ioring_data> d;
   unsigned iodepth = 0;
+  bool hipri = false;      ///< use IO polling (IORING_SETUP_IOPOLL)
+  unsigned hipri_spin_us = 0; ///< how long to poll before blocking
+  bool sq_thread = false;  ///< use kernel submission thread (IORING_SETUP_SQPOLL)
+  unsigned nr_buffers = 0; ///< number of pre-registered io buffers
+  size_t buffer_size = 0;  ///< size of each pre-registered io buffer
 
   typedef std::list<aio_t>::iterator aio_iter;
 
   // Returns true if arch is x86-64 and kernel supports io_uring
   static bool supported();
 
-  ioring_queue_t(unsigned iodepth_);
+  ioring_queue_t(unsigned iodepth_, bool hipri_, unsigned hipri_spin_us_,
+		 bool sq_thread_, unsigned nr_buffers_, size_t buffer_size_);
   ~ioring_queue_t() final;
 
   int init(std::vector<int> &fds) final;
@@ -28,4 +34,6 @@ struct ioring_queue_t final : public io_queue_t {
   int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
                    void *priv, int *retries) final;
   int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+
+  ceph::bufferptr get_registered_buffer(unsigned len) final;
 };
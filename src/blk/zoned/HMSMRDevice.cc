@@ -64,7 +64,9 @@ HMSMRDevice::HMSMRDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, aio_
   unsigned int iodepth = cct->_conf->bdev_aio_max_queue_depth;
 
   if (use_ioring && ioring_queue_t::supported()) {
-    io_queue = std::make_unique<ioring_queue_t>(iodepth);
+    // no polling nor registered buffers on zoned devices
+    io_queue = std::make_unique<ioring_queue_t>(iodepth, false, 0, false,
+						0, 0);
   } else {
     static bool once;
     if (use_ioring && !once) {
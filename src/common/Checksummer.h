@@ -4,9 +4,12 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include <algorithm>
+
 #include "include/buffer.h"
 #include "include/byteorder.h"
 #include "include/ceph_assert.h"
+#include "include/crc32c.h"
 
 #include "xxHash/xxhash.h"
 
@@ -90,6 +93,18 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+    static void calc_multi(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const* const*>(data),
+			n, len, out);
+    }
   };
 
   struct crc32c_16 {
@@ -111,6 +126,21 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+    static void calc_multi(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const* const*>(data),
+			n, len, out);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = out[i] & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -132,6 +162,21 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+    static void calc_multi(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const* const*>(data),
+			n, len, out);
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = out[i] & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -161,6 +206,18 @@ public:
       }
       return XXH32_digest(state);
     }
+    static void calc_multi(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = XXH32(data[i], len, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -190,8 +247,58 @@ public:
       }
       return XXH64_digest(state);
     }
+    static void calc_multi(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char * const *data,
+      size_t n,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < n; ++i) {
+	out[i] = XXH64(data[i], len, init_value);
+      }
+    }
   };
 
+  // number of csum blocks handed to Alg::calc_multi at once
+  static constexpr size_t max_batch = 16;
+
+  // Checksum the next n (<= max_batch) blocks at p into out.  Runs of
+  // blocks that each lie within a single buffer are batched; a block
+  // straddling two buffers is checksummed on its own.
+  template<class Alg>
+  static void calc_blocks(
+    typename Alg::state_t state,
+    typename Alg::init_value_t init_value,
+    size_t csum_block_size,
+    size_t n,
+    ceph::buffer::list::const_iterator& p,
+    typename Alg::init_value_t *out
+    ) {
+    const char *batch[max_batch];
+    size_t batched = 0;
+    while (n--) {
+      auto start = p;
+      const char *data;
+      if (p.get_ptr_and_advance(csum_block_size, &data) == csum_block_size) {
+	batch[batched++] = data;
+	continue;
+      }
+      if (batched) {
+	Alg::calc_multi(state, init_value, csum_block_size, batch, batched,
+			out);
+	out += batched;
+	batched = 0;
+      }
+      p = start;
+      *out++ = Alg::calc(state, init_value, csum_block_size, p);
+    }
+    if (batched) {
+      Alg::calc_multi(state, init_value, csum_block_size, batch, batched, out);
+    }
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -225,9 +332,14 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
+    typename Alg::init_value_t v[max_batch];
+    while (blocks > 0) {
+      size_t n = std::min(blocks, max_batch);
+      calc_blocks<Alg>(state, init_value, csum_block_size, n, p, v);
+      for (size_t i = 0; i < n; ++i) {
+	*pv++ = v[i];
+      }
+      blocks -= n;
     }
     Alg::fini(&state);
     return 0;
@@ -253,18 +365,23 @@ public:
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
     size_t pos = offset;
-    while (length > 0) {
-      typename Alg::init_value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+    size_t blocks = length / csum_block_size;
+    typename Alg::init_value_t v[max_batch];
+    while (blocks > 0) {
+      size_t n = std::min(blocks, max_batch);
+      calc_blocks<Alg>(state, -1, csum_block_size, n, p, v);
+      for (size_t i = 0; i < n; ++i) {
+	if (*pv != v[i]) {
+	  if (bad_csum) {
+	    *bad_csum = v[i];
+	  }
+	  Alg::fini(&state);
+	  return pos;
 	}
-	Alg::fini(&state);
-	return pos;
+	++pv;
+	pos += csum_block_size;
       }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
+      blocks -= n;
     }
     Alg::fini(&state);
     return -1;  // no errors
@@ -12,6 +12,8 @@
  * 
  */
 
+#include <sched.h>
+
 #include "WorkQueue.h"
 #include "include/compat.h"
 #include "common/errno.h"
@@ -409,3 +411,31 @@ void ShardedThreadPool::drain()
   ldout(cct,10) << "drained" << dendl;
 }
 
+
+int ShardedThreadPool::set_cpu_affinity(size_t cpu_set_size,
+					cpu_set_t *cpu_set)
+{
+#ifdef HAVE_SCHED
+  std::lock_guard l(shardedpool_lock);
+  if (threads_shardedpool.empty()) {
+    return -EAGAIN;  // not started yet
+  }
+  for (auto t : threads_shardedpool) {
+    pid_t tid = t->get_pid();
+    if (!tid) {
+      return -EAGAIN;  // not running yet
+    }
+    if (sched_setaffinity(tid, sizeof(*cpu_set), cpu_set) < 0) {
+      int r = -errno;
+      ldout(cct, 1) << __func__ << " failed to set affinity of " << tid
+		    << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+  ldout(cct, 10) << __func__ << " pinned " << threads_shardedpool.size()
+		 << " threads" << dendl;
+  return 0;
+#else
+  return -ENOTSUP;
+#endif
+}
@@ -24,6 +24,7 @@ struct ThreadPool {
 
 #else
 
+#include <sched.h>
 #include <atomic>
 #include <list>
 #include <set>
@@ -666,6 +667,8 @@ public:
   void unpause();
   /// wait for all work to complete
   void drain();
+  /// pin the pool's (started) threads to the given cpus
+  int set_cpu_affinity(size_t cpu_set_size, cpu_set_t *cpu_set);
 
 };
 
@@ -11,6 +11,11 @@
 #include "common/crc32c_aarch64.h"
 #include "common/crc32c_ppc.h"
 
+#include <string.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#endif
+
 /*
  * choose best implementation based on the CPU architecture.
  */
@@ -52,6 +57,69 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+#if defined(__x86_64__) && defined(__GNUC__)
+/*
+ * crc32 has a latency of three cycles but a throughput of one, so a
+ * single stream leaves the unit mostly idle.  Run four buffers through
+ * it side by side instead; unlike folding the lanes of one buffer back
+ * together this needs no carry-less multiply and pays off for any length.
+ */
+__attribute__((target("sse4.2")))
+static void crc32c_multi_sse42(uint32_t crc, unsigned char const * const *bufs,
+			       unsigned n, unsigned length, uint32_t *out)
+{
+  unsigned i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const unsigned char *p0 = bufs[i], *p1 = bufs[i + 1];
+    const unsigned char *p2 = bufs[i + 2], *p3 = bufs[i + 3];
+    uint64_t c0 = crc, c1 = crc, c2 = crc, c3 = crc;
+    unsigned left = length;
+    for (; left >= 8; left -= 8) {
+      uint64_t v0, v1, v2, v3;
+      memcpy(&v0, p0, 8);
+      memcpy(&v1, p1, 8);
+      memcpy(&v2, p2, 8);
+      memcpy(&v3, p3, 8);
+      c0 = _mm_crc32_u64(c0, v0);
+      c1 = _mm_crc32_u64(c1, v1);
+      c2 = _mm_crc32_u64(c2, v2);
+      c3 = _mm_crc32_u64(c3, v3);
+      p0 += 8;
+      p1 += 8;
+      p2 += 8;
+      p3 += 8;
+    }
+    for (; left > 0; --left) {
+      c0 = _mm_crc32_u8(c0, *p0++);
+      c1 = _mm_crc32_u8(c1, *p1++);
+      c2 = _mm_crc32_u8(c2, *p2++);
+      c3 = _mm_crc32_u8(c3, *p3++);
+    }
+    out[i] = c0;
+    out[i + 1] = c1;
+    out[i + 2] = c2;
+    out[i + 3] = c3;
+  }
+  for (; i < n; ++i) {
+    out[i] = ceph_crc32c_func(crc, bufs[i], length);
+  }
+}
+#endif
+
+void ceph_crc32c_multi(uint32_t crc, unsigned char const * const *bufs,
+		       unsigned n, unsigned length, uint32_t *out)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+  if (ceph_arch_intel_sse42) {
+    crc32c_multi_sse42(crc, bufs, n, length, out);
+    return;
+  }
+#endif
+  for (unsigned i = 0; i < n; ++i) {
+    out[i] = ceph_crc32c_func(crc, bufs[i], length);
+  }
+}
+
 
 /*
  * Look: http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
@@ -6,6 +6,10 @@
 #include <cstring>
 #include <errno.h>
 #include <iostream>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 
 #include "include/stringify.h"
 #include "common/safe_io.h"
@@ -188,6 +192,39 @@ int set_cpu_affinity_all_threads(size_t cpu_set_size, cpu_set_t *cpu_set)
   return 0;
 }
 
+int set_numa_mempolicy_this_thread(int node)
+{
+  unsigned long mask = 0;
+  if (node < 0 || node >= (int)(sizeof(mask) * 8)) {
+    return -EINVAL;
+  }
+  mask = 1ul << node;
+  // note that the kernel ignores the last bit of maxnode
+  int r = syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask,
+		  sizeof(mask) * 8 + 1);
+  if (r < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+int set_numa_affinity_this_thread(int node)
+{
+  size_t cpu_set_size = 0;
+  cpu_set_t cpu_set;
+  int r = get_numa_node_cpu_set(node, &cpu_set_size, &cpu_set);
+  if (r < 0) {
+    return r;
+  }
+  r = sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+  if (r < 0) {
+    return -errno;
+  }
+  // cpu affinity already gets us node-local first-touch allocations; this
+  // keeps them local if the cpu set is later widened.
+  return set_numa_mempolicy_this_thread(node);
+}
+
 #else
 int parse_cpu_set_list(const char *s,
 		       size_t *cpu_set_size,
@@ -221,4 +258,14 @@ int set_cpu_affinity_all_threads(size_t cpu_set_size,
   return -ENOTSUP;
 }
 
+int set_numa_mempolicy_this_thread(int node)
+{
+  return -ENOTSUP;
+}
+
+int set_numa_affinity_this_thread(int node)
+{
+  return -ENOTSUP;
+}
+
 #endif
@@ -22,3 +22,10 @@ int get_numa_node_cpu_set(int node,
 
 int set_cpu_affinity_all_threads(size_t cpu_set_size,
 				 cpu_set_t *cpu_set);
+
+/// pin the calling thread to the CPUs of @node and prefer @node's memory
+/// for its allocations
+int set_numa_affinity_this_thread(int node);
+
+/// prefer memory from @node for the calling thread's allocations
+int set_numa_mempolicy_this_thread(int node);
@@ -1147,6 +1147,14 @@ std::vector<Option> get_global_options() {
     .set_description("Maximum threadpool size of AsyncMessenger")
     .add_see_also("ms_async_op_threads"),
 
+    Option("ms_async_rx_align_data", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Place received message data so that it is page aligned "
+                     "relative to the message's data offset (msgr2)")
+    .set_long_description("This lets block aligned writes go to the object "
+                          "store's device without being copied to realign "
+                          "them.  See bluestore's write_realign_bytes counter."),
+
     Option("ms_async_rdma_device_name", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("")
     .set_description(""),
@@ -2521,6 +2529,19 @@ std::vector<Option> get_global_options() {
     .set_description("set affinity to a numa node (-1 for none)")
     .add_see_also("osd_numa_auto_affinity"),
 
+    Option("osd_numa_shard_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("pin op shard threads to the storage numa node when the OSD as a whole is not pinned")
+    .set_long_description("Applies when the OSD boots without an OSD-wide "
+                          "affinity, i.e. osd_numa_node is not set and "
+                          "osd_numa_auto_affinity did not pick a node, and all "
+                          "object store devices are on one numa node.  All op "
+                          "shard threads, which do most of the object store "
+                          "and cache work, are then pinned to that node.")
+    .add_see_also("osd_numa_auto_affinity")
+    .add_see_also("bluestore_numa_affinity"),
+
     Option("osd_smart_report_timeout", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(5)
     .set_description("Timeout (in seconds) for smarctl to run, default is set to 5"),
@@ -2964,10 +2985,12 @@ std::vector<Option> get_global_options() {
 
     Option("osd_op_queue", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("wpq")
-    .set_enum_allowed( { "wpq", "mclock_scheduler", "debug_random" } )
+    .set_enum_allowed( { "wpq", "mclock_scheduler", "lockfree_wpq", "debug_random" } )
     .set_description("which operation priority queue algorithm to use")
     .set_long_description("which operation priority queue algorithm to use; "
-			  "mclock_scheduler is currently experimental")
+			  "mclock_scheduler is currently experimental; "
+			  "lockfree_wpq enqueues without taking the shard lock, "
+			  "it orders by priority like wpq but ignores op cost")
     .add_see_also("osd_op_queue_cut_off"),
 
     Option("osd_op_queue_cut_off", Option::TYPE_STR, Option::LEVEL_ADVANCED)
@@ -3044,6 +3067,12 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("update parity from deltas on small overwrites of erasure coded objects")
+    .set_long_description("When a write to a pool with allow_ec_overwrites modifies only some of the data chunks of a stripe, and the erasure code plugin supports it, read only those data chunks and the coding chunks, compute the new coding chunks from the difference between the old and new data, and write only the chunks that changed. Otherwise the whole stripe is read and encoded again."),
+
     // Only use clone_overlap for recovery if there are fewer than
     // osd_recover_clone_overlap_limit entries in the overlap set
     Option("osd_recover_clone_overlap_limit", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
@@ -3367,6 +3396,20 @@ std::vector<Option> get_global_options() {
     .set_description("Scrubs will randomly become deep scrubs at this rate (0.15 -> 15% of scrubs are deep)")
     .set_long_description("This prevents a deep scrub 'stampede' by spreading deep scrubs so they are uniformly distributed over the week"),
 
+    Option("osd_deep_scrub_incremental", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Periodic deep scrubs only read the data of the objects written since the last deep scrub of the PG and of a rotating sample of the others")
+    .set_long_description("Objects are still listed and their metadata and omap are still compared. Deep scrubs requested by an operator, repairs and deep scrubs of PGs with deep scrub errors always read every object.")
+    .add_see_also("osd_deep_scrub_incremental_sample"),
+
+    Option("osd_deep_scrub_incremental_sample", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(10)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("An incremental deep scrub reads the data of 1 in this many of the objects not written since the last deep scrub")
+    .set_long_description("Unchanged objects are split into this many groups by the hash of their name, and each deep scrub of a PG reads the next group, so that every object is read at least once every this many deep scrubs. 1 reads every object, 0 none of them.")
+    .add_see_also("osd_deep_scrub_incremental"),
+
     Option("osd_deep_scrub_stride", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(512_K)
     .set_description("Number of bytes to read from an object at a time during deep scrub"),
@@ -3375,6 +3418,27 @@ std::vector<Option> get_global_options() {
     .set_default(1024)
     .set_description("Number of keys to read from an object at a time during deep scrub"),
 
+    Option("osd_scrub_read_ahead_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(8)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Number of objects of a deep scrub chunk whose data is read and hashed ahead of the scan")
+    .set_long_description("The data of the next objects of the chunk being deep scrubbed is read and its digest computed by the scrub read ahead threads while the PG scans the current one. 0 reads every object on the PG's own thread.")
+    .add_see_also({"osd_scrub_read_ahead_threads", "osd_scrub_read_ahead_memory"}),
+
+    Option("osd_scrub_read_ahead_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of threads reading and hashing object data ahead of deep scrub")
+    .set_long_description("0 disables the read ahead.")
+    .add_see_also("osd_scrub_read_ahead_objects"),
+
+    Option("osd_scrub_read_ahead_memory", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Memory an OSD may use for deep scrub read ahead buffers")
+    .set_long_description("Each object being read ahead holds one osd_deep_scrub_stride buffer at a time. Objects that do not fit in the budget are read by the PG when the scan reaches them.")
+    .add_see_also({"osd_scrub_read_ahead_objects", "osd_deep_scrub_stride"}),
+
     Option("osd_deep_scrub_update_digest_min_age", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(2_hr)
     .set_description("Update overall object digest only if object was last modified longer ago than this"),
@@ -3761,6 +3825,19 @@ std::vector<Option> get_global_options() {
     .set_default("binned_lru")
     .set_description(""),
 
+    Option("rocksdb_cache_per_cf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Give each sharded column family its own block cache")
+    .set_long_description("When enabled with the binned_lru cache type, every column family from the sharding definition (e.g. O, m, p, L) gets a separate block cache that is registered with the priority cache manager.  The kv share of the cache budget is split among them according to their recent hit rate.")
+    .add_see_also("rocksdb_cache_per_cf_min_ratio"),
+
+    Option("rocksdb_cache_per_cf_min_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.05)
+    .set_min_max(0.0, 1.0)
+    .set_description("Minimum fraction of the kv cache share kept by each per column family cache")
+    .add_see_also("rocksdb_cache_per_cf"),
+
     Option("rocksdb_block_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(4_K)
     .set_description(""),
@@ -4082,6 +4159,16 @@ std::vector<Option> get_global_options() {
     Option("bdev_async_discard", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description(""),
+
+    Option("bdev_numa_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Bind block device completion threads to the device's numa node")
+    .set_long_description("The aio completion and discard threads of a kernel "
+                          "block device are pinned to the CPUs of the numa "
+                          "node the device is attached to and prefer that "
+                          "node's memory.")
+    .add_see_also("bluestore_numa_affinity"),
     
     Option("bdev_flock_retry_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(0.1)
@@ -4107,6 +4194,17 @@ std::vector<Option> get_global_options() {
     .set_default(1_M)
     .set_description(""),
 
+    Option("bluefs_read_ahead_depth", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of asynchronous read-ahead requests kept in flight per bluefs reader")
+    .set_long_description("When non-zero, sequential bluefs readers (and RocksDB Prefetch hints) keep up to this many aio reads outstanding beyond the prefetch buffer.  The read-ahead window starts at bluefs_max_prefetch and doubles each time the reader consumes it, up to bluefs_read_ahead_max_window.  0 disables asynchronous read-ahead.")
+    .add_see_also("bluefs_read_ahead_max_window"),
+
+    Option("bluefs_read_ahead_max_window", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(8_M)
+    .set_description("Maximum size of a single bluefs asynchronous read-ahead request")
+    .add_see_also("bluefs_read_ahead_depth"),
+
     Option("bluefs_min_log_runway", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(1_M)
     .set_description(""),
@@ -4131,6 +4229,12 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("bluefs_compact_log_incremental", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Write the compacted bluefs log without holding the bluefs lock")
+    .set_long_description("Async log compaction snapshots the file map and allocates space for the new log under the bluefs lock, then encodes and writes the new log with the lock dropped, and only retakes it to switch logs.  This keeps RocksDB WAL appends from stalling behind compaction of large metadata logs.")
+    .add_see_also("bluefs_compact_log_sync"),
+
     Option("bluefs_buffered_io", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_description("Enabled buffered IO for bluefs reads.")
@@ -4142,7 +4246,7 @@ std::vector<Option> get_global_options() {
 
     Option("bluefs_allocator", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("hybrid")
-    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid"})
+    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid", "sizeclass"})
     .set_description(""),
 
     Option("bluefs_log_replay_check_allocations", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
@@ -4309,10 +4413,26 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_compression_mode", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("none")
-    .set_enum_allowed({"none", "passive", "aggressive", "force"})
+    .set_enum_allowed({"none", "passive", "aggressive", "force", "adaptive"})
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Default policy for using compression when pool does not specify")
-    .set_long_description("'none' means never use compression.  'passive' means use compression when clients hint that data is compressible.  'aggressive' means use compression unless clients hint that data is not compressible.  This option is used when the per-pool property for the compression mode is not present."),
+    .set_long_description("'none' means never use compression.  'passive' means use compression when clients hint that data is compressible.  'aggressive' means use compression unless clients hint that data is not compressible.  'adaptive' is like 'aggressive', but skips blobs whose sampled byte entropy is too high and classes of writes that have mostly failed bluestore_compression_required_ratio recently.  This option is used when the per-pool property for the compression mode is not present.")
+    .add_see_also("bluestore_compression_adaptive_entropy")
+    .add_see_also("bluestore_compression_adaptive_probe"),
+
+    Option("bluestore_compression_adaptive_entropy", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(7.6)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Skip compressing blobs whose sampled entropy exceeds this many bits per byte in adaptive compression mode")
+    .set_long_description("The entropy is estimated from a 1 KiB sample spread over the blob.  Already compressed or encrypted data scores close to 8; 0 disables the check.")
+    .add_see_also("bluestore_compression_mode"),
+
+    Option("bluestore_compression_adaptive_probe", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("In adaptive compression mode, still try one in this many blobs of a class of writes that has been failing to compress")
+    .set_long_description("Writes are classed by object name suffix, allocation hints and blob size.  A class that mostly fails the required ratio is skipped, apart from these probes which let it be re-learned once its data changes.")
+    .add_see_also("bluestore_compression_mode"),
 
     Option("bluestore_compression_algorithm", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("snappy")
@@ -4367,6 +4487,100 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description(""),
 
+    Option("bluestore_omap_delete_range_threshold", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(128)
+    .set_min(1)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Number of omap keys above which clearing an omap or removing a key range uses a single range tombstone")
+    .set_long_description("Removing keys one by one leaves a tombstone per key behind, which slows down later iteration over the omap until compaction catches up.  This is the BlueStore omap counterpart of rocksdb_delete_range_threshold.")
+    .add_see_also("rocksdb_delete_range_threshold"),
+
+    Option("bluestore_defrag_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("How often (in seconds) to check whether the store is idle enough to defragment objects")
+    .set_long_description("When the client transaction rate drops to bluestore_defrag_idle_txc_rate or below, a background pass rewrites fragmented objects into contiguous blobs.  0 (the default) disables idle passes; they can still be started with the 'bluestore defrag start' admin socket command.")
+    .add_see_also("bluestore_defrag_idle_txc_rate"),
+
+    Option("bluestore_defrag_idle_txc_rate", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(5)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Transactions per second at or below which the store is considered idle for defragmentation")
+    .set_long_description("An idle pass pauses as soon as the rate goes above this.")
+    .add_see_also("bluestore_defrag_interval"),
+
+    Option("bluestore_defrag_batch", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(32)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Number of objects a defragmentation pass examines between sleeps"),
+
+    Option("bluestore_defrag_sleep", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.5)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Time (in seconds) a defragmentation pass sleeps between batches"),
+
+    Option("bluestore_defrag_min_fragments", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(32)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Objects with fewer physically discontiguous extents than this are never defragmented")
+    .add_see_also("bluestore_defrag_fragments_per_mb"),
+
+    Option("bluestore_defrag_fragments_per_mb", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(8)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Defragment objects with at least this many physically discontiguous extents per MB of object size")
+    .add_see_also("bluestore_defrag_min_fragments"),
+
+    Option("bluestore_defrag_blobs_per_mb", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(128)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Defragment objects split into at least this many blobs per MB of object size")
+    .set_long_description("Such objects have large extent maps that are slow to decode.  0 disables this check."),
+
+    Option("bluestore_defrag_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(4_M)
+    .set_min(64_K)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum amount of data of one object rewritten at a time when defragmenting")
+    .set_long_description("The object's collection is locked while it is rewritten.  Fragmented data beyond this is left for later passes."),
+
+    Option("bluestore_fast_tier_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Space on the dedicated DB device to keep copies of frequently read object data in")
+    .set_long_description("Small extents that are read often are copied to the fast device and read from there.  The main device always keeps the data, so the copies are simply dropped when they are overwritten, freed or no longer read, and are not kept across restarts.  The space is taken from what BlueFS has free on the DB device at mount, and is not used if it can't all be found there.  0 disables the tier.")
+    .add_see_also("bluestore_fast_tier_max_extent")
+    .add_see_also("bluestore_fast_tier_promote_reads"),
+
+    Option("bluestore_fast_tier_max_extent", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Only extents up to this size are copied to the fast tier")
+    .add_see_also("bluestore_fast_tier_size"),
+
+    Option("bluestore_fast_tier_promote_reads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(3)
+    .set_min(1)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Number of reads after which an extent is copied to the fast tier")
+    .set_long_description("Read counts are halved every bluestore_fast_tier_decay_interval seconds.")
+    .add_see_also("bluestore_fast_tier_decay_interval"),
+
+    Option("bluestore_fast_tier_decay_interval", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(60)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("How often (in seconds) read counts of extents not in the fast tier are halved"),
+
+    Option("bluestore_fast_tier_cold_age", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(3600)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Drop extents from the fast tier that have not been read for this many seconds"),
+
+    Option("bluestore_fast_tier_max_tracked", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(1 << 20)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum number of extents whose reads are counted for the fast tier"),
+
     Option("bluestore_max_blob_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4385,6 +4599,13 @@ std::vector<Option> get_global_options() {
     .set_description("")
     .add_see_also("bluestore_max_blob_size"),
 
+    Option("bluestore_compression_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of threads compressing blobs on behalf of writers")
+    .set_long_description("When a write produces several compressible blobs they are handed to a pool of this many threads, shared by all transactions, and the writing thread helps out rather than compressing them one after another.  The writing thread still waits until all of its blobs are compressed, and a write of a single blob is compressed inline, so this shortens large writes but does not take compression off the write path.  With qat_compressor_enabled the pool keeps several requests in flight to the accelerator.  0 compresses inline.")
+    .add_see_also("bluestore_compression_mode"),
+
     Option("bluestore_compression_required_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(.875)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4424,6 +4645,38 @@ std::vector<Option> get_global_options() {
     .set_enum_allowed({"2q", "lru"})
     .set_description("Cache replacement algorithm"),
 
+    Option("bluestore_numa_affinity", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Bind kv sync, commit and finalize threads to the storage numa node")
+    .set_long_description("When all devices are attached to the same numa "
+                          "node, the kv threads are pinned to its CPUs and "
+                          "prefer its memory.  Remote-node activity is "
+                          "reported by the numa_remote_* perf counters.")
+    .add_see_also("bdev_numa_affinity")
+    .add_see_also("osd_numa_shard_affinity"),
+
+    Option("bluestore_cache_lockless_read", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Serve fully cached buffer reads without taking the cache shard lock")
+    .set_long_description("Each buffer space publishes an immutable copy of its readable buffers once a read is fully served from cache.  Later reads that are fully covered by that copy are answered without the buffer cache shard lock.  Any change to the buffer space drops the copy.  Cache LRU updates from such reads are skipped when the lock is busy."),
+
+    Option("bluestore_onode_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("lru")
+    .set_enum_allowed({"lru", "clock"})
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Onode cache replacement algorithm")
+    .set_long_description("With 'clock', onodes in use stay cached, so cache hits do not take the cache shard lock to pin and unpin them, and eviction is scan resistant.")
+    .add_see_also("bluestore_onode_cache_clock_hot_ratio"),
+
+    Option("bluestore_onode_cache_clock_hot_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.5)
+    .set_min_max(0.0, 1.0)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Max fraction of the clock onode cache holding hot (re-referenced) onodes")
+    .add_see_also("bluestore_onode_cache_type"),
+
     Option("bluestore_2q_cache_kin_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
     .set_default(.5)
     .set_description("2Q paper suggests .5"),
@@ -4479,7 +4732,7 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("hybrid")
-    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid", "zoned"})
+    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid", "sizeclass", "zoned"})
     .set_description("Allocator policy")
     .set_long_description("Allocator to use for bluestore.  Stupid should only be used for testing."),
 
@@ -4569,6 +4822,21 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_sync_pipeline", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Pipeline kv commits by building the next commit group while the previous one is syncing")
+    .set_long_description("When enabled, a dedicated thread waits for the rocksdb sync of a commit group while the kv sync thread batches and submits the next group, so that small-write throughput is not limited by a single thread alternating between submission and sync.")
+    .add_see_also("bluestore_kv_finalize_threads"),
+
+    Option("bluestore_kv_finalize_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min_max(1, 32)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Number of threads finalizing committed transactions")
+    .set_long_description("Committed transactions are sharded across finalize threads by their sequencer, preserving per-collection ordering.")
+    .add_see_also("bluestore_kv_sync_pipeline"),
+
     Option("bluestore_fsck_read_bytes_cap", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4578,6 +4846,36 @@ std::vector<Option> get_global_options() {
       .set_default(2)
       .set_description("Number of additional threads to perform quick-fix (shallow fsck) command"),
 
+    Option("bluestore_fsck_deep_read_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+      .set_default(4)
+      .set_description("Number of threads reading back object data during deep fsck")
+      .set_long_description("Deep fsck reads every object to verify its "
+                            "checksums.  These reads are handed to a pool of "
+                            "this many threads while the object keyspace walk "
+                            "continues; 0 reads inline.  Progress of a running "
+                            "fsck can be queried with the admin socket command "
+                            "'bluestore fsck progress'.")
+      .add_see_also("bluestore_fsck_read_bytes_cap"),
+
+    Option("bluestore_fsck_freelist_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+      .set_default(4)
+      .set_description("Number of threads comparing the freelist with the allocated blocks during fsck")
+      .set_long_description("Each thread checks free extents against, and "
+                            "looks for leaked blocks in, its own part of the "
+                            "device; 0 or 1 does it inline."),
+
+    Option("bluestore_alloc_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+      .set_default(false)
+      .set_flag(Option::FLAG_STARTUP)
+      .set_description("Persist the allocator state at umount and load it on the next mount")
+      .set_long_description("On a clean umount the free extents are written "
+                            "to the db together with a checksum.  The next "
+                            "mount loads them instead of walking the whole "
+                            "freelist, which is faster on large devices.  The "
+                            "snapshot is dropped as soon as the store is opened "
+                            "for write, so after a crash, or if it fails "
+                            "validation, the freelist is scanned as before."),
+
     Option("bluestore_throttle_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4622,6 +4920,20 @@ std::vector<Option> get_global_options() {
     .set_description("Default bluestore_deferred_batch_ops for non-rotational (solid state) media")
     .add_see_also("bluestore_deferred_batch_ops"),
 
+    Option("bluestore_deferred_merge", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Coalesce the deferred writes of a transaction before logging them")
+    .set_long_description("Overlapping deferred writes within a transaction "
+                          "are reduced to their final contents and adjacent "
+                          "extents are joined, so fewer bytes go to the WAL "
+                          "and the deferred batch issues fewer device IOs.  "
+                          "Writes from different transactions in the same "
+                          "batch are always merged before submission; see "
+                          "the deferred_write_extents, deferred_write_ops and "
+                          "deferred_write_merged_bytes perf counters.")
+    .add_see_also("bluestore_deferred_batch_ops"),
+
     Option("bluestore_nid_prealloc", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(1024)
     .set_description("Number of unique object ids to preallocate at a time"),
@@ -4775,6 +5087,12 @@ std::vector<Option> get_global_options() {
     .set_default(64_M)
     .set_description("Maximum RAM hybrid allocator should use before enabling bitmap supplement"),
 
+    Option("bluestore_sizeclass_alloc_large_threshold", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(1_M)
+    .set_description("Requests at least this large are placed contiguously by the sizeclass allocator")
+    .set_long_description("The sizeclass allocator carves such requests out of a single free extent when one is big enough, and only then splits them into max_alloc_size pieces.  Smaller requests are packed into the smallest free extents that fit.")
+    .add_see_also("bluestore_allocator"),
+
     Option("bluestore_volume_selection_policy", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("use_some_extra")
     .set_enum_allowed({ "rocksdb_original", "use_some_extra" })
@@ -4795,6 +5113,37 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Enables Linux io_uring API instead of libaio"),
 
+    Option("bdev_ioring_hipri", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use polled io completions with io_uring")
+    .set_long_description("Completions are found by polling the device instead of waiting for interrupts; requires a block device with poll queues enabled.")
+    .add_see_also("bdev_ioring")
+    .add_see_also("bdev_ioring_hipri_spin_us"),
+
+    Option("bdev_ioring_hipri_spin_us", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(100)
+    .set_description("How long to poll for an io_uring completion before blocking")
+    .set_long_description("With bdev_ioring_hipri, the completion thread polls the device for up to this many microseconds, then waits in the kernel for a completion. It sleeps while no io is in flight.")
+    .add_see_also("bdev_ioring_hipri"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Offload io_uring submission to a kernel polling thread")
+    .set_long_description("A kernel thread polls the submission queue so that submitting io does not need a syscall.")
+    .add_see_also("bdev_ioring"),
+
+    Option("bdev_ioring_registered_buffers", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of io buffers to pin and register with io_uring")
+    .set_long_description("Direct writes that must be copied for alignment are copied into one of these buffers and issued as fixed-buffer io, avoiding per-io page pinning. 0 disables the pool.")
+    .add_see_also("bdev_ioring")
+    .add_see_also("bdev_ioring_registered_buffer_size"),
+
+    Option("bdev_ioring_registered_buffer_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Size of each io buffer registered with io_uring")
+    .add_see_also("bdev_ioring_registered_buffers"),
+
     // -----------------------------------------
     // kstore
 
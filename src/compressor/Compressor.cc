@@ -51,6 +51,7 @@ const char *Compressor::get_comp_mode_name(int m) {
     case COMP_PASSIVE: return "passive";
     case COMP_AGGRESSIVE: return "aggressive";
     case COMP_FORCE: return "force";
+    case COMP_ADAPTIVE: return "adaptive";
     default: return "???";
   }
 }
@@ -61,6 +62,8 @@ boost::optional<Compressor::CompressionMode> Compressor::get_comp_mode_type(cons
     return COMP_AGGRESSIVE;
   if (s == "passive")
     return COMP_PASSIVE;
+  if (s == "adaptive")
+    return COMP_ADAPTIVE;
   if (s == "none")
     return COMP_NONE;
   return boost::optional<CompressionMode>();
@@ -18,6 +18,7 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 #include <boost/optional.hpp>
 #include "include/ceph_assert.h"    // boost clobbers this
 #include "include/common_fwd.h"
@@ -65,7 +66,9 @@ public:
     COMP_NONE,                  ///< compress never
     COMP_PASSIVE,               ///< compress if hinted COMPRESSIBLE
     COMP_AGGRESSIVE,            ///< compress unless hinted INCOMPRESSIBLE
-    COMP_FORCE                  ///< compress always
+    COMP_FORCE,                 ///< compress always
+    COMP_ADAPTIVE               ///< like aggressive, but skip data that
+                                ///< sampling or history says won't compress
   };
 
 #ifdef HAVE_QATZIP
@@ -94,6 +97,46 @@ public:
   // alignment with decode methods
   virtual int decompress(ceph::bufferlist::const_iterator &p, size_t compressed_len, ceph::bufferlist &out, boost::optional<int32_t> compressor_message) = 0;
 
+
+  // Trained dictionaries help with small, similar inputs.  Algorithms
+  // without dictionary support keep these defaults.
+  struct Dictionary {
+    uint32_t id = 0;         ///< crc32c of raw
+    ceph::bufferlist raw;    ///< as produced by train_dictionary()
+    virtual ~Dictionary() {}
+  };
+  typedef std::shared_ptr<const Dictionary> DictionaryRef;
+
+  /// build a dictionary of at most max_size bytes from samples
+  virtual int train_dictionary(const std::vector<ceph::bufferlist>& samples,
+			       size_t max_size,
+			       ceph::bufferlist *raw) {
+    return -EOPNOTSUPP;
+  }
+  /// prepare a dictionary for use; null if raw is unusable
+  virtual DictionaryRef load_dictionary(const ceph::bufferlist& raw) {
+    return nullptr;
+  }
+  /// compressor_message is set so that get_dictionary_id() finds dict
+  virtual int compress_with_dictionary(const ceph::bufferlist &in,
+				       ceph::bufferlist &out,
+				       boost::optional<int32_t> &compressor_message,
+				       const DictionaryRef& dict) {
+    return -EOPNOTSUPP;
+  }
+  virtual int decompress_with_dictionary(ceph::bufferlist::const_iterator &p,
+					 size_t compressed_len,
+					 ceph::bufferlist &out,
+					 boost::optional<int32_t> compressor_message,
+					 const DictionaryRef& dict) {
+    return -EOPNOTSUPP;
+  }
+  /// id of the dictionary needed to decompress data with this message
+  virtual boost::optional<uint32_t> get_dictionary_id(
+    boost::optional<int32_t> compressor_message) {
+    return boost::none;
+  }
+
   static CompressorRef create(CephContext *cct, const std::string &type);
   static CompressorRef create(CephContext *cct, int alg);
 
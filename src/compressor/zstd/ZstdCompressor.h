@@ -17,10 +17,16 @@
 
 #define ZSTD_STATIC_LINKING_ONLY
 #include "zstd/lib/zstd.h"
+#if __has_include("zstd/lib/zdict.h")
+#include "zstd/lib/zdict.h"
+#else
+#include "zstd/lib/dictBuilder/zdict.h"
+#endif
 
 #include "include/buffer.h"
 #include "include/encoding.h"
 #include "compressor/Compressor.h"
+#include "common/ceph_context.h"
 
 class ZstdCompressor : public Compressor {
  public:
@@ -29,6 +35,120 @@ class ZstdCompressor : public Compressor {
   int compress(const ceph::buffer::list &src, ceph::buffer::list &dst, boost::optional<int32_t> &compressor_message) override {
     ZSTD_CStream *s = ZSTD_createCStream();
     ZSTD_initCStream_srcSize(s, cct->_conf->compressor_zstd_level, src.length());
+    return compress_stream(s, src, dst);
+  }
+
+  int compress_with_dictionary(const ceph::buffer::list &src,
+			       ceph::buffer::list &dst,
+			       boost::optional<int32_t> &compressor_message,
+			       const DictionaryRef& dict) override {
+    auto d = static_cast<const ZstdDictionary*>(dict.get());
+    ZSTD_CCtx *s = ZSTD_createCCtx();
+    ZSTD_CCtx_refCDict(s, d->cdict);
+    ZSTD_CCtx_setPledgedSrcSize(s, src.length());
+    int r = compress_stream(s, src, dst);
+    if (r == 0) {
+      compressor_message = (int32_t)d->id;
+    }
+    return r;
+  }
+
+  int train_dictionary(const std::vector<ceph::buffer::list>& samples,
+		       size_t max_size,
+		       ceph::buffer::list *raw) override {
+    ceph::buffer::list all;
+    std::vector<size_t> sizes;
+    for (auto& s : samples) {
+      if (s.length()) {
+	all.append(s);
+	sizes.push_back(s.length());
+      }
+    }
+    if (sizes.empty()) {
+      return -EINVAL;
+    }
+    ceph::buffer::ptr out(max_size);
+    size_t r = ZDICT_trainFromBuffer(out.c_str(), out.length(), all.c_str(),
+				     sizes.data(), sizes.size());
+    if (ZDICT_isError(r)) {
+      // typically too few or too small samples
+      return -EINVAL;
+    }
+    out.set_length(r);
+    raw->clear();
+    raw->append(out);
+    return 0;
+  }
+
+  DictionaryRef load_dictionary(const ceph::buffer::list& raw) override {
+    auto d = std::make_shared<ZstdDictionary>();
+    d->raw = raw;
+    d->raw.rebuild();
+    d->id = d->raw.crc32c(0);
+    d->cdict = ZSTD_createCDict(d->raw.c_str(), d->raw.length(),
+				cct->_conf->compressor_zstd_level);
+    d->ddict = ZSTD_createDDict(d->raw.c_str(), d->raw.length());
+    if (!d->cdict || !d->ddict) {
+      return nullptr;
+    }
+    return d;
+  }
+
+  boost::optional<uint32_t> get_dictionary_id(
+    boost::optional<int32_t> compressor_message) override {
+    // plain zstd output carries no message
+    if (compressor_message) {
+      return (uint32_t)*compressor_message;
+    }
+    return boost::none;
+  }
+
+  int decompress(const ceph::buffer::list &src, ceph::buffer::list &dst, boost::optional<int32_t> compressor_message) override {
+    auto i = std::cbegin(src);
+    return decompress(i, src.length(), dst, compressor_message);
+  }
+
+  int decompress(ceph::buffer::list::const_iterator &p,
+		 size_t compressed_len,
+		 ceph::buffer::list &dst,
+		 boost::optional<int32_t> compressor_message) override {
+    if (compressor_message) {
+      // needs a dictionary
+      return -EINVAL;
+    }
+    ZSTD_DStream *s = ZSTD_createDStream();
+    ZSTD_initDStream(s);
+    return decompress_stream(s, p, compressed_len, dst);
+  }
+
+  int decompress_with_dictionary(ceph::buffer::list::const_iterator &p,
+				 size_t compressed_len,
+				 ceph::buffer::list &dst,
+				 boost::optional<int32_t> compressor_message,
+				 const DictionaryRef& dict) override {
+    auto d = static_cast<const ZstdDictionary*>(dict.get());
+    if (!compressor_message || (uint32_t)*compressor_message != d->id) {
+      return -EINVAL;
+    }
+    ZSTD_DCtx *s = ZSTD_createDCtx();
+    ZSTD_DCtx_refDDict(s, d->ddict);
+    return decompress_stream(s, p, compressed_len, dst);
+  }
+
+ private:
+  struct ZstdDictionary : public Dictionary {
+    ZSTD_CDict *cdict = nullptr;
+    ZSTD_DDict *ddict = nullptr;
+    ~ZstdDictionary() override {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+    }
+  };
+
+  /// compress src with s, which is freed
+  int compress_stream(ZSTD_CStream *s,
+		      const ceph::buffer::list &src,
+		      ceph::buffer::list &dst) {
     auto p = src.begin();
     size_t left = src.length();
 
@@ -48,6 +168,7 @@ class ZstdCompressor : public Compressor {
       ZSTD_EndDirective const zed = (left==0) ? ZSTD_e_end : ZSTD_e_continue;
       size_t r = ZSTD_compressStream2(s, &outbuf, &inbuf, zed);
       if (ZSTD_isError(r)) {
+	ZSTD_freeCStream(s);
 	return -EINVAL;
       }
     }
@@ -61,16 +182,13 @@ class ZstdCompressor : public Compressor {
     return 0;
   }
 
-  int decompress(const ceph::buffer::list &src, ceph::buffer::list &dst, boost::optional<int32_t> compressor_message) override {
-    auto i = std::cbegin(src);
-    return decompress(i, src.length(), dst, compressor_message);
-  }
-
-  int decompress(ceph::buffer::list::const_iterator &p,
-		 size_t compressed_len,
-		 ceph::buffer::list &dst,
-		 boost::optional<int32_t> compressor_message) override {
+  /// decompress with s, which is freed
+  int decompress_stream(ZSTD_DStream *s,
+			ceph::buffer::list::const_iterator &p,
+			size_t compressed_len,
+			ceph::buffer::list &dst) {
     if (compressed_len < 4) {
+      ZSTD_freeDStream(s);
       return -1;
     }
     compressed_len -= 4;
@@ -82,17 +200,20 @@ class ZstdCompressor : public Compressor {
     outbuf.dst = dstptr.c_str();
     outbuf.size = dstptr.length();
     outbuf.pos = 0;
-    ZSTD_DStream *s = ZSTD_createDStream();
-    ZSTD_initDStream(s);
     while (compressed_len > 0) {
       if (p.end()) {
+	ZSTD_freeDStream(s);
 	return -1;
       }
       ZSTD_inBuffer_s inbuf;
       inbuf.pos = 0;
       inbuf.size = p.get_ptr_and_advance(compressed_len,
 					 (const char**)&inbuf.src);
-      ZSTD_decompressStream(s, &outbuf, &inbuf);
+      size_t r = ZSTD_decompressStream(s, &outbuf, &inbuf);
+      if (ZSTD_isError(r)) {
+	ZSTD_freeDStream(s);
+	return -1;
+      }
       compressed_len -= inbuf.size;
     }
     ZSTD_freeDStream(s);
@@ -100,7 +221,7 @@ class ZstdCompressor : public Compressor {
     dst.append(dstptr, 0, outbuf.pos);
     return 0;
   }
- private:
+
   CephContext *const cct;
 };
 
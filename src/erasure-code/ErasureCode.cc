@@ -346,4 +346,56 @@ int ErasureCode::decode_concat(const map<int, bufferlist> &chunks,
   }
   return r;
 }
+
+int ErasureCode::encode_delta(const bufferlist &old_data,
+			      const bufferlist &new_data,
+			      bufferlist *delta)
+{
+  if (old_data.length() != new_data.length())
+    return -EINVAL;
+  // subtraction is an exclusive or in GF(2^w)
+  bufferptr buf(buffer::create_aligned(old_data.length(), SIMD_ALIGN));
+  old_data.begin().copy(old_data.length(), buf.c_str());
+  char *p = buf.c_str();
+  for (auto &b : new_data.buffers()) {
+    const char *q = b.c_str();
+    for (unsigned i = 0; i < b.length(); i++)
+      *p++ ^= q[i];
+  }
+  delta->push_back(std::move(buf));
+  return 0;
+}
+
+int ErasureCode::apply_delta(const map<int, bufferlist> &deltas,
+			     map<int, bufferlist> *coding)
+{
+  return -EOPNOTSUPP;
+}
+
+int ErasureCode::prepare_delta(const map<int, bufferlist> &deltas,
+			       map<int, bufferlist> *coding,
+			       map<int, bufferlist> *delta_chunks,
+			       unsigned *blocksize)
+{
+  unsigned int k = get_data_chunk_count();
+  unsigned int m = get_chunk_count() - k;
+  if (coding->size() != m || deltas.empty())
+    return -EINVAL;
+  *blocksize = coding->begin()->second.length();
+  for (unsigned int i = k; i < k + m; i++) {
+    auto p = coding->find(i);
+    if (p == coding->end() || p->second.length() != *blocksize)
+      return -EINVAL;
+    p->second.rebuild_aligned_size_and_memory(*blocksize, SIMD_ALIGN);
+  }
+  for (auto &&i : deltas) {
+    if (i.first < 0 || i.first >= (int)k ||
+	i.second.length() != *blocksize)
+      return -EINVAL;
+    bufferlist &chunk = (*delta_chunks)[i.first];
+    chunk = i.second;
+    chunk.rebuild_aligned_size_and_memory(*blocksize, SIMD_ALIGN);
+  }
+  return 0;
+}
 }
@@ -113,7 +113,24 @@ namespace ceph {
     int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) override;
 
+    bool supports_parity_delta() const override {
+      return false;
+    }
+
+    int encode_delta(const bufferlist &old_data,
+		     const bufferlist &new_data,
+		     bufferlist *delta) override;
+
+    int apply_delta(const std::map<int, bufferlist> &deltas,
+		    std::map<int, bufferlist> *coding) override;
+
   protected:
+    // check the arguments of apply_delta and make the buffers contiguous
+    int prepare_delta(const std::map<int, bufferlist> &deltas,
+		      std::map<int, bufferlist> *coding,
+		      std::map<int, bufferlist> *delta_chunks,
+		      unsigned *blocksize);
+
     int parse(const ErasureCodeProfile &profile,
 	      std::ostream *ss);
 
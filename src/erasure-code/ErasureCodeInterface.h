@@ -459,6 +459,58 @@ namespace ceph {
      */
     virtual int decode_concat(const std::map<int, bufferlist> &chunks,
 			      bufferlist *decoded) = 0;
+
+    /**
+     * Return true if the coding chunks can be updated with
+     * **apply_delta** after some of the data chunks are modified,
+     * without reading the data chunks that did not change. This is
+     * the case for linear codes such as Reed-Solomon, where each
+     * coding chunk is a sum of the data chunks multiplied by
+     * constants.
+     *
+     * @return true if **apply_delta** is implemented
+     */
+    virtual bool supports_parity_delta() const = 0;
+
+    /**
+     * Compute in **delta** the difference between **old_data** and
+     * **new_data**, the content of the same range of a data chunk
+     * before and after it is modified.
+     *
+     * Both buffers must have the same size and **delta** is
+     * expected to be a pointer to an empty bufferlist.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] old_data content of the range before the write
+     * @param [in] new_data content of the range after the write
+     * @param [out] delta difference to be given to **apply_delta**
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_delta(const bufferlist &old_data,
+			     const bufferlist &new_data,
+			     bufferlist *delta) = 0;
+
+    /**
+     * Update the coding chunks in **coding** to account for the
+     * data chunk deltas in **deltas**. The **deltas** map is keyed
+     * by data chunk index, data chunks that did not change are not
+     * listed. The **coding** map must contain every coding chunk,
+     * keyed by chunk index, with the content they had before the
+     * data chunks changed. They are updated in place.
+     *
+     * All buffers must have the same size and cover the same range
+     * of their respective chunks. The range may span several
+     * consecutive encoded chunks.
+     *
+     * Returns -EOPNOTSUPP if **supports_parity_delta** is false.
+     *
+     * @param [in] deltas map data chunk indexes to deltas
+     * @param [in,out] coding map coding chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int apply_delta(const std::map<int, bufferlist> &deltas,
+			    std::map<int, bufferlist> *coding) = 0;
   };
 
   typedef std::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
@@ -114,6 +114,22 @@ int ErasureCodeIsa::decode_chunks(const set<int> &want_to_read,
   return isa_decode(erasures, data, coding, blocksize);
 }
 
+int ErasureCodeIsa::apply_delta(const map<int, bufferlist> &deltas,
+                                map<int, bufferlist> *coding)
+{
+  map<int, bufferlist> delta_chunks;
+  unsigned blocksize;
+  int r = prepare_delta(deltas, coding, &delta_chunks, &blocksize);
+  if (r < 0)
+    return r;
+  char *parity[m];
+  for (int i = 0; i < m; i++)
+    parity[i] = (*coding)[k + i].c_str();
+  for (auto &&i : delta_chunks)
+    isa_encode_delta(i.first, i.second.c_str(), parity, blocksize);
+  return 0;
+}
+
 // -----------------------------------------------------------------------------
 
 void
@@ -132,6 +148,29 @@ ErasureCodeIsaDefault::isa_encode(char **data,
 
 // -----------------------------------------------------------------------------
 
+void
+ErasureCodeIsaDefault::isa_encode_delta(int index,
+                                        char *delta,
+                                        char **coding,
+                                        int blocksize)
+{
+  if (m == 1) {
+    // single parity stripe, see isa_encode
+    unsigned words = blocksize / EC_ISA_VECTOR_OP_WORDSIZE;
+    unsigned aligned = words * EC_ISA_VECTOR_OP_WORDSIZE;
+    vector_xor((vector_op_t*) delta, (vector_op_t*) coding[0],
+               (vector_op_t*) delta + words);
+    byte_xor((unsigned char*) delta + aligned,
+             (unsigned char*) coding[0] + aligned,
+             (unsigned char*) delta + blocksize);
+  } else {
+    ec_encode_data_update(blocksize, k, m, index, encode_tbls,
+                          (unsigned char*) delta, (unsigned char**) coding);
+  }
+}
+
+// -----------------------------------------------------------------------------
+
 bool
 ErasureCodeIsaDefault::erasure_contains(int *erasures, int i)
 {
@@ -82,6 +82,14 @@ public:
 
   int init(ceph::ErasureCodeProfile &profile, std::ostream *ss) override;
 
+  bool supports_parity_delta() const override
+  {
+    return true;
+  }
+
+  int apply_delta(const std::map<int, ceph::buffer::list> &deltas,
+                  std::map<int, ceph::buffer::list> *coding) override;
+
   virtual void isa_encode(char **data,
                           char **coding,
                           int blocksize) = 0;
@@ -92,6 +100,11 @@ public:
                          char **coding,
                          int blocksize) = 0;
 
+  virtual void isa_encode_delta(int index,
+                                char *delta,
+                                char **coding,
+                                int blocksize) = 0;
+
   virtual unsigned get_alignment() const = 0;
 
   virtual void prepare() = 0;
@@ -141,6 +154,11 @@ public:
                          char **coding,
                          int blocksize) override;
 
+  void isa_encode_delta(int index,
+                        char *delta,
+                        char **coding,
+                        int blocksize) override;
+
   unsigned get_alignment() const override;
 
   void prepare() override;
@@ -137,6 +137,39 @@ int ErasureCodeJerasure::decode_chunks(const set<int> &want_to_read,
   return jerasure_decode(erasures, data, coding, blocksize);
 }
 
+int ErasureCodeJerasure::matrix_apply_delta(int *matrix,
+					    const map<int, bufferlist> &deltas,
+					    map<int, bufferlist> *coding)
+{
+  map<int, bufferlist> delta_chunks;
+  unsigned blocksize;
+  int r = prepare_delta(deltas, coding, &delta_chunks, &blocksize);
+  if (r < 0)
+    return r;
+  if (blocksize % (w / 8))
+    return -EINVAL;
+  // coding[j] = sum(matrix[j][i] * data[i]), add matrix[j][i] * delta[i]
+  for (int j = 0; j < m; j++) {
+    char *parity = (*coding)[k + j].c_str();
+    for (auto &&i : delta_chunks) {
+      int e = matrix[j * k + i.first];
+      char *delta = i.second.c_str();
+      if (e == 0) {
+	continue;
+      } else if (e == 1) {
+	galois_region_xor(delta, parity, blocksize);
+      } else if (w == 8) {
+	galois_w08_region_multiply(delta, e, blocksize, parity, 1);
+      } else if (w == 16) {
+	galois_w16_region_multiply(delta, e, blocksize, parity, 1);
+      } else {
+	galois_w32_region_multiply(delta, e, blocksize, parity, 1);
+      }
+    }
+  }
+  return 0;
+}
+
 bool ErasureCodeJerasure::is_prime(int value)
 {
   int prime55[] = {
@@ -30,6 +30,22 @@ extern ceph_crc32c_func_t ceph_choose_crc32(void);
  */
 uint32_t ceph_crc32c_zeros(uint32_t crc, unsigned length);
 
+/**
+ * calculate crc32c of several equally sized buffers
+ *
+ * The buffers are independent, so on CPUs with a crc32 instruction
+ * several of them are run through it interleaved, hiding its latency.
+ * None of the buffer pointers may be NULL.
+ *
+ * @param crc initial value for every buffer
+ * @param bufs array of n buffer pointers
+ * @param n number of buffers
+ * @param length length of each buffer
+ * @param out array of n results
+ */
+void ceph_crc32c_multi(uint32_t crc, unsigned char const * const *bufs,
+		       unsigned n, unsigned length, uint32_t *out);
+
 /**
  * calculate crc32c
  *
@@ -123,6 +123,17 @@ public:
       const std::string &end        ///< [in] The start bound of remove keys
       ) = 0;
 
+    /// Removes keys in [start, end), with a single range tombstone
+    /// once more than max_keys keys would have to be removed one by one.
+    /// This is a performance hint: stores without range deletes simply
+    /// remove the keys.
+    virtual void rm_range_keys(
+      const std::string &prefix,    ///< [in] Prefix by which to remove keys
+      const std::string &start,     ///< [in] The start bound of remove keys
+      const std::string &end,       ///< [in] The end bound of remove keys
+      uint64_t max_keys             ///< [in] Max number of per key deletes
+      ) { rm_range_keys(prefix, start, end); }
+
     /// Merge value into key
     virtual void merge(
       const std::string &prefix,   ///< [in] Prefix/CF ==> MUST match some established merge operator
@@ -342,6 +353,20 @@ public:
     return nullptr;
   }
 
+  /// additional caches to balance next to get_priority_cache(), by name
+  virtual std::map<std::string, std::shared_ptr<PriorityCache::PriCache>>
+  get_cf_priority_caches() const {
+    return {};
+  }
+
+  /// split the kv share of the cache budget across the priority caches
+  virtual void set_cache_ratios(double ratio) {
+    auto c = get_priority_cache();
+    if (c) {
+      c->set_cache_ratio(ratio);
+    }
+  }
+
   virtual ~KeyValueDB() {}
 
   /// estimate space utilization for a prefix (in bytes)
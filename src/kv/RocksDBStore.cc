@@ -357,6 +357,100 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+int RocksDBStore::install_cf_block_cache(
+  const string &cf_name,
+  const rocksdb::Options& opt,
+  rocksdb::ColumnFamilyOptions *cf_opt)
+{
+  ceph_assert(cf_opt != nullptr);
+  if (!cct->_conf.get_val<bool>("rocksdb_cache_per_cf") ||
+      cct->_conf->rocksdb_cache_type != "binned_lru" ||
+      bbt_opts.no_block_cache ||
+      cf_opt->table_factory != opt.table_factory) {
+    // not enabled, or the CF brings its own table options
+    return 0;
+  }
+  auto& cache = cf_block_caches[cf_name];
+  if (!cache) {
+    cache = rocksdb_cache::NewBinnedLRUCache(
+      cct,
+      block_cache_size,
+      cct->_conf->rocksdb_cache_shard_bits);
+    // start with an even split; PriorityCache rebalances from there
+    uint64_t share = block_cache_size / (cf_block_caches.size() + 1);
+    bbt_opts.block_cache->SetCapacity(share);
+    for (auto& [name, c] : cf_block_caches) {
+      c->SetCapacity(share);
+    }
+    dout(10) << __func__ << " column " << cf_name << " block_cache size "
+	     << byte_u_t(share) << dendl;
+  }
+  rocksdb::BlockBasedTableOptions cf_bbt_opts(bbt_opts);
+  cf_bbt_opts.block_cache = cache;
+  cf_opt->table_factory.reset(rocksdb::NewBlockBasedTableFactory(cf_bbt_opts));
+  return 0;
+}
+
+std::map<std::string, std::shared_ptr<PriorityCache::PriCache>>
+RocksDBStore::get_cf_priority_caches() const
+{
+  std::map<std::string, std::shared_ptr<PriorityCache::PriCache>> caches;
+  for (auto& [name, cache] : cf_block_caches) {
+    auto c = std::dynamic_pointer_cast<PriorityCache::PriCache>(cache);
+    if (c) {
+      caches.emplace(name, c);
+    }
+  }
+  return caches;
+}
+
+void RocksDBStore::set_cache_ratios(double ratio)
+{
+  if (cf_block_caches.empty()) {
+    KeyValueDB::set_cache_ratios(ratio);
+    return;
+  }
+  // Weight each cache by its recent lookup hits per byte of capacity.  A
+  // cache whose hits keep growing with its size holds on to its share;
+  // one that stopped profiting from more memory hands it to the others.
+  std::map<std::string, std::shared_ptr<rocksdb_cache::BinnedLRUCache>> caches;
+  caches[rocksdb::kDefaultColumnFamilyName] =
+    std::dynamic_pointer_cast<rocksdb_cache::BinnedLRUCache>(bbt_opts.block_cache);
+  for (auto& [name, cache] : cf_block_caches) {
+    caches[name] = std::dynamic_pointer_cast<rocksdb_cache::BinnedLRUCache>(cache);
+  }
+  std::map<std::string, double> weights;
+  double total = 0;
+  for (auto& [name, cache] : caches) {
+    if (!cache) {
+      continue;
+    }
+    uint64_t hits, misses;
+    cache->GetHitStats(&hits, &misses);
+    auto& stats = cache_hit_stats[name];
+    stats.avg_hits = (stats.avg_hits + (hits - stats.hits)) / 2;
+    stats.hits = hits;
+    double w = (stats.avg_hits + 1) /
+      std::max<double>(cache->GetCapacity(), 1 << 20);
+    weights[name] = w;
+    total += w;
+  }
+  if (weights.empty()) {
+    return;
+  }
+  double min_ratio = cct->_conf.get_val<double>("rocksdb_cache_per_cf_min_ratio");
+  min_ratio = std::min(min_ratio, 1.0 / weights.size());
+  double spread = 1.0 - min_ratio * weights.size();
+  for (auto& [name, w] : weights) {
+    double r = ratio * (min_ratio + spread * w / total);
+    dout(20) << __func__ << " " << name << " avg hits "
+	     << cache_hit_stats[name].avg_hits
+	     << " capacity " << byte_u_t(caches[name]->GetCapacity())
+	     << " ratio " << r << dendl;
+    caches[name]->set_cache_ratio(r);
+  }
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const std::string& cfs)
 {
@@ -434,7 +528,9 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
     cache_size = cct->_conf->rocksdb_cache_size;
   }
   uint64_t row_cache_size = cache_size * cct->_conf->rocksdb_cache_row_ratio;
-  uint64_t block_cache_size = cache_size - row_cache_size;
+  block_cache_size = cache_size - row_cache_size;
+  cf_block_caches.clear();
+  cache_hit_stats.clear();
 
   if (cct->_conf->rocksdb_cache_type == "binned_lru") {
     bbt_opts.block_cache = rocksdb_cache::NewBinnedLRUCache(
@@ -692,6 +788,7 @@ int RocksDBStore::create_shards(const rocksdb::Options& opt,
       return -EINVAL;
     }
     install_cf_mergeop(p.name, &cf_opt);
+    install_cf_block_cache(p.name, opt, &cf_opt);
     for (size_t idx = 0; idx < p.shard_cnt; idx++) {
       std::string cf_name;
       if (p.shard_cnt == 1)
@@ -805,6 +902,7 @@ int RocksDBStore::verify_sharding(const rocksdb::Options& opt,
       return -EINVAL;
     }
     install_cf_mergeop(column.name, &cf_opt);
+    install_cf_block_cache(column.name, opt, &cf_opt);
 
     if (column.shard_cnt == 1) {
       emplace_cf(column, 0, column.name, cf_opt);
@@ -1468,10 +1566,18 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
 void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
+{
+  rm_range_keys(prefix, start, end, db->delete_range_threshold);
+}
+
+void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
+                                                         const string &start,
+                                                         const string &end,
+                                                         uint64_t max_keys)
 {
   auto p_iter = db->cf_handles.find(prefix);
   if (p_iter == db->cf_handles.end()) {
-    uint64_t cnt = db->delete_range_threshold;
+    uint64_t cnt = max_keys;
     bat.SetSavePoint();
     auto it = db->get_iterator(prefix);
     for (it->lower_bound(start);
@@ -1490,7 +1596,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
   } else {
     ceph_assert(p_iter->second.handles.size() >= 1);
     for (auto cf : p_iter->second.handles) {
-      uint64_t cnt = db->delete_range_threshold;
+      uint64_t cnt = max_keys;
       bat.SetSavePoint();
       rocksdb::Iterator* it = db->new_shard_iterator(cf);
       ceph_assert(it != nullptr);
@@ -82,7 +82,19 @@ class RocksDBStore : public KeyValueDB {
   std::string options_str;
 
   uint64_t cache_size = 0;
+  uint64_t block_cache_size = 0;
   bool set_cache_flag = false;
+  /// per column family block caches (rocksdb_cache_per_cf), by CF name;
+  /// only changed while the db is opened
+  std::map<std::string, std::shared_ptr<rocksdb::Cache>> cf_block_caches;
+  /// lookup hits seen at the last set_cache_ratios() call, by cache; only
+  /// used by set_cache_ratios(), which the single cache balancing thread
+  /// calls, so there is no lock
+  struct cache_hit_stats_t {
+    uint64_t hits = 0;
+    double avg_hits = 0;  ///< smoothed hits per interval
+  };
+  std::map<std::string, cache_hit_stats_t> cache_hit_stats;
   friend class ShardMergeIteratorImpl;
   friend class WholeMergeIteratorImpl;
   /*
@@ -124,6 +136,9 @@ private:
 
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const std::string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
+  int install_cf_block_cache(const std::string &cf_name,
+			     const rocksdb::Options& opt,
+			     rocksdb::ColumnFamilyOptions *cf_opt);
   int create_db_dir();
   int do_open(std::ostream &out, bool create_if_missing, bool open_readonly,
 	      const std::string& cfs="");
@@ -299,6 +314,11 @@ public:
       const std::string &prefix,
       const std::string &start,
       const std::string &end) override;
+    void rm_range_keys(
+      const std::string &prefix,
+      const std::string &start,
+      const std::string &end,
+      uint64_t max_keys) override;
     void merge(
       const std::string& prefix,
       const std::string& k,
@@ -457,7 +477,11 @@ err:
   }
 
   virtual int64_t get_cache_usage() const override {
-    return static_cast<int64_t>(bbt_opts.block_cache->GetUsage());
+    int64_t usage = static_cast<int64_t>(bbt_opts.block_cache->GetUsage());
+    for (auto& [name, cache] : cf_block_caches) {
+      usage += static_cast<int64_t>(cache->GetUsage());
+    }
+    return usage;
   }
 
   int set_cache_size(uint64_t s) override {
@@ -472,6 +496,10 @@ err:
         bbt_opts.block_cache);
   }
 
+  std::map<std::string, std::shared_ptr<PriorityCache::PriCache>>
+  get_cf_priority_caches() const override;
+  void set_cache_ratios(double ratio) override;
+
   WholeSpaceIterator get_wholespace_iterator(IteratorOpts opts = 0) override;
 private:
   WholeSpaceIterator get_default_cf_iterator();
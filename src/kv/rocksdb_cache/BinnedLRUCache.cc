@@ -187,6 +187,12 @@ size_t BinnedLRUCacheShard::GetHighPriPoolUsage() const {
   return high_pri_pool_usage_;
 }
 
+void BinnedLRUCacheShard::GetHitStats(uint64_t* hits, uint64_t* misses) const {
+  std::lock_guard<std::mutex> l(mutex_);
+  *hits += hits_;
+  *misses += misses_;
+}
+
 void BinnedLRUCacheShard::LRU_Remove(BinnedLRUHandle* e) {
   ceph_assert(e->next != nullptr);
   ceph_assert(e->prev != nullptr);
@@ -283,6 +289,9 @@ rocksdb::Cache::Handle* BinnedLRUCacheShard::Lookup(const rocksdb::Slice& key, u
     }
     e->refs++;
     e->SetHit();
+    ++hits_;
+  } else {
+    ++misses_;
   }
   return reinterpret_cast<rocksdb::Cache::Handle*>(e);
 }
@@ -549,6 +558,14 @@ size_t BinnedLRUCache::GetHighPriPoolUsage() const {
   return usage;
 }
 
+void BinnedLRUCache::GetHitStats(uint64_t* hits, uint64_t* misses) const {
+  *hits = 0;
+  *misses = 0;
+  for (int s = 0; s < num_shards_; s++) {
+    shards_[s].GetHitStats(hits, misses);
+  }
+}
+
 // PriCache
 
 int64_t BinnedLRUCache::request_cache_bytes(PriorityCache::Priority pri, uint64_t total_cache) const
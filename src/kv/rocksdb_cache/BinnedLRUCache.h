@@ -224,6 +224,9 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
   // Retrieves high pri pool usage
   size_t GetHighPriPoolUsage() const;
 
+  // Retrieves the number of lookups that hit and missed
+  void GetHitStats(uint64_t* hits, uint64_t* misses) const;
+
  private:
   void LRU_Remove(BinnedLRUHandle* e);
   void LRU_Insert(BinnedLRUHandle* e);
@@ -289,6 +292,12 @@ class alignas(CACHE_LINE_SIZE) BinnedLRUCacheShard : public CacheShard {
   // We don't count mutex_ as the cache's internal state so semantically we
   // don't mind mutex_ invoking the non-const actions.
   mutable std::mutex mutex_;
+
+  // Lookup outcomes, for hit-rate driven cache sizing.  Bumped by Lookup()
+  // with mutex_ held, which it takes anyway, and read by GetHitStats()
+  // under mutex_ as well, so they need not be atomic.
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
 };
 
 class BinnedLRUCache : public ShardedCache {
@@ -312,6 +321,8 @@ class BinnedLRUCache : public ShardedCache {
   double GetHighPriPoolRatio() const;
   // Retrieves high pri pool usage
   size_t GetHighPriPoolUsage() const;
+  // Retrieves the number of lookups that hit and missed in all shards
+  void GetHitStats(uint64_t* hits, uint64_t* misses) const;
 
   // PriorityCache
   virtual int64_t request_cache_bytes(
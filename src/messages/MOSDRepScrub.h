@@ -24,7 +24,7 @@
 
 class MOSDRepScrub : public MOSDFastDispatchOp {
 public:
-  static constexpr int HEAD_VERSION = 9;
+  static constexpr int HEAD_VERSION = 10;
   static constexpr int COMPAT_VERSION = 6;
 
   spg_t pgid;             // PG to scrub
@@ -38,6 +38,9 @@ public:
   bool allow_preemption = false;
   int32_t priority = 0;
   bool high_priority = false;
+  eversion_t deep_since; // if set, only read objects written since
+  uint32_t deep_sample_slot = 0; // or in this slot of deep_sample_rate
+  uint32_t deep_sample_rate = 0;
 
   epoch_t get_map_epoch() const override {
     return map_epoch;
@@ -87,8 +90,12 @@ public:
         << ",version:" << header.version
 	<< ",allow_preemption:" << (int)allow_preemption
 	<< ",priority=" << priority
-	<< (high_priority ? " (high)":"")
-	<< ")";
+	<< (high_priority ? " (high)":"");
+    if (deep_since != eversion_t()) {
+      out << ",deep_since:" << deep_since
+	  << ",sample:" << deep_sample_rate;
+    }
+    out << ")";
   }
 
   void encode_payload(uint64_t features) override {
@@ -107,6 +114,9 @@ public:
     encode(allow_preemption, payload);
     encode(priority, payload);
     encode(high_priority, payload);
+    encode(deep_since, payload);
+    encode(deep_sample_slot, payload);
+    encode(deep_sample_rate, payload);
   }
   void decode_payload() override {
     using ceph::decode;
@@ -136,6 +146,11 @@ public:
       decode(priority, p);
       decode(high_priority, p);
     }
+    if (header.version >= 10) {
+      decode(deep_since, p);
+      decode(deep_sample_slot, p);
+      decode(deep_sample_rate, p);
+    }
   }
 };
 
@@ -390,6 +390,24 @@ int ConfigKeyService::validate_osd_new(
   return 0;
 }
 
+int ConfigKeyService::validate_compression_dictionary(
+    const string& id,
+    stringstream& ss)
+{
+  string key = "compression_dictionary/" + id;
+  bufferlist value;
+  if (!store_exists(key) || store_get(key, value) < 0) {
+    ss << "no dictionary at config-key " << key;
+    return -ENOENT;
+  }
+  char *end = nullptr;
+  if (id.empty() || strtoul(id.c_str(), &end, 16) != value.crc32c(0) || *end) {
+    ss << "config-key " << key << " is not dictionary " << id;
+    return -EINVAL;
+  }
+  return 0;
+}
+
 void ConfigKeyService::do_osd_new(
     const uuid_d& uuid,
     const string& dmcrypt_key)
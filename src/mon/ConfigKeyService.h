@@ -68,6 +68,11 @@ public:
       const std::string& dmcrypt_key,
       std::stringstream& ss);
   void do_osd_new(const uuid_d& uuid, const std::string& dmcrypt_key);
+  /// a dictionary with the crc32c id (hex) must be stored at
+  /// compression_dictionary/<id>
+  int validate_compression_dictionary(
+      const std::string& id,
+      std::stringstream& ss);
 
   int get_type() override {
     return QuorumService::SERVICE_CONFIG_KEY;
@@ -183,6 +183,10 @@ void MonCapGrant::expand_profile(const EntityName& name) const
     profile_grants.push_back(MonCapGrant("mon", MON_CAP_R));
     profile_grants.push_back(MonCapGrant("pg", MON_CAP_R | MON_CAP_W));
     profile_grants.push_back(MonCapGrant("log", MON_CAP_W));
+    // dictionaries named by the compression_dictionary pool option
+    StringConstraint constraint(StringConstraint::MATCH_TYPE_PREFIX,
+                                "compression_dictionary/");
+    profile_grants.push_back(MonCapGrant("config-key get", "key", constraint));
   }
   if (profile == "mds") {
     profile_grants.push_back(MonCapGrant("mds", MON_CAP_ALL));
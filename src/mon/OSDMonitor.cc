@@ -5382,7 +5382,8 @@ namespace {
     HIT_SET_GRADE_DECAY_RATE, HIT_SET_SEARCH_LAST_N,
     SCRUB_MIN_INTERVAL, SCRUB_MAX_INTERVAL, DEEP_SCRUB_INTERVAL,
     RECOVERY_PRIORITY, RECOVERY_OP_PRIORITY, SCRUB_PRIORITY,
-    COMPRESSION_MODE, COMPRESSION_ALGORITHM, COMPRESSION_REQUIRED_RATIO,
+    COMPRESSION_MODE, COMPRESSION_ALGORITHM, COMPRESSION_DICTIONARY,
+    COMPRESSION_REQUIRED_RATIO, EC_READ_HEDGE,
     COMPRESSION_MAX_BLOB_SIZE, COMPRESSION_MIN_BLOB_SIZE,
     CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK, FINGERPRINT_ALGORITHM,
     PG_AUTOSCALE_MODE, PG_NUM_MIN, TARGET_SIZE_BYTES, TARGET_SIZE_RATIO,
@@ -6109,6 +6110,8 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
       {"scrub_priority", SCRUB_PRIORITY},
       {"compression_mode", COMPRESSION_MODE},
       {"compression_algorithm", COMPRESSION_ALGORITHM},
+      {"compression_dictionary", COMPRESSION_DICTIONARY},
+      {"ec_read_hedge", EC_READ_HEDGE},
       {"compression_required_ratio", COMPRESSION_REQUIRED_RATIO},
       {"compression_max_blob_size", COMPRESSION_MAX_BLOB_SIZE},
       {"compression_min_blob_size", COMPRESSION_MIN_BLOB_SIZE},
@@ -6326,6 +6329,8 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
           case SCRUB_PRIORITY:
 	  case COMPRESSION_MODE:
 	  case COMPRESSION_ALGORITHM:
+	  case COMPRESSION_DICTIONARY:
+	  case EC_READ_HEDGE:
 	  case COMPRESSION_REQUIRED_RATIO:
 	  case COMPRESSION_MAX_BLOB_SIZE:
 	  case COMPRESSION_MIN_BLOB_SIZE:
@@ -6483,6 +6488,8 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
           case SCRUB_PRIORITY:
 	  case COMPRESSION_MODE:
 	  case COMPRESSION_ALGORITHM:
+	  case COMPRESSION_DICTIONARY:
+	  case EC_READ_HEDGE:
 	  case COMPRESSION_REQUIRED_RATIO:
 	  case COMPRESSION_MAX_BLOB_SIZE:
 	  case COMPRESSION_MIN_BLOB_SIZE:
@@ -8581,6 +8588,12 @@ int OSDMonitor::prepare_command_pool_set(const cmdmap_t& cmdmap,
 	  ss << "unrecognized compression mode '" << val << "'";
 	  return -EINVAL;
         }
+        if (*cmode == Compressor::COMP_ADAPTIVE &&
+            osdmap.require_osd_release < ceph_release_t::pacific) {
+          ss << "must set require_osd_release to pacific or "
+             << "later before setting compression_mode to adaptive";
+          return -EINVAL;
+        }
       }
     } else if (var == "compression_algorithm") {
       if (!unset) {
@@ -8590,6 +8603,14 @@ int OSDMonitor::prepare_command_pool_set(const cmdmap_t& cmdmap,
 	  return -EINVAL;
         }
       }
+    } else if (var == "compression_dictionary") {
+      if (!unset) {
+        ConfigKeyService *svc = (ConfigKeyService*)mon->config_key_service;
+        int err = svc->validate_compression_dictionary(val, ss);
+        if (err < 0) {
+          return err;
+        }
+      }
     } else if (var == "compression_required_ratio") {
       if (floaterr.length()) {
         ss << "error parsing float value '" << val << "': " << floaterr;
@@ -8656,6 +8677,19 @@ int OSDMonitor::prepare_command_pool_set(const cmdmap_t& cmdmap,
           return -EINVAL;
         }
       }
+    } else if (var == "ec_read_hedge") {
+      if (!p.is_erasure()) {
+        ss << "ec_read_hedge is only supported on erasure coded pools";
+        return -EINVAL;
+      }
+      if (interr.length()) {
+        ss << "error parsing int value '" << val << "': " << interr;
+        return -EINVAL;
+      }
+      if (n < 0 || n >= (int)p.get_size()) {
+        ss << "ec_read_hedge must be between 0 and " << p.get_size() - 1;
+        return -EINVAL;
+      }
     } else if (var == "pg_autoscale_bias") {
       if (f < 0.0 || f > 1000.0) {
 	ss << "pg_autoscale_bias must be between 0 and 1000";
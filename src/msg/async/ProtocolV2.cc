@@ -1161,14 +1161,25 @@ CtPtr ProtocolV2::read_frame_segment() {
 
   rx_buffer_t rx_buffer;
   uint16_t align = rx_frame_asm.get_segment_align(seg_idx);
+  uint32_t head = 0;
+  if (next_tag == Tag::MESSAGE &&
+      seg_idx == SegmentIndex::Msg::DATA &&
+      align == segment_t::PAGE_SIZE_ALIGNMENT) {
+    head = get_rx_data_head();
+  }
   try {
     rx_buffer = ceph::buffer::ptr_node::create(ceph::buffer::create_aligned(
-        onwire_len, align));
+        onwire_len + head, align));
+    if (head) {
+      rx_buffer->set_offset(head);
+      rx_buffer->set_length(onwire_len);
+    }
   } catch (std::bad_alloc&) {
     // Catching because of potential issues with satisfying alignment.
     ldout(cct, 1) << __func__ << " can't allocate aligned rx_buffer"
                   << " len=" << onwire_len
                   << " align=" << align
+                  << " head=" << head
                   << dendl;
     return _fault();
   }
@@ -1176,6 +1187,28 @@ CtPtr ProtocolV2::read_frame_segment() {
   return READ_RXBUF(std::move(rx_buffer), handle_read_frame_segment);
 }
 
+// Like msgr1's alloc_aligned_buffer(): place the data segment so that
+// the byte at object offset data_off starts at the same offset within a
+// page.  Block aligned extents of a write then sit on page boundaries in
+// memory and the store can submit them to the device without copying.
+// The header hasn't been verified yet; a bogus data_off only costs us
+// the realignment later on.
+uint32_t ProtocolV2::get_rx_data_head() {
+  if (!cct->_conf.get_val<bool>("ms_async_rx_align_data")) {
+    return 0;
+  }
+  ceph_msg_header2 header;
+  if (!rx_frame_asm.peek_first_segment(
+        rx_preamble, rx_segments_data[SegmentIndex::Msg::HEADER],
+        sizeof(header), reinterpret_cast<char*>(&header))) {
+    return 0;
+  }
+  uint32_t head = header.data_off & (segment_t::PAGE_SIZE_ALIGNMENT - 1);
+  ldout(cct, 25) << __func__ << " data_off=" << header.data_off
+                 << " head=" << head << dendl;
+  return head;
+}
+
 CtPtr ProtocolV2::handle_read_frame_segment(rx_buffer_t &&rx_buffer, int r) {
   ldout(cct, 20) << __func__ << " r=" << r << dendl;
 
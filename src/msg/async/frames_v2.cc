@@ -457,6 +457,29 @@ bool FrameAssembler::disassemble_remaining_segments(
   return disasm_all_crc_rev0(segment_bls, epilogue_bl);
 }
 
+bool FrameAssembler::peek_first_segment(const bufferlist& preamble_bl,
+                                        const bufferlist& segment_bl,
+                                        uint32_t len, char* dst) const {
+  ceph_assert(!m_descs.empty());
+  if (len > m_descs[0].logical_len) {
+    return false;
+  }
+  if (m_crypto->rx) {
+    if (!m_is_rev1 || len > FRAME_PREAMBLE_INLINE_SIZE ||
+        preamble_bl.length() < FRAME_PREAMBLE_WITH_INLINE_SIZE) {
+      return false;
+    }
+    // the inline buffer has been decrypted along with the preamble
+    preamble_bl.begin(sizeof(preamble_block_t)).copy(len, dst);
+    return true;
+  }
+  if (segment_bl.length() < len) {
+    return false;
+  }
+  segment_bl.begin().copy(len, dst);
+  return true;
+}
+
 std::ostream& operator<<(std::ostream& os, const FrameAssembler& frame_asm) {
   if (!frame_asm.m_descs.empty()) {
     os << frame_asm.get_preamble_onwire_len();
@@ -330,6 +330,15 @@ public:
   bool disassemble_remaining_segments(bufferlist segment_bls[],
                                       bufferlist& epilogue_bl) const;
 
+  // Copy the leading len bytes of the first segment out of the frame
+  // while it is still being read in, without verifying them.  This is
+  // only good for hints (e.g. placement of a later segment in memory);
+  // nothing that affects correctness may depend on it.  Returns false if
+  // the bytes aren't available in the clear yet (msgr2.0 secure mode).
+  bool peek_first_segment(const bufferlist& preamble_bl,
+                          const bufferlist& segment_bl,
+                          uint32_t len, char* dst) const;
+
 private:
   struct segment_desc_t {
     uint32_t logical_len;
@@ -104,6 +104,42 @@ int ObjectStore::probe_block_device_fsid(
   return -EINVAL;
 }
 
+int ObjectStore::omap_get_batch(
+  CollectionHandle &c,
+  const ghobject_t &oid,
+  const std::string &start_after,
+  const std::string &filter_prefix,
+  uint64_t max_count,
+  uint64_t max_bytes,
+  std::map<std::string, ceph::buffer::list> *out,
+  bool *more)
+{
+  *more = false;
+  ObjectMap::ObjectMapIterator iter = get_omap_iterator(c, oid);
+  if (!iter) {
+    return -ENOENT;
+  }
+  iter->upper_bound(start_after);
+  if (filter_prefix > start_after) {
+    iter->lower_bound(filter_prefix);
+  }
+  uint64_t bytes = 0;
+  for (; iter->valid(); iter->next()) {
+    std::string key = iter->key();
+    if (key.compare(0, filter_prefix.size(), filter_prefix) != 0) {
+      break;
+    }
+    if (out->size() >= max_count || bytes >= max_bytes) {
+      *more = true;
+      break;
+    }
+    bufferlist value = iter->value();
+    bytes += key.size() + value.length();
+    out->emplace_hint(out->end(), std::move(key), std::move(value));
+  }
+  return iter->status();
+}
+
 int ObjectStore::write_meta(const std::string& key,
 			    const std::string& value)
 {
@@ -433,6 +433,19 @@ public:
     CollectionHandle& c,
     const pool_opts_t& opts) = 0;
 
+  /**
+   * set_compression_dictionary -- provide a compression dictionary
+   *
+   * The compression_dictionary pool option only names a dictionary by
+   * its id, the crc32c of its bytes.
+   *
+   * @param id id of the dictionary
+   * @param raw the dictionary
+   */
+  virtual void set_compression_dictionary(
+    uint32_t id,
+    const ceph::buffer::list& raw) {}
+
   /**
    * stat -- get information for an object
    *
@@ -745,6 +758,27 @@ public:
     const ghobject_t &oid  ///< [in] object
     ) = 0;
 
+  /**
+   * Get a batch of key/value pairs in key order
+   *
+   * Returns the keys after start_after that begin with filter_prefix,
+   * stopping before max_count pairs or once max_bytes bytes of keys and
+   * values have been collected, whichever comes first.  This is what
+   * paging through an omap with get_omap_iterator() does, in one call.
+   *
+   * @return 0 on success, -ENOENT if oid does not exist
+   */
+  virtual int omap_get_batch(
+    CollectionHandle &c,               ///< [in] Collection containing oid
+    const ghobject_t &oid,             ///< [in] Object containing omap
+    const std::string &start_after,    ///< [in] Return keys after this one
+    const std::string &filter_prefix,  ///< [in] Return keys with this prefix
+    uint64_t max_count,                ///< [in] Max number of keys
+    uint64_t max_bytes,                ///< [in] Max key and value bytes
+    std::map<std::string, ceph::buffer::list> *out, ///< [out] Keys and values
+    bool *more                         ///< [out] More keys are left
+    );
+
   virtual int flush_journal() { return -EOPNOTSUPP; }
 
   virtual int dump_journal(std::ostream& out) { return -EOPNOTSUPP; }
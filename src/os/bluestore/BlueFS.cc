@@ -283,6 +283,26 @@ void BlueFS::_init_logger()
 		    "Bytes requested in prefetch read mode", NULL,
 		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
 
+  b.add_u64_counter(l_bluefs_read_ahead_count, "read_ahead_count",
+		    "asynchronous read-ahead requests issued");
+  b.add_u64_counter(l_bluefs_read_ahead_bytes, "read_ahead_bytes",
+		    "Bytes requested by asynchronous read-ahead", NULL,
+		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluefs_read_ahead_hit_bytes, "read_ahead_hit_bytes",
+		    "Read-ahead bytes consumed by readers", NULL,
+		    PerfCountersBuilder::PRIO_INTERESTING, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluefs_read_ahead_wasted_bytes, "read_ahead_wasted_bytes",
+		    "Read-ahead bytes dropped without being used", NULL,
+		    PerfCountersBuilder::PRIO_INTERESTING, unit_t(UNIT_BYTES));
+
+  b.add_time_avg(l_bluefs_log_compaction_lat, "log_compaction_lat",
+		 "Average duration of async metadata log compaction");
+  b.add_time_avg(l_bluefs_log_compaction_lock_lat, "log_compaction_lock_lat",
+		 "Average time async log compaction held the bluefs lock");
+  b.add_time_avg(l_bluefs_log_compaction_stall_lat, "log_compaction_stall_lat",
+		 "Average time log flushes waited for log compaction to finish",
+		 NULL, PerfCountersBuilder::PRIO_INTERESTING);
+
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -463,6 +483,33 @@ int BlueFS::get_block_extents(unsigned id, interval_set<uint64_t> *extents)
   return 0;
 }
 
+int BlueFS::get_block_extents(unsigned id, interval_set<uint64_t> *extents,
+			      std::function<void()> under_lock)
+{
+  std::lock_guard l(lock);
+  dout(10) << __func__ << " bdev " << id << dendl;
+  ceph_assert(id < alloc.size());
+  for (auto& p : file_map) {
+    for (auto& q : p.second->fnode.extents) {
+      if (q.bdev == id) {
+        extents->union_insert(q.offset, q.length);
+      }
+    }
+  }
+  if (new_log) {
+    for (auto& q : new_log->fnode.extents) {
+      if (q.bdev == id) {
+        extents->union_insert(q.offset, q.length);
+      }
+    }
+  }
+  if (id < pending_release.size()) {
+    extents->union_of(pending_release[id]);
+  }
+  under_lock();
+  return 0;
+}
+
 int BlueFS::mkfs(uuid_d osd_uuid, const bluefs_layout_t& layout)
 {
   std::unique_lock l(lock);
@@ -1727,6 +1774,16 @@ int64_t BlueFS::_read_random(
   std::shared_lock s_lock(h->lock);
   buf->bl.reassign_to_mempool(mempool::mempool_bluefs_file_reader);
   while (len > 0) {
+    if (off >= buf->get_buf_end() && buf->in_read_ahead(off)) {
+      // the data is already being read ahead; wait for it
+      s_lock.unlock();
+      {
+	std::unique_lock u_lock(h->lock);
+	_read_ahead_consume(h, off);
+      }
+      s_lock.lock();
+      continue;
+    }
     if (off < buf->bl_off || off >= buf->get_buf_end()) {
       s_lock.unlock();
       uint64_t x_off = 0;
@@ -1827,8 +1884,21 @@ int64_t BlueFS::_read(
       s_lock.unlock();
       std::unique_lock u_lock(h->lock);
       buf->bl.reassign_to_mempool(mempool::mempool_bluefs_file_reader);
-      if (off < buf->bl_off || off >= buf->get_buf_end()) {
+      if ((off < buf->bl_off || off >= buf->get_buf_end()) &&
+	  !_read_ahead_consume(h, off)) {
         // if precondition hasn't changed during locking upgrade.
+	uint64_t dropped = buf->drain_read_ahead();
+	if (dropped) {
+	  logger->inc(l_bluefs_read_ahead_wasted_bytes, dropped);
+	}
+	if (off == buf->get_buf_end()) {
+	  // sequential access; (re)start read-ahead behind this fetch
+	  if (!buf->read_ahead_window) {
+	    buf->read_ahead_window = buf->max_prefetch;
+	  }
+	} else {
+	  buf->read_ahead_window = 0;
+	}
         buf->bl.clear();
         buf->bl_off = off & super.block_mask();
         uint64_t x_off = 0;
@@ -1856,6 +1926,9 @@ int64_t BlueFS::_read(
         int r = bdev[p->bdev]->read(p->offset + x_off, l, &buf->bl, ioc[p->bdev],
 				    cct->_conf->bluefs_buffered_io);
         ceph_assert(r == 0);
+	if (buf->read_ahead_window && !h->random && !h->ignore_eof) {
+	  _read_ahead_issue(h, 0);
+	}
       }
       u_lock.unlock();
       s_lock.lock();
@@ -1897,6 +1970,126 @@ int64_t BlueFS::_read(
   return ret;
 }
 
+bool BlueFS::_read_ahead_consume(FileReader *h, uint64_t off)
+{
+  // caller holds h->lock exclusively
+  auto* buf = &h->buf;
+  if (!buf->in_read_ahead(off)) {
+    return false;
+  }
+  while (buf->read_ahead.front()->get_end() <= off) {
+    // skipped over by the reader
+    auto& ra = buf->read_ahead.front();
+    ra->ioc.aio_wait();
+    logger->inc(l_bluefs_read_ahead_wasted_bytes, ra->len);
+    buf->read_ahead.pop_front();
+  }
+  auto& ra = buf->read_ahead.front();
+  ra->ioc.aio_wait();
+  int r = ra->ioc.get_return_value();
+  if (r < 0) {
+    dout(1) << __func__ << " h " << h << " read-ahead 0x"
+	    << std::hex << ra->off << "~" << ra->len << std::dec
+	    << " failed: " << cpp_strerror(r) << dendl;
+    logger->inc(l_bluefs_read_ahead_wasted_bytes, buf->drain_read_ahead());
+    return false;
+  }
+  dout(20) << __func__ << " h " << h << " 0x"
+	   << std::hex << ra->off << "~" << ra->len << std::dec << dendl;
+  buf->bl.clear();
+  buf->bl.claim_append(ra->bl);
+  buf->bl.reassign_to_mempool(mempool::mempool_bluefs_file_reader);
+  buf->bl_off = ra->off;
+  logger->inc(l_bluefs_read_ahead_hit_bytes, ra->len);
+  buf->read_ahead.pop_front();
+
+  // the reader keeps up with us: widen the window
+  buf->read_ahead_window = std::min<uint64_t>(
+    buf->read_ahead_window * 2,
+    cct->_conf.get_val<Option::size_t>("bluefs_read_ahead_max_window"));
+  if ((!h->random || buf->read_ahead_hint) && !h->ignore_eof) {
+    _read_ahead_issue(h, 0);
+  }
+  return true;
+}
+
+void BlueFS::_read_ahead_issue(FileReader *h, uint64_t until)
+{
+  // caller holds h->lock exclusively
+  auto* buf = &h->buf;
+  auto depth = cct->_conf.get_val<uint64_t>("bluefs_read_ahead_depth");
+  uint64_t window = round_up_to(buf->read_ahead_window, super.block_size);
+  uint64_t eof_offset = round_up_to(h->file->fnode.size, super.block_size);
+  while (window && buf->read_ahead.size() < depth) {
+    uint64_t next = buf->get_read_ahead_end();
+    if (next >= eof_offset || (until && next >= until)) {
+      break;
+    }
+    uint64_t x_off = 0;
+    auto p = h->file->fnode.seek(next, &x_off);
+    if (p == h->file->fnode.extents.end()) {
+      break;
+    }
+    uint64_t l = std::min(p->length - x_off, window);
+    if (until) {
+      l = std::min(l, round_up_to(until - next, super.block_size));
+    }
+    l = std::min(l, eof_offset - next);
+    dout(20) << __func__ << " h " << h << " 0x"
+	     << std::hex << next << "~" << l << std::dec
+	     << " of " << *p << dendl;
+    auto ra = std::make_unique<FileReaderBuffer::ReadAhead>(cct, next, l);
+    int r = bdev[p->bdev]->aio_read(p->offset + x_off, l, &ra->bl, &ra->ioc);
+    if (r < 0) {
+      dout(1) << __func__ << " h " << h << " aio_read failed: "
+	      << cpp_strerror(r) << dendl;
+      break;
+    }
+    if (ra->ioc.has_pending_aios()) {
+      bdev[p->bdev]->aio_submit(&ra->ioc);
+    }
+    logger->inc(l_bluefs_read_ahead_count, 1);
+    logger->inc(l_bluefs_read_ahead_bytes, l);
+    buf->read_ahead.push_back(std::move(ra));
+  }
+}
+
+void BlueFS::prefetch(FileReader *h, uint64_t off, size_t len)
+{
+  if (h->ignore_eof ||
+      cct->_conf.get_val<uint64_t>("bluefs_read_ahead_depth") == 0) {
+    // synchronous prefetch into the reader buffer
+    _read(h, off, len, nullptr, nullptr);
+    return;
+  }
+  dout(10) << __func__ << " h " << h
+	   << " 0x" << std::hex << off << "~" << len << std::dec
+	   << " from " << h->file->fnode << dendl;
+  logger->inc(l_bluefs_read_prefetch_count, 1);
+  logger->inc(l_bluefs_read_prefetch_bytes, len);
+
+  std::unique_lock u_lock(h->lock);
+  auto* buf = &h->buf;
+  if (off >= buf->bl_off && off + len <= buf->get_buf_end()) {
+    return;
+  }
+  if (off < buf->bl_off || off > buf->get_read_ahead_end()) {
+    // not a continuation of what we have; start over at off
+    uint64_t dropped = buf->drain_read_ahead();
+    if (dropped) {
+      logger->inc(l_bluefs_read_ahead_wasted_bytes, dropped);
+    }
+    buf->bl.clear();
+    buf->bl_off = off & super.block_mask();
+    buf->read_ahead_window = 0;
+  }
+  if (!buf->read_ahead_window) {
+    buf->read_ahead_window = std::max<uint64_t>(
+      buf->max_prefetch, cct->_conf->bluefs_max_prefetch);
+  }
+  _read_ahead_issue(h, off + len);
+}
+
 void BlueFS::_invalidate_cache(FileRef f, uint64_t offset, uint64_t length)
 {
   dout(10) << __func__ << " file " << f->fnode
@@ -1933,6 +2126,10 @@ void BlueFS::compact_log()
 {
   std::unique_lock<ceph::mutex> l(lock);
   if (!cct->_conf->bluefs_replay_recovery_disable_compact) {
+    while (new_log) {
+      dout(10) << __func__ << " waiting for async compaction" << dendl;
+      log_cond.wait(l);
+    }
     if (cct->_conf->bluefs_compact_log_sync) {
       _compact_log_sync();
     } else {
@@ -2139,6 +2336,10 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   File *log_file = log_writer->file.get();
   ceph_assert(!new_log);
   ceph_assert(!new_log_writer);
+  ceph_assert(!new_log_writing);
+  bool incremental = cct->_conf.get_val<bool>("bluefs_compact_log_incremental");
+  auto start = ceph::mono_clock::now();
+  ceph::timespan unlocked = ceph::timespan::zero();
 
   // create a new log [writer] so that we know compaction is in progress
   // (see _should_compact_log)
@@ -2200,22 +2401,47 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   // we might have some more ops in log_t due to _allocate call
   t.claim_ops(log_t);
 
-  bufferlist bl;
-  encode(t, bl);
-  _pad_bl(bl);
-
   dout(10) << __func__ << " new_log_jump_to 0x" << std::hex << new_log_jump_to
 	   << std::dec << dendl;
 
-  new_log_writer = _create_writer(new_log);
-  new_log_writer->append(bl);
+  bufferlist bl;
+  if (incremental) {
+    // The snapshot and the space for it are fixed now, and everything
+    // logged from here on lands past old_log_jump_to.  Encode and write
+    // the compacted log without holding the lock so foreground log
+    // flushes are not stalled behind it.
+    new_log_writing = true;
+    auto unlock_start = ceph::mono_clock::now();
+    l.unlock();
+
+    // 3. write and 4. wait
+    encode(t, bl);
+    _pad_bl(bl);
+    ceph_assert(bl.length() <= new_log_jump_to);
+    _write_compacted_log(new_log->fnode, bl);
+
+    l.lock();
+    // let a racing log flush finish before we move its extents around
+    while (log_flushing) {
+      log_cond.wait(l);
+    }
+    unlocked += ceph::mono_clock::now() - unlock_start;
+  } else {
+    encode(t, bl);
+    _pad_bl(bl);
+
+    new_log_writer = _create_writer(new_log);
+    new_log_writer->append(bl);
 
-  // 3. flush
-  r = _flush(new_log_writer, true);
-  ceph_assert(r == 0);
+    // 3. flush
+    r = _flush(new_log_writer, true);
+    ceph_assert(r == 0);
 
-  // 4. wait
-  _flush_bdev_safely(new_log_writer);
+    // 4. wait
+    auto unlock_start = ceph::mono_clock::now();
+    _flush_bdev_safely(new_log_writer);
+    unlocked += ceph::mono_clock::now() - unlock_start;
+  }
 
   // 5. update our log fnode
   // discard first old_log_jump_to extents
@@ -2268,9 +2494,11 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   ++super.version;
   _write_super(BDEV_DB);
 
+  auto unlock_start = ceph::mono_clock::now();
   lock.unlock();
   flush_bdev();
   lock.lock();
+  unlocked += ceph::mono_clock::now() - unlock_start;
 
   // 7. release old space
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
@@ -2279,18 +2507,48 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   }
 
   // delete the new log, remove from the dirty files list
-  _close_writer(new_log_writer);
+  if (new_log_writer) {
+    _close_writer(new_log_writer);
+  }
   if (new_log->dirty_seq) {
     ceph_assert(dirty_files.count(new_log->dirty_seq));
     auto it = dirty_files[new_log->dirty_seq].iterator_to(*new_log);
     dirty_files[new_log->dirty_seq].erase(it);
   }
   new_log_writer = nullptr;
+  new_log_writing = false;
   new_log = nullptr;
   log_cond.notify_all();
 
   dout(10) << __func__ << " log extents " << log_file->fnode.extents << dendl;
   logger->inc(l_bluefs_log_compactions);
+  auto lat = ceph::mono_clock::now() - start;
+  logger->tinc(l_bluefs_log_compaction_lat, lat);
+  logger->tinc(l_bluefs_log_compaction_lock_lat, lat - unlocked);
+}
+
+void BlueFS::_write_compacted_log(const bluefs_fnode_t& fnode, bufferlist& bl)
+{
+  // called without the lock: nobody else knows about these extents yet
+  std::array<bool, MAX_BDEV> dirty_devs;
+  dirty_devs.fill(false);
+  uint64_t pos = 0;
+  for (auto& e : fnode.extents) {
+    if (pos >= bl.length()) {
+      break;
+    }
+    uint64_t l = std::min<uint64_t>(e.length, bl.length() - pos);
+    bufferlist t;
+    t.substr_of(bl, pos, l);
+    dout(20) << __func__ << " 0x" << std::hex << pos << "~" << l << std::dec
+	     << " to " << e << dendl;
+    int r = bdev[e.bdev]->write(e.offset, t, false, WRITE_LIFE_SHORT);
+    ceph_assert(r == 0);
+    dirty_devs[e.bdev] = true;
+    pos += l;
+  }
+  ceph_assert(pos == bl.length());
+  flush_bdev(dirty_devs);
 }
 
 void BlueFS::_pad_bl(bufferlist& bl)
@@ -2355,9 +2613,14 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
   if (runway < (int64_t)cct->_conf->bluefs_min_log_runway) {
     dout(10) << __func__ << " allocating more log runway (0x"
 	     << std::hex << runway << std::dec  << " remaining)" << dendl;
-    while (new_log_writer) {
-      dout(10) << __func__ << " waiting for async compaction" << dendl;
-      log_cond.wait(l);
+    if (new_log_writer || new_log_writing) {
+      auto wait_start = ceph::mono_clock::now();
+      while (new_log_writer || new_log_writing) {
+	dout(10) << __func__ << " waiting for async compaction" << dendl;
+	log_cond.wait(l);
+      }
+      logger->tinc(l_bluefs_log_compaction_stall_lat,
+		   ceph::mono_clock::now() - wait_start);
     }
     vselector->sub_usage(log_writer->file->vselector_hint, log_writer->file->fnode);
     int r = _allocate(
@@ -2935,6 +3198,51 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
   return 0;
 }
 
+int BlueFS::read_raw(FileRef f, uint64_t offset, uint64_t len, char *out)
+{
+  dout(20) << __func__ << " file " << f->fnode.ino << " 0x"
+	   << std::hex << offset << "~" << len << std::dec << dendl;
+  while (len > 0) {
+    uint64_t x_off = 0;
+    auto p = f->fnode.seek(offset, &x_off);
+    if (p == f->fnode.extents.end()) {
+      return -ERANGE;
+    }
+    uint64_t l = std::min(p->length - x_off, len);
+    int r = bdev[p->bdev]->read_random(p->offset + x_off, l, out, false);
+    if (r < 0) {
+      return r;
+    }
+    offset += l;
+    len -= l;
+    out += l;
+  }
+  return 0;
+}
+
+int BlueFS::write_raw(FileRef f, uint64_t offset, bufferlist& bl)
+{
+  dout(20) << __func__ << " file " << f->fnode.ino << " 0x"
+	   << std::hex << offset << "~" << bl.length() << std::dec << dendl;
+  uint64_t pos = 0;
+  while (pos < bl.length()) {
+    uint64_t x_off = 0;
+    auto p = f->fnode.seek(offset + pos, &x_off);
+    if (p == f->fnode.extents.end()) {
+      return -ERANGE;
+    }
+    uint64_t l = std::min<uint64_t>(p->length - x_off, bl.length() - pos);
+    bufferlist t;
+    t.substr_of(bl, pos, l);
+    int r = bdev[p->bdev]->write(p->offset + x_off, t, false);
+    if (r < 0) {
+      return r;
+    }
+    pos += l;
+  }
+  return 0;
+}
+
 int BlueFS::_preallocate(FileRef f, uint64_t off, uint64_t len)
 {
   dout(10) << __func__ << " file " << f->fnode << " 0x"
@@ -4,6 +4,8 @@
 #define CEPH_OS_BLUESTORE_BLUEFS_H
 
 #include <atomic>
+#include <deque>
+#include <functional>
 #include <mutex>
 
 #include "bluefs_types.h"
@@ -49,6 +51,13 @@ enum {
   l_bluefs_read_bytes,
   l_bluefs_read_prefetch_count,
   l_bluefs_read_prefetch_bytes,
+  l_bluefs_read_ahead_count,
+  l_bluefs_read_ahead_bytes,
+  l_bluefs_read_ahead_hit_bytes,
+  l_bluefs_read_ahead_wasted_bytes,
+  l_bluefs_log_compaction_lat,
+  l_bluefs_log_compaction_lock_lat,
+  l_bluefs_log_compaction_stall_lat,
 
   l_bluefs_last,
 };
@@ -229,8 +238,47 @@ public:
     uint64_t pos = 0;       ///< current logical offset
     uint64_t max_prefetch;  ///< max allowed prefetch
 
+    /// asynchronous read-ahead following the prefetch buffer
+    struct ReadAhead {
+      uint64_t off;                ///< logical offset
+      uint64_t len;                ///< logical length
+      ceph::buffer::list bl;       ///< valid once ioc has completed
+      IOContext ioc;
+
+      ReadAhead(CephContext* cct, uint64_t o, uint64_t l)
+	: off(o), len(l), ioc(cct, nullptr) {}
+      uint64_t get_end() const {
+	return off + len;
+      }
+    };
+    std::deque<std::unique_ptr<ReadAhead>> read_ahead; ///< sorted, contiguous
+    uint64_t read_ahead_window = 0; ///< current window, 0 until first use
+    bool read_ahead_hint = false;   ///< caller announced sequential access
+
     explicit FileReaderBuffer(uint64_t mpf)
       : max_prefetch(mpf) {}
+    ~FileReaderBuffer() {
+      drain_read_ahead();
+    }
+
+    bool in_read_ahead(uint64_t p) const {
+      return !read_ahead.empty() &&
+	p >= read_ahead.front()->off &&
+	p < read_ahead.back()->get_end();
+    }
+    uint64_t get_read_ahead_end() const {
+      return read_ahead.empty() ? get_buf_end() : read_ahead.back()->get_end();
+    }
+    /// wait for and drop all in-flight read-ahead, return bytes dropped
+    uint64_t drain_read_ahead() {
+      uint64_t dropped = 0;
+      for (auto& ra : read_ahead) {
+	ra->ioc.aio_wait();
+	dropped += ra->len;
+      }
+      read_ahead.clear();
+      return dropped;
+    }
 
     uint64_t get_buf_end() const {
       return bl_off + bl.length();
@@ -252,6 +300,11 @@ public:
 	bl.clear();
 	bl_off = 0;
       }
+      if (!read_ahead.empty() &&
+	  (length == 0 || offset + length > read_ahead.front()->off) &&
+	  offset < get_read_ahead_end()) {
+	drain_read_ahead();
+      }
     }
   };
 
@@ -276,6 +329,7 @@ public:
       ++file->num_readers;
     }
     ~FileReader() {
+      buf.drain_read_ahead();
       --file->num_readers;
     }
   };
@@ -319,6 +373,7 @@ private:
   uint64_t old_log_jump_to = 0;
   FileRef new_log = nullptr;
   FileWriter *new_log_writer = nullptr;
+  bool new_log_writing = false; ///< compacted log being written unlocked
 
   /*
    * There are up to 3 block devices:
@@ -399,6 +454,8 @@ private:
 				  int flags);
   void _compact_log_sync();
   void _compact_log_async(std::unique_lock<ceph::mutex>& l);
+  void _write_compacted_log(const bluefs_fnode_t& fnode,
+			    ceph::buffer::list& bl);
 
   void _rewrite_log_and_layout_sync(bool allocate_with_fallback,
 				    int super_dev,
@@ -428,6 +485,9 @@ private:
     uint64_t len,    ///< [in] this many bytes
     char *out);      ///< [out] optional: or copy it here
 
+  bool _read_ahead_consume(FileReader *h, uint64_t off);
+  void _read_ahead_issue(FileReader *h, uint64_t until);
+
   void _invalidate_cache(FileRef f, uint64_t offset, uint64_t length);
 
   int _open_super();
@@ -493,6 +553,11 @@ public:
 
   /// get current extents that we own for given block device
   int get_block_extents(unsigned id, interval_set<uint64_t> *extents);
+  /// get every extent we hold on the given block device, including those
+  /// of a log being compacted and those pending release, and run
+  /// @under_lock while bluefs allocations are blocked
+  int get_block_extents(unsigned id, interval_set<uint64_t> *extents,
+			std::function<void()> under_lock);
 
   int open_for_write(
     const std::string& dir,
@@ -589,6 +654,15 @@ public:
     // atomics and asserts).
     return _read_random(h, offset, len, out);
   }
+  /// start asynchronous read-ahead of the given range without waiting
+  void prefetch(FileReader *h, uint64_t offset, size_t len);
+
+  /// Read or write the space allocated to a file in place, regardless of
+  /// its size and without logging anything.  For preallocated files whose
+  /// contents need not survive a restart; the caller serializes access
+  /// to each range.
+  int read_raw(FileRef f, uint64_t offset, uint64_t len, char *out);
+  int write_raw(FileRef f, uint64_t offset, ceph::buffer::list& bl);
   void invalidate_cache(FileRef f, uint64_t offset, uint64_t len) {
     std::lock_guard l(lock);
     _invalidate_cache(f, offset, len);
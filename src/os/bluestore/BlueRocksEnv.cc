@@ -124,24 +124,31 @@ class BlueRocksRandomAccessFile : public rocksdb::RandomAccessFile {
 
   // Readahead the file starting from offset by n bytes for caching.
   rocksdb::Status Prefetch(uint64_t offset, size_t n) override {
-    fs->read(h, offset, n, nullptr, nullptr);
+    fs->prefetch(h, offset, n);
     return rocksdb::Status::OK();
   }
 
   //enum AccessPattern { NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED };
 
   void Hint(AccessPattern pattern) override {
-    if (pattern == RANDOM)
+    std::unique_lock l(h->lock);
+    if (pattern == RANDOM) {
       h->buf.max_prefetch = 4096;
-    else if (pattern == SEQUENTIAL)
+      h->buf.read_ahead_hint = false;
+    } else if (pattern == SEQUENTIAL) {
       h->buf.max_prefetch = fs->cct->_conf->bluefs_max_prefetch;
+      h->buf.read_ahead_hint = true;
+    }
   }
 
   // Remove any kind of caching of data from the offset to offset+length
   // of this file. If the length is 0, then it refers to the end of file.
   // If the system is not caching the file contents, then this is a noop.
   rocksdb::Status InvalidateCache(size_t offset, size_t length) override {
-    h->buf.invalidate_cache(offset, length);
+    {
+      std::unique_lock l(h->lock);
+      h->buf.invalidate_cache(offset, length);
+    }
     fs->invalidate_cache(h->file, offset, length);
     return rocksdb::Status::OK();
   }
@@ -31,6 +31,7 @@
 #include "include/stringify.h"
 #include "include/str_map.h"
 #include "include/util.h"
+#include "common/admin_socket.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "common/PriorityCache.h"
@@ -120,6 +121,8 @@ const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
 const string PREFIX_ZONED_FM_META = "Z";  // (see ZonedFreelistManager)
 const string PREFIX_ZONED_FM_INFO = "z";  // (see ZonedFreelistManager)
 const string PREFIX_ZONED_CL_INFO = "G";  // (per-zone cleaner metadata)
+const string PREFIX_ALLOC_SNAPSHOT = "a"; // u64 chunk -> free extents
+const string PREFIX_COMPRESSION_DICT = "D"; // coll + u64 alg << 32 | id -> dict
 
 const string BLUESTORE_GLOBAL_STATFS_KEY = "bluestore_statfs";
 
@@ -542,6 +545,20 @@ static int get_key_pool_stat(const string& key, uint64_t* pool_id)
   return 0;
 }
 
+static void get_compression_dict_key(const coll_t& cid, uint64_t k,
+				     string *key)
+{
+  *key = stringify(cid) + '.';
+  _key_encode_u64(k, key);
+}
+
+static void get_compression_dict_range(const coll_t& cid,
+				       string *start, string *end)
+{
+  *start = stringify(cid) + '.';
+  *end = stringify(cid) + '/';
+}
+
 template <int LogLevelV>
 void _dump_extent_map(CephContext *cct, const BlueStore::ExtentMap &em)
 {
@@ -1091,6 +1108,156 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
   }
 };
 
+// ClockOnodeCacheShard
+//
+// A CLOCK-Pro flavoured replacement policy.  Onodes stay on the clock
+// while in use, so a cache hit only sets the atomic cache_ref bit and
+// never takes the shard lock to pin/unpin.  New onodes start cold;
+// the sweep promotes referenced cold onodes to hot (bounded by
+// bluestore_onode_cache_clock_hot_ratio), demotes unreferenced hot ones
+// and evicts only unreferenced cold ones, so a single pass over many
+// objects (scrub, backfill) cannot flush the hot working set.
+// Since pins_onodes() is false, OnodeSpace::lookup() serves hits under
+// the collection's map_lock alone; eviction rechecks nref under that
+// lock exclusively (OnodeSpace::_try_remove) so it cannot race a hit.
+struct ClockOnodeCacheShard : public BlueStore::OnodeCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Onode,
+    boost::intrusive::member_hook<
+      BlueStore::Onode,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Onode::lru_item> > list_t;
+
+  list_t clock;
+  list_t::iterator hand;
+  uint64_t num_hot = 0;
+  double hot_ratio;
+
+  explicit ClockOnodeCacheShard(CephContext *cct)
+    : BlueStore::OnodeCacheShard(cct),
+      hand(clock.end()),
+      hot_ratio(cct->_conf.get_val<double>(
+		  "bluestore_onode_cache_clock_hot_ratio")) {}
+
+  void pin(BlueStore::Onode* o, std::function<bool ()> validator) override
+  {
+    // lock-free hit: just note the reference for the next sweep
+    o->cache_ref.store(true, std::memory_order_relaxed);
+  }
+  void unpin(BlueStore::Onode* o, std::function<bool()> validator) override
+  {
+  }
+  bool pins_onodes() const override
+  {
+    return false;
+  }
+  void _pin(BlueStore::Onode* o) override
+  {
+  }
+  void _unpin(BlueStore::Onode* o) override
+  {
+  }
+
+  void _add(BlueStore::Onode* o, int level) override
+  {
+    o->put_cache();
+    o->cache_hot = false;
+    o->cache_ref = false;
+    // insert right behind the hand: the newcomer gets a full revolution
+    // before it can be considered for eviction
+    clock.insert(hand, *o);
+    ++num;
+    dout(20) << __func__ << " " << this << " " << o->oid << " added, num=" << num << dendl;
+  }
+  void _rm(BlueStore::Onode* o) override
+  {
+    o->pop_cache();
+    auto p = clock.iterator_to(*o);
+    if (p == hand) {
+      hand = clock.erase(p);
+    } else {
+      clock.erase(p);
+    }
+    if (o->cache_hot) {
+      o->cache_hot = false;
+      ceph_assert(num_hot);
+      --num_hot;
+    }
+    ceph_assert(num);
+    --num;
+    dout(20) << __func__ << " " << this << " " << " " << o->oid << " removed, num=" << num << dendl;
+  }
+
+  void _trim_to(uint64_t new_size) override
+  {
+    if (new_size >= clock.size()) {
+      return; // don't even try
+    }
+    uint64_t n = clock.size() - new_size;
+    uint64_t max_hot = clock.size() * hot_ratio;
+    uint64_t in_use = 0;
+    // a hot referenced onode needs three passes of the hand to be
+    // evicted; bound the sweep so that an all-in-use clock terminates
+    uint64_t steps = clock.size() * 3;
+    while (n > 0 && steps-- > 0) {
+      if (hand == clock.end()) {
+	hand = clock.begin();
+	in_use = 0;
+      }
+      BlueStore::Onode *o = &*hand;
+      if (o->nref > 1) {
+	// in use; the onode_map holds the only other ref
+	++in_use;
+	++hand;
+	continue;
+      }
+      if (o->cache_ref.exchange(false, std::memory_order_relaxed)) {
+	if (!o->cache_hot && num_hot < max_hot) {
+	  o->cache_hot = true;
+	  ++num_hot;
+	}
+	++hand;
+	continue;
+      }
+      if (o->cache_hot) {
+	o->cache_hot = false;
+	--num_hot;
+	++hand;
+	continue;
+      }
+      // lookups do not take our lock, so recheck under the map's
+      OnodeRef last = o->c->onode_map._try_remove(o);
+      if (!last) {
+	++in_use;
+	++hand;
+	continue;
+      }
+      dout(20) << __func__ << "  rm " << o->oid << " "
+               << o->nref << " " << o->cached << dendl;
+      hand = clock.erase(hand);
+      ceph_assert(num);
+      --num;
+      --n;
+      o->pop_cache();
+    }
+    num_pinned = in_use;
+  }
+  void move_pinned(OnodeCacheShard *to, BlueStore::Onode *o) override
+  {
+    if (to == this) {
+      return;
+    }
+    ceph_assert(o->cached);
+    _rm(o);
+    to->_add(o, 1);
+  }
+  void add_stats(uint64_t *onodes, uint64_t *pinned_onodes) override
+  {
+    *onodes += num;
+    *pinned_onodes += num_pinned;
+  }
+};
+
 // OnodeCacheShard
 BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     CephContext* cct,
@@ -1098,8 +1265,12 @@ BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     PerfCounters *logger)
 {
   BlueStore::OnodeCacheShard *c = nullptr;
-  // Currently we only implement an LRU cache for onodes
-  c = new LruOnodeCacheShard(cct);
+  if (type == "lru")
+    c = new LruOnodeCacheShard(cct);
+  else if (type == "clock")
+    c = new ClockOnodeCacheShard(cct);
+  else
+    ceph_abort_msg("unrecognized onode cache type");
   c->logger = logger;
   return c;
 }
@@ -1410,6 +1581,7 @@ public:
         list_bytes[BUFFER_WARM_IN] -= b->length;
         to_evict_bytes -= b->length;
         evicted += b->length;
+        b->space->_invalidate_snapshot();
         b->state = BlueStore::Buffer::STATE_EMPTY;
         b->data.clear();
         warm_in.erase(warm_in.iterator_to(*b));
@@ -1529,6 +1701,7 @@ BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
   else
     ceph_abort_msg("unrecognized cache type");
   c->logger = logger;
+  c->lockless_read = cct->_conf.get_val<bool>("bluestore_cache_lockless_read");
   return c;
 }
 
@@ -1553,6 +1726,7 @@ int BlueStore::BufferSpace::_discard(BufferCacheShard* cache, uint32_t offset, u
            << std::dec << dendl;
   int cache_private = 0;
   cache->_audit("discard start");
+  _invalidate_snapshot();
   auto i = _data_lower_bound(offset);
   uint32_t end = offset + length;
   while (i != buffer_map.end()) {
@@ -1632,6 +1806,16 @@ void BlueStore::BufferSpace::read(
   uint32_t want_bytes = length;
   uint32_t end = offset + length;
 
+  if (cache->lockless_read && !(flags & BYPASS_CLEAN_CACHE)) {
+    if (_read_snapshot(cache, offset, length, res, res_intervals)) {
+      cache->logger->inc(l_bluestore_buffer_hit_bytes, want_bytes);
+      cache->logger->inc(l_bluestore_buffer_lockless_hit_bytes, want_bytes);
+      return;
+    }
+    res.clear();
+    res_intervals.clear();
+  }
+
   {
     std::lock_guard l(cache->lock);
     for (auto i = _data_lower_bound(offset);
@@ -1683,6 +1867,11 @@ void BlueStore::BufferSpace::read(
         }
       }
     }
+    if (cache->lockless_read && !snapshot &&
+	res_intervals.size() == want_bytes) {
+      // cache resident; let the next reads skip the lock
+      _publish_snapshot();
+    }
   }
 
   uint64_t hit_bytes = res_intervals.size();
@@ -1692,8 +1881,73 @@ void BlueStore::BufferSpace::read(
   cache->logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
 }
 
+void BlueStore::BufferSpace::_publish_snapshot()
+{
+  // note: we already hold cache->lock
+  auto snap = std::make_shared<snapshot_t>();
+  snap->entries.reserve(buffer_map.size());
+  for (auto& [offset, b] : buffer_map) {
+    if (b->is_clean() || b->is_writing()) {
+      snap->entries.push_back({b->offset, b->length, b->data, b.get()});
+    }
+  }
+  std::atomic_store(&snapshot, std::shared_ptr<const snapshot_t>(std::move(snap)));
+}
+
+bool BlueStore::BufferSpace::_read_snapshot(
+  BufferCacheShard* cache,
+  uint32_t offset,
+  uint32_t length,
+  BlueStore::ready_regions_t& res,
+  interval_set<uint32_t>& res_intervals)
+{
+  auto snap = std::atomic_load(&snapshot);
+  if (!snap) {
+    return false;
+  }
+  auto& entries = snap->entries;
+  auto p = std::upper_bound(
+    entries.begin(), entries.end(), offset,
+    [](uint32_t o, const snapshot_t::entry_t& e) {
+      return o < e.offset;
+    });
+  if (p == entries.begin()) {
+    return false;
+  }
+  --p;
+  auto first = p;
+  uint32_t end = offset + length;
+  while (offset < end) {
+    if (p == entries.end() ||
+	p->offset > offset ||
+	p->offset + p->length <= offset) {
+      // only full hits are served here
+      return false;
+    }
+    uint32_t skip = offset - p->offset;
+    uint32_t l = std::min(end - offset, p->length - skip);
+    res[offset].substr_of(p->data, skip, l);
+    res_intervals.insert(offset, l);
+    offset += l;
+    ++p;
+  }
+
+  // Keep the LRU informed, but never wait for the lock to do so.  The
+  // buffers are alive as long as the snapshot is still published.
+  std::unique_lock l(cache->lock, std::try_to_lock);
+  if (l.owns_lock() && std::atomic_load(&snapshot) == snap) {
+    for (; first != p; ++first) {
+      if (!first->b->is_writing()) {
+	cache->_touch(first->b);
+      }
+    }
+  }
+  return true;
+}
+
 void BlueStore::BufferSpace::_finish_write(BufferCacheShard* cache, uint64_t seq)
 {
+  _invalidate_snapshot();
   auto i = writing.begin();
   while (i != writing.end()) {
     if (i->seq > seq) {
@@ -1730,6 +1984,7 @@ void BlueStore::BufferSpace::split(BufferCacheShard* cache, size_t pos, BlueStor
   if (buffer_map.empty())
     return;
 
+  _invalidate_snapshot();
   auto p = --buffer_map.end();
   while (true) {
     if (p->second->end() <= pos)
@@ -1784,16 +2039,19 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid,
   OnodeRef& o)
 {
   std::lock_guard l(cache->lock);
-  auto p = onode_map.find(oid);
-  if (p != onode_map.end()) {
-    ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
-			  << " raced, returning existing " << p->second
-			  << dendl;
-    return p->second;
+  {
+    std::unique_lock ml(map_lock);
+    auto p = onode_map.find(oid);
+    if (p != onode_map.end()) {
+      ldout(cache->cct, 30) << __func__ << " " << oid << " " << o
+			    << " raced, returning existing " << p->second
+			    << dendl;
+      return p->second;
+    }
+    ldout(cache->cct, 20) << __func__ << " " << oid << " " << o << dendl;
+    onode_map[oid] = o;
+    cache->_add(o.get(), 1);
   }
-  ldout(cache->cct, 20) << __func__ << " " << oid << " " << o << dendl;
-  onode_map[oid] = o;
-  cache->_add(o.get(), 1);
   cache->_trim();
   return o;
 }
@@ -1801,9 +2059,25 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid,
 void BlueStore::OnodeSpace::_remove(const ghobject_t& oid)
 {
   ldout(cache->cct, 20) << __func__ << " " << oid << " " << dendl;
+  std::unique_lock ml(map_lock);
   onode_map.erase(oid);
 }
 
+BlueStore::OnodeRef BlueStore::OnodeSpace::_try_remove(Onode* o)
+{
+  std::unique_lock ml(map_lock);
+  // lookups take their ref under map_lock, so none can appear now
+  if (o->nref > 1) {
+    return OnodeRef();
+  }
+  auto p = onode_map.find(o->oid);
+  ceph_assert(p != onode_map.end() && p->second == o);
+  ldout(cache->cct, 20) << __func__ << " " << o->oid << " " << dendl;
+  OnodeRef r = std::move(p->second);
+  onode_map.erase(p);
+  return r;
+}
+
 BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 {
   ldout(cache->cct, 30) << __func__ << dendl;
@@ -1811,7 +2085,13 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   bool hit = false;
 
   {
-    std::lock_guard l(cache->lock);
+    // pinning in an LRU shard relinks the onode, so the shard lock is
+    // needed; other shards pin without it and evict under map_lock
+    std::unique_lock l(cache->lock, std::defer_lock);
+    if (cache->pins_onodes()) {
+      l.lock();
+    }
+    std::shared_lock ml(map_lock);
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
     if (p == onode_map.end()) {
       ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
@@ -1824,7 +2104,7 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
       // This will pin onode and implicitly touch the cache when Onode
       // eventually will become unpinned
       o = p->second;
-      ceph_assert(!o->cached || o->pinned);
+      ceph_assert(!o->cached || o->pinned || !cache->pins_onodes());
 
       hit = true;
     }
@@ -1838,9 +2118,23 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   return o;
 }
 
+void BlueStore::OnodeSpace::remove(const ghobject_t& oid)
+{
+  std::lock_guard l(cache->lock);
+  std::unique_lock ml(map_lock);
+  auto p = onode_map.find(oid);
+  if (p == onode_map.end()) {
+    return;
+  }
+  ldout(cache->cct, 20) << __func__ << " " << oid << " " << p->second << dendl;
+  cache->_rm(p->second.get());
+  onode_map.erase(p);
+}
+
 void BlueStore::OnodeSpace::clear()
 {
   std::lock_guard l(cache->lock);
+  std::unique_lock ml(map_lock);
   ldout(cache->cct, 10) << __func__ << " " << onode_map.size()<< dendl;
   for (auto &p : onode_map) {
     cache->_rm(p.second.get());
@@ -1850,7 +2144,7 @@ void BlueStore::OnodeSpace::clear()
 
 bool BlueStore::OnodeSpace::empty()
 {
-  std::lock_guard l(cache->lock);
+  std::shared_lock ml(map_lock);
   return onode_map.empty();
 }
 
@@ -1861,6 +2155,7 @@ void BlueStore::OnodeSpace::rename(
   const mempool::bluestore_cache_meta::string& new_okey)
 {
   std::lock_guard l(cache->lock);
+  std::unique_lock ml(map_lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1885,16 +2180,18 @@ void BlueStore::OnodeSpace::rename(
   // This will pin 'o' and implicitly touch cache
   // when it will eventually become unpinned
   onode_map.insert(make_pair(new_oid, o));
-  ceph_assert(o->pinned);
+  ceph_assert(o->pinned || !cache->pins_onodes());
 
   o->oid = new_oid;
   o->key = new_okey;
+  ml.unlock();
   cache->_trim();
 }
 
 bool BlueStore::OnodeSpace::map_any(std::function<bool(OnodeRef)> f)
 {
   std::lock_guard l(cache->lock);
+  std::shared_lock ml(map_lock);
   ldout(cache->cct, 20) << __func__ << dendl;
   for (auto& i : onode_map) {
     if (f(i.second)) {
@@ -3635,12 +3932,12 @@ bool BlueStore::WriteContext::has_conflict(
 #undef dout_context
 #define dout_context cct
 
-void BlueStore::DeferredBatch::prepare_write(
+uint64_t BlueStore::DeferredBatch::prepare_write(
   CephContext *cct,
   uint64_t seq, uint64_t offset, uint64_t length,
   bufferlist::const_iterator& blp)
 {
-  _discard(cct, offset, length);
+  uint64_t superseded = _discard(cct, offset, length);
   auto i = iomap.insert(make_pair(offset, deferred_io()));
   ceph_assert(i.second);  // this should be a new insertion
   i.first->second.seq = seq;
@@ -3655,13 +3952,15 @@ void BlueStore::DeferredBatch::prepare_write(
 #ifdef DEBUG_DEFERRED
   _audit(cct);
 #endif
+  return superseded;
 }
 
-void BlueStore::DeferredBatch::_discard(
+uint64_t BlueStore::DeferredBatch::_discard(
   CephContext *cct, uint64_t offset, uint64_t length)
 {
   generic_dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
 		   << std::dec << dendl;
+  uint64_t dropped = 0;
   auto p = iomap.lower_bound(offset);
   if (p != iomap.begin()) {
     --p;
@@ -3685,8 +3984,10 @@ void BlueStore::DeferredBatch::_discard(
 	n.bl.swap(tail);
 	n.seq = p->second.seq;
 	i->second -= length;
+	dropped += length;
       } else {
 	i->second -= end - offset;
+	dropped += end - offset;
       }
       ceph_assert(i->second >= 0);
       p->second.bl.swap(head);
@@ -3712,15 +4013,18 @@ void BlueStore::DeferredBatch::_discard(
       s.seq = p->second.seq;
       s.bl.substr_of(p->second.bl, drop_front, keep_tail);
       i->second -= drop_front;
+      dropped += drop_front;
     } else {
       dout(20) << __func__ << "  drop " << p->second.seq
 	       << " 0x" << std::hex << p->first << "~" << p->second.bl.length()
 	       << std::dec << dendl;
       i->second -= p->second.bl.length();
+      dropped += p->second.bl.length();
     }
     ceph_assert(i->second >= 0);
     p = iomap.erase(p);
   }
+  return dropped;
 }
 
 void BlueStore::DeferredBatch::_audit(CephContext *cct)
@@ -3912,6 +4216,7 @@ void BlueStore::Collection::split_cache(
   std::lock(cache->lock, dest->cache->lock);
   std::lock_guard l(cache->lock, std::adopt_lock);
   std::lock_guard l2(dest->cache->lock, std::adopt_lock);
+  std::scoped_lock ml(onode_map.map_lock, dest->onode_map.map_lock);
 
   int destbits = dest->cnode.bits;
   spg_t destpg;
@@ -3933,7 +4238,7 @@ void BlueStore::Collection::split_cache(
       // ensuring that nref is always >= 2 and hence onode is pinned and 
       // physically out of cache during the transition
       OnodeRef o_pin = o;
-      ceph_assert(o->pinned);
+      ceph_assert(o->pinned || !get_onode_cache()->pins_onodes());
 
       p = onode_map.onode_map.erase(p);
       dest->onode_map.onode_map[o->oid] = o;
@@ -4010,10 +4315,14 @@ void *BlueStore::MempoolThread::entry()
   }
 
   binned_kv_cache = store->db->get_priority_cache();
+  kv_cf_caches = store->db->get_cf_priority_caches();
   if (store->cache_autotune && binned_kv_cache != nullptr) {
     pcm = std::make_shared<PriorityCache::Manager>(
         store->cct, min, max, target, true, "bluestore-pricache");
     pcm->insert("kv", binned_kv_cache, true);
+    for (auto& [name, cache] : kv_cf_caches) {
+      pcm->insert("kv_" + name, cache, true);
+    }
     pcm->insert("meta", meta_cache, true);
     pcm->insert("data", data_cache, true);
   }
@@ -4089,13 +4398,14 @@ void *BlueStore::MempoolThread::entry()
   store->_record_allocation_stats();
   stop = false;
   pcm = nullptr;
+  kv_cf_caches.clear();
   return NULL;
 }
 
 void BlueStore::MempoolThread::_adjust_cache_settings()
 {
   if (binned_kv_cache != nullptr) {
-    binned_kv_cache->set_cache_ratio(store->cache_kv_ratio);
+    store->db->set_cache_ratios(store->cache_kv_ratio);
   }
   meta_cache->set_cache_ratio(store->cache_meta_ratio);
   data_cache->set_cache_ratio(store->cache_data_ratio);
@@ -4120,6 +4430,9 @@ void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
   if (pcm != nullptr && binned_kv_cache != nullptr) {
     cache_size = pcm->get_tuned_mem();
     kv_alloc = binned_kv_cache->get_committed_size();
+    for (auto& [name, cache] : kv_cf_caches) {
+      kv_alloc += cache->get_committed_size();
+    }
     meta_alloc = meta_cache->get_committed_size();
     data_alloc = data_cache->get_committed_size();
   }
@@ -4372,10 +4685,11 @@ BlueStore::BlueStore(CephContext *cct,
     throttle(cct),
     finisher(cct, "commit_finisher", "cfin"),
     kv_sync_thread(this),
-    kv_finalize_thread(this),
+    kv_commit_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
-    mempool_thread(this)
+    mempool_thread(this),
+    defrag_thread(this)
 {
   _init_logger();
   cct->_conf.add_observer(this);
@@ -4734,6 +5048,8 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
 		 "Average kv_finalize thread latency",
 		 "kf_l", PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_u64_counter(l_bluestore_kv_sync_pipelined, "kv_sync_pipelined",
+		    "Commit groups built while a previous group was syncing");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -4783,12 +5099,29 @@ void BlueStore::_init_logger()
     "Sum for beneficial compress ops");
   b.add_u64_counter(l_bluestore_compress_rejected_count, "compress_rejected_count",
     "Sum for compress ops rejected due to low net gain of space");
+  b.add_u64_counter(l_bluestore_compress_offloaded_count,
+    "compress_offloaded_count",
+    "Sum for compress ops run by the compression thread pool");
+  b.add_u64_counter(l_bluestore_compress_skipped_count,
+    "compress_skipped_count",
+    "Sum for blobs adaptive compression did not try to compress");
   b.add_u64_counter(l_bluestore_write_pad_bytes, "write_pad_bytes",
 		    "Sum for write-op padded bytes", NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_write_realign_bytes, "write_realign_bytes",
+		    "Sum for direct write bytes copied to meet device alignment",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_deferred_write_ops, "deferred_write_ops",
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def", 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_write_extents,
+		    "deferred_write_extents",
+		    "Sum for extents queued for deferred write",
+		    NULL, 0, unit_t(UNIT_NONE));
+  b.add_u64_counter(l_bluestore_deferred_write_merged_bytes,
+		    "deferred_write_merged_bytes",
+		    "Sum for deferred write bytes superseded before submission",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -4829,6 +5162,10 @@ void BlueStore::_init_logger()
 	    "Sum for bytes of read hit in the cache", NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
 	    "Sum for bytes of read missed in the cache", NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_buffer_lockless_hit_bytes,
+	    "bluestore_buffer_lockless_hit_bytes",
+	    "Sum for bytes of read hit in the cache without taking the cache lock",
+	    NULL, 0, unit_t(UNIT_BYTES));
 
   b.add_u64_counter(l_bluestore_write_big, "bluestore_write_big",
 		    "Large aligned writes into fresh blobs");
@@ -4866,6 +5203,11 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_gc_merged, "bluestore_gc_merged",
 		    "Sum for extents that have been merged due to garbage "
 		    "collection");
+  b.add_u64_counter(l_bluestore_defrag_onodes, "bluestore_defrag_onodes",
+		    "Fragmented objects rewritten by defragmentation");
+  b.add_u64_counter(l_bluestore_defrag_bytes, "bluestore_defrag_bytes",
+		    "Sum for bytes rewritten by defragmentation",
+		    NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_read_eio, "bluestore_read_eio",
                     "Read EIO errors propagated to high level callers");
   b.add_u64_counter(l_bluestore_reads_with_retries, "bluestore_reads_with_retries",
@@ -4882,6 +5224,10 @@ void BlueStore::_init_logger()
     "Average omap iterator next call latency");
   b.add_time_avg(l_bluestore_clist_lat, "clist_lat",
     "Average collection listing latency");
+  b.add_u64_counter(l_bluestore_numa_remote_txc, "numa_remote_txc",
+    "Transactions prepared on a CPU outside the storage numa node");
+  b.add_u64_counter(l_bluestore_numa_remote_kv_sync, "numa_remote_kv_sync",
+    "KV sync cycles run on a CPU outside the storage numa node");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -5307,24 +5653,209 @@ int BlueStore::_init_alloc()
   uint64_t num = 0, bytes = 0;
 
   dout(1) << __func__ << " opening allocation metadata" << dendl;
-  // initialize from freelist
-  fm->enumerate_reset();
-  uint64_t offset, length;
-  while (fm->enumerate_next(db, &offset, &length)) {
-    shared_alloc.a->init_add_free(offset, length);
-    ++num;
-    bytes += length;
+  bool from_snapshot = false;
+  if (!bdev->is_smr() &&
+      cct->_conf.get_val<bool>("bluestore_alloc_snapshot")) {
+    r = _read_alloc_snapshot(&num, &bytes);
+    if (r == 0) {
+      from_snapshot = true;
+    } else if (r != -ENOENT) {
+      derr << __func__ << " ignoring allocator snapshot: " << cpp_strerror(r)
+	   << dendl;
+      num = bytes = 0;
+    }
+  }
+  if (!from_snapshot) {
+    // initialize from freelist
+    fm->enumerate_reset();
+    uint64_t offset, length;
+    while (fm->enumerate_next(db, &offset, &length)) {
+      shared_alloc.a->init_add_free(offset, length);
+      ++num;
+      bytes += length;
+    }
+    fm->enumerate_reset();
   }
-  fm->enumerate_reset();
 
   dout(1) << __func__ << " loaded " << byte_u_t(bytes)
     << " in " << num << " extents"
+    << (from_snapshot ? " from snapshot" : "")
     << " available " << byte_u_t(shared_alloc.a->get_free())
     << dendl;
 
   return 0;
 }
 
+/*
+ * The allocator snapshot is the freelist as of a clean umount: a header
+ * (PREFIX_SUPER "alloc_snapshot") and chunks of free extents.  It is only
+ * trusted while no one could have changed the freelist since, so it is
+ * removed whenever the db is opened for write.
+ */
+int BlueStore::_read_alloc_snapshot(uint64_t *num, uint64_t *bytes)
+{
+  auto start = mono_clock::now();
+  bufferlist hbl;
+  int r = db->get(PREFIX_SUPER, "alloc_snapshot", &hbl);
+  if (r < 0) {
+    return -ENOENT;
+  }
+  uint64_t dev_size, alloc_unit, fm_size, num_chunks, num_extents, free_bytes;
+  uint32_t crc;
+  try {
+    auto p = hbl.cbegin();
+    DECODE_START(1, p);
+    decode(dev_size, p);
+    decode(alloc_unit, p);
+    decode(fm_size, p);
+    decode(num_chunks, p);
+    decode(num_extents, p);
+    decode(free_bytes, p);
+    decode(crc, p);
+    DECODE_FINISH(p);
+  } catch (ceph::buffer::error& e) {
+    return -EIO;
+  }
+  if (dev_size != bdev->get_size() ||
+      alloc_unit != min_alloc_size ||
+      fm_size != fm->get_size()) {
+    dout(1) << __func__ << " snapshot of 0x" << std::hex << dev_size
+	    << "/0x" << alloc_unit << "/0x" << fm_size
+	    << " does not match device 0x" << bdev->get_size()
+	    << "/0x" << min_alloc_size << "/0x" << fm->get_size()
+	    << std::dec << dendl;
+    return -ESTALE;
+  }
+
+  // validate everything before touching the allocator
+  std::vector<std::pair<uint64_t, uint64_t>> extents;
+  extents.reserve(num_extents);
+  uint32_t actual_crc = -1;
+  uint64_t chunk = 0, total = 0;
+  auto it = db->get_iterator(PREFIX_ALLOC_SNAPSHOT, KeyValueDB::ITERATOR_NOCACHE);
+  for (it->lower_bound(string()); it->valid(); it->next(), ++chunk) {
+    uint64_t n;
+    _key_decode_u64(it->key().c_str(), &n);
+    if (n != chunk) {
+      return -EIO;
+    }
+    bufferlist bl = it->value();
+    actual_crc = bl.crc32c(actual_crc);
+    try {
+      auto p = bl.cbegin();
+      while (!p.end()) {
+	uint64_t offset, length;
+	decode(offset, p);
+	decode(length, p);
+	extents.emplace_back(offset, length);
+	total += length;
+      }
+    } catch (ceph::buffer::error& e) {
+      return -EIO;
+    }
+  }
+  if (chunk != num_chunks ||
+      extents.size() != num_extents ||
+      total != free_bytes ||
+      actual_crc != crc) {
+    return -EIO;
+  }
+  for (auto& [offset, length] : extents) {
+    shared_alloc.a->init_add_free(offset, length);
+  }
+  *num = num_extents;
+  *bytes = free_bytes;
+  dout(1) << __func__ << " loaded " << num_extents << " extents in "
+	  << ceph::to_seconds<double>(mono_clock::now() - start) << "s"
+	  << dendl;
+  return 0;
+}
+
+void BlueStore::_write_alloc_snapshot()
+{
+  if (bdev->is_smr()) {
+    return;
+  }
+  auto start = mono_clock::now();
+  // let releases waiting on discard reach the allocator
+  bdev->discard_drain();
+
+  // The freelist sees the space bluefs holds on the shared device as free,
+  // so add it back.  The allocator is dumped under the bluefs lock so that
+  // no bluefs allocation falls between the two views; anything bluefs
+  // allocates or frees later is reconciled when it mounts.
+  interval_set<uint64_t> free;
+  auto dump_alloc = [&]() {
+    shared_alloc.a->dump([&](uint64_t offset, uint64_t length) {
+      free.union_insert(offset, length);
+    });
+  };
+  if (bluefs) {
+    interval_set<uint64_t> bluefs_extents;
+    int r = bluefs->get_block_extents(bluefs_layout.shared_bdev,
+				      &bluefs_extents, dump_alloc);
+    ceph_assert(r == 0);
+    free.union_of(bluefs_extents);
+  } else {
+    dump_alloc();
+  }
+
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkeys_by_prefix(PREFIX_ALLOC_SNAPSHOT);
+  const uint64_t chunk_extents = 65536;
+  uint64_t chunk = 0, n = 0;
+  uint32_t crc = -1;
+  bufferlist bl;
+  auto flush_chunk = [&]() {
+    crc = bl.crc32c(crc);
+    string key;
+    _key_encode_u64(chunk++, &key);
+    t->set(PREFIX_ALLOC_SNAPSHOT, key, bl);
+    bl.clear();
+  };
+  for (auto p = free.begin(); p != free.end(); ++p) {
+    encode(p.get_start(), bl);
+    encode(p.get_len(), bl);
+    if (++n % chunk_extents == 0) {
+      flush_chunk();
+    }
+  }
+  if (bl.length()) {
+    flush_chunk();
+  }
+  bufferlist hbl;
+  ENCODE_START(1, 1, hbl);
+  encode((uint64_t)bdev->get_size(), hbl);
+  encode((uint64_t)min_alloc_size, hbl);
+  encode((uint64_t)fm->get_size(), hbl);
+  encode(chunk, hbl);
+  encode(n, hbl);
+  encode((uint64_t)free.size(), hbl);
+  encode(crc, hbl);
+  ENCODE_FINISH(hbl);
+  t->set(PREFIX_SUPER, "alloc_snapshot", hbl);
+  int r = db->submit_transaction_sync(t);
+  ceph_assert(r == 0);
+  dout(1) << __func__ << " wrote " << n << " extents, "
+	  << byte_u_t(free.size()) << " free, in "
+	  << ceph::to_seconds<double>(mono_clock::now() - start) << "s"
+	  << dendl;
+}
+
+void BlueStore::_remove_alloc_snapshot()
+{
+  bufferlist bl;
+  if (db->get(PREFIX_SUPER, "alloc_snapshot", &bl) < 0) {
+    return;
+  }
+  dout(10) << __func__ << dendl;
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkey(PREFIX_SUPER, "alloc_snapshot");
+  t->rmkeys_by_prefix(PREFIX_ALLOC_SNAPSHOT);
+  int r = db->submit_transaction_sync(t);
+  ceph_assert(r == 0);
+}
+
 void BlueStore::_close_alloc()
 {
   ceph_assert(bdev);
@@ -5747,6 +6278,10 @@ int BlueStore::_open_db_and_around(bool read_only, bool to_repair)
   if (r < 0) {
     goto out_alloc;
   }
+  if (!read_only) {
+    // from here on the freelist may change under the snapshot
+    _remove_alloc_snapshot();
+  }
   return 0;
 
 out_alloc:
@@ -6788,8 +7323,9 @@ void BlueStore::set_cache_shards(unsigned num)
   buffer_cache_shards.resize(num);
   for (unsigned i = oold; i < num; ++i) {
     onode_cache_shards[i] = 
-        OnodeCacheShard::create(cct, cct->_conf->bluestore_cache_type,
-                                 logger);
+        OnodeCacheShard::create(cct,
+          cct->_conf.get_val<std::string>("bluestore_onode_cache_type"),
+          logger);
   }
   for (unsigned i = bold; i < num; ++i) {
     buffer_cache_shards[i] = 
@@ -6798,6 +7334,76 @@ void BlueStore::set_cache_shards(unsigned num)
   }
 }
 
+void BlueStore::_open_fast_tier()
+{
+  uint64_t size = cct->_conf.get_val<Option::size_t>("bluestore_fast_tier_size");
+  if (!size || !bluefs || !bluefs_layout.dedicated_db) {
+    return;
+  }
+  fast_tier = new FastTier(cct, bluefs);
+  int r = fast_tier->open(size, block_size);
+  if (r < 0) {
+    derr << __func__ << " failed to set up the fast tier: " << cpp_strerror(r)
+	 << ", continuing without it" << dendl;
+    delete fast_tier;
+    fast_tier = nullptr;
+  }
+}
+
+void BlueStore::_close_fast_tier()
+{
+  if (fast_tier) {
+    fast_tier->close();
+    delete fast_tier;
+    fast_tier = nullptr;
+  }
+}
+
+/// starts, stops and reports on defragmentation passes
+class BlueStore::DefragSocketHook : public AdminSocketHook {
+  BlueStore* store;
+public:
+  explicit DefragSocketHook(BlueStore* store) : store(store) {
+    AdminSocket* admin_socket = store->cct->get_admin_socket();
+    if (admin_socket) {
+      admin_socket->register_command(
+        "bluestore defrag start", this,
+        "rewrite fragmented objects now instead of waiting for idle time");
+      admin_socket->register_command(
+        "bluestore defrag stop", this,
+        "abort the running defragmentation pass");
+      admin_socket->register_command(
+        "bluestore defrag status", this,
+        "report defragmentation progress");
+    }
+  }
+  ~DefragSocketHook() {
+    AdminSocket* admin_socket = store->cct->get_admin_socket();
+    if (admin_socket) {
+      admin_socket->unregister_commands(this);
+    }
+  }
+
+  int call(std::string_view command,
+           const cmdmap_t& cmdmap,
+           Formatter *f,
+           std::ostream& ss,
+           bufferlist& out) override {
+    if (command == "bluestore defrag start") {
+      store->defrag_thread.start_pass();
+    } else if (command == "bluestore defrag stop") {
+      store->defrag_thread.stop_pass();
+    } else if (command != "bluestore defrag status") {
+      ss << "Invalid command" << std::endl;
+      return -ENOSYS;
+    }
+    f->open_object_section("defrag");
+    store->defrag_thread.dump(f);
+    f->close_section();
+    return 0;
+  }
+};
+
 int BlueStore::_mount()
 {
   dout(1) << __func__ << " path " << path << dendl;
@@ -6845,6 +7451,9 @@ int BlueStore::_mount()
     goto out_stop;
 
   mempool_thread.init();
+  defrag_thread.init();
+  defrag_hook = new DefragSocketHook(this);
+  _open_fast_tier();
 
   if ((!per_pool_stat_collection || !per_pool_omap) &&
     cct->_conf->bluestore_fsck_quick_fix_on_mount == true) {
@@ -6882,6 +7491,11 @@ int BlueStore::umount()
   ceph_assert(_kv_only || mounted);
   dout(1) << __func__ << dendl;
 
+  if (!_kv_only) {
+    delete defrag_hook;
+    defrag_hook = nullptr;
+    defrag_thread.shutdown();
+  }
   _osr_drain_all();
 
   mounted = false;
@@ -6889,7 +7503,11 @@ int BlueStore::umount()
     mempool_thread.shutdown();
     dout(20) << __func__ << " stopping kv thread" << dendl;
     _kv_stop();
+    _close_fast_tier();
     _shutdown_cache();
+    if (cct->_conf.get_val<bool>("bluestore_alloc_snapshot")) {
+      _write_alloc_snapshot();
+    }
     dout(20) << __func__ << " closing" << dendl;
 
   }
@@ -7623,22 +8241,118 @@ void BlueStore::_fsck_check_object_omap(FSCKDepth depth,
   }
 }
 
-void BlueStore::_fsck_check_objects(FSCKDepth depth,
-  BlueStore::FSCK_ObjectCtx& ctx)
+int BlueStore::_fsck_deep_read(Collection* c, OnodeRef& o)
 {
-  auto& errors = ctx.errors;
-  auto sb_info_lock = ctx.sb_info_lock;
-  auto& sb_info = ctx.sb_info;
-  auto repairer = ctx.repairer;
-
-  uint64_t_btree_t used_nids;
-
-  size_t processed_myself = 0;
+  int errors = 0;
+  bufferlist bl;
+  uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
+  uint64_t offset = 0;
+  do {
+    uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
+    int r = _do_read(c, o, offset, l, bl,
+      CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
+    if (r < 0) {
+      ++errors;
+      derr << "fsck error: " << o->oid << std::hex
+        << " error during read: "
+        << " " << offset << "~" << l
+        << " " << cpp_strerror(r) << std::dec
+        << dendl;
+      break;
+    }
+    offset += l;
+    fsck_progress.deep_bytes += l;
+  } while (offset < o->onode.size);
+  ++fsck_progress.deep_objects;
+  return errors;
+}
 
-  auto it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE);
-  mempool::bluestore_fsck::list<string> expecting_shards;
-  if (it) {
-    const size_t thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
+/// Reads back object data for deep fsck on a few threads so the keyspace
+/// walk (which owns all the shared accounting) is not bound by device
+/// read latency.
+class BlueStore::FSCKDeepReadPool {
+  BlueStore* store;
+  const size_t max_queued;
+  ceph::mutex lock = ceph::make_mutex("FSCKDeepReadPool::lock");
+  ceph::condition_variable cond;
+  std::deque<std::pair<BlueStore::CollectionRef, BlueStore::OnodeRef>> q;
+  bool stop = false;
+  std::atomic<int64_t> errors = {0};
+  std::vector<std::thread> threads;
+
+  void worker() {
+    std::unique_lock l(lock);
+    while (true) {
+      if (q.empty()) {
+        if (stop) {
+          break;
+        }
+        cond.wait(l);
+        continue;
+      }
+      {
+        auto item = std::move(q.front());
+        q.pop_front();
+        cond.notify_all();
+        l.unlock();
+        std::shared_lock cl(item.first->lock);
+        errors += store->_fsck_deep_read(item.first.get(), item.second);
+      }
+      l.lock();
+    }
+  }
+
+public:
+  FSCKDeepReadPool(BlueStore* store, size_t n)
+    : store(store), max_queued(n * 4) {
+    for (size_t i = 0; i < n; ++i) {
+      threads.push_back(make_named_thread("bstore_fsck_rd",
+                                          &FSCKDeepReadPool::worker, this));
+    }
+  }
+  ~FSCKDeepReadPool() {
+    finish();
+  }
+
+  /// hand over an object; blocks while the queue is full
+  void queue(BlueStore::CollectionRef c, BlueStore::OnodeRef o) {
+    std::unique_lock l(lock);
+    cond.wait(l, [this] { return q.size() < max_queued; });
+    q.emplace_back(std::move(c), std::move(o));
+    cond.notify_all();
+  }
+
+  /// wait for all queued reads; returns the number of errors seen
+  int64_t finish() {
+    {
+      std::lock_guard l(lock);
+      stop = true;
+      cond.notify_all();
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    threads.clear();
+    return errors.exchange(0);
+  }
+};
+
+void BlueStore::_fsck_check_objects(FSCKDepth depth,
+  BlueStore::FSCK_ObjectCtx& ctx)
+{
+  auto& errors = ctx.errors;
+  auto sb_info_lock = ctx.sb_info_lock;
+  auto& sb_info = ctx.sb_info;
+  auto repairer = ctx.repairer;
+
+  uint64_t_btree_t used_nids;
+
+  size_t processed_myself = 0;
+
+  auto it = db->get_iterator(PREFIX_OBJ, KeyValueDB::ITERATOR_NOCACHE);
+  mempool::bluestore_fsck::list<string> expecting_shards;
+  if (it) {
+    const size_t thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
     typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
     std::unique_ptr<WQ> wq(
       new WQ(
@@ -7658,6 +8372,15 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
       thread_pool.start();
     }
 
+    std::unique_ptr<FSCKDeepReadPool> deep_pool;
+    if (depth == FSCK_DEEP) {
+      const size_t deep_threads =
+        cct->_conf.get_val<uint64_t>("bluestore_fsck_deep_read_threads");
+      if (deep_threads > 0) {
+        deep_pool.reset(new FSCKDeepReadPool(this, deep_threads));
+      }
+    }
+
     //fill global if not overriden below
     CollectionRef c;
     int64_t pool_id = -1;
@@ -7711,6 +8434,7 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
 
       ghobject_t oid;
       int r = get_key_object(it->key(), &oid);
+      ++fsck_progress.objects;
       if (r < 0) {
         derr << "fsck error: bad object key "
           << pretty_binary_string(it->key()) << dendl;
@@ -7844,27 +8568,17 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
           }
         } // if (o->onode.has_omap())
         if (depth == FSCK_DEEP) {
-          bufferlist bl;
-          uint64_t max_read_block = cct->_conf->bluestore_fsck_read_bytes_cap;
-          uint64_t offset = 0;
-          do {
-            uint64_t l = std::min(uint64_t(o->onode.size - offset), max_read_block);
-            int r = _do_read(c.get(), o, offset, l, bl,
-              CEPH_OSD_OP_FLAG_FADVISE_NOCACHE);
-            if (r < 0) {
-              ++errors;
-              derr << "fsck error: " << oid << std::hex
-                << " error during read: "
-                << " " << offset << "~" << l
-                << " " << cpp_strerror(r) << std::dec
-                << dendl;
-              break;
-            }
-            offset += l;
-          } while (offset < o->onode.size);
+          if (deep_pool) {
+            deep_pool->queue(c, o);
+          } else {
+            errors += _fsck_deep_read(c.get(), o);
+          }
         } // deep
       } //if (depth != FSCK_SHALLOW)
     } // for (it->lower_bound(string()); it->valid(); it->next())
+    if (deep_pool) {
+      errors += deep_pool->finish();
+    }
     if (depth == FSCK_SHALLOW && thread_count > 0) {
       wq->finalize(thread_pool, ctx);
       if (processed_myself) {
@@ -7878,6 +8592,178 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
     }
   } // if (it)
 }
+int64_t BlueStore::_fsck_check_freelist(
+  mempool_dynamic_bitset& used_blocks,
+  const mempool_dynamic_bitset& bluefs_used_blocks,
+  BlueStoreRepairer* repairer)
+{
+  typedef std::pair<uint64_t, uint64_t> extent_t;  // offset, length
+  auto alloc_size = fm->get_alloc_size();
+  int64_t errors = 0;
+
+  mempool::bluestore_fsck::vector<extent_t> free_extents;
+  fm->enumerate_reset();
+  uint64_t offset, length;
+  while (fm->enumerate_next(db, &offset, &length)) {
+    free_extents.emplace_back(offset, length);
+  }
+  fm->enumerate_reset();
+
+  // Each thread owns a slice of used_blocks that starts and ends on a word
+  // boundary, so the bits it sets never share a word with another thread.
+  // Findings are collected per slice and reported/repaired here, in order.
+  const size_t bits = used_blocks.size();
+  const size_t word_bits = mempool_dynamic_bitset::bits_per_block;
+  size_t nthreads = std::max<uint64_t>(1,
+    cct->_conf.get_val<uint64_t>("bluestore_fsck_freelist_threads"));
+  size_t slice = round_up_to(
+    std::max<size_t>(1, (bits + nthreads - 1) / nthreads), word_bits);
+  nthreads = std::max<size_t>(1, (bits + slice - 1) / slice);
+
+  struct slice_result_t {
+    bool super_reserved = false;       ///< saw the pre-mimic reserved gap
+    std::vector<size_t> intersecting;  ///< indices into free_extents
+    std::vector<uint64_t> false_free;  ///< bit positions to mark used
+    std::vector<extent_t> leaked;      ///< bit position, count
+  };
+  std::vector<slice_result_t> results(nthreads);
+
+  auto run = [&](auto&& f) {
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < nthreads; ++i) {
+      threads.push_back(make_named_thread("bstore_fsck_fl", f, i));
+    }
+    f(0);
+    for (auto& t : threads) {
+      t.join();
+    }
+  };
+
+  run([&](size_t i) {
+    uint64_t b0 = i * slice;
+    uint64_t b1 = std::min(bits, (i + 1) * slice);
+    auto& r = results[i];
+    // the first extent that ends past the slice start
+    auto p = std::upper_bound(
+      free_extents.begin(), free_extents.end(), b0,
+      [&](uint64_t b, const extent_t& e) {
+        return b < round_up_to(e.first + e.second, alloc_size) / alloc_size;
+      });
+    for (; p != free_extents.end() && p->first / alloc_size < b1; ++p) {
+      uint64_t off = std::max<uint64_t>(p->first, b0 * alloc_size);
+      uint64_t end = std::min<uint64_t>(p->first + p->second,
+                                        b1 * alloc_size);
+      bool intersects = false;
+      apply_for_bitset_range(
+        off, end - off, alloc_size, used_blocks,
+        [&](uint64_t pos, mempool_dynamic_bitset &bs) {
+          ceph_assert(pos < bs.size());
+          if (bs.test(pos) && !bluefs_used_blocks.test(pos)) {
+            if (p->first == SUPER_RESERVED &&
+                p->second == min_alloc_size - SUPER_RESERVED) {
+              // this is due to the change just after luminous to
+              // min_alloc_size granularity allocations, and our baked in
+              // assumption at the top of _fsck that
+              // 0~round_up_to(SUPER_RESERVED,min_alloc_size) is used (vs
+              // luminous's round_up_to(SUPER_RESERVED,block_size)).
+              // harmless, since we will never allocate this region below
+              // min_alloc_size.
+              r.super_reserved = true;
+            } else {
+              intersects = true;
+              r.false_free.push_back(pos);
+            }
+          } else {
+            bs.set(pos);
+          }
+        }
+      );
+      if (intersects) {
+        r.intersecting.push_back(p - free_extents.begin());
+      }
+    }
+  });
+
+  size_t last_intersecting = free_extents.size();
+  for (auto& r : results) {
+    if (r.super_reserved) {
+      dout(10) << __func__ << " ignoring free extent between SUPER_RESERVED"
+               << " and min_alloc_size, 0x" << std::hex << SUPER_RESERVED
+               << "~" << (min_alloc_size - SUPER_RESERVED) << std::dec
+               << dendl;
+    }
+    for (size_t idx : r.intersecting) {
+      // an extent crossing slices is seen by each of them
+      if (idx == last_intersecting) {
+        continue;
+      }
+      last_intersecting = idx;
+      auto& e = free_extents[idx];
+      derr << "fsck error: free extent 0x" << std::hex << e.first
+           << "~" << e.second << std::dec
+           << " intersects allocated blocks" << dendl;
+      ++errors;
+    }
+    if (repairer) {
+      for (auto pos : r.false_free) {
+        repairer->fix_false_free(db, fm, pos * min_alloc_size,
+                                 min_alloc_size);
+      }
+    }
+  }
+  free_extents.clear();
+
+  size_t count = used_blocks.count();
+  if (used_blocks.size() == count) {
+    return errors;
+  }
+  ceph_assert(used_blocks.size() > count);
+  used_blocks.flip();
+  run([&](size_t i) {
+    uint64_t b0 = i * slice;
+    uint64_t b1 = std::min(bits, (i + 1) * slice);
+    auto& leaked = results[i].leaked;
+    size_t pos = b0 == 0 ? used_blocks.find_first() :
+      used_blocks.find_next(b0 - 1);
+    while (pos != mempool_dynamic_bitset::npos && pos < b1) {
+      if (!leaked.empty() &&
+          leaked.back().first + leaked.back().second == pos) {
+        ++leaked.back().second;
+      } else {
+        leaked.emplace_back(pos, 1);
+      }
+      pos = used_blocks.find_next(pos);
+    }
+  });
+  used_blocks.flip();
+
+  std::vector<extent_t> leaked;
+  for (auto& r : results) {
+    for (auto& l : r.leaked) {
+      // runs crossing a slice boundary are found in two pieces
+      if (!leaked.empty() &&
+          leaked.back().first + leaked.back().second == l.first) {
+        leaked.back().second += l.second;
+      } else {
+        leaked.push_back(l);
+      }
+    }
+  }
+  for (auto& l : leaked) {
+    ++errors;
+    derr << "fsck error: leaked extent 0x" << std::hex
+         << (l.first * alloc_size) << "~"
+         << (l.second * alloc_size) << std::dec
+         << dendl;
+    if (repairer) {
+      repairer->fix_leaked(db, fm,
+                           l.first * min_alloc_size,
+                           l.second * min_alloc_size);
+    }
+  }
+  return errors;
+}
+
 /**
 An overview for currently implemented repair logics 
 performed in fsck in two stages: detection(+preparation) and commit.
@@ -7963,6 +8849,61 @@ out_db:
   return r;
 }
 
+void BlueStore::fsck_progress_t::dump(Formatter *f) const
+{
+  auto p = phase.load();
+  f->dump_string("phase", p ? p : "none");
+  f->dump_unsigned("objects", objects);
+  f->dump_unsigned("deep_objects", deep_objects);
+  f->dump_unsigned("deep_bytes", deep_bytes);
+  f->dump_unsigned("shared_blobs", shared_blobs);
+  double elapsed = (double)(ceph_clock_now() - start);
+  f->dump_float("elapsed", elapsed);
+  if (elapsed > 0) {
+    f->dump_float("objects_per_sec", objects / elapsed);
+    f->dump_float("deep_bytes_per_sec", deep_bytes / elapsed);
+  }
+}
+
+/// exposes fsck progress while an fsck is running
+class BlueStore::FSCKSocketHook : public AdminSocketHook {
+  BlueStore* store;
+  bool registered = false;
+public:
+  explicit FSCKSocketHook(BlueStore* store) : store(store) {
+    AdminSocket* admin_socket = store->cct->get_admin_socket();
+    if (admin_socket) {
+      int r = admin_socket->register_command(
+        "bluestore fsck progress", this,
+        "report progress of the running fsck/repair");
+      registered = (r == 0);
+    }
+  }
+  ~FSCKSocketHook() {
+    if (registered) {
+      store->cct->get_admin_socket()->unregister_commands(this);
+    }
+  }
+  bool is_registered() const {
+    return registered;
+  }
+
+  int call(std::string_view command,
+           const cmdmap_t& cmdmap,
+           Formatter *f,
+           std::ostream& ss,
+           bufferlist& out) override {
+    if (command != "bluestore fsck progress") {
+      ss << "Invalid command" << std::endl;
+      return -ENOSYS;
+    }
+    f->open_object_section("fsck_progress");
+    store->fsck_progress.dump(f);
+    f->close_section();
+    return 0;
+  }
+};
+
 int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
 {
   dout(1) << __func__
@@ -7996,6 +8937,12 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
   auto alloc_size = fm->get_alloc_size();
 
   utime_t start = ceph_clock_now();
+  fsck_progress.reset();
+  fsck_progress.phase = "collections";
+  FSCKSocketHook progress_hook(this);
+  if (!progress_hook.is_registered()) {
+    dout(1) << __func__ << " cannot register fsck progress SocketHook" << dendl;
+  }
 
   _fsck_collections(&errors);
   used_blocks.resize(fm->get_alloc_units());
@@ -8081,6 +9028,7 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
   // walk PREFIX_OBJ
   {
     dout(1) << __func__ << " walking object keyspace" << dendl;
+    fsck_progress.phase = "objects";
     ceph::mutex sb_info_lock =  ceph::make_mutex("BlueStore::fsck::sbinfo_lock");
     BlueStore::FSCK_ObjectCtx ctx(
       errors,
@@ -8104,6 +9052,7 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
   }
 
   dout(1) << __func__ << " checking shared_blobs" << dendl;
+  fsck_progress.phase = "shared_blobs";
   it = db->get_iterator(PREFIX_SHARED_BLOB, KeyValueDB::ITERATOR_NOCACHE);
   if (it) {
     // FIXME minor: perhaps simplify for shallow mode?
@@ -8132,6 +9081,7 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
 	++errors;
       } else {
 	++num_shared_blobs;
+	++fsck_progress.shared_blobs;
 	sb_info_t& sbi = p->second;
 	bluestore_shared_blob_t shared_blob(sbid);
 	bufferlist bl = it->value();
@@ -8185,6 +9135,7 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
   if (repair && repairer.preprocess_misreference(db)) {
 
     dout(1) << __func__ << " sorting out misreferenced extents" << dendl;
+    fsck_progress.phase = "misreferences";
     auto& space_tracker = repairer.get_space_usage_tracker();
     auto& misref_extents = repairer.get_misreferences();
     interval_set<uint64_t> to_release;
@@ -8318,6 +9269,7 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
 	    b->get_blob().map_bl(
 	      b_off, bl,
 	      [&](uint64_t offset, bufferlist& t) {
+		_tier_invalidate(offset, t.length());
 		int r = bdev->write(offset, t, false);
 		ceph_assert(r == 0);
 	      });
@@ -8421,11 +9373,13 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
   }
 
   dout(1) << __func__ << " checking pool_statfs" << dendl;
+  fsck_progress.phase = "pool_statfs";
   _fsck_check_pool_statfs(expected_pool_statfs,
 			  errors, warnings, repair ? &repairer : nullptr);
 
   if (depth != FSCK_SHALLOW) {
     dout(1) << __func__ << " checking for stray omap data " << dendl;
+    fsck_progress.phase = "omap";
     it = db->get_iterator(PREFIX_OMAP, KeyValueDB::ITERATOR_NOCACHE);
     if (it) {
       uint64_t last_omap_head = 0;
@@ -8479,6 +9433,7 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
       }
     }
     dout(1) << __func__ << " checking deferred events" << dendl;
+    fsck_progress.phase = "deferred";
     it = db->get_iterator(PREFIX_DEFERRED, KeyValueDB::ITERATOR_NOCACHE);
     if (it) {
       for (it->lower_bound(string()); it->valid(); it->next()) {
@@ -8513,77 +9468,9 @@ int BlueStore::_fsck_on_open(BlueStore::FSCKDepth depth, bool repair)
     }
 
     dout(1) << __func__ << " checking freelist vs allocated" << dendl;
-    {
-      fm->enumerate_reset();
-      uint64_t offset, length;
-      while (fm->enumerate_next(db, &offset, &length)) {
-        bool intersects = false;
-        apply_for_bitset_range(
-          offset, length, alloc_size, used_blocks,
-          [&](uint64_t pos, mempool_dynamic_bitset &bs) {
-	    ceph_assert(pos < bs.size());
-            if (bs.test(pos) && !bluefs_used_blocks.test(pos)) {
-	      if (offset == SUPER_RESERVED &&
-	          length == min_alloc_size - SUPER_RESERVED) {
-	        // this is due to the change just after luminous to min_alloc_size
-	        // granularity allocations, and our baked in assumption at the top
-	        // of _fsck that 0~round_up_to(SUPER_RESERVED,min_alloc_size) is used
-	        // (vs luminous's round_up_to(SUPER_RESERVED,block_size)).  harmless,
-	        // since we will never allocate this region below min_alloc_size.
-	        dout(10) << __func__ << " ignoring free extent between SUPER_RESERVED"
-		         << " and min_alloc_size, 0x" << std::hex << offset << "~"
-		         << length << std::dec << dendl;
-	      } else {
-                intersects = true;
-	        if (repair) {
-		  repairer.fix_false_free(db, fm,
-					  pos * min_alloc_size,
-					  min_alloc_size);
-	        }
-	      }
-            } else {
-	      bs.set(pos);
-            }
-          }
-        );
-        if (intersects) {
-	  derr << "fsck error: free extent 0x" << std::hex << offset
-	        << "~" << length << std::dec
-	        << " intersects allocated blocks" << dendl;
-	  ++errors;
-        }
-      }
-      fm->enumerate_reset();
-      size_t count = used_blocks.count();
-      if (used_blocks.size() != count) {
-        ceph_assert(used_blocks.size() > count);
-        used_blocks.flip();
-        size_t start = used_blocks.find_first();
-        while (start != decltype(used_blocks)::npos) {
-	  size_t cur = start;
-	  while (true) {
-	    size_t next = used_blocks.find_next(cur);
-	    if (next != cur + 1) {
-	      ++errors;
-	      derr << "fsck error: leaked extent 0x" << std::hex
-		   << ((uint64_t)start * fm->get_alloc_size()) << "~"
-		   << ((cur + 1 - start) * fm->get_alloc_size()) << std::dec
-		   << dendl;
-	      if (repair) {
-	        repairer.fix_leaked(db,
-				    fm,
-				    start * min_alloc_size,
-				    (cur + 1 - start) * min_alloc_size);
-	      }
-	      start = next;
-	      break;
-	    }
-	    cur = next;
-	  }
-        }
-        used_blocks.flip();
-      }
-    }
+    fsck_progress.phase = "freelist";
+    errors += _fsck_check_freelist(used_blocks, bluefs_used_blocks,
+                                   repair ? &repairer : nullptr);
   }
   if (repair) {
     if (!per_pool_omap) {
@@ -9029,8 +9916,8 @@ BlueStore::CollectionRef BlueStore::_get_collection(const coll_t& cid)
 void BlueStore::_queue_reap_collection(CollectionRef& c)
 {
   dout(10) << __func__ << " " << c << " " << c->cid << dendl;
-  // _reap_collections and this in the same thread,
-  // so no need a lock.
+  // may be called from several kv finalize shards concurrently
+  std::lock_guard l(removed_collections_lock);
   removed_collections.push_back(c);
 }
 
@@ -9039,8 +9926,7 @@ void BlueStore::_reap_collections()
 
   list<CollectionRef> removed_colls;
   {
-    // _queue_reap_collection and this in the same thread.
-    // So no need a lock.
+    std::lock_guard l(removed_collections_lock);
     if (!removed_collections.empty())
       removed_colls.swap(removed_collections);
     else
@@ -9070,6 +9956,7 @@ void BlueStore::_reap_collections()
   if (removed_colls.empty()) {
     dout(10) << __func__ << " all reaped" << dendl;
   } else {
+    std::lock_guard l(removed_collections_lock);
     removed_collections.splice(removed_collections.begin(), removed_colls);
   }
 }
@@ -9357,7 +10244,8 @@ void BlueStore::_read_cache(
 int BlueStore::_prepare_read_ioc(
   blobs2read_t& blobs2read,
   vector<bufferlist>* compressed_blob_bls,
-  IOContext* ioc)
+  IOContext* ioc,
+  uint64_t tier_seq)
 {
   for (auto& p : blobs2read) {
     const BlobRef& bptr = p.first;
@@ -9375,6 +10263,9 @@ int BlueStore::_prepare_read_ioc(
       auto r = bptr->get_blob().map(
         0, bptr->get_blob().get_ondisk_length(),
         [&](uint64_t offset, uint64_t length) {
+          if (tier_seq && fast_tier->read(offset, length, &bl)) {
+            return 0;
+          }
           int r = bdev->aio_read(offset, length, &bl, ioc);
           if (r < 0)
             return r;
@@ -9402,6 +10293,9 @@ int BlueStore::_prepare_read_ioc(
         auto r = bptr->get_blob().map(
           req.r_off, req.r_len,
           [&](uint64_t offset, uint64_t length) {
+            if (tier_seq && fast_tier->read(offset, length, &req.bl)) {
+              return 0;
+            }
             int r = bdev->aio_read(offset, length, &req.bl, ioc);
             if (r < 0)
               return r;
@@ -9423,6 +10317,20 @@ int BlueStore::_prepare_read_ioc(
   return 0;
 }
 
+void BlueStore::_tier_note_read(
+  const bluestore_blob_t& blob,
+  uint64_t b_off,
+  const bufferlist& bl,
+  uint64_t tier_seq)
+{
+  bufferlist t = bl;
+  blob.map_bl(b_off, t, [&](uint64_t offset, bufferlist& pbl) {
+    if (offset != bluestore_pextent_t::INVALID_OFFSET) {
+      fast_tier->note_read(offset, pbl, tier_seq);
+    }
+  });
+}
+
 int BlueStore::_generate_read_result_bl(
   OnodeRef o,
   uint64_t offset,
@@ -9431,6 +10339,7 @@ int BlueStore::_generate_read_result_bl(
   vector<bufferlist>& compressed_blob_bls,
   blobs2read_t& blobs2read,
   bool buffered,
+  uint64_t tier_seq,
   bool* csum_error,
   bufferlist& bl)
 {
@@ -9450,8 +10359,11 @@ int BlueStore::_generate_read_result_bl(
         *csum_error = true;
         return -EIO;
       }
+      if (tier_seq) {
+        _tier_note_read(bptr->get_blob(), 0, compressed_bl, tier_seq);
+      }
       bufferlist raw_bl;
-      auto r = _decompress(compressed_bl, &raw_bl);
+      auto r = _decompress(o->c, compressed_bl, &raw_bl);
       if (r < 0)
         return r;
       if (buffered) {
@@ -9471,6 +10383,9 @@ int BlueStore::_generate_read_result_bl(
           *csum_error = true;
           return -EIO;
         }
+        if (tier_seq) {
+          _tier_note_read(bptr->get_blob(), req.r_off, req.bl, tier_seq);
+        }
         if (buffered) {
           bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(),
                                          req.r_off, req.bl);
@@ -9582,7 +10497,8 @@ int BlueStore::_do_read(
                              // The error isn't that much...
   vector<bufferlist> compressed_blob_bls;
   IOContext ioc(cct, NULL, true); // allow EIO
-  r = _prepare_read_ioc(blobs2read, &compressed_blob_bls, &ioc);
+  uint64_t tier_seq = _get_tier_seq(read_cache_policy);
+  r = _prepare_read_ioc(blobs2read, &compressed_blob_bls, &ioc, tier_seq);
   // we always issue aio for reading, so errors other than EIO are not allowed
   if (r < 0)
     return r;
@@ -9609,7 +10525,7 @@ int BlueStore::_do_read(
   bool csum_error = false;
   r = _generate_read_result_bl(o, offset, length, ready_regions,
                               compressed_blob_bls, blobs2read,
-                              buffered, &csum_error, bl);
+                              buffered, tier_seq, &csum_error, bl);
   if (csum_error) {
     // Handles spurious read errors caused by a kernel bug.
     // We sometimes get all-zero pages as a result of the read under
@@ -9685,7 +10601,8 @@ int BlueStore::_verify_csum(OnodeRef& o,
   return r;
 }
 
-int BlueStore::_decompress(bufferlist& source, bufferlist* result)
+int BlueStore::_decompress(Collection *c, bufferlist& source,
+			   bufferlist* result)
 {
   int r = 0;
   auto start = mono_clock::now();
@@ -9707,7 +10624,20 @@ int BlueStore::_decompress(bufferlist& source, bufferlist* result)
     _set_compression_alert(false, alg_name);
     r = -EIO;
   } else {
-    r = cp->decompress(i, chdr.length, *result, chdr.compressor_message);
+    auto dict_id = cp->get_dictionary_id(chdr.compressor_message);
+    if (dict_id) {
+      auto dict = _get_compression_dict(c, cp, *dict_id);
+      if (dict) {
+        r = cp->decompress_with_dictionary(i, chdr.length, *result,
+                                           chdr.compressor_message, dict);
+      } else {
+        derr << __func__ << " missing " << cp->get_type_name()
+             << " dictionary " << *dict_id << dendl;
+        r = -ENOENT;
+      }
+    } else {
+      r = cp->decompress(i, chdr.length, *result, chdr.compressor_message);
+    }
     if (r < 0) {
       derr << __func__ << " decompression failed with exit code " << r << dendl;
       r = -EIO;
@@ -9720,6 +10650,151 @@ int BlueStore::_decompress(bufferlist& source, bufferlist* result)
   return r;
 }
 
+void BlueStore::set_compression_dictionary(uint32_t id,
+					   const bufferlist& raw)
+{
+  dout(10) << __func__ << " " << std::hex << id << std::dec << " ("
+	   << raw.length() << " bytes)" << dendl;
+  std::lock_guard l(compression_dict_lock);
+  compression_dicts_offered[id] = raw;
+  ++compression_dict_gen;
+}
+
+/*
+ * A collection stores the dictionaries of its blobs under its own keys,
+ * in the txc of the first blob compressed with each, and drops them when
+ * it is removed.  Writes only use a dictionary without storing it again
+ * once that txc has committed.
+ */
+Compressor::DictionaryRef BlueStore::_get_write_compression_dict(
+  TransContext *txc,
+  Collection *c,
+  CompressorRef& cp)
+{
+  ceph_assert(ceph_mutex_is_wlocked(c->lock));
+  string val;
+  if (!c->pool_opts.get(pool_opts_t::COMPRESSION_DICTIONARY, &val)) {
+    c->compression_dict.reset();
+    c->compression_dict_src.clear();
+    return nullptr;
+  }
+  uint64_t gen = compression_dict_gen;
+  if (val == c->compression_dict_src &&
+      cp->get_type() == c->compression_dict_alg &&
+      (c->compression_dict || gen == c->compression_dict_gen)) {
+    return c->compression_dict;
+  }
+  c->compression_dict.reset();
+  c->compression_dict_src = val;
+  c->compression_dict_alg = cp->get_type();
+  c->compression_dict_gen = gen;
+
+  char *end = nullptr;
+  uint32_t id = strtoul(val.c_str(), &end, 16);
+  if (val.empty() || *end) {
+    derr << __func__ << " bad compression_dictionary '" << val << "' for "
+	 << c->cid << dendl;
+    return nullptr;
+  }
+  uint64_t k = ((uint64_t)cp->get_type() << 32) | id;
+  Compressor::DictionaryRef dict;
+  {
+    std::lock_guard l(compression_dict_lock);
+    auto p = compression_dicts.find(k);
+    if (p != compression_dicts.end()) {
+      dict = p->second;
+    } else {
+      auto q = compression_dicts_offered.find(id);
+      if (q == compression_dicts_offered.end()) {
+	dout(10) << __func__ << " dictionary " << val << " of " << c->cid
+		 << " not available yet" << dendl;
+	return nullptr;
+      }
+      dict = cp->load_dictionary(q->second);
+      if (!dict || dict->id != id) {
+	dout(5) << __func__ << " " << cp->get_type_name()
+		<< " cannot use the compression_dictionary of " << c->cid
+		<< dendl;
+	return nullptr;
+      }
+    }
+  }
+
+  string key;
+  get_compression_dict_key(c->cid, k, &key);
+  bufferlist stored;
+  bool have = db->get(PREFIX_COMPRESSION_DICT, key, &stored) >= 0;
+  if (have && !stored.contents_equal(dict->raw)) {
+    derr << __func__ << " dictionary " << val << " of " << c->cid
+	 << " collides with a stored one, not using it" << dendl;
+    return nullptr;
+  }
+  {
+    std::lock_guard l(compression_dict_lock);
+    compression_dicts.emplace(k, dict);
+  }
+  if (have) {
+    c->compression_dict = dict;
+    return dict;
+  }
+
+  // the blobs of this txc commit along with the dictionary
+  txc->t->set(PREFIX_COMPRESSION_DICT, key, dict->raw);
+  txc->oncommits.push_back(new LambdaContext(
+    [c = CollectionRef(c), dict, val, alg = cp->get_type()](int) {
+      std::unique_lock l(c->lock);
+      if (c->compression_dict_src == val && c->compression_dict_alg == alg) {
+	c->compression_dict = dict;
+      }
+    }));
+  dout(1) << __func__ << " storing " << cp->get_type_name() << " dictionary "
+	  << val << " (" << dict->raw.length() << " bytes) for " << c->cid
+	  << dendl;
+  return dict;
+}
+
+Compressor::DictionaryRef BlueStore::_get_compression_dict(
+  Collection *c,
+  CompressorRef& cp,
+  uint32_t id)
+{
+  uint64_t k = ((uint64_t)cp->get_type() << 32) | id;
+  {
+    std::lock_guard l(compression_dict_lock);
+    auto p = compression_dicts.find(k);
+    if (p != compression_dicts.end()) {
+      return p->second;
+    }
+  }
+  string key;
+  get_compression_dict_key(c->cid, k, &key);
+  bufferlist raw;
+  if (db->get(PREFIX_COMPRESSION_DICT, key, &raw) < 0) {
+    return nullptr;
+  }
+  auto dict = cp->load_dictionary(raw);
+  if (dict) {
+    std::lock_guard l(compression_dict_lock);
+    compression_dicts.emplace(k, dict);
+  }
+  return dict;
+}
+
+void BlueStore::_copy_compression_dicts(TransContext *txc,
+					const coll_t& from, const coll_t& to)
+{
+  string start, end, to_start, to_end;
+  get_compression_dict_range(from, &start, &end);
+  get_compression_dict_range(to, &to_start, &to_end);
+  auto it = db->get_iterator(PREFIX_COMPRESSION_DICT);
+  for (it->lower_bound(start); it->valid() && it->key() < end; it->next()) {
+    dout(20) << __func__ << " " << from << " to " << to << " "
+	     << pretty_binary_string(it->key()) << dendl;
+    txc->t->set(PREFIX_COMPRESSION_DICT,
+		to_start + it->key().substr(start.size()), it->value());
+  }
+}
+
 // this stores fiemap into interval_set, other variations
 // use it internally
 int BlueStore::_fiemap(
@@ -9928,6 +11003,7 @@ int BlueStore::_do_readv(
   _dump_onode<30>(cct, *o);
 
   IOContext ioc(cct, NULL, true); // allow EIO
+  uint64_t tier_seq = _get_tier_seq(read_cache_policy);
   vector<std::tuple<ready_regions_t, vector<bufferlist>, blobs2read_t>> raw_results;
   raw_results.reserve(m.num_intervals());
   int i = 0;
@@ -9935,7 +11011,7 @@ int BlueStore::_do_readv(
     raw_results.push_back({});
     _read_cache(o, p.get_start(), p.get_len(), read_cache_policy,
                 std::get<0>(raw_results[i]), std::get<2>(raw_results[i]));
-    r = _prepare_read_ioc(std::get<2>(raw_results[i]), &std::get<1>(raw_results[i]), &ioc);
+    r = _prepare_read_ioc(std::get<2>(raw_results[i]), &std::get<1>(raw_results[i]), &ioc, tier_seq);
     // we always issue aio for reading, so errors other than EIO are not allowed
     if (r < 0)
       return r;
@@ -9969,7 +11045,7 @@ int BlueStore::_do_readv(
                                  std::get<0>(raw_results[i]),
                                  std::get<1>(raw_results[i]),
                                  std::get<2>(raw_results[i]),
-                                 buffered, &csum_error, t);
+                                 buffered, tier_seq, &csum_error, t);
     if (csum_error) {
       // Handles spurious read errors caused by a kernel bug.
       // We sometimes get all-zero pages as a result of the read under
@@ -10630,6 +11706,74 @@ ObjectMap::ObjectMapIterator BlueStore::get_omap_iterator(
   return ObjectMap::ObjectMapIterator(new OmapIteratorImpl(c, o, it));
 }
 
+int BlueStore::omap_get_batch(
+  CollectionHandle &c_,
+  const ghobject_t &oid,
+  const string &start_after,
+  const string &filter_prefix,
+  uint64_t max_count,
+  uint64_t max_bytes,
+  map<string, bufferlist> *out,
+  bool *more)
+{
+  Collection *c = static_cast<Collection *>(c_.get());
+  dout(15) << __func__ << " " << c->get_cid() << " oid " << oid
+	   << " start_after " << start_after
+	   << " filter_prefix " << filter_prefix
+	   << " max_count " << max_count << dendl;
+  *more = false;
+  if (!c->exists)
+    return -ENOENT;
+  std::shared_lock l(c->lock);
+  int r = 0;
+  uint64_t bytes = 0;
+  OnodeRef o = c->get_onode(oid, false);
+  if (!o || !o->exists) {
+    r = -ENOENT;
+    goto out;
+  }
+  if (!o->onode.has_omap()) {
+    goto out;
+  }
+  o->flush();
+  {
+    // all wanted keys share this prefix, which also excludes the header
+    // and the tail
+    string key_prefix, seek_key;
+    o->get_omap_key(filter_prefix, &key_prefix);
+    KeyValueDB::Iterator it = db->get_iterator(o->get_omap_prefix());
+    if (filter_prefix > start_after) {
+      it->lower_bound(key_prefix);
+    } else {
+      o->get_omap_key(start_after, &seek_key);
+      it->upper_bound(seek_key);
+    }
+    for (; it->valid(); it->next()) {
+      string key = it->key();
+      if (key.compare(0, key_prefix.size(), key_prefix) != 0) {
+	break;
+      }
+      if (out->size() >= max_count || bytes >= max_bytes) {
+	*more = true;
+	break;
+      }
+      string user_key;
+      o->decode_omap_key(key, &user_key);
+      dout(30) << __func__ << "  got " << pretty_binary_string(key)
+	       << " -> " << user_key << dendl;
+      bufferlist value = it->value();
+      bytes += user_key.size() + value.length();
+      out->emplace_hint(out->end(), std::move(user_key), std::move(value));
+    }
+    r = it->status();
+  }
+ out:
+  dout(10) << __func__ << " " << c->get_cid() << " oid " << oid
+	   << " got " << out->size() << (*more ? " (more)" : "")
+	   << " = " << r << dendl;
+  return r;
+}
+
 // -----------------
 // write helpers
 
@@ -11428,6 +12572,11 @@ void BlueStore::_txc_finish(TransContext *txc)
 void BlueStore::_txc_release_alloc(TransContext *txc)
 {
   // it's expected we're called with lazy_release_lock already taken!
+  if (fast_tier) {
+    for (auto p = txc->released.begin(); p != txc->released.end(); ++p) {
+      fast_tier->invalidate(p.get_start(), p.get_len());
+    }
+  }
   if (likely(!cct->_conf->bluestore_debug_no_reuse_blocks)) {
     int r = 0;
     if (cct->_conf->bdev_enable_discard && cct->_conf->bdev_async_discard) {
@@ -11572,9 +12721,9 @@ void BlueStore::_osr_drain_all()
     std::lock_guard l(kv_lock);
     kv_cond.notify_one();
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_cond.notify_one();
+  for (auto& shard : kv_finalize_shards) {
+    std::lock_guard l(shard->lock);
+    shard->cond.notify_one();
   }
   for (auto osr : s) {
     dout(20) << __func__ << " drain " << osr << dendl;
@@ -11603,96 +12752,290 @@ void BlueStore::_osr_drain_all()
 }
 
 
-void BlueStore::_kv_start()
-{
-  dout(10) << __func__ << dendl;
+struct CompressJob {
+  CompressorRef c;
+  Compressor::DictionaryRef dict;
+  const bufferlist *in;
+  bufferlist out;
+  boost::optional<int32_t> compressor_message;
+  int r = 0;
+  mono_clock::duration lat;
+  bool offloaded = false;
 
-  finisher.start();
-  kv_sync_thread.create("bstore_kv_sync");
-  kv_finalize_thread.create("bstore_kv_final");
-}
+  CompressJob(CompressorRef c, Compressor::DictionaryRef dict,
+	      const bufferlist *in)
+    : c(std::move(c)), dict(std::move(dict)), in(in) {}
 
-void BlueStore::_kv_stop()
-{
-  dout(10) << __func__ << dendl;
-  {
-    std::unique_lock l{kv_lock};
-    while (!kv_sync_started) {
-      kv_cond.wait(l);
+  void run() {
+    auto start = mono_clock::now();
+    if (dict) {
+      r = c->compress_with_dictionary(*in, out, compressor_message, dict);
+    } else {
+      r = c->compress(*in, out, compressor_message);
     }
-    kv_stop = true;
-    kv_cond.notify_all();
+    lat = mono_clock::now() - start;
   }
-  {
-    std::unique_lock l{kv_finalize_lock};
-    while (!kv_finalize_started) {
-      kv_finalize_cond.wait(l);
+};
+
+/*
+ * Compresses the blobs of many concurrent _do_alloc_write calls.  Each
+ * caller queues its blobs as one batch and then works through that batch
+ * itself as well, so a large write is spread over the pool while small
+ * ones cost no more than compressing inline.  Workers take blobs from
+ * whichever batch is at the front, whichever transaction it belongs to.
+ *
+ * This is not an asynchronous stage: the caller returns only once all of
+ * its blobs are compressed, because allocation needs their sizes.
+ */
+class BlueStore::CompressPool {
+  struct Batch {
+    std::vector<CompressJob>& jobs;
+    std::atomic<size_t> next = {0};  ///< first unclaimed job
+    std::atomic<size_t> done = {0};
+    unsigned users = 0;              ///< workers inside; protected by lock
+
+    explicit Batch(std::vector<CompressJob>& jobs) : jobs(jobs) {}
+  };
+
+  ceph::mutex lock = ceph::make_mutex("BlueStore::CompressPool::lock");
+  ceph::condition_variable cond;       ///< work queued or stopping
+  ceph::condition_variable done_cond;  ///< a worker left a batch
+  std::deque<Batch*> q;
+  bool stop = false;
+  std::vector<std::thread> threads;
+
+  /// claim and run one job; false once all of b's jobs are claimed
+  static bool run_one(Batch *b, bool offloaded) {
+    size_t i = b->next++;
+    if (i >= b->jobs.size()) {
+      return false;
     }
-    kv_finalize_stop = true;
-    kv_finalize_cond.notify_all();
+    b->jobs[i].offloaded = offloaded;
+    b->jobs[i].run();
+    ++b->done;
+    return true;
+  }
+
+  void worker() {
+    std::unique_lock l(lock);
+    while (true) {
+      if (q.empty()) {
+        if (stop) {
+          break;
+        }
+        cond.wait(l);
+        continue;
+      }
+      Batch *b = q.front();
+      if (b->next >= b->jobs.size()) {
+        q.pop_front();
+        continue;
+      }
+      ++b->users;
+      l.unlock();
+      run_one(b, true);
+      l.lock();
+      --b->users;
+      done_cond.notify_all();
+    }
+  }
+
+public:
+  explicit CompressPool(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      threads.push_back(make_named_thread("bstore_compress",
+                                          &CompressPool::worker, this));
+    }
+  }
+  ~CompressPool() {
+    {
+      std::lock_guard l(lock);
+      stop = true;
+      cond.notify_all();
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  /// run all jobs, returning once every one of them is done
+  void compress(std::vector<CompressJob>& jobs) {
+    Batch b(jobs);
+    {
+      std::lock_guard l(lock);
+      q.push_back(&b);
+      cond.notify_all();
+    }
+    while (run_one(&b, false))
+      ;
+    std::unique_lock l(lock);
+    auto p = std::find(q.begin(), q.end(), &b);
+    if (p != q.end()) {
+      q.erase(p);
+    }
+    done_cond.wait(l, [&] {
+      return b.done == jobs.size() && b.users == 0;
+    });
+  }
+};
+
+void BlueStore::_kv_start()
+{
+  dout(10) << __func__ << dendl;
+
+  kv_sync_pipeline = cct->_conf.get_val<bool>("bluestore_kv_sync_pipeline");
+  deferred_merge = cct->_conf.get_val<bool>("bluestore_deferred_merge");
+  uint64_t num_finalize = std::max<uint64_t>(
+    1, cct->_conf.get_val<uint64_t>("bluestore_kv_finalize_threads"));
+  ceph_assert(kv_finalize_shards.empty());
+  for (uint64_t i = 0; i < num_finalize; ++i) {
+    kv_finalize_shards.emplace_back(new KVFinalizeShard(this, i));
+  }
+  dout(10) << __func__ << " pipeline " << kv_sync_pipeline
+	   << " finalize shards " << num_finalize << dendl;
+
+  numa_node = -1;
+  CPU_ZERO(&numa_cpu_set);
+  int node = -1;
+  get_numa_node(&node, nullptr, nullptr);
+  if (node >= 0) {
+    size_t numa_cpu_set_size = 0;
+    if (get_numa_node_cpu_set(node, &numa_cpu_set_size, &numa_cpu_set) == 0) {
+      numa_node = node;
+      dout(10) << __func__ << " storage numa node " << numa_node << " cpus "
+	       << cpu_set_to_str_list(numa_cpu_set_size, &numa_cpu_set)
+	       << dendl;
+    }
+  }
+
+  auto compress_threads =
+    cct->_conf.get_val<uint64_t>("bluestore_compression_threads");
+  if (compress_threads) {
+    compress_pool.reset(new CompressPool(compress_threads));
+  }
+
+  finisher.start();
+  kv_sync_thread.create("bstore_kv_sync");
+  if (kv_sync_pipeline) {
+    kv_commit_thread.create("bstore_kv_commit");
+  }
+  for (auto& shard : kv_finalize_shards) {
+    shard->thread.create("bstore_kv_final");
+  }
+}
+
+void BlueStore::_kv_stop()
+{
+  dout(10) << __func__ << dendl;
+  {
+    std::unique_lock l{kv_lock};
+    while (!kv_sync_started) {
+      kv_cond.wait(l);
+    }
+    kv_stop = true;
+    kv_cond.notify_all();
+  }
+  for (auto& shard : kv_finalize_shards) {
+    std::unique_lock l{shard->lock};
+    while (!shard->started) {
+      shard->cond.wait(l);
+    }
+    shard->stop = true;
+    shard->cond.notify_all();
   }
   kv_sync_thread.join();
-  kv_finalize_thread.join();
+  if (kv_sync_pipeline) {
+    // the sync thread stops the commit thread once nothing is in flight
+    kv_commit_thread.join();
+  }
+  for (auto& shard : kv_finalize_shards) {
+    shard->thread.join();
+  }
   ceph_assert(removed_collections.empty());
   {
     std::lock_guard l(kv_lock);
     kv_stop = false;
+    kv_commit_stop = false;
   }
-  {
-    std::lock_guard l(kv_finalize_lock);
-    kv_finalize_stop = false;
-  }
+  kv_finalize_shards.clear();
+  compress_pool.reset();
   dout(10) << __func__ << " stopping finishers" << dendl;
   finisher.wait_for_empty();
   finisher.stop();
   dout(10) << __func__ << " stopped" << dendl;
 }
 
+void BlueStore::_set_numa_affinity()
+{
+  if (numa_node < 0 ||
+      !cct->_conf.get_val<bool>("bluestore_numa_affinity")) {
+    return;
+  }
+  int r = set_numa_affinity_this_thread(numa_node);
+  if (r < 0) {
+    derr << __func__ << " failed to bind to numa node " << numa_node << ": "
+	 << cpp_strerror(r) << dendl;
+    return;
+  }
+  dout(10) << __func__ << " bound to numa node " << numa_node << dendl;
+}
+
 void BlueStore::_kv_sync_thread()
 {
   dout(10) << __func__ << " start" << dendl;
-  deque<DeferredBatch*> deferred_stable_queue; ///< deferred ios done + stable
+  _set_numa_affinity();
   std::unique_lock l{kv_lock};
   ceph_assert(!kv_sync_started);
   kv_sync_started = true;
   kv_cond.notify_all();
   while (true) {
-    ceph_assert(kv_committing.empty());
     if (kv_queue.empty() &&
 	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
 	 !deferred_aggressive)) {
-      if (kv_stop)
+      if (kv_stop && !kv_commit_in_flight)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
       kv_sync_in_progress = false;
       kv_cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
+    } else if (kv_sync_pipeline && !kv_commit_queue.empty()) {
+      // the previous group has not been picked up by the commit thread
+      // yet; keep batching until it starts syncing.
+      dout(20) << __func__ << " wait for commit thread" << dendl;
+      kv_cond.wait(l);
     } else {
+      KVCommitGroup *g = new KVCommitGroup;
       deque<TransContext*> kv_submitting;
-      deque<DeferredBatch*> deferred_done, deferred_stable;
       uint64_t aios = 0, costs = 0;
 
       dout(20) << __func__ << " committing " << kv_queue.size()
 	       << " submitting " << kv_queue_unsubmitted.size()
 	       << " deferred done " << deferred_done_queue.size()
 	       << " stable " << deferred_stable_queue.size()
+	       << " in flight " << kv_commit_in_flight
 	       << dendl;
-      kv_committing.swap(kv_queue);
+      g->committing.swap(kv_queue);
       kv_submitting.swap(kv_queue_unsubmitted);
-      deferred_done.swap(deferred_done_queue);
-      deferred_stable.swap(deferred_stable_queue);
+      g->deferred_done.swap(deferred_done_queue);
+      g->deferred_stable.swap(deferred_stable_queue);
       aios = kv_ios;
       costs = kv_throttle_costs;
       kv_ios = 0;
       kv_throttle_costs = 0;
+      if (kv_commit_in_flight) {
+	logger->inc(l_bluestore_kv_sync_pipelined);
+      }
+      if (_is_numa_remote()) {
+	logger->inc(l_bluestore_numa_remote_kv_sync);
+      }
       l.unlock();
 
-      dout(30) << __func__ << " committing " << kv_committing << dendl;
+      dout(30) << __func__ << " committing " << g->committing << dendl;
       dout(30) << __func__ << " submitting " << kv_submitting << dendl;
-      dout(30) << __func__ << " deferred_done " << deferred_done << dendl;
-      dout(30) << __func__ << " deferred_stable " << deferred_stable << dendl;
+      dout(30) << __func__ << " deferred_done " << g->deferred_done << dendl;
+      dout(30) << __func__ << " deferred_stable " << g->deferred_stable << dendl;
 
-      auto start = mono_clock::now();
+      g->start = mono_clock::now();
 
       bool force_flush = false;
       // if bluefs is sharing the same device as data (only), then we
@@ -11702,13 +13045,13 @@ void BlueStore::_kv_sync_thread()
       if (bluefs && bluefs_layout.single_shared_device()) {
 	if (aios) {
 	  force_flush = true;
-	} else if (kv_committing.empty() && deferred_stable.empty()) {
+	} else if (g->committing.empty() && g->deferred_stable.empty()) {
 	  force_flush = true;  // there's nothing else to commit!
 	} else if (deferred_aggressive) {
 	  force_flush = true;
 	}
       } else {
-      	if (aios || !deferred_done.empty()) {
+      	if (aios || !g->deferred_done.empty()) {
 	  force_flush = true;
       	} else {
 	  dout(20) << __func__ << " skipping flush (no aios, no deferred_done)" << dendl;
@@ -11723,40 +13066,51 @@ void BlueStore::_kv_sync_thread()
 	bdev->flush();
 
 	// if we flush then deferred done are now deferred stable
-	deferred_stable.insert(deferred_stable.end(), deferred_done.begin(),
-			       deferred_done.end());
-	deferred_done.clear();
+	g->deferred_stable.insert(g->deferred_stable.end(),
+				  g->deferred_done.begin(),
+				  g->deferred_done.end());
+	g->deferred_done.clear();
       }
-      auto after_flush = mono_clock::now();
+      g->after_flush = mono_clock::now();
 
       // we will use one final transaction to force a sync
-      KeyValueDB::Transaction synct = db->get_transaction();
+      g->synct = db->get_transaction();
+
+      if (kv_sync_pipeline &&
+	  (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max ||
+	   blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max)) {
+	// a new {nid,blobid}_max must not be reordered in the kv log
+	// against the one written by a group that is still syncing, and
+	// must be computed from the max that group made durable.
+	dout(20) << __func__ << " draining pipeline for new max" << dendl;
+	std::unique_lock m{kv_lock};
+	kv_cond.wait(m, [this] { return kv_commit_in_flight == 0; });
+      }
 
       // increase {nid,blobid}_max?  note that this covers both the
       // case where we are approaching the max and the case we passed
       // it.  in either case, we increase the max in the earlier txn
       // we submit.
-      uint64_t new_nid_max = 0, new_blobid_max = 0;
       if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
 	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
+	  kv_submitting.empty() ? g->synct : kv_submitting.front()->t;
+	g->new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
 	bufferlist bl;
-	encode(new_nid_max, bl);
+	encode(g->new_nid_max, bl);
 	t->set(PREFIX_SUPER, "nid_max", bl);
-	dout(10) << __func__ << " new_nid_max " << new_nid_max << dendl;
+	dout(10) << __func__ << " new_nid_max " << g->new_nid_max << dendl;
       }
       if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
 	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
+	  kv_submitting.empty() ? g->synct : kv_submitting.front()->t;
+	g->new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
 	bufferlist bl;
-	encode(new_blobid_max, bl);
+	encode(g->new_blobid_max, bl);
 	t->set(PREFIX_SUPER, "blobid_max", bl);
-	dout(10) << __func__ << " new_blobid_max " << new_blobid_max << dendl;
+	dout(10) << __func__ << " new_blobid_max " << g->new_blobid_max << dendl;
       }
 
-      for (auto txc : kv_committing) {
+      for (auto txc : g->committing) {
 	throttle.log_state_latency(*txc, logger, l_bluestore_state_kv_queued_lat);
 	if (txc->get_state() == TransContext::STATE_KV_QUEUED) {
 	  _txc_apply_kv(txc, false);
@@ -11778,144 +13132,229 @@ void BlueStore::_kv_sync_thread()
       throttle.release_kv_throttle(costs);
 
       // cleanup sync deferred keys
-      for (auto b : deferred_stable) {
+      for (auto b : g->deferred_stable) {
 	for (auto& txc : b->txcs) {
 	  bluestore_deferred_transaction_t& wt = *txc.deferred_txn;
 	  ceph_assert(wt.released.empty()); // only kraken did this
 	  string key;
 	  get_deferred_key(wt.seq, &key);
-	  synct->rm_single_key(PREFIX_DEFERRED, key);
+	  g->synct->rm_single_key(PREFIX_DEFERRED, key);
 	}
       }
 
+      if (kv_sync_pipeline) {
+	// hand the group over and go collect the next one while it syncs
+	l.lock();
+	kv_commit_queue.push_back(g);
+	++kv_commit_in_flight;
+	kv_commit_cond.notify_one();
+      } else {
+	_kv_sync_commit(*g);
+	delete g;
+	l.lock();
+      }
+    }
+  }
+  if (kv_sync_pipeline) {
+    kv_commit_stop = true;
+    kv_commit_cond.notify_all();
+  }
+  dout(10) << __func__ << " finish" << dendl;
+  kv_sync_started = false;
+}
+
+void BlueStore::_kv_sync_commit(KVCommitGroup& g)
+{
 #if defined(WITH_LTTNG)
-      auto sync_start = mono_clock::now();
+  auto sync_start = mono_clock::now();
 #endif
-      // submit synct synchronously (block and wait for it to commit)
-      int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
-      ceph_assert(r == 0);
+  // submit synct synchronously (block and wait for it to commit)
+  int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(g.synct);
+  ceph_assert(r == 0);
 
 #ifdef WITH_BLKIN
-      for (auto txc : kv_committing) {
-        if (txc->trace) {
-          txc->trace.event("db sync submit");
-          txc->trace.keyval("kv_committing size", kv_committing.size());
-        }
-      }
+  for (auto txc : g.committing) {
+    if (txc->trace) {
+      txc->trace.event("db sync submit");
+      txc->trace.keyval("kv_committing size", g.committing.size());
+    }
+  }
 #endif
 
-      int committing_size = kv_committing.size();
-      int deferred_size = deferred_stable.size();
+  int committing_size = g.committing.size();
+  int deferred_size = g.deferred_stable.size();
 
 #if defined(WITH_LTTNG)
-      double sync_latency = ceph::to_seconds<double>(mono_clock::now() - sync_start);
-      for (auto txc: kv_committing) {
-	if (txc->tracing) {
-	  tracepoint(
-	    bluestore,
-	    transaction_kv_sync_latency,
-	    txc->osr->get_sequencer_id(),
-	    txc->seq,
-	    kv_committing.size(),
-	    deferred_done.size(),
-	    deferred_stable.size(),
-	    sync_latency);
-	}
-      }
+  double sync_latency = ceph::to_seconds<double>(mono_clock::now() - sync_start);
+  for (auto txc: g.committing) {
+    if (txc->tracing) {
+      tracepoint(
+	bluestore,
+	transaction_kv_sync_latency,
+	txc->osr->get_sequencer_id(),
+	txc->seq,
+	g.committing.size(),
+	g.deferred_done.size(),
+	g.deferred_stable.size(),
+	sync_latency);
+    }
+  }
 #endif
 
-      {
-	std::unique_lock m{kv_finalize_lock};
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
-	} else {
-	  kv_committing_to_finalize.insert(
-	      kv_committing_to_finalize.end(),
-	      kv_committing.begin(),
-	      kv_committing.end());
-	  kv_committing.clear();
-	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
-	} else {
-	  deferred_stable_to_finalize.insert(
-	      deferred_stable_to_finalize.end(),
-	      deferred_stable.begin(),
-	      deferred_stable.end());
-	  deferred_stable.clear();
-	}
-	if (!kv_finalize_in_progress) {
-	  kv_finalize_in_progress = true;
-	  kv_finalize_cond.notify_one();
-	}
-      }
+  _kv_finalize_queue(g);
 
-      if (new_nid_max) {
-	nid_max = new_nid_max;
-	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-      }
-      if (new_blobid_max) {
-	blobid_max = new_blobid_max;
-	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
-      }
+  if (g.new_nid_max) {
+    nid_max = g.new_nid_max;
+    dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+  }
+  if (g.new_blobid_max) {
+    blobid_max = g.new_blobid_max;
+    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+  }
 
-      {
-	auto finish = mono_clock::now();
-	ceph::timespan dur_flush = after_flush - start;
-	ceph::timespan dur_kv = finish - after_flush;
-	ceph::timespan dur = finish - start;
-	dout(20) << __func__ << " committed " << committing_size
-	  << " cleaned " << deferred_size
-	  << " in " << dur
-	  << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
-	  << dendl;
-	log_latency("kv_flush",
-	  l_bluestore_kv_flush_lat,
-	  dur_flush,
-	  cct->_conf->bluestore_log_op_age);
-	log_latency("kv_commit",
-	  l_bluestore_kv_commit_lat,
-	  dur_kv,
-	  cct->_conf->bluestore_log_op_age);
-	log_latency("kv_sync",
-	  l_bluestore_kv_sync_lat,
-	  dur,
-	  cct->_conf->bluestore_log_op_age);
-      }
+  {
+    auto finish = mono_clock::now();
+    ceph::timespan dur_flush = g.after_flush - g.start;
+    ceph::timespan dur_kv = finish - g.after_flush;
+    ceph::timespan dur = finish - g.start;
+    dout(20) << __func__ << " committed " << committing_size
+      << " cleaned " << deferred_size
+      << " in " << dur
+      << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
+      << dendl;
+    log_latency("kv_flush",
+      l_bluestore_kv_flush_lat,
+      dur_flush,
+      cct->_conf->bluestore_log_op_age);
+    log_latency("kv_commit",
+      l_bluestore_kv_commit_lat,
+      dur_kv,
+      cct->_conf->bluestore_log_op_age);
+    log_latency("kv_sync",
+      l_bluestore_kv_sync_lat,
+      dur,
+      cct->_conf->bluestore_log_op_age);
+  }
+
+  {
+    // previously deferred "done" are now "stable" by virtue of this
+    // commit cycle.
+    std::lock_guard l(kv_lock);
+    deferred_stable_queue.insert(deferred_stable_queue.end(),
+				 g.deferred_done.begin(),
+				 g.deferred_done.end());
+    g.deferred_done.clear();
+  }
+}
+
+void BlueStore::_kv_commit_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  _set_numa_affinity();
+  std::unique_lock l{kv_lock};
+  ceph_assert(!kv_commit_started);
+  kv_commit_started = true;
+  while (true) {
+    if (kv_commit_queue.empty()) {
+      if (kv_commit_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_commit_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      KVCommitGroup *g = kv_commit_queue.front();
+      kv_commit_queue.pop_front();
+      // let the sync thread start building the next group
+      kv_cond.notify_all();
+      l.unlock();
+
+      _kv_sync_commit(*g);
+      delete g;
 
       l.lock();
-      // previously deferred "done" are now "stable" by virtue of this
-      // commit cycle.
-      deferred_stable_queue.swap(deferred_done);
+      --kv_commit_in_flight;
+      kv_cond.notify_all();
     }
   }
   dout(10) << __func__ << " finish" << dendl;
-  kv_sync_started = false;
+  kv_commit_started = false;
+}
+
+void BlueStore::_kv_finalize_queue(KVCommitGroup& g)
+{
+  // txcs (and deferred batches) of one OpSequencer always land on the
+  // same shard so that they are finalized in commit order.
+  size_t num_shards = kv_finalize_shards.size();
+  std::vector<std::deque<TransContext*>> committed(num_shards);
+  std::vector<std::deque<DeferredBatch*>> stable(num_shards);
+  if (num_shards == 1) {
+    committed[0].swap(g.committing);
+    stable[0].swap(g.deferred_stable);
+  } else {
+    for (auto txc : g.committing) {
+      committed[txc->osr->get_sequencer_id() % num_shards].push_back(txc);
+    }
+    for (auto b : g.deferred_stable) {
+      stable[b->osr->get_sequencer_id() % num_shards].push_back(b);
+    }
+    g.committing.clear();
+    g.deferred_stable.clear();
+  }
+
+  for (size_t i = 0; i < num_shards; ++i) {
+    if (committed[i].empty() && stable[i].empty()) {
+      continue;
+    }
+    auto& shard = *kv_finalize_shards[i];
+    std::lock_guard m(shard.lock);
+    if (shard.kv_committing_to_finalize.empty()) {
+      shard.kv_committing_to_finalize.swap(committed[i]);
+    } else {
+      shard.kv_committing_to_finalize.insert(
+	shard.kv_committing_to_finalize.end(),
+	committed[i].begin(),
+	committed[i].end());
+    }
+    if (shard.deferred_stable_to_finalize.empty()) {
+      shard.deferred_stable_to_finalize.swap(stable[i]);
+    } else {
+      shard.deferred_stable_to_finalize.insert(
+	shard.deferred_stable_to_finalize.end(),
+	stable[i].begin(),
+	stable[i].end());
+    }
+    if (!shard.in_progress) {
+      shard.in_progress = true;
+      shard.cond.notify_one();
+    }
+  }
 }
 
-void BlueStore::_kv_finalize_thread()
+void BlueStore::_kv_finalize_thread(size_t shard_id)
 {
+  auto& shard = *kv_finalize_shards[shard_id];
   deque<TransContext*> kv_committed;
   deque<DeferredBatch*> deferred_stable;
-  dout(10) << __func__ << " start" << dendl;
-  std::unique_lock l(kv_finalize_lock);
-  ceph_assert(!kv_finalize_started);
-  kv_finalize_started = true;
-  kv_finalize_cond.notify_all();
+  dout(10) << __func__ << " " << shard_id << " start" << dendl;
+  _set_numa_affinity();
+  std::unique_lock l(shard.lock);
+  ceph_assert(!shard.started);
+  shard.started = true;
+  shard.cond.notify_all();
   while (true) {
     ceph_assert(kv_committed.empty());
     ceph_assert(deferred_stable.empty());
-    if (kv_committing_to_finalize.empty() &&
-	deferred_stable_to_finalize.empty()) {
-      if (kv_finalize_stop)
+    if (shard.kv_committing_to_finalize.empty() &&
+	shard.deferred_stable_to_finalize.empty()) {
+      if (shard.stop)
 	break;
-      dout(20) << __func__ << " sleep" << dendl;
-      kv_finalize_in_progress = false;
-      kv_finalize_cond.wait(l);
-      dout(20) << __func__ << " wake" << dendl;
+      dout(20) << __func__ << " " << shard_id << " sleep" << dendl;
+      shard.in_progress = false;
+      shard.cond.wait(l);
+      dout(20) << __func__ << " " << shard_id << " wake" << dendl;
     } else {
-      kv_committed.swap(kv_committing_to_finalize);
-      deferred_stable.swap(deferred_stable_to_finalize);
+      kv_committed.swap(shard.kv_committing_to_finalize);
+      deferred_stable.swap(shard.deferred_stable_to_finalize);
       l.unlock();
       dout(20) << __func__ << " kv_committed " << kv_committed << dendl;
       dout(20) << __func__ << " deferred_stable " << deferred_stable << dendl;
@@ -11961,8 +13400,8 @@ void BlueStore::_kv_finalize_thread()
       l.lock();
     }
   }
-  dout(10) << __func__ << " finish" << dendl;
-  kv_finalize_started = false;
+  dout(10) << __func__ << " " << shard_id << " finish" << dendl;
+  shard.started = false;
 }
 
 bluestore_deferred_op_t *BlueStore::_get_deferred_op(
@@ -11989,15 +13428,19 @@ void BlueStore::_deferred_queue(TransContext *txc)
   ++deferred_queue_size;
   txc->osr->deferred_pending->txcs.push_back(*txc);
   bluestore_deferred_transaction_t& wt = *txc->deferred_txn;
+  uint64_t extents = 0, superseded = 0;
   for (auto opi = wt.ops.begin(); opi != wt.ops.end(); ++opi) {
     const auto& op = *opi;
     ceph_assert(op.op == bluestore_deferred_op_t::OP_WRITE);
     bufferlist::const_iterator p = op.data.begin();
     for (auto e : op.extents) {
-      txc->osr->deferred_pending->prepare_write(
+      superseded += txc->osr->deferred_pending->prepare_write(
 	cct, wt.seq, e.offset, e.length, p);
     }
+    extents += op.extents.size();
   }
+  logger->inc(l_bluestore_deferred_write_extents, extents);
+  logger->inc(l_bluestore_deferred_write_merged_bytes, superseded);
   if (deferred_aggressive &&
       !txc->osr->deferred_running) {
     _deferred_submit_unlock(txc->osr.get());
@@ -12065,6 +13508,7 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
 	if (!g_conf()->bluestore_debug_omit_block_device_write) {
 	  logger->inc(l_bluestore_deferred_write_ops);
 	  logger->inc(l_bluestore_deferred_write_bytes, bl.length());
+	  _tier_invalidate(start, bl.length());
 	  int r = bdev->aio_write(start, bl, &b->ioc, false);
 	  ceph_assert(r == 0);
 	}
@@ -12196,6 +13640,379 @@ int BlueStore::_deferred_replay()
   return r;
 }
 
+// ---------------------------
+// defragmentation
+
+void *BlueStore::DefragThread::entry()
+{
+  std::unique_lock l{lock};
+  uint64_t prev_txc = store->logger->get(l_bluestore_txc);
+  auto prev = mono_clock::now();
+  while (!stop) {
+    auto& conf = store->cct->_conf;
+    double interval = conf.get_val<double>("bluestore_defrag_interval");
+    double wait = running ? conf.get_val<double>("bluestore_defrag_sleep") :
+      (interval > 0 ? interval : 1.0);
+    if (!kick) {
+      cond.wait_for(l, ceph::make_timespan(wait));
+    }
+    if (stop) {
+      break;
+    }
+
+    // idle means few client transactions since we last looked; our own
+    // rewrites are not counted in l_bluestore_txc
+    auto now = mono_clock::now();
+    uint64_t txc = store->logger->get(l_bluestore_txc);
+    double elapsed = std::max(
+      std::chrono::duration<double>(now - prev).count(), 0.001);
+    bool idle = interval > 0 &&
+      (txc - prev_txc) / elapsed <=
+        conf.get_val<double>("bluestore_defrag_idle_txc_rate");
+    prev = now;
+    prev_txc = txc;
+
+    if (kick) {
+      kick = false;
+      manual = true;
+      _reset_pass();
+    } else if (!running && idle) {
+      manual = false;
+      _reset_pass();
+    }
+    if (!running || (!manual && !idle)) {
+      continue;
+    }
+
+    auto batch = conf.get_val<uint64_t>("bluestore_defrag_batch");
+    l.unlock();
+    int r = _step(batch);
+    l.lock();
+    if (r < 0) {
+      // e.g. out of space; start over once idle again
+      running = false;
+    } else if (r > 0 && running) {
+      running = false;
+      ++passes;
+      last_pass = ceph_clock_now();
+    }
+  }
+  stop = false;
+  return NULL;
+}
+
+void BlueStore::DefragThread::_reset_pass()
+{
+  pass_colls.clear();
+  {
+    std::shared_lock l(store->coll_lock);
+    for (auto& p : store->coll_map) {
+      pass_colls.push_back(p.first);
+    }
+  }
+  std::sort(pass_colls.begin(), pass_colls.end());
+  pass_pos = 0;
+  pass_next = ghobject_t();
+  running = true;
+}
+
+int BlueStore::DefragThread::_step(unsigned max_objects)
+{
+  uint64_t n_scanned = 0, n_rewritten = 0, n_bytes = 0;
+  int ret = 0;
+  while (max_objects > 0 && pass_pos < pass_colls.size() && ret == 0) {
+    CollectionRef c = store->_get_collection(pass_colls[pass_pos]);
+    // meta and temp collections are left alone
+    if (!c || !c->cid.is_pg()) {
+      ++pass_pos;
+      pass_next = ghobject_t();
+      continue;
+    }
+    std::vector<ghobject_t> ls;
+    ghobject_t next;
+    int r;
+    {
+      std::shared_lock l(c->lock);
+      r = store->_collection_list(c.get(), pass_next, ghobject_t::get_max(),
+				  max_objects, false, &ls, &next);
+    }
+    if (r < 0 || ls.empty()) {
+      next = ghobject_t::get_max();
+    }
+    for (auto& oid : ls) {
+      uint64_t bytes = 0;
+      r = store->_defrag_object(c, oid, false, &bytes);
+      ++n_scanned;
+      --max_objects;
+      if (r > 0) {
+	++n_rewritten;
+	n_bytes += bytes;
+      } else if (r < 0 && r != -ENOENT && r != -EIO) {
+	ret = r;
+	break;
+      }
+    }
+    if (ret < 0) {
+      ldout(store->cct, 1) << __func__ << " giving up the pass at "
+			   << c->cid << ": " << cpp_strerror(ret) << dendl;
+      break;
+    }
+    if (next.is_max()) {
+      ++pass_pos;
+      pass_next = ghobject_t();
+    } else {
+      pass_next = next;
+    }
+  }
+
+  std::lock_guard l(lock);
+  scanned += n_scanned;
+  rewritten += n_rewritten;
+  rewritten_bytes += n_bytes;
+  if (ret < 0) {
+    return ret;
+  }
+  return pass_pos >= pass_colls.size() ? 1 : 0;
+}
+
+void BlueStore::DefragThread::start_pass()
+{
+  std::lock_guard l(lock);
+  kick = true;
+  cond.notify_all();
+}
+
+void BlueStore::DefragThread::stop_pass()
+{
+  std::lock_guard l(lock);
+  kick = false;
+  running = false;
+}
+
+void BlueStore::DefragThread::dump(Formatter *f)
+{
+  std::lock_guard l(lock);
+  f->dump_bool("running", running || kick);
+  f->dump_bool("manual", manual);
+  f->dump_unsigned("passes", passes);
+  f->dump_stream("last_pass") << last_pass;
+  f->dump_unsigned("objects_scanned", scanned);
+  f->dump_unsigned("objects_rewritten", rewritten);
+  f->dump_unsigned("bytes_rewritten", rewritten_bytes);
+}
+
+/*
+ * An object, or a range of it, is worth rewriting when reading it
+ * sequentially means many seeks (physically discontiguous pieces, in
+ * logical order) or when it is split into so many small blobs that
+ * decoding the onode is costly.
+ * Objects sharing blobs with clones are skipped: rewriting them would
+ * unshare the data and take more space.
+ */
+bool BlueStore::_defrag_wanted(OnodeRef& o, uint64_t offset, uint64_t length,
+			       bool force)
+{
+  if (length == 0 || o->extent_map.extent_map.empty()) {
+    return false;
+  }
+  uint64_t end = offset + length;
+  uint64_t fragments = 0;
+  uint64_t prev_end = 0;
+  std::set<Blob*> blobs;
+  for (auto e = o->extent_map.seek_lextent(offset);
+       e != o->extent_map.extent_map.end() && e->logical_offset < end;
+       ++e) {
+    const bluestore_blob_t& b = e->blob->get_blob();
+    if (b.is_shared()) {
+      return false;
+    }
+    bool first = blobs.insert(e->blob.get()).second;
+    if (b.is_compressed()) {
+      if (first) {
+	for (auto& p : b.get_extents()) {
+	  if (p.is_valid()) {
+	    fragments += p.offset != prev_end;
+	    prev_end = p.end();
+	  }
+	}
+      }
+      continue;
+    }
+    uint64_t start = std::max<uint64_t>(offset, e->logical_offset);
+    uint64_t len = std::min<uint64_t>(end, e->logical_end()) - start;
+    b.map(e->blob_offset + start - e->logical_offset, len,
+	  [&](uint64_t poff, uint64_t plen) {
+      fragments += poff != prev_end;
+      prev_end = poff + plen;
+      return 0;
+    });
+  }
+  uint64_t mb = std::max<uint64_t>(1, length >> 20);
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << offset
+	   << "~" << length << std::dec << " fragments " << fragments
+	   << " blobs " << blobs.size() << dendl;
+  if (force) {
+    return true;
+  }
+  auto min_fragments = cct->_conf.get_val<uint64_t>("bluestore_defrag_min_fragments");
+  auto fragments_per_mb = cct->_conf.get_val<uint64_t>("bluestore_defrag_fragments_per_mb");
+  auto blobs_per_mb = cct->_conf.get_val<uint64_t>("bluestore_defrag_blobs_per_mb");
+  return (fragments >= min_fragments && fragments >= fragments_per_mb * mb) ||
+    (blobs_per_mb && blobs.size() >= blobs_per_mb * mb);
+}
+
+int BlueStore::_defrag_object(CollectionRef& c, const ghobject_t& oid,
+			      bool force, uint64_t *bytes)
+{
+  // the collection may have been removed, or split, since oid was listed
+  auto moved = [&]() {
+    spg_t pgid;
+    return !c->exists ||
+      (c->cid.is_pg(&pgid) && !oid.match(c->cnode.bits, pgid.ps()));
+  };
+  {
+    std::shared_lock l(c->lock);
+    if (moved()) {
+      return -ENOENT;
+    }
+    OnodeRef o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      return -ENOENT;
+    }
+    o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+    if (!_defrag_wanted(o, 0, o->onode.size, force)) {
+      return 0;
+    }
+  }
+  dout(10) << __func__ << " " << c->cid << " " << oid << dendl;
+
+  // Build the txc the same way queue_transactions() does.  The object
+  // may have changed since we looked, so check again under the lock.
+  std::unique_lock pl(c->prepare_lock);
+  std::unique_lock sl(atomic_alloc_and_submit_lock, std::defer_lock);
+  if (bdev->is_smr()) {
+    sl.lock();
+  }
+  std::unique_lock l(c->lock);
+  OnodeRef o;
+  if (!moved()) {
+    o = c->get_onode(oid, false);
+  }
+  if (!o || !o->exists) {
+    return -ENOENT;
+  }
+  o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+  if (!_defrag_wanted(o, 0, o->onode.size, force)) {
+    return 0;
+  }
+
+  // Everything is rewritten with the collection locked, so only so much
+  // at a time; the fragmented parts left are for the next pass.
+  uint64_t max_bytes = cct->_conf.get_val<Option::size_t>(
+    "bluestore_defrag_max_bytes");
+  if (shared_alloc.a->get_free() < std::min<uint64_t>(max_bytes,
+						      o->onode.size)) {
+    dout(10) << __func__ << " " << c->cid << " " << oid
+	     << " not enough free space" << dendl;
+    return -ENOSPC;
+  }
+
+  int r = 0;
+  uint64_t rewritten = 0;
+  TransContext *txc = _txc_create(c.get(), c->osr.get(), nullptr);
+  spg_t pgid;
+  if (c->cid.is_pg(&pgid)) {
+    txc->osd_pool_id = pgid.pool();
+  }
+  // rewrite the fragmented chunks of every run of logically contiguous data
+  const uint64_t chunk = std::min<uint64_t>(4ull << 20, max_bytes);
+  interval_set<uint64_t> runs;
+  for (auto& e : o->extent_map.extent_map) {
+    runs.union_insert(e.logical_offset, e.length);
+  }
+  for (auto p = runs.begin();
+       p != runs.end() && r >= 0 && rewritten < max_bytes;
+       ++p) {
+    for (uint64_t off = p.get_start();
+	 off < p.get_end() && rewritten < max_bytes;
+	 off += chunk) {
+      uint64_t len = std::min({chunk, p.get_end() - off, max_bytes - rewritten});
+      if (!_defrag_wanted(o, off, len, force)) {
+	continue;
+      }
+      bufferlist bl;
+      r = _do_read(c.get(), o, off, len, bl, 0);
+      if (r < 0) {
+	// leave the rest alone, what we've rewritten so far is fine
+	derr << __func__ << " " << c->cid << " " << oid << " read failed: "
+	     << cpp_strerror(r) << dendl;
+	break;
+      }
+      ceph_assert(bl.length() == len);
+      r = _write(txc, c, o, off, len, bl,
+		 CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+      if (r < 0) {
+	// Nothing of the txc has reached the disk or the kv store, but the
+	// cached onode already refers to the space it allocated.  Once the
+	// txcs before it have committed the onode in the kv store is current
+	// again, so drop the cached one along with the txc.
+	derr << __func__ << " " << c->cid << " " << oid << " write failed: "
+	     << cpp_strerror(r) << dendl;
+	_osr_drain_preceding(txc);
+	c->onode_map.remove(oid);
+	o.reset();
+	if (!txc->allocated.empty()) {
+	  shared_alloc.a->release(txc->allocated);
+	}
+	c->osr->drop_new(txc);
+	delete txc;
+	return r;
+      }
+      rewritten += len;
+    }
+  }
+  if (!rewritten) {
+    c->osr->drop_new(txc);
+    delete txc;
+    return r < 0 ? r : 0;
+  }
+  o->extent_map.request_reshard(0, OBJECT_MAX_SIZE);
+  txc->write_onode(o);
+  l.unlock();
+
+  txc->bytes = rewritten;
+  _txc_calc_cost(txc);
+  _txc_write_nodes(txc, txc->t);
+  _txc_journal_deferred(txc);
+  _txc_finalize_kv(txc, txc->t);
+  pl.unlock();
+
+  _txc_throttle(txc, mono_clock::now());
+  _txc_state_proc(txc);
+  if (sl.owns_lock()) {
+    sl.unlock();
+  }
+
+  if (bytes) {
+    *bytes = rewritten;
+  }
+  logger->inc(l_bluestore_defrag_onodes);
+  logger->inc(l_bluestore_defrag_bytes, rewritten);
+  dout(10) << __func__ << " " << c->cid << " " << oid << " rewrote 0x"
+	   << std::hex << rewritten << std::dec << dendl;
+  return 1;
+}
+
+int BlueStore::defrag_object(CollectionHandle& ch, const ghobject_t& oid,
+			     bool force)
+{
+  CollectionRef c = static_cast<Collection*>(ch.get());
+  if (!c->exists) {
+    return -ENOENT;
+  }
+  return _defrag_object(c, oid, force, nullptr);
+}
+
 // ---------------------------
 // transactions
 
@@ -12216,7 +14033,12 @@ int BlueStore::queue_transactions(
   OpSequencer *osr = c->osr.get();
   dout(10) << __func__ << " ch " << c << " " << c->cid << dendl;
 
+  if (_is_numa_remote()) {
+    logger->inc(l_bluestore_numa_remote_txc);
+  }
+
   // prepare
+  std::unique_lock pl(c->prepare_lock);
   TransContext *txc = _txc_create(static_cast<Collection*>(ch.get()), osr,
 				  &on_commit, op);
 
@@ -12236,18 +14058,9 @@ int BlueStore::queue_transactions(
   _txc_calc_cost(txc);
 
   _txc_write_nodes(txc, txc->t);
-
-  // journal deferred items
-  if (txc->deferred_txn) {
-    txc->deferred_txn->seq = ++deferred_seq;
-    bufferlist bl;
-    encode(*txc->deferred_txn, bl);
-    string key;
-    get_deferred_key(txc->deferred_txn->seq, &key);
-    txc->t->set(PREFIX_DEFERRED, key, bl);
-  }
-
+  _txc_journal_deferred(txc);
   _txc_finalize_kv(txc, txc->t);
+  pl.unlock();
 
 #ifdef WITH_BLKIN
   if (txc->trace) {
@@ -12259,27 +14072,7 @@ int BlueStore::queue_transactions(
     handle->suspend_tp_timeout();
 
   auto tstart = mono_clock::now();
-
-  if (!throttle.try_start_transaction(
-	*db,
-	*txc,
-	tstart)) {
-    // ensure we do not block here because of deferred writes
-    dout(10) << __func__ << " failed get throttle_deferred_bytes, aggressive"
-	     << dendl;
-    ++deferred_aggressive;
-    deferred_try_submit();
-    {
-      // wake up any previously finished deferred events
-      std::lock_guard l(kv_lock);
-      if (!kv_sync_in_progress) {
-	kv_sync_in_progress = true;
-	kv_cond.notify_one();
-      }
-    }
-    throttle.finish_start_transaction(*db, *txc, tstart);
-    --deferred_aggressive;
-  }
+  _txc_throttle(txc, tstart);
   auto tend = mono_clock::now();
 
   if (handle)
@@ -12329,6 +14122,49 @@ void BlueStore::_txc_aio_submit(TransContext *txc)
   bdev->aio_submit(&txc->ioc);
 }
 
+void BlueStore::_txc_journal_deferred(TransContext *txc)
+{
+  if (!txc->deferred_txn) {
+    return;
+  }
+  if (deferred_merge) {
+    uint64_t superseded = txc->deferred_txn->coalesce();
+    if (superseded) {
+      logger->inc(l_bluestore_deferred_write_merged_bytes, superseded);
+    }
+  }
+  txc->deferred_txn->seq = ++deferred_seq;
+  bufferlist bl;
+  encode(*txc->deferred_txn, bl);
+  string key;
+  get_deferred_key(txc->deferred_txn->seq, &key);
+  txc->t->set(PREFIX_DEFERRED, key, bl);
+}
+
+void BlueStore::_txc_throttle(TransContext *txc, mono_clock::time_point start)
+{
+  if (!throttle.try_start_transaction(
+	*db,
+	*txc,
+	start)) {
+    // ensure we do not block here because of deferred writes
+    dout(10) << __func__ << " failed get throttle_deferred_bytes, aggressive"
+	     << dendl;
+    ++deferred_aggressive;
+    deferred_try_submit();
+    {
+      // wake up any previously finished deferred events
+      std::lock_guard l(kv_lock);
+      if (!kv_sync_in_progress) {
+	kv_sync_in_progress = true;
+	kv_cond.notify_one();
+      }
+    }
+    throttle.finish_start_transaction(*db, *txc, start);
+    --deferred_aggressive;
+  }
+}
+
 void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 {
   Transaction::iterator i = t->begin();
@@ -12928,6 +14764,11 @@ void BlueStore::_do_write_small(
 	      b->get_blob().map_bl(
 		b_off, bl,
 		[&](uint64_t offset, bufferlist& t) {
+		  if (!wctx->buffered &&
+		      !t.is_aligned_size_and_memory(block_size, block_size)) {
+		    logger->inc(l_bluestore_write_realign_bytes, t.length());
+		  }
+		  _tier_invalidate(offset, t.length());
 		  bdev->aio_write(offset, t,
 				  &txc->ioc, wctx->buffered);
 		});
@@ -13521,21 +15362,75 @@ int BlueStore::_do_alloc_write(
     }
   );
 
-  // compress (as needed) and calc needed space
+  // compress (as needed)
+  std::vector<CompressJob> compress_jobs;
+  std::vector<unsigned> compress_classes;
+  auto& estimator = coll->compression_estimator;
+  Compressor::DictionaryRef dict;
+  if (c) {
+    dict = _get_write_compression_dict(txc, coll.get(), c);
+    double max_entropy = 0;
+    unsigned probe = 0;
+    if (wctx->compress_adaptive) {
+      max_entropy =
+        cct->_conf.get_val<double>("bluestore_compression_adaptive_entropy");
+      probe = cct->_conf.get_val<uint64_t>("bluestore_compression_adaptive_probe");
+    }
+    for (auto& wi : wctx->writes) {
+      if (wi.blob_length > min_alloc_size) {
+        ceph_assert(wi.b_off == 0);
+        ceph_assert(wi.blob_length == wi.bl.length());
+        if (wctx->compress_adaptive) {
+          unsigned cls = CompressionEstimator::classify(
+            o->oid.hobj.oid.name, o->onode.alloc_hint_flags, wi.blob_length);
+          if (!estimator.should_try(cls, probe)) {
+            dout(20) << __func__ << std::hex << "  0x" << wi.blob_length
+                     << std::dec << " skipping compression, class " << cls
+                     << " keeps failing" << dendl;
+            logger->inc(l_bluestore_compress_skipped_count);
+            continue;
+          }
+          double entropy = 0;
+          if (max_entropy > 0 &&
+              (entropy = CompressionEstimator::sample_entropy(wi.bl)) >
+                max_entropy) {
+            dout(20) << __func__ << std::hex << "  0x" << wi.blob_length
+                     << std::dec << " skipping compression, sampled entropy "
+                     << entropy << dendl;
+            estimator.record(cls, false);
+            logger->inc(l_bluestore_compress_skipped_count);
+            continue;
+          }
+          compress_classes.push_back(cls);
+        }
+        // FIXME: memory alignment here is bad
+        compress_jobs.emplace_back(c, dict, &wi.bl);
+      }
+    }
+    // a lone blob would be claimed by this thread first anyway; handing it
+    // over would only add a wakeup while we wait for it
+    if (compress_pool && compress_jobs.size() > 1) {
+      compress_pool->compress(compress_jobs);
+    } else {
+      for (auto& job : compress_jobs) {
+        job.run();
+      }
+    }
+  }
+
+  // calc needed space
   uint64_t need = 0;
   auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
+  auto job = compress_jobs.begin();
+  auto cls = compress_classes.begin();
   for (auto& wi : wctx->writes) {
-    if (c && wi.blob_length > min_alloc_size) {
-      auto start = mono_clock::now();
-
-      // compress
-      ceph_assert(wi.b_off == 0);
-      ceph_assert(wi.blob_length == wi.bl.length());
-
-      // FIXME: memory alignment here is bad
-      bufferlist t;
-      boost::optional<int32_t> compressor_message;
-      int r = c->compress(wi.bl, t, compressor_message);
+    if (job != compress_jobs.end() && job->in == &wi.bl) {
+      bufferlist& t = job->out;
+      boost::optional<int32_t>& compressor_message = job->compressor_message;
+      int r = job->r;
+      if (job->offloaded) {
+        logger->inc(l_bluestore_compress_offloaded_count);
+      }
       uint64_t want_len_raw = wi.blob_length * crr;
       uint64_t want_len = p2roundup(want_len_raw, min_alloc_size);
       bool rejected = false;
@@ -13584,6 +15479,9 @@ int BlueStore::_do_alloc_write(
       } else {
 	rejected = true;
       }
+      if (wctx->compress_adaptive) {
+	estimator.record(*cls++, wi.compressed);
+      }
 
       if (rejected) {
 	dout(20) << __func__ << std::hex << "  0x" << wi.blob_length
@@ -13598,8 +15496,9 @@ int BlueStore::_do_alloc_write(
       }
       log_latency("compress@_do_alloc_write",
 	l_bluestore_compress_lat,
-        mono_clock::now() - start,
+        job->lat,
 	cct->_conf->bluestore_log_op_age );
+      ++job;
     } else {
       need += wi.blob_length;
     }
@@ -13757,6 +15656,10 @@ int BlueStore::_do_alloc_write(
 	b->get_blob().map_bl(
 	  b_off, *l,
 	  [&](uint64_t offset, bufferlist& t) {
+	    if (!t.is_aligned_size_and_memory(block_size, block_size)) {
+	      logger->inc(l_bluestore_write_realign_bytes, t.length());
+	    }
+	    _tier_invalidate(offset, t.length());
 	    bdev->aio_write(offset, t, &txc->ioc, false);
 	  });
 	logger->inc(l_bluestore_write_new);
@@ -13881,6 +15784,90 @@ void BlueStore::_do_write_data(
   }
 }
 
+unsigned BlueStore::CompressionEstimator::classify(
+  const std::string& name,
+  unsigned alloc_hints,
+  uint64_t blob_length)
+{
+  // The name suffix tells media from text best: take the last token after
+  // a '.' that looks like an extension, skipping e.g. rgw's ".2~tag_1"
+  // multipart tails.
+  std::string_view ext;
+  for (size_t p = name.find('.'); p != std::string::npos;
+       p = name.find('.', p + 1)) {
+    size_t e = p + 1;
+    while (e < name.size() && e - p <= 5 && isalnum(name[e])) {
+      ++e;
+    }
+    if (e > p + 1 && e - p <= 5 && isalpha(name[p + 1])) {
+      ext = std::string_view(name).substr(p + 1, e - p - 1);
+    }
+  }
+  size_t h = std::hash<std::string_view>{}(ext);
+  boost::hash_combine(h, alloc_hints & (CEPH_OSD_ALLOC_HINT_FLAG_IMMUTABLE |
+					CEPH_OSD_ALLOC_HINT_FLAG_APPEND_ONLY |
+					CEPH_OSD_ALLOC_HINT_FLAG_COMPRESSIBLE |
+					CEPH_OSD_ALLOC_HINT_FLAG_SEQUENTIAL_READ));
+  boost::hash_combine(h, std::min<unsigned>(ctz(blob_length), 24));
+  return h % NUM_CLASSES;
+}
+
+bool BlueStore::CompressionEstimator::should_try(unsigned cls,
+						 unsigned probe_interval)
+{
+  auto& c = classes[cls];
+  if (c.fail_score.load(std::memory_order_relaxed) < SCORE_MAX * 3 / 4) {
+    return true;
+  }
+  return probe_interval &&
+    c.skipped.fetch_add(1, std::memory_order_relaxed) % probe_interval == 0;
+}
+
+void BlueStore::CompressionEstimator::record(unsigned cls, bool success)
+{
+  // exponential moving average over roughly the last 8 outcomes
+  auto& c = classes[cls];
+  int64_t score = c.fail_score.load(std::memory_order_relaxed);
+  int64_t target = success ? 0 : SCORE_MAX;
+  score += (target - score) / 8;
+  if (!success && score < SCORE_MAX) {
+    ++score;  // let repeated failures actually reach the top
+  }
+  c.fail_score.store(score, std::memory_order_relaxed);
+}
+
+double BlueStore::CompressionEstimator::sample_entropy(const bufferlist& bl)
+{
+  // 16 windows of 64 bytes spread evenly over the buffer
+  constexpr unsigned windows = 16, window = 64;
+  unsigned len = bl.length();
+  if (len < windows * window) {
+    return 0;
+  }
+  std::array<unsigned, 256> hist = {};
+  auto p = bl.cbegin();
+  unsigned pos = 0;
+  char buf[window];
+  for (unsigned i = 0; i < windows; ++i) {
+    unsigned off = (uint64_t)(len - window) * i / (windows - 1);
+    p += off - pos;
+    p.copy(window, buf);
+    pos = off + window;
+    for (unsigned j = 0; j < window; ++j) {
+      ++hist[(unsigned char)buf[j]];
+    }
+  }
+  double entropy = 0;
+  const double n = windows * window;
+  for (auto c : hist) {
+    if (c) {
+      double f = c / n;
+      entropy -= f * log2(f);
+    }
+  }
+  return entropy;
+}
+
 void BlueStore::_choose_write_options(
    CollectionRef& c,
    OnodeRef o,
@@ -13917,10 +15904,13 @@ void BlueStore::_choose_write_options(
 
   wctx->compress = (cm != Compressor::COMP_NONE) &&
     ((cm == Compressor::COMP_FORCE) ||
-     (cm == Compressor::COMP_AGGRESSIVE &&
+     ((cm == Compressor::COMP_AGGRESSIVE ||
+       cm == Compressor::COMP_ADAPTIVE) &&
       (alloc_hints & CEPH_OSD_ALLOC_HINT_FLAG_INCOMPRESSIBLE) == 0) ||
      (cm == Compressor::COMP_PASSIVE &&
       (alloc_hints & CEPH_OSD_ALLOC_HINT_FLAG_COMPRESSIBLE)));
+  wctx->compress_adaptive =
+    wctx->compress && cm == Compressor::COMP_ADAPTIVE;
 
   if ((alloc_hints & CEPH_OSD_ALLOC_HINT_FLAG_SEQUENTIAL_READ) &&
       (alloc_hints & CEPH_OSD_ALLOC_HINT_FLAG_RANDOM_READ) == 0 &&
@@ -14497,7 +16487,8 @@ void BlueStore::_do_omap_clear(TransContext *txc, OnodeRef& o)
   string prefix, tail;
   o->get_omap_header(&prefix);
   o->get_omap_tail(&tail);
-  txc->t->rm_range_keys(omap_prefix, prefix, tail);
+  txc->t->rm_range_keys(omap_prefix, prefix, tail,
+    cct->_conf.get_val<uint64_t>("bluestore_omap_delete_range_threshold"));
   txc->t->rmkey(omap_prefix, tail);
   dout(20) << __func__ << " remove range start: "
            << pretty_binary_string(prefix) << " end: "
@@ -14650,7 +16641,8 @@ int BlueStore::_omap_rmkey_range(TransContext *txc,
     o->flush();
     o->get_omap_key(first, &key_first);
     o->get_omap_key(last, &key_last);
-    txc->t->rm_range_keys(prefix, key_first, key_last);
+    txc->t->rm_range_keys(prefix, key_first, key_last,
+      cct->_conf.get_val<uint64_t>("bluestore_omap_delete_range_threshold"));
     dout(20) << __func__ << " remove range start: "
              << pretty_binary_string(key_first) << " end: "
              << pretty_binary_string(key_last) << dendl;
@@ -15007,6 +16999,9 @@ void BlueStore::_do_remove_collection(TransContext *txc,
   (*c)->exists = false;
   _osr_register_zombie((*c)->osr.get());
   txc->t->rmkey(PREFIX_COLL, stringify((*c)->cid));
+  string start, end;
+  get_compression_dict_range((*c)->cid, &start, &end);
+  txc->t->rm_range_keys(PREFIX_COMPRESSION_DICT, start, end);
   c->reset();
 }
 
@@ -15053,6 +17048,9 @@ int BlueStore::_split_collection(TransContext *txc,
   ceph_assert(d->cnode.bits == bits);
   r = 0;
 
+  // the child's objects need the dictionaries of their blobs
+  _copy_compression_dicts(txc, c->cid, d->cid);
+
   bufferlist bl;
   encode(c->cnode, bl);
   txc->t->set(PREFIX_COLL, stringify(c->cid), bl);
@@ -15101,6 +17099,8 @@ int BlueStore::_merge_collection(
   // behavior depends on target (d) bits, so this after that is updated.
   (*c)->split_cache(d.get());
 
+  _copy_compression_dicts(txc, cid, d->cid);
+
   // remove source collection
   {
     std::unique_lock l3(coll_lock);
@@ -17,8 +17,10 @@
 
 #include "acconfig.h"
 
+#include <sched.h>
 #include <unistd.h>
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <ratio>
@@ -50,6 +52,7 @@
 
 #include "bluestore_types.h"
 #include "BlueFS.h"
+#include "FastTier.h"
 #include "common/EventTrace.h"
 
 #ifdef WITH_BLKIN
@@ -75,6 +78,7 @@ enum {
   l_bluestore_kv_commit_lat,
   l_bluestore_kv_sync_lat,
   l_bluestore_kv_final_lat,
+  l_bluestore_kv_sync_pipelined,
   l_bluestore_state_prepare_lat,
   l_bluestore_state_aio_wait_lat,
   l_bluestore_state_io_done_lat,
@@ -97,9 +101,14 @@ enum {
   l_bluestore_csum_lat,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
+  l_bluestore_compress_offloaded_count,
+  l_bluestore_compress_skipped_count,
   l_bluestore_write_pad_bytes,
+  l_bluestore_write_realign_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_write_extents,
+  l_bluestore_deferred_write_merged_bytes,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -118,6 +127,7 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_buffer_lockless_hit_bytes,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -133,6 +143,8 @@ enum {
   l_bluestore_blob_split,
   l_bluestore_extent_compress,
   l_bluestore_gc_merged,
+  l_bluestore_defrag_onodes,
+  l_bluestore_defrag_bytes,
   l_bluestore_read_eio,
   l_bluestore_reads_with_retries,
   l_bluestore_fragmentation,
@@ -141,6 +153,8 @@ enum {
   l_bluestore_omap_lower_bound_lat,
   l_bluestore_omap_next_lat,
   l_bluestore_clist_lat,
+  l_bluestore_numa_remote_txc,
+  l_bluestore_numa_remote_kv_sync,
   l_bluestore_last
 };
 
@@ -292,13 +306,39 @@ public:
     // few IOs in flight to the same Blob at the same time).
     state_list_t writing;   ///< writing buffers, sorted by seq, ascending
 
+    /// immutable copy of the readable (clean or writing) buffers
+    struct snapshot_t {
+      struct entry_t {
+	uint32_t offset, length;
+	ceph::buffer::list data;
+	Buffer *b;  ///< only valid while this snapshot is published
+      };
+      mempool::bluestore_cache_meta::vector<entry_t> entries; ///< by offset
+    };
+    /// Published with atomic shared_ptr ops so readers can serve full hits
+    /// without the cache lock.  Any change to buffer_map (made under the
+    /// cache lock) unpublishes it; a later locked read republishes it.
+    std::shared_ptr<const snapshot_t> snapshot;
+
     ~BufferSpace() {
       ceph_assert(buffer_map.empty());
       ceph_assert(writing.empty());
     }
 
+    void _invalidate_snapshot() {
+      if (snapshot) {
+	std::atomic_store(&snapshot, std::shared_ptr<const snapshot_t>());
+      }
+    }
+    void _publish_snapshot();
+    bool _read_snapshot(BufferCacheShard* cache, uint32_t offset,
+			uint32_t length,
+			BlueStore::ready_regions_t& res,
+			interval_set<uint32_t>& res_intervals);
+
     void _add_buffer(BufferCacheShard* cache, Buffer *b, int level, Buffer *near) {
       cache->_audit("_add_buffer start");
+      _invalidate_snapshot();
       buffer_map[b->offset].reset(b);
       if (b->is_writing()) {
 	b->data.reassign_to_mempool(mempool::mempool_bluestore_writing);
@@ -328,6 +368,7 @@ public:
 		    std::map<uint32_t, std::unique_ptr<Buffer>>::iterator p) {
       ceph_assert(p != buffer_map.end());
       cache->_audit("_rm_buffer start");
+      _invalidate_snapshot();
       if (p->second->is_writing()) {
         writing.erase(writing.iterator_to(*p->second));
       } else {
@@ -1074,6 +1115,9 @@ public:
                               /// of it at the moment though)
     bool pinned;              ///< Onode is pinned
                               /// (or should be pinned when cached)
+    std::atomic<bool> cache_ref = {false}; ///< referenced since last clock
+                                           ///  sweep (clock cache only)
+    bool cache_hot = false;   ///< hot in clock cache, protected by cache lock
     ExtentMap extent_map;
 
     // track txc's that have not been committed to kv store (and whose
@@ -1226,20 +1270,26 @@ public:
     virtual void _add(Onode* o, int level) = 0;
     virtual void _rm(Onode* o) = 0;
 
-    void pin(Onode* o, std::function<bool ()> validator) {
+    virtual void pin(Onode* o, std::function<bool ()> validator) {
       std::lock_guard l(lock);
       if (validator()) {
         _pin(o);
       }
     }
 
-    void unpin(Onode* o, std::function<bool()> validator) {
+    virtual void unpin(Onode* o, std::function<bool()> validator) {
       std::lock_guard l(lock);
       if (validator()) {
         _unpin(o);
       }
     }
 
+    /// true if onodes in use are pinned, i.e. taken out of the replacement
+    /// structure until unused; otherwise they stay cached and trim skips them
+    virtual bool pins_onodes() const {
+      return true;
+    }
+
     virtual void move_pinned(OnodeCacheShard *to, Onode *o) = 0;
     virtual void add_stats(uint64_t *onodes, uint64_t *pinned_onodes) = 0;
     bool empty() {
@@ -1254,6 +1304,8 @@ public:
     uint64_t buffer_bytes = 0;
 
   public:
+    bool lockless_read = false; ///< serve full hits from BufferSpace snapshots
+
     BufferCacheShard(CephContext* cct) : CacheShard(cct) {}
     static BufferCacheShard *create(CephContext* cct, std::string type, 
                                     PerfCounters *logger);
@@ -1296,13 +1348,21 @@ public:
     OnodeCacheShard *cache;
 
   private:
+    /// protects onode_map.  Taken after cache->lock where both are held;
+    /// a lookup in a cache that does not pin onodes takes only this one,
+    /// shared, so cache hits do not serialize on the shard lock.
+    ceph::shared_mutex map_lock =
+      ceph::make_shared_mutex("BlueStore::OnodeSpace::map_lock", true, false);
     /// forward lookups
     mempool::bluestore_cache_meta::unordered_map<ghobject_t,OnodeRef> onode_map;
 
     friend struct Collection; // for split_cache()
 
     friend struct LruOnodeCacheShard;
+    friend struct ClockOnodeCacheShard;
     void _remove(const ghobject_t& oid);
+    /// unmap o unless someone else holds a ref; returns the map's ref
+    OnodeRef _try_remove(Onode* o);
   public:
     OnodeSpace(OnodeCacheShard *c) : cache(c) {}
     ~OnodeSpace() {
@@ -1314,6 +1374,8 @@ public:
     void rename(OnodeRef& o, const ghobject_t& old_oid,
 		const ghobject_t& new_oid,
 		const mempool::bluestore_cache_meta::string& new_okey);
+    /// drop oid from the cache; the next lookup reads it from the kv store
+    void remove(const ghobject_t& oid);
     void clear();
     bool empty();
 
@@ -1327,6 +1389,27 @@ public:
   class OpSequencer;
   using OpSequencerRef = ceph::ref_t<OpSequencer>;
 
+  /// learns which classes of writes are worth compressing (adaptive mode)
+  struct CompressionEstimator {
+    static constexpr unsigned NUM_CLASSES = 64;
+    static constexpr uint32_t SCORE_MAX = 1024;
+    struct class_t {
+      // recent failure rate scaled to SCORE_MAX; updates may race, which
+      // only makes the average a little less exact
+      std::atomic<uint32_t> fail_score = {0};
+      std::atomic<uint32_t> skipped = {0};
+    };
+    std::array<class_t, NUM_CLASSES> classes;
+
+    static unsigned classify(const std::string& name, unsigned alloc_hints,
+			     uint64_t blob_length);
+    /// false if the class has been failing and this is not a probe
+    bool should_try(unsigned cls, unsigned probe_interval);
+    void record(unsigned cls, bool success);
+    /// Shannon entropy in bits per byte of a sample of bl
+    static double sample_entropy(const ceph::buffer::list& bl);
+  };
+
   struct Collection : public CollectionImpl {
     BlueStore *store;
     OpSequencerRef osr;
@@ -1334,6 +1417,10 @@ public:
     bluestore_cnode_t cnode;
     ceph::shared_mutex lock =
       ceph::make_shared_mutex("BlueStore::Collection::lock", true, false);
+    /// held from txc creation until the txc's kv updates are prepared,
+    /// so txcs queued by the store itself keep osr order with the OSD's
+    ceph::mutex prepare_lock =
+      ceph::make_mutex("BlueStore::Collection::prepare_lock");
 
     bool exists;
 
@@ -1347,6 +1434,15 @@ public:
     pool_opts_t pool_opts;
     ContextQueue *commit_queue;
 
+    CompressionEstimator compression_estimator;
+    /// the pool's compression_dictionary as last looked up, all under lock
+    std::string compression_dict_src;
+    Compressor::CompressionAlgorithm compression_dict_alg =
+      Compressor::COMP_ALG_NONE;
+    uint64_t compression_dict_gen = 0;
+    /// set once stored with the collection
+    Compressor::DictionaryRef compression_dict;
+
     OnodeCacheShard* get_onode_cache() const {
       return onode_map.cache;
     }
@@ -1828,14 +1924,15 @@ public:
     /// bytes of pending io for each deferred seq (may be 0)
     std::map<uint64_t,int> seq_bytes;
 
-    void _discard(CephContext *cct, uint64_t offset, uint64_t length);
+    /// drop pending bytes in the range; returns the number dropped
+    uint64_t _discard(CephContext *cct, uint64_t offset, uint64_t length);
     void _audit(CephContext *cct);
 
     DeferredBatch(CephContext *cct, OpSequencer *osr)
       : osr(osr), ioc(cct, this) {}
 
-    /// prepare a write
-    void prepare_write(CephContext *cct,
+    /// prepare a write; returns pending bytes it supersedes
+    uint64_t prepare_write(CephContext *cct,
 		       uint64_t seq, uint64_t offset, uint64_t length,
 		       ceph::buffer::list::const_iterator& p);
 
@@ -1886,6 +1983,14 @@ public:
       q.push_back(*txc);
     }
 
+    /// undo queue_new() for a txc that was never submitted
+    void drop_new(TransContext *txc) {
+      std::lock_guard l(qlock);
+      ceph_assert(!q.empty() && &q.back() == txc);
+      q.pop_back();
+      qcond.notify_all();
+    }
+
     void drain() {
       std::unique_lock l(qlock);
       while (!q.empty())
@@ -1986,15 +2091,50 @@ public:
       return NULL;
     }
   };
+  struct KVCommitThread : public Thread {
+    BlueStore *store;
+    explicit KVCommitThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_kv_commit_thread();
+      return NULL;
+    }
+  };
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
-    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
-    void *entry() {
-      store->_kv_finalize_thread();
+    size_t shard_id;
+    KVFinalizeThread(BlueStore *s, size_t id) : store(s), shard_id(id) {}
+    void *entry() override {
+      store->_kv_finalize_thread(shard_id);
       return NULL;
     }
   };
 
+  /// a batch of txcs (plus deferred cleanup) committed by one kv sync
+  struct KVCommitGroup {
+    std::deque<TransContext*> committing;   ///< submitted, awaiting sync
+    std::deque<DeferredBatch*> deferred_done;   ///< become stable after sync
+    std::deque<DeferredBatch*> deferred_stable; ///< keys removed by synct
+    KeyValueDB::Transaction synct;          ///< final txn forcing the sync
+    uint64_t new_nid_max = 0;
+    uint64_t new_blobid_max = 0;
+    ceph::mono_clock::time_point start;
+    ceph::mono_clock::time_point after_flush;
+  };
+
+  /// committed txcs are finalized by the shard owning their OpSequencer
+  struct KVFinalizeShard {
+    KVFinalizeThread thread;
+    ceph::mutex lock = ceph::make_mutex("BlueStore::KVFinalizeShard::lock");
+    ceph::condition_variable cond;
+    std::deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
+    std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
+    bool started = false;
+    bool stop = false;
+    bool in_progress = false;
+
+    KVFinalizeShard(BlueStore *s, size_t id) : thread(s, id) {}
+  };
+
   struct DBHistogram {
     struct value_dist {
       uint64_t count;
@@ -2044,6 +2184,7 @@ public:
   // members
 private:
   BlueFS *bluefs = nullptr;
+  FastTier *fast_tier = nullptr;  ///< copies of hot data on the db device
   bluefs_layout_t bluefs_layout;
   utime_t next_dump_on_bluefs_alloc_failure;
 
@@ -2093,23 +2234,45 @@ private:
   bool _kv_only = false;
   bool kv_sync_started = false;
   bool kv_stop = false;
-  bool kv_finalize_started = false;
-  bool kv_finalize_stop = false;
   std::deque<TransContext*> kv_queue;             ///< ready, already submitted
   std::deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
-  std::deque<TransContext*> kv_committing;        ///< currently syncing
   std::deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
+  std::deque<DeferredBatch*> deferred_stable_queue; ///< deferred ios done + stable
   bool kv_sync_in_progress = false;
 
-  KVFinalizeThread kv_finalize_thread;
-  ceph::mutex kv_finalize_lock = ceph::make_mutex("BlueStore::kv_finalize_lock");
-  ceph::condition_variable kv_finalize_cond;
-  std::deque<TransContext*> kv_committing_to_finalize;   ///< pending finalization
-  std::deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
-  bool kv_finalize_in_progress = false;
+  /// pipelined commit: build the next group while the previous one syncs
+  bool kv_sync_pipeline = false;
+  bool deferred_merge = false;  ///< coalesce deferred ops of each txc
+  KVCommitThread kv_commit_thread;
+  ceph::condition_variable kv_commit_cond;     ///< protected by kv_lock
+  std::deque<KVCommitGroup*> kv_commit_queue;  ///< built, waiting for sync
+  unsigned kv_commit_in_flight = 0;            ///< queued + syncing groups
+  bool kv_commit_started = false;
+  bool kv_commit_stop = false;
+
+  /// numa node of the underlying devices (-1 if unknown or mixed)
+  int numa_node = -1;
+  cpu_set_t numa_cpu_set;
+
+  std::vector<std::unique_ptr<KVFinalizeShard>> kv_finalize_shards;
+
+  /// workers compressing the blobs of _do_alloc_write (null: inline)
+  class CompressPool;
+  std::unique_ptr<CompressPool> compress_pool;
+
+  /// compression dictionaries loaded, by alg << 32 | id, and offered by
+  /// set_compression_dictionary(), by id
+  ceph::mutex compression_dict_lock =
+    ceph::make_mutex("BlueStore::compression_dict_lock");
+  std::map<uint64_t, Compressor::DictionaryRef> compression_dicts;
+  std::map<uint32_t, ceph::buffer::list> compression_dicts_offered;
+  /// bumped when a dictionary is offered
+  std::atomic<uint64_t> compression_dict_gen = {0};
 
   PerfCounters *logger = nullptr;
 
+  ceph::mutex removed_collections_lock =
+    ceph::make_mutex("BlueStore::removed_collections_lock");
   std::list<CollectionRef> removed_collections;
 
   ceph::shared_mutex debug_read_error_lock =
@@ -2186,6 +2349,7 @@ private:
     ceph::mutex lock = ceph::make_mutex("BlueStore::MempoolThread::lock");
     bool stop = false;
     std::shared_ptr<PriorityCache::PriCache> binned_kv_cache = nullptr;
+    std::map<std::string, std::shared_ptr<PriorityCache::PriCache>> kv_cf_caches;
     std::shared_ptr<PriorityCache::Manager> pcm = nullptr;
 
     struct MempoolCache : public PriorityCache::PriCache {
@@ -2321,6 +2485,54 @@ private:
     void _resize_shards(bool interval_stats);
   } mempool_thread;
 
+  /// rewrites fragmented objects in the background, see _defrag_object()
+  struct DefragThread : public Thread {
+    BlueStore *store;
+
+    ceph::condition_variable cond;
+    ceph::mutex lock = ceph::make_mutex("BlueStore::DefragThread::lock");
+    bool stop = false;
+    bool kick = false;       ///< start a pass now, idle or not
+    bool manual = false;     ///< current pass was requested via asok
+    bool running = false;    ///< a pass is in progress
+
+    // position of the current pass
+    std::vector<coll_t> pass_colls;
+    size_t pass_pos = 0;
+    ghobject_t pass_next;
+
+    uint64_t passes = 0;
+    uint64_t scanned = 0;
+    uint64_t rewritten = 0;
+    uint64_t rewritten_bytes = 0;
+    utime_t last_pass;
+
+    explicit DefragThread(BlueStore *s) : store(s) {}
+
+    void *entry() override;
+    void init() {
+      ceph_assert(stop == false);
+      create("bstore_defrag");
+    }
+    void shutdown() {
+      lock.lock();
+      stop = true;
+      cond.notify_all();
+      lock.unlock();
+      join();
+    }
+    void start_pass();
+    void stop_pass();
+    void dump(ceph::Formatter *f);
+
+  private:
+    void _reset_pass();
+    /// @return 1 at the end of the pass, 0 if not there yet, <0 to give up
+    int _step(unsigned max_objects);
+  } defrag_thread;
+  class DefragSocketHook;
+  DefragSocketHook *defrag_hook = nullptr;
+
 #ifdef WITH_BLKIN
   ZTracer::Endpoint trace_endpoint {"0.0.0.0", 0, "BlueStore"};
 #endif
@@ -2334,6 +2546,8 @@ private:
 
   int _open_path();
   void _close_path();
+  void _open_fast_tier();
+  void _close_fast_tier();
   int _open_fsid(bool create);
   int _lock_fsid();
   int _read_fsid(uuid_d *f);
@@ -2383,6 +2597,9 @@ private:
   int _create_alloc();
   int _init_alloc();
   void _close_alloc();
+  int _read_alloc_snapshot(uint64_t *num, uint64_t *bytes);
+  void _write_alloc_snapshot();
+  void _remove_alloc_snapshot();
   int _open_collections();
   void _fsck_collections(int64_t* errors);
   void _close_collections();
@@ -2419,6 +2636,13 @@ private:
   void _dump_alloc_on_failure();
 
   CollectionRef _get_collection(const coll_t& cid);
+
+  bool _defrag_wanted(OnodeRef& o, uint64_t offset, uint64_t length,
+		      bool force);
+  int _defrag_object(CollectionRef& c, const ghobject_t& oid, bool force,
+		     uint64_t *bytes);
+  void _txc_journal_deferred(TransContext *txc);
+  void _txc_throttle(TransContext *txc, mono_clock::time_point start);
   void _queue_reap_collection(CollectionRef& c);
   void _reap_collections();
   void _update_cache_logger();
@@ -2463,7 +2687,18 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
-  void _kv_finalize_thread();
+  void _kv_sync_commit(KVCommitGroup& g);
+  void _kv_commit_thread();
+  void _set_numa_affinity();
+  bool _is_numa_remote() const {
+    if (numa_node < 0) {
+      return false;
+    }
+    int cpu = sched_getcpu();
+    return cpu >= 0 && cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &numa_cpu_set);
+  }
+  void _kv_finalize_queue(KVCommitGroup& g);
+  void _kv_finalize_thread(size_t shard_id);
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc);
   void _deferred_queue(TransContext *txc);
@@ -2627,6 +2862,11 @@ public:
     return _fsck(FSCK_SHALLOW, true);
   }
 
+  /// rewrite an object into contiguous blobs if it is fragmented (or
+  /// unconditionally with force); returns 1 if it was rewritten
+  int defrag_object(CollectionHandle& ch, const ghobject_t& oid,
+		    bool force = false);
+
   void set_cache_shards(unsigned num) override;
   void dump_cache_stats(ceph::Formatter *f) override {
     int onode_count = 0, buffers_bytes = 0;
@@ -2696,6 +2936,9 @@ public:
   int set_collection_opts(
     CollectionHandle& c,
     const pool_opts_t& opts) override;
+  void set_compression_dictionary(
+    uint32_t id,
+    const ceph::buffer::list& raw) override;
   int stat(
     CollectionHandle &c,
     const ghobject_t& oid,
@@ -2767,10 +3010,12 @@ private:
     blobs2read_t& blobs2read);
 
 
+  /// tier_seq is 0, or FastTier::get_seq() to look in the fast tier first
   int _prepare_read_ioc(
     blobs2read_t& blobs2read,
     std::vector<ceph::buffer::list>* compressed_blob_bls,
-    IOContext* ioc);
+    IOContext* ioc,
+    uint64_t tier_seq);
 
   int _generate_read_result_bl(
     OnodeRef o,
@@ -2780,9 +3025,24 @@ private:
     std::vector<ceph::buffer::list>& compressed_blob_bls,
     blobs2read_t& blobs2read,
     bool buffered,
+    uint64_t tier_seq,
     bool* csum_error,
     ceph::buffer::list& bl);
 
+  uint64_t _get_tier_seq(int read_cache_policy) const {
+    if (!fast_tier || read_cache_policy == BufferSpace::BYPASS_CLEAN_CACHE) {
+      return 0;
+    }
+    return fast_tier->get_seq();
+  }
+  void _tier_note_read(const bluestore_blob_t& blob, uint64_t b_off,
+		       const ceph::buffer::list& bl, uint64_t tier_seq);
+  void _tier_invalidate(uint64_t offset, uint64_t length) {
+    if (fast_tier) {
+      fast_tier->invalidate(offset, length);
+    }
+  }
+
   int _do_read(
     Collection *c,
     OnodeRef o,
@@ -2912,6 +3172,17 @@ public:
     const ghobject_t &oid  ///< [in] object
     ) override;
 
+  int omap_get_batch(
+    CollectionHandle &c,               ///< [in] Collection containing oid
+    const ghobject_t &oid,             ///< [in] Object containing omap
+    const std::string &start_after,    ///< [in] Return keys after this one
+    const std::string &filter_prefix,  ///< [in] Return keys with this prefix
+    uint64_t max_count,                ///< [in] Max number of keys
+    uint64_t max_bytes,                ///< [in] Max key and value bytes
+    std::map<std::string, ceph::buffer::list> *out, ///< [out] Keys and values
+    bool *more                         ///< [out] More keys are left
+    ) override;
+
   void set_fsid(uuid_d u) override {
     fsid = u;
   }
@@ -2947,6 +3218,9 @@ public:
   const PerfCounters* get_bluefs_perf_counters() const {
     return bluefs->get_perf_counters();
   }
+  const PerfCounters* get_fast_tier_perf_counters() const {
+    return fast_tier ? fast_tier->get_perf_counters() : nullptr;
+  }
 
   int queue_transactions(
     CollectionHandle& ch,
@@ -3077,7 +3351,16 @@ private:
     uint64_t blob_xoffset,
     const ceph::buffer::list& bl,
     uint64_t logical_offset) const;
-  int _decompress(ceph::buffer::list& source, ceph::buffer::list* result);
+  int _decompress(Collection *c, ceph::buffer::list& source,
+		  ceph::buffer::list* result);
+  Compressor::DictionaryRef _get_write_compression_dict(TransContext *txc,
+							Collection *c,
+							CompressorRef& cp);
+  Compressor::DictionaryRef _get_compression_dict(Collection *c,
+						  CompressorRef& cp,
+						  uint32_t id);
+  void _copy_compression_dicts(TransContext *txc, const coll_t& from,
+			       const coll_t& to);
 
 
   // --------------------------------------------------------
@@ -3086,6 +3369,7 @@ private:
   struct WriteContext {
     bool buffered = false;          ///< buffered write
     bool compress = false;          ///< compressed write
+    bool compress_adaptive = false; ///< consult the compression estimator
     uint64_t target_blob_size = 0;  ///< target (max) blob size
     unsigned csum_order = 0;        ///< target checksum chunk order
 
@@ -3135,6 +3419,7 @@ private:
     void fork(const WriteContext& other) {
       buffered = other.buffered;
       compress = other.compress;
+      compress_adaptive = other.compress_adaptive;
       target_blob_size = other.target_blob_size;
       csum_order = other.csum_order;
     }
@@ -3427,7 +3712,39 @@ public:
     std::map<BlobRef, bluestore_blob_t::unused_t>* referenced,
     const BlueStore::FSCK_ObjectCtx& ctx);
 
+  /// progress of a running fsck, reported via the admin socket
+  struct fsck_progress_t {
+    std::atomic<const char*> phase = {nullptr};
+    std::atomic<uint64_t> objects = {0};       ///< object keys walked
+    std::atomic<uint64_t> deep_objects = {0};  ///< objects read back
+    std::atomic<uint64_t> deep_bytes = {0};
+    std::atomic<uint64_t> shared_blobs = {0};
+    utime_t start;
+
+    void reset() {
+      phase = nullptr;
+      objects = 0;
+      deep_objects = 0;
+      deep_bytes = 0;
+      shared_blobs = 0;
+      start = ceph_clock_now();
+    }
+    void dump(ceph::Formatter *f) const;
+  };
+
 private:
+  fsck_progress_t fsck_progress;
+  class FSCKSocketHook;
+  class FSCKDeepReadPool;
+
+  /// read all data of the object, verifying checksums; returns # of errors
+  int _fsck_deep_read(Collection* c, OnodeRef& o);
+
+  /// compare the freelist with used_blocks; returns # of errors
+  int64_t _fsck_check_freelist(mempool_dynamic_bitset& used_blocks,
+    const mempool_dynamic_bitset& bluefs_used_blocks,
+    BlueStoreRepairer* repairer);
+
   void _fsck_check_object_omap(FSCKDepth depth,
     OnodeRef& o,
     const BlueStore::FSCK_ObjectCtx& ctx);
@@ -0,0 +1,492 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "FastTier.h"
+
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/perf_counters.h"
+#include "include/intarith.h"
+#include "Allocator.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.tier "
+
+static const std::string TIER_DIR = "bluestore.tier";
+static const std::string TIER_FILE = "data";
+
+/*
+ * Enough history to decide about any read that is still in flight;
+ * older reads are simply not promoted.
+ */
+static constexpr size_t MAX_RECENT = 4096;
+
+/// cap on data waiting to be copied to the tier
+static constexpr uint64_t MAX_PENDING_BYTES = 64 << 20;
+
+FastTier::FastTier(CephContext *cct, BlueFS *bluefs)
+  : thread(this), cct(cct), bluefs(bluefs)
+{
+}
+
+FastTier::~FastTier()
+{
+  ceph_assert(!file);
+}
+
+void FastTier::_init_logger(uint64_t size)
+{
+  PerfCountersBuilder b(cct, "bluestore-tier",
+			l_bluestore_tier_first, l_bluestore_tier_last);
+  b.add_u64(l_bluestore_tier_total_bytes, "total_bytes",
+	    "Fast device space set aside for the data tier",
+	    nullptr, PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64(l_bluestore_tier_used_bytes, "used_bytes",
+	    "Fast device space holding copies of hot data",
+	    nullptr, PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
+  b.add_u64(l_bluestore_tier_extents, "extents",
+	    "Number of extents on the data tier");
+  b.add_u64_counter(l_bluestore_tier_hit, "hit",
+		    "Reads served from the fast device",
+		    nullptr, PerfCountersBuilder::PRIO_USEFUL);
+  b.add_u64_counter(l_bluestore_tier_hit_bytes, "hit_bytes",
+		    "Bytes read from the fast device instead of the main one",
+		    nullptr, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_tier_promote, "promote",
+		    "Extents copied to the fast device");
+  b.add_u64_counter(l_bluestore_tier_promote_bytes, "promote_bytes",
+		    "Bytes copied to the fast device",
+		    nullptr, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_tier_evict, "evict",
+		    "Cold extents dropped from the fast device");
+  b.add_u64_counter(l_bluestore_tier_invalidate, "invalidate",
+		    "Extents dropped from the fast device as overwritten or freed");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  logger->set(l_bluestore_tier_total_bytes, size);
+}
+
+void FastTier::_shutdown_logger()
+{
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  logger = nullptr;
+}
+
+int FastTier::open(uint64_t size, uint64_t bsize)
+{
+  ceph_assert(!file);
+  block_size = bsize;
+  size = p2align(size, block_size);
+  max_extent = p2align<uint64_t>(
+    cct->_conf.get_val<Option::size_t>("bluestore_fast_tier_max_extent"),
+    block_size);
+  if (size == 0 || max_extent == 0) {
+    return -EINVAL;
+  }
+
+  int r = 0;
+  if (!bluefs->dir_exists(TIER_DIR)) {
+    r = bluefs->mkdir(TIER_DIR);
+    if (r < 0) {
+      derr << __func__ << " mkdir " << TIER_DIR << ": " << cpp_strerror(r)
+	   << dendl;
+      return r;
+    }
+  }
+  // whatever a previous run left there is stale
+  r = bluefs->open_for_write(TIER_DIR, TIER_FILE, &file, false);
+  if (r < 0) {
+    derr << __func__ << " open " << TIER_DIR << "/" << TIER_FILE << ": "
+	 << cpp_strerror(r) << dendl;
+    file = nullptr;
+    return r;
+  }
+  r = bluefs->preallocate(file->file, 0, size);
+  for (auto& e : file->file->fnode.extents) {
+    if (r == 0 && e.bdev != BlueFS::BDEV_DB) {
+      // not worth it unless all of it is on the fast device
+      r = -ENOSPC;
+    }
+  }
+  if (r < 0) {
+    derr << __func__ << " can't get 0x" << std::hex << size << std::dec
+	 << " bytes on the db device: " << cpp_strerror(r) << dendl;
+    bluefs->close_writer(file);
+    file = nullptr;
+    bluefs->unlink(TIER_DIR, TIER_FILE);
+    return r;
+  }
+
+  alloc = Allocator::create(cct, "avl", size, block_size, "bluestore-tier");
+  ceph_assert(alloc);
+  alloc->init_add_free(0, size);
+  start = ceph::coarse_mono_clock::now();
+  stop = false;
+  _init_logger(size);
+  thread.create("bstore_tier");
+  dout(1) << __func__ << " 0x" << std::hex << size
+	  << " bytes, max extent 0x" << max_extent << std::dec << dendl;
+  return 0;
+}
+
+void FastTier::close()
+{
+  if (!file) {
+    return;
+  }
+  {
+    std::lock_guard l(heat_lock);
+    stop = true;
+    heat_cond.notify_all();
+  }
+  thread.join();
+
+  cached.clear();
+  pending.clear();
+  heat.clear();
+  recent.clear();
+  used = pending_bytes = 0;
+  alloc->shutdown();
+  delete alloc;
+  alloc = nullptr;
+  bluefs->close_writer(file);
+  file = nullptr;
+  bluefs->unlink(TIER_DIR, TIER_FILE);
+  _shutdown_logger();
+}
+
+bool FastTier::read(uint64_t offset, uint64_t length, bufferlist *bl)
+{
+  std::shared_lock l(lock);
+  if (cached.empty()) {
+    return false;
+  }
+  auto p = cached.upper_bound(offset);
+  if (p == cached.begin()) {
+    return false;
+  }
+  --p;
+  if (p->first + p->second.length < offset + length) {
+    return false;
+  }
+
+  // the extent can't be released while we hold the lock
+  bufferptr buf(ceph::buffer::create_small_page_aligned(length));
+  uint64_t x_off = offset - p->first;
+  uint64_t pos = 0;
+  for (auto& e : p->second.tier) {
+    if (x_off >= e.length) {
+      x_off -= e.length;
+      continue;
+    }
+    uint64_t l = std::min<uint64_t>(e.length - x_off, length - pos);
+    int r = bluefs->read_raw(file->file, e.offset + x_off,
+			     l, buf.c_str() + pos);
+    if (r < 0) {
+      derr << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << " failed: " << cpp_strerror(r) << dendl;
+      return false;
+    }
+    pos += l;
+    x_off = 0;
+    if (pos == length) {
+      break;
+    }
+  }
+  ceph_assert(pos == length);
+  p->second.referenced = true;
+  p->second.last_read = _now();
+  bl->append(std::move(buf));
+  logger->inc(l_bluestore_tier_hit);
+  logger->inc(l_bluestore_tier_hit_bytes, length);
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  return true;
+}
+
+bool FastTier::_overlaps_cached(uint64_t offset, uint64_t length)
+{
+  auto p = cached.lower_bound(offset > max_extent ? offset - max_extent : 0);
+  for (; p != cached.end() && p->first < offset + length; ++p) {
+    if (p->first + p->second.length > offset) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FastTier::note_read(uint64_t offset, const bufferlist& bl,
+			 uint64_t read_seq)
+{
+  uint64_t length = bl.length();
+  if (length > max_extent || length == 0 ||
+      p2phase(offset, block_size) || p2phase(length, block_size)) {
+    return;
+  }
+  auto promote_reads =
+    cct->_conf.get_val<uint64_t>("bluestore_fast_tier_promote_reads");
+
+  std::shared_lock l(lock);
+  if (_overlaps_cached(offset, length)) {
+    return;
+  }
+  std::lock_guard hl(heat_lock);
+  auto max_tracked =
+    cct->_conf.get_val<uint64_t>("bluestore_fast_tier_max_tracked");
+  if (heat.size() >= max_tracked && !heat.count(offset)) {
+    _decay();
+  }
+  heat_t& h = heat[offset];
+  if (h.length != length) {
+    h.length = length;
+    h.reads = 0;
+  }
+  if (++h.reads < promote_reads || pending.count(offset) ||
+      pending_bytes + length > MAX_PENDING_BYTES) {
+    return;
+  }
+
+  // the data may predate a write or release we've seen since
+  if (!recent.empty() && recent.front().seq > read_seq + 1) {
+    return;
+  }
+  for (auto i = recent.rbegin(); i != recent.rend() && i->seq > read_seq; ++i) {
+    if (i->offset < offset + length && offset < i->offset + i->length) {
+      return;
+    }
+  }
+
+  heat.erase(offset);
+  pending_t& q = pending[offset];
+  q.length = length;
+  q.id = ++next_pending_id;
+  // don't hold on to (or share) the caller's buffers
+  bufferptr buf(ceph::buffer::create_small_page_aligned(length));
+  bl.begin().copy(length, buf.c_str());
+  q.bl.append(std::move(buf));
+  pending_bytes += length;
+  heat_cond.notify_all();
+  dout(20) << __func__ << " queue 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+}
+
+void FastTier::invalidate(uint64_t offset, uint64_t length)
+{
+  std::unique_lock l(lock);
+  uint64_t end = offset + length;
+  auto p = cached.lower_bound(offset > max_extent ? offset - max_extent : 0);
+  while (p != cached.end() && p->first < end) {
+    if (p->first + p->second.length > offset) {
+      dout(20) << __func__ << " drop 0x" << std::hex << p->first << "~"
+	       << p->second.length << std::dec << dendl;
+      logger->inc(l_bluestore_tier_invalidate);
+      _release(p++);
+    } else {
+      ++p;
+    }
+  }
+
+  std::lock_guard hl(heat_lock);
+  recent.push_back({++seq, offset, length});
+  if (recent.size() > MAX_RECENT) {
+    recent.pop_front();
+  }
+  auto q = pending.lower_bound(offset > max_extent ? offset - max_extent : 0);
+  while (q != pending.end() && q->first < end) {
+    if (q->first + q->second.length > offset) {
+      pending_bytes -= q->second.length;
+      q = pending.erase(q);
+    } else {
+      ++q;
+    }
+  }
+}
+
+void FastTier::_release(std::map<uint64_t, extent_t>::iterator p)
+{
+  interval_set<uint64_t> release_set;
+  for (auto& e : p->second.tier) {
+    release_set.insert(e.offset, e.length);
+  }
+  alloc->release(release_set);
+  used -= p->second.length;
+  if (clock_hand == p->first) {
+    ++clock_hand;
+  }
+  cached.erase(p);
+  logger->set(l_bluestore_tier_used_bytes, used);
+  logger->set(l_bluestore_tier_extents, cached.size());
+}
+
+/*
+ * Second chance (clock) eviction: skip extents read since the hand last
+ * passed them.
+ */
+bool FastTier::_evict_one()
+{
+  // everything gets a second chance at most once
+  for (size_t n = 0; n <= 2 * cached.size(); ++n) {
+    auto p = cached.lower_bound(clock_hand);
+    if (p == cached.end()) {
+      p = cached.begin();
+    }
+    if (!p->second.referenced.exchange(false)) {
+      dout(20) << __func__ << " 0x" << std::hex << p->first << "~"
+	       << p->second.length << std::dec << dendl;
+      logger->inc(l_bluestore_tier_evict);
+      clock_hand = p->first;
+      _release(p);
+      return true;
+    }
+    clock_hand = p->first + 1;
+  }
+  return false;
+}
+
+void FastTier::_evict_cold(int64_t max_age)
+{
+  std::vector<uint64_t> cold;
+  int64_t cutoff = _now() - max_age;
+  {
+    std::shared_lock l(lock);
+    for (auto& [offset, e] : cached) {
+      if (e.last_read < cutoff) {
+	cold.push_back(offset);
+      }
+    }
+  }
+  if (cold.empty()) {
+    return;
+  }
+  std::unique_lock l(lock);
+  for (auto offset : cold) {
+    auto p = cached.find(offset);
+    if (p != cached.end() && p->second.last_read < cutoff) {
+      logger->inc(l_bluestore_tier_evict);
+      _release(p);
+    }
+  }
+  dout(10) << __func__ << " dropped up to " << cold.size()
+	   << " extents not read for " << max_age << "s" << dendl;
+}
+
+/// halve all read counts, forgetting what has not been read lately
+void FastTier::_decay()
+{
+  for (auto p = heat.begin(); p != heat.end(); ) {
+    p->second.reads /= 2;
+    if (p->second.reads == 0) {
+      p = heat.erase(p);
+    } else {
+      ++p;
+    }
+  }
+}
+
+bool FastTier::_promote_one()
+{
+  uint64_t offset, id;
+  bufferlist bl;
+  {
+    std::lock_guard hl(heat_lock);
+    if (pending.empty()) {
+      return false;
+    }
+    auto p = pending.begin();
+    offset = p->first;
+    id = p->second.id;
+    bl = p->second.bl;
+  }
+  uint64_t length = bl.length();
+
+  PExtentVector extents;
+  {
+    std::unique_lock l(lock);
+    while (true) {
+      int64_t got = alloc->allocate(length, block_size, 0, 0, &extents);
+      if (got == (int64_t)length) {
+	break;
+      }
+      if (got > 0) {
+	alloc->release(extents);
+	extents.clear();
+      }
+      if (!_evict_one()) {
+	break;
+      }
+    }
+  }
+
+  int r = extents.empty() ? -ENOSPC : 0;
+  uint64_t pos = 0;
+  for (auto& e : extents) {
+    if (r < 0) {
+      break;
+    }
+    bufferlist t;
+    t.substr_of(bl, pos, e.length);
+    r = bluefs->write_raw(file->file, e.offset, t);
+    pos += e.length;
+  }
+
+  std::unique_lock l(lock);
+  std::lock_guard hl(heat_lock);
+  auto p = pending.find(offset);
+  bool valid = p != pending.end() && p->second.id == id;
+  if (valid) {
+    pending_bytes -= p->second.length;
+    pending.erase(p);
+  }
+  if (r < 0 || !valid || _overlaps_cached(offset, length)) {
+    if (r < 0 && r != -ENOSPC) {
+      derr << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << " failed: " << cpp_strerror(r) << dendl;
+    }
+    if (!extents.empty()) {
+      alloc->release(extents);
+    }
+    return true;
+  }
+  cached.emplace(std::piecewise_construct,
+		 std::forward_as_tuple(offset),
+		 std::forward_as_tuple(length, std::move(extents), _now()));
+  used += length;
+  logger->inc(l_bluestore_tier_promote);
+  logger->inc(l_bluestore_tier_promote_bytes, length);
+  logger->set(l_bluestore_tier_used_bytes, used);
+  logger->set(l_bluestore_tier_extents, cached.size());
+  dout(20) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  return true;
+}
+
+void FastTier::_thread_entry()
+{
+  auto last_decay = ceph::coarse_mono_clock::now();
+  std::unique_lock hl(heat_lock);
+  while (!stop) {
+    if (pending.empty()) {
+      heat_cond.wait_for(hl, std::chrono::seconds(1));
+    }
+    if (stop) {
+      break;
+    }
+    hl.unlock();
+    while (_promote_one()) ;
+
+    auto decay_interval = ceph::make_timespan(
+      cct->_conf.get_val<double>("bluestore_fast_tier_decay_interval"));
+    auto now = ceph::coarse_mono_clock::now();
+    if (now - last_decay >= decay_interval) {
+      last_decay = now;
+      _evict_cold(
+	cct->_conf.get_val<double>("bluestore_fast_tier_cold_age"));
+      std::lock_guard l(heat_lock);
+      _decay();
+    }
+    hl.lock();
+  }
+}
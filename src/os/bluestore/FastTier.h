@@ -0,0 +1,152 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <unordered_map>
+
+#include "common/Thread.h"
+#include "common/ceph_mutex.h"
+#include "common/ceph_time.h"
+#include "include/buffer.h"
+#include "include/common_fwd.h"
+#include "bluestore_types.h"
+#include "BlueFS.h"
+
+class Allocator;
+
+enum {
+  l_bluestore_tier_first = 732700,
+  l_bluestore_tier_total_bytes,
+  l_bluestore_tier_used_bytes,
+  l_bluestore_tier_extents,
+  l_bluestore_tier_hit,
+  l_bluestore_tier_hit_bytes,
+  l_bluestore_tier_promote,
+  l_bluestore_tier_promote_bytes,
+  l_bluestore_tier_evict,
+  l_bluestore_tier_invalidate,
+  l_bluestore_tier_last
+};
+
+/*
+ * Read tier on the fast (DB) device.
+ *
+ * Small extents of the main device that are read over and over are
+ * copied into a preallocated BlueFS file and served from there.  The
+ * main device keeps the authoritative copy: writing to or releasing main
+ * device space drops the copies it overlaps, and demoting a cold extent
+ * just means dropping its copy.  Nothing here is persistent, the file is
+ * recreated on every mount.
+ *
+ * Extents are promoted from data the read path has already read and
+ * verified, never by reading the main device behind BlueStore's back.
+ * A read started before an overlapping invalidation is not promoted.
+ */
+class FastTier {
+public:
+  FastTier(CephContext *cct, BlueFS *bluefs);
+  ~FastTier();
+
+  int open(uint64_t size, uint64_t block_size);
+  void close();
+
+  /// pass this to note_read() for data read from the main device from now on
+  uint64_t get_seq() const {
+    return seq;
+  }
+
+  /// fill bl with main device range offset~length if the tier has all of it
+  bool read(uint64_t offset, uint64_t length, ceph::buffer::list *bl);
+
+  /// account for a verified read of main device data issued at read_seq
+  void note_read(uint64_t offset, const ceph::buffer::list& bl,
+		 uint64_t read_seq);
+
+  /// main device range is about to be overwritten or has been released
+  void invalidate(uint64_t offset, uint64_t length);
+
+  const PerfCounters* get_perf_counters() const {
+    return logger;
+  }
+
+private:
+  struct extent_t {
+    uint32_t length;
+    PExtentVector tier;               ///< where the copy lives in the file
+    std::atomic<bool> referenced = {true};
+    std::atomic<int64_t> last_read;   ///< coarse seconds since open
+
+    extent_t(uint32_t l, PExtentVector&& t, int64_t now)
+      : length(l), tier(std::move(t)), last_read(now) {}
+  };
+  struct pending_t {
+    uint32_t length;
+    uint64_t id;
+    ceph::buffer::list bl;
+  };
+  struct heat_t {
+    uint32_t length = 0;
+    uint32_t reads = 0;
+  };
+  struct invalidation_t {
+    uint64_t seq;
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  struct TierThread : public Thread {
+    FastTier *tier;
+    explicit TierThread(FastTier *t) : tier(t) {}
+    void *entry() override {
+      tier->_thread_entry();
+      return nullptr;
+    }
+  } thread;
+
+  CephContext *cct;
+  BlueFS *bluefs;
+  PerfCounters *logger = nullptr;
+
+  BlueFS::FileWriter *file = nullptr;
+  Allocator *alloc = nullptr;
+  uint64_t block_size = 0;
+  uint64_t max_extent = 0;  ///< fixed at open, bounds every extent length
+  ceph::coarse_mono_time start;
+
+  /// protects cached and tier space; shared while reading from the tier
+  ceph::shared_mutex lock =
+    ceph::make_shared_mutex("FastTier::lock");
+  std::map<uint64_t, extent_t> cached;  ///< by main device offset
+  uint64_t clock_hand = 0;              ///< eviction position in cached
+  uint64_t used = 0;
+
+  /// protects everything below; nests inside lock
+  ceph::mutex heat_lock = ceph::make_mutex("FastTier::heat_lock");
+  ceph::condition_variable heat_cond;
+  bool stop = false;
+  std::atomic<uint64_t> seq = {1};
+  std::deque<invalidation_t> recent;    ///< latest invalidations, by seq
+  std::unordered_map<uint64_t, heat_t> heat;
+  std::map<uint64_t, pending_t> pending;
+  uint64_t pending_bytes = 0;
+  uint64_t next_pending_id = 0;
+
+  int64_t _now() const {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+      ceph::coarse_mono_clock::now() - start).count();
+  }
+  void _init_logger(uint64_t size);
+  void _shutdown_logger();
+
+  void _thread_entry();
+  bool _promote_one();
+  void _decay();
+  void _evict_cold(int64_t max_age);
+  bool _evict_one();
+  void _release(std::map<uint64_t, extent_t>::iterator p);
+  bool _overlaps_cached(uint64_t offset, uint64_t length);
+};
@@ -0,0 +1,311 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "SizeClassAllocator.h"
+
+#include <limits>
+
+#include "common/config_proxy.h"
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef  dout_prefix
+#define dout_prefix *_dout << "SizeClassAllocator "
+
+namespace {
+  // a light-weight "range_seg_t", only used as the search key
+  struct range_t {
+    uint64_t start;
+    uint64_t end;
+  };
+}
+
+SizeClassAllocator::SizeClassAllocator(CephContext* cct,
+				       int64_t device_size,
+				       int64_t block_size,
+				       const std::string& name) :
+  Allocator(name),
+  cct(cct),
+  block_size(block_size),
+  large_threshold(
+    cct->_conf.get_val<Option::size_t>("bluestore_sizeclass_alloc_large_threshold"))
+{}
+
+SizeClassAllocator::~SizeClassAllocator()
+{
+  shutdown();
+}
+
+/*
+ * Lowest offset extent in the smallest size class that can hold size
+ * bytes at unit alignment.
+ */
+bool SizeClassAllocator::_pick_fit(uint64_t size, uint64_t unit,
+				   uint64_t *offset)
+{
+  for (unsigned c = _class_of(size); c < NUM_CLASSES; ++c) {
+    unsigned scanned = 0;
+    for (auto& rs : classes[c]) {
+      uint64_t start = p2roundup(rs.start, unit);
+      if (start + size <= rs.end) {
+	*offset = start;
+	return true;
+      }
+      // extents in the higher classes are long enough as a rule, only
+      // alignment may get in the way; don't walk a crowded class forever
+      if (++scanned >= MAX_CLASS_SCAN) {
+	break;
+      }
+    }
+  }
+  return false;
+}
+
+/*
+ * Nothing can hold the request as a whole: return the first unit aligned
+ * piece of the largest size class that has one.
+ */
+bool SizeClassAllocator::_pick_largest(uint64_t unit, uint64_t *offset,
+				       uint64_t *length)
+{
+  for (int c = NUM_CLASSES - 1; c >= 0; --c) {
+    if (c < (int)NUM_CLASSES - 1 && ((2ull << c) - 1) * block_size < unit) {
+      // neither this class nor the smaller ones can hold a unit
+      break;
+    }
+    unsigned scanned = 0;
+    for (auto& rs : classes[c]) {
+      uint64_t start = p2roundup(rs.start, unit);
+      if (start < rs.end && rs.end - start >= unit) {
+	*offset = start;
+	*length = p2align(rs.end - start, unit);
+	return true;
+      }
+      if (++scanned >= MAX_CLASS_SCAN) {
+	break;
+      }
+    }
+  }
+  return false;
+}
+
+void SizeClassAllocator::_add_to_tree(uint64_t start, uint64_t size)
+{
+  ceph_assert(size != 0);
+
+  uint64_t end = start + size;
+
+  auto rs_after = range_tree.upper_bound(range_t{start, end},
+					 range_tree.key_comp());
+
+  /* Make sure we don't overlap with either of our neighbors */
+  auto rs_before = range_tree.end();
+  if (rs_after != range_tree.begin()) {
+    rs_before = std::prev(rs_after);
+  }
+
+  bool merge_before = (rs_before != range_tree.end() && rs_before->end == start);
+  bool merge_after = (rs_after != range_tree.end() && rs_after->start == end);
+
+  if (merge_before && merge_after) {
+    _class_rm(*rs_before);
+    _class_rm(*rs_after);
+    rs_after->start = rs_before->start;
+    range_tree.erase_and_dispose(rs_before, dispose_rs{});
+    _class_insert(*rs_after);
+  } else if (merge_before) {
+    _class_rm(*rs_before);
+    rs_before->end = end;
+    _class_insert(*rs_before);
+  } else if (merge_after) {
+    _class_rm(*rs_after);
+    rs_after->start = start;
+    _class_insert(*rs_after);
+  } else {
+    auto rs = new range_seg_t{start, end};
+    range_tree.insert_before(rs_after, *rs);
+    _class_insert(*rs);
+  }
+}
+
+void SizeClassAllocator::_remove_from_tree(uint64_t start, uint64_t size)
+{
+  uint64_t end = start + size;
+
+  ceph_assert(size != 0);
+  ceph_assert(size <= num_free);
+
+  auto rs = range_tree.find(range_t{start, end}, range_tree.key_comp());
+  /* Make sure we completely overlap with someone */
+  ceph_assert(rs != range_tree.end());
+  ceph_assert(rs->start <= start);
+  ceph_assert(rs->end >= end);
+
+  bool left_over = (rs->start != start);
+  bool right_over = (rs->end != end);
+
+  _class_rm(*rs);
+
+  if (left_over && right_over) {
+    auto tail = new range_seg_t{end, rs->end};
+    rs->end = start;
+    range_tree.insert_before(std::next(rs), *tail);
+    _class_insert(*tail);
+    _class_insert(*rs);
+  } else if (left_over) {
+    rs->end = start;
+    _class_insert(*rs);
+  } else if (right_over) {
+    rs->start = end;
+    _class_insert(*rs);
+  } else {
+    range_tree.erase_and_dispose(rs, dispose_rs{});
+  }
+}
+
+int64_t SizeClassAllocator::_allocate(
+  uint64_t want,
+  uint64_t unit,
+  uint64_t max_alloc_size,
+  PExtentVector *extents)
+{
+  uint64_t allocated = 0;
+  while (allocated < want) {
+    uint64_t left = want - allocated;
+    uint64_t size = left >= large_threshold ?
+      left : std::min(left, max_alloc_size);
+    uint64_t offset, length = size;
+    if (!_pick_fit(size, unit, &offset)) {
+      if (!_pick_largest(unit, &offset, &length)) {
+	break;
+      }
+      length = std::min(length, size);
+    }
+    ldout(cct, 20) << __func__ << std::hex
+		   << " size 0x" << size
+		   << " got 0x" << offset << "~" << length
+		   << std::dec << dendl;
+    _remove_from_tree(offset, length);
+    for (uint64_t pos = 0; pos < length; pos += max_alloc_size) {
+      extents->emplace_back(offset + pos, std::min(max_alloc_size,
+						   length - pos));
+    }
+    allocated += length;
+  }
+  return allocated ? allocated : -ENOSPC;
+}
+
+int64_t SizeClassAllocator::allocate(
+  uint64_t want,
+  uint64_t unit,
+  uint64_t max_alloc_size,
+  int64_t  hint, // unused
+  PExtentVector* extents)
+{
+  ldout(cct, 10) << __func__ << std::hex
+                 << " want 0x" << want
+                 << " unit 0x" << unit
+                 << " max_alloc_size 0x" << max_alloc_size
+                 << " hint 0x" << hint
+                 << std::dec << dendl;
+  ceph_assert(isp2(unit));
+  ceph_assert(want % unit == 0);
+
+  if (max_alloc_size == 0) {
+    max_alloc_size = want;
+  }
+  if (constexpr auto cap = std::numeric_limits<decltype(bluestore_pextent_t::length)>::max();
+      max_alloc_size >= cap) {
+    max_alloc_size = p2align(uint64_t(cap), (uint64_t)block_size);
+  }
+  std::lock_guard l(lock);
+  return _allocate(want, unit, max_alloc_size, extents);
+}
+
+void SizeClassAllocator::release(const interval_set<uint64_t>& release_set)
+{
+  std::lock_guard l(lock);
+  for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+    const auto offset = p.get_start();
+    const auto length = p.get_len();
+    ldout(cct, 10) << __func__ << std::hex
+      << " offset 0x" << offset
+      << " length 0x" << length
+      << std::dec << dendl;
+    _add_to_tree(offset, length);
+  }
+}
+
+uint64_t SizeClassAllocator::get_free()
+{
+  std::lock_guard l(lock);
+  return num_free;
+}
+
+double SizeClassAllocator::get_fragmentation()
+{
+  std::lock_guard l(lock);
+  return _get_fragmentation();
+}
+
+void SizeClassAllocator::dump()
+{
+  std::lock_guard l(lock);
+  ldout(cct, 0) << __func__ << " range_tree: " << dendl;
+  for (auto& rs : range_tree) {
+    ldout(cct, 0) << std::hex
+      << "0x" << rs.start << "~" << rs.end
+      << std::dec
+      << dendl;
+  }
+  for (unsigned c = 0; c < NUM_CLASSES; ++c) {
+    if (!classes[c].empty()) {
+      ldout(cct, 0) << __func__ << " class " << c
+		    << " extents " << classes[c].size() << dendl;
+    }
+  }
+}
+
+void SizeClassAllocator::dump(std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard l(lock);
+  for (auto& rs : range_tree) {
+    notify(rs.start, rs.end - rs.start);
+  }
+}
+
+void SizeClassAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard l(lock);
+  ldout(cct, 10) << __func__ << std::hex
+                 << " offset 0x" << offset
+                 << " length 0x" << length
+                 << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+void SizeClassAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard l(lock);
+  ldout(cct, 10) << __func__ << std::hex
+                 << " offset 0x" << offset
+                 << " length 0x" << length
+                 << std::dec << dendl;
+  _remove_from_tree(offset, length);
+}
+
+void SizeClassAllocator::_shutdown()
+{
+  for (auto& c : classes) {
+    c.clear();
+  }
+  range_tree.clear_and_dispose(dispose_rs{});
+  num_free = 0;
+}
+
+void SizeClassAllocator::shutdown()
+{
+  std::lock_guard l(lock);
+  _shutdown();
+}
@@ -0,0 +1,139 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include <mutex>
+#include <boost/intrusive/avl_set.hpp>
+
+#include "Allocator.h"
+#include "AvlAllocator.h"
+#include "os/bluestore/bluestore_types.h"
+
+/*
+ * Segregated fit allocator.
+ *
+ * Free extents are kept in an offset ordered tree, used for merging on
+ * release, and in one offset ordered list per power of two size class.
+ *
+ * Small requests are served from the smallest size class that can hold
+ * them, lowest offset first, so they fill the holes left behind by
+ * earlier releases instead of cutting into long free runs.  Requests of
+ * at least large_threshold bytes are carved out of a single free extent
+ * as a whole whenever one is big enough, and only then split into
+ * max_alloc_size pieces, so big writes end up physically contiguous.
+ */
+class SizeClassAllocator : public Allocator {
+  struct dispose_rs {
+    void operator()(range_seg_t* p)
+    {
+      delete p;
+    }
+  };
+
+public:
+  SizeClassAllocator(CephContext* cct, int64_t device_size,
+		     int64_t block_size, const std::string& name);
+  ~SizeClassAllocator();
+
+  int64_t allocate(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    int64_t  hint,
+    PExtentVector *extents) override;
+  void release(const interval_set<uint64_t>& release_set) override;
+  uint64_t get_free() override;
+  double get_fragmentation() override;
+
+  void dump() override;
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify) override;
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+  void shutdown() override;
+
+private:
+  using range_tree_t =
+    boost::intrusive::avl_set<
+      range_seg_t,
+      boost::intrusive::compare<range_seg_t::before_t>,
+      boost::intrusive::member_hook<
+	range_seg_t,
+	boost::intrusive::avl_set_member_hook<>,
+	&range_seg_t::offset_hook>>;
+  range_tree_t range_tree;    ///< all free extents, by offset
+
+  // range_seg_t::size_hook links an extent into its size class list
+  using class_list_t =
+    boost::intrusive::avl_set<
+      range_seg_t,
+      boost::intrusive::compare<range_seg_t::before_t>,
+      boost::intrusive::member_hook<
+	range_seg_t,
+	boost::intrusive::avl_set_member_hook<>,
+	&range_seg_t::size_hook>,
+      boost::intrusive::constant_time_size<true>>;
+
+  /*
+   * Class N holds extents of [2^N, 2^(N+1)) blocks; the last class takes
+   * everything larger.
+   */
+  static constexpr unsigned NUM_CLASSES = 24;
+  class_list_t classes[NUM_CLASSES];
+
+  /*
+   * How many too-short or misaligned extents to step over in a class
+   * before moving on to the next one.
+   */
+  static constexpr unsigned MAX_CLASS_SCAN = 64;
+
+  CephContext* cct;
+  std::mutex lock;
+
+  const uint64_t block_size; ///< block size
+  uint64_t num_free = 0;     ///< total bytes in freelist
+
+  /*
+   * Requests of this size or larger are allocated as one contiguous run
+   * when possible.
+   */
+  uint64_t large_threshold = 0;
+
+  unsigned _class_of(uint64_t length) const {
+    uint64_t blocks = length / block_size;
+    if (blocks == 0) {
+      return 0;
+    }
+    return std::min<unsigned>(cbits(blocks) - 1, NUM_CLASSES - 1);
+  }
+  void _class_insert(range_seg_t& rs) {
+    classes[_class_of(rs.length())].insert(rs);
+    num_free += rs.length();
+  }
+  void _class_rm(range_seg_t& rs) {
+    ceph_assert(num_free >= rs.length());
+    num_free -= rs.length();
+    classes[_class_of(rs.length())].erase(rs);
+  }
+
+  bool _pick_fit(uint64_t size, uint64_t unit, uint64_t *offset);
+  bool _pick_largest(uint64_t unit, uint64_t *offset, uint64_t *length);
+
+  void _add_to_tree(uint64_t start, uint64_t size);
+  void _remove_from_tree(uint64_t start, uint64_t size);
+
+  int64_t _allocate(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    PExtentVector *extents);
+
+  double _get_fragmentation() const {
+    auto free_blocks = p2align(num_free, block_size) / block_size;
+    if (free_blocks <= 1) {
+      return .0;
+    }
+    return (static_cast<double>(range_tree.size() - 1) / (free_blocks - 1));
+  }
+  void _shutdown();
+};
@@ -1153,6 +1153,71 @@ void bluestore_deferred_transaction_t::dump(Formatter *f) const
   f->close_section();
 }
 
+uint64_t bluestore_deferred_transaction_t::coalesce()
+{
+  if (ops.size() < 2) {
+    return 0;
+  }
+  uint64_t superseded = 0;
+  std::map<uint64_t, bufferlist> m;  // offset -> data, non-overlapping
+  for (auto& op : ops) {
+    ceph_assert(op.op == bluestore_deferred_op_t::OP_WRITE);
+    auto p = op.data.cbegin();
+    for (auto& e : op.extents) {
+      uint64_t end = e.offset + e.length;
+      auto q = m.lower_bound(e.offset);
+      if (q != m.begin()) {
+	auto h = std::prev(q);
+	uint64_t hend = h->first + h->second.length();
+	if (hend > e.offset) {
+	  if (hend > end) {
+	    bufferlist tail;
+	    tail.substr_of(h->second, end - h->first, hend - end);
+	    m[end].swap(tail);
+	    superseded += e.length;
+	  } else {
+	    superseded += hend - e.offset;
+	  }
+	  bufferlist head;
+	  head.substr_of(h->second, 0, e.offset - h->first);
+	  h->second.swap(head);
+	}
+      }
+      while (q != m.end() && q->first < end) {
+	uint64_t qend = q->first + q->second.length();
+	if (qend > end) {
+	  bufferlist tail;
+	  tail.substr_of(q->second, end - q->first, qend - end);
+	  superseded += end - q->first;
+	  m.erase(q);
+	  m[end].swap(tail);
+	  break;
+	}
+	superseded += q->second.length();
+	q = m.erase(q);
+      }
+      p.copy(e.length, m[e.offset]);
+    }
+  }
+
+  bluestore_deferred_op_t merged;
+  merged.op = bluestore_deferred_op_t::OP_WRITE;
+  for (auto& [offset, bl] : m) {
+    if (!merged.extents.empty() &&
+	merged.extents.back().end() == offset &&
+	merged.extents.back().length + (uint64_t)bl.length() <=
+	  std::numeric_limits<uint32_t>::max()) {
+      merged.extents.back().length += bl.length();
+    } else {
+      merged.extents.emplace_back(offset, bl.length());
+    }
+    merged.data.claim_append(bl);
+  }
+  ops.clear();
+  ops.push_back(std::move(merged));
+  return superseded;
+}
+
 void bluestore_deferred_transaction_t::generate_test_instances(list<bluestore_deferred_transaction_t*>& o)
 {
   o.push_back(new bluestore_deferred_transaction_t());
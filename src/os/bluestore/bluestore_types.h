@@ -1064,6 +1064,11 @@ struct bluestore_deferred_transaction_t {
 
   bluestore_deferred_transaction_t() : seq(0) {}
 
+  /// fold all writes into a single op: later writes replace overlapped
+  /// bytes of earlier ones and adjacent extents are joined.  returns the
+  /// number of superseded bytes that no longer need to be logged/written.
+  uint64_t coalesce();
+
   DENC(bluestore_deferred_transaction_t, v, p) {
     DENC_START(1, 1, p);
     denc(v.seq, p);
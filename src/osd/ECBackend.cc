@@ -136,6 +136,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::ReadOp &rhs)
 	     << ", priority=" << rhs.priority
 	     << ", obj_to_source=" << rhs.obj_to_source
 	     << ", source_to_obj=" << rhs.source_to_obj
+	     << ", hedge_shards=" << rhs.hedge_shards
 	     << ", in_progress=" << rhs.in_progress << ")";
 }
 
@@ -150,6 +151,7 @@ void ECBackend::ReadOp::dump(Formatter *f) const
   f->dump_int("priority", priority);
   f->dump_stream("obj_to_source") << obj_to_source;
   f->dump_stream("source_to_obj") << source_to_obj;
+  f->dump_stream("hedge_shards") << hedge_shards;
   f->dump_stream("in_progress") << in_progress;
 }
 
@@ -174,6 +176,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
       << " plan.will_write=" << rhs.plan.will_write
+      << " plan.delta_shards=" << rhs.plan.delta_shards
       << ")";
   return lhs;
 }
@@ -1248,9 +1251,11 @@ void ECBackend::handle_sub_read_reply(
   ceph_assert(rop.in_progress.count(from));
   rop.in_progress.erase(from);
   unsigned is_complete = 0;
-  // For redundant reads check for completion as each shard comes in,
-  // or in a non-recovery read check for completion once all the shards read.
-  if (rop.do_redundant_reads || rop.in_progress.empty()) {
+  // For redundant or hedged reads check for completion as each shard comes
+  // in, or in a non-recovery read check for completion once all the shards
+  // read.
+  if (rop.do_redundant_reads || !rop.hedge_shards.empty() ||
+      rop.in_progress.empty()) {
     for (map<hobject_t, read_result_t>::const_iterator iter =
         rop.complete.begin();
       iter != rop.complete.end();
@@ -1308,6 +1313,15 @@ void ECBackend::handle_sub_read_reply(
   }
   if (rop.in_progress.empty() || is_complete == rop.complete.size()) {
     dout(20) << __func__ << " Complete: " << rop << dendl;
+    if (!rop.hedge_shards.empty()) {
+      for (auto &&i : rop.in_progress) {
+	if (!rop.hedge_shards.count(i)) {
+	  // a shard of the minimum set is still being read
+	  get_parent()->get_logger()->inc(l_osd_ec_hedged_read_helped);
+	  break;
+	}
+      }
+    }
     rop.trace.event("ec read complete");
     complete_read_op(rop, m);
   } else {
@@ -1649,6 +1663,31 @@ int ECBackend::get_min_avail_to_read_shards(
   return 0;
 }
 
+void ECBackend::get_hedge_shards(
+  const hobject_t &hoid,
+  unsigned count,
+  map<pg_shard_t, vector<pair<int, int>>> *to_read,
+  set<pg_shard_t> *hedge_shards)
+{
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  set<pg_shard_t> error_shards;
+
+  get_all_avail_shards(hoid, error_shards, have, shards, false);
+
+  vector<pair<int, int>> subchunks;
+  subchunks.push_back(make_pair(0, ec_impl->get_sub_chunk_count()));
+  for (auto &&i : shards) {
+    if (!count)
+      break;
+    if (to_read->count(i.second))
+      continue;
+    to_read->insert(make_pair(i.second, subchunks));
+    hedge_shards->insert(i.second);
+    --count;
+  }
+}
+
 int ECBackend::get_remaining_shards(
   const hobject_t &hoid,
   const set<int> &avail,
@@ -1701,7 +1740,8 @@ void ECBackend::start_read_op(
   map<hobject_t, read_request_t> &to_read,
   OpRequestRef _op,
   bool do_redundant_reads,
-  bool for_recovery)
+  bool for_recovery,
+  set<pg_shard_t> &&hedge_shards)
 {
   ceph_tid_t tid = get_parent()->get_tid();
   ceph_assert(!tid_to_read_map.count(tid));
@@ -1714,7 +1754,8 @@ void ECBackend::start_read_op(
       for_recovery,
       _op,
       std::move(want_to_read),
-      std::move(to_read))).first->second;
+      std::move(to_read),
+      std::move(hedge_shards))).first->second;
   dout(10) << __func__ << ": starting " << op << dendl;
   if (_op) {
     op.trace = _op->pg_trace;
@@ -1896,7 +1937,18 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
-  if (!pipeline_state.caching_enabled()) {
+  if (op->requires_rmw() && write_in_flight_overlaps(*op, true)) {
+    dout(20) << __func__ << ": blocking " << *op
+	     << " because it reads stripes that a parity delta write"
+	     << " in flight is changing"
+	     << dendl;
+    return false;
+  }
+
+  bool parity_delta = op->requires_rmw() && try_parity_delta(op);
+  if (parity_delta) {
+    op->using_cache = false;
+  } else if (!pipeline_state.caching_enabled()) {
     op->using_cache = false;
   } else if (op->invalidates_cache()) {
     dout(20) << __func__ << ": invalidating cache after this op"
@@ -1907,7 +1959,9 @@ bool ECBackend::try_state_to_reads()
   waiting_state.pop_front();
   waiting_reads.push_back(*op);
 
-  if (op->using_cache) {
+  if (parity_delta) {
+    op->remote_read = op->plan.to_read;
+  } else if (op->using_cache) {
     cache.open_write_pin(op->pin);
 
     extent_set empty;
@@ -1940,7 +1994,9 @@ bool ECBackend::try_state_to_reads()
 
   dout(10) << __func__ << ": " << *op << dendl;
 
-  if (!op->remote_read.empty()) {
+  if (parity_delta) {
+    read_parity_delta_shards(op);
+  } else if (!op->remote_read.empty()) {
     ceph_assert(get_parent()->get_pool().allows_ecoverwrites());
     objects_read_async_no_cache(
       op->remote_read,
@@ -2003,6 +2059,7 @@ bool ECBackend::try_reads_to_commit()
       get_parent()->get_info().pgid.pgid,
       sinfo,
       op->remote_read_result,
+      op->delta_read_result,
       op->log_entries,
       &written,
       &trans,
@@ -2041,6 +2098,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read_result.clear();
 
   ObjectStore::Transaction empty;
   bool should_write_local = false;
@@ -2174,6 +2232,144 @@ void ECBackend::check_ops()
 	 try_finish_rmw());
 }
 
+bool ECBackend::write_in_flight_overlaps(const Op &op, bool delta_only) const
+{
+  for (const op_list *l : { &waiting_reads, &waiting_commit }) {
+    for (auto &&i : *l) {
+      for (auto &&hpair : op.plan.to_read) {
+	if (delta_only && !i.plan.delta_shards.count(hpair.first))
+	  continue;
+	auto witer = i.plan.will_write.find(hpair.first);
+	if (witer == i.plan.will_write.end())
+	  continue;
+	extent_set overlap;
+	overlap.intersection_of(witer->second, hpair.second);
+	if (!overlap.empty())
+	  return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool ECBackend::try_parity_delta(Op *op)
+{
+  if (!cct->_conf.get_val<bool>("osd_ec_parity_delta_writes") ||
+      !get_parent()->get_pool().allows_ecoverwrites() ||
+      op->invalidates_cache() ||
+      !ec_impl->supports_parity_delta() ||
+      !ec_impl->get_chunk_mapping().empty() ||
+      ec_impl->get_sub_chunk_count() != 1)
+    return false;
+  // the extent cache has the new content of the stripes other writes
+  // in flight are changing, the shards do not yet
+  if (write_in_flight_overlaps(*op, false))
+    return false;
+  if (!ECTransaction::plan_parity_delta(
+	sinfo, ec_impl->get_coding_chunk_count(), &(op->plan)))
+    return false;
+  dout(20) << __func__ << ": " << *op << dendl;
+  return true;
+}
+
+struct OnParityDeltaReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ECBackend::Op *op;
+  hobject_t hoid;
+  OnParityDeltaReadComplete(ECBackend *ec, ECBackend::Op *op,
+			    const hobject_t &hoid)
+    : ec(ec), op(op), hoid(hoid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ec->handle_parity_delta_read(op, hoid, in.second);
+  }
+};
+
+void ECBackend::read_parity_delta_shards(Op *op)
+{
+  map<hobject_t, set<int>> want_to_read;
+  map<hobject_t, read_request_t> for_read_op;
+  for (auto &&hpair : op->plan.delta_shards) {
+    set<int> want = hpair.second;
+    for (unsigned i = ec_impl->get_data_chunk_count();
+	 i < ec_impl->get_chunk_count();
+	 ++i) {
+      want.insert(i);
+    }
+    // normally exactly want, unless some of them must be decoded
+    map<pg_shard_t, vector<pair<int, int>>> shards;
+    int r = get_min_avail_to_read_shards(
+      hpair.first,
+      want,
+      false,
+      false,
+      &shards);
+    ceph_assert(r == 0);
+
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+    for (auto extent : op->remote_read.at(hpair.first)) {
+      to_read.push_back(boost::make_tuple(extent.first, extent.second, 0));
+    }
+    for_read_op.insert(
+      make_pair(
+	hpair.first,
+	read_request_t(
+	  to_read,
+	  shards,
+	  false,
+	  new OnParityDeltaReadComplete(this, op, hpair.first))));
+    want_to_read.insert(make_pair(hpair.first, std::move(want)));
+  }
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    want_to_read,
+    for_read_op,
+    OpRequestRef(),
+    false, false);
+}
+
+void ECBackend::handle_parity_delta_read(
+  Op *op,
+  const hobject_t &hoid,
+  read_result_t &res)
+{
+  if (res.r != 0) {
+    derr << __func__ << ": reading " << hoid << " for " << *op
+	 << " returned " << res.r << " and there is no way to recover"
+	 << " from such an error in this context" << dendl;
+    ceph_abort();
+  }
+  ceph_assert(res.returned.size() == 1);
+
+  map<int, bufferlist> from;
+  for (auto &&i : res.returned.front().get<2>()) {
+    from[i.first.shard] = std::move(i.second);
+  }
+  auto &result = op->delta_read_result[hoid];
+  map<int, bufferlist*> to_decode;
+  auto want = op->plan.delta_shards.at(hoid);
+  for (unsigned i = ec_impl->get_data_chunk_count();
+       i < ec_impl->get_chunk_count();
+       ++i) {
+    want.insert(i);
+  }
+  for (int i : want) {
+    auto p = from.find(i);
+    if (p != from.end()) {
+      result[i] = p->second;
+    } else {
+      to_decode[i] = &result[i];
+    }
+  }
+  if (!to_decode.empty()) {
+    int r = ECUtil::decode(sinfo, ec_impl, from, to_decode);
+    ceph_assert(r == 0);
+  }
+  dout(20) << __func__ << ": " << hoid << " read shards " << want
+	   << " decoded " << to_decode.size() << dendl;
+  check_ops();
+}
+
 int ECBackend::objects_read_sync(
   const hobject_t &hoid,
   uint64_t off,
@@ -2378,7 +2574,15 @@ void ECBackend::objects_read_and_reconstruct(
   map<hobject_t, set<int>> obj_want_to_read;
   set<int> want_to_read;
   get_want_to_read_shards(&want_to_read);
-    
+
+  // fast_read already reads every shard, and the decoding of sub-chunks
+  // does not mix with the full chunks read from the extra shards
+  int64_t hedge = 0;
+  if (!fast_read && ec_impl->get_sub_chunk_count() == 1) {
+    get_parent()->get_pool().opts.get(pool_opts_t::EC_READ_HEDGE, &hedge);
+  }
+  set<pg_shard_t> hedge_shards;
+
   map<hobject_t, read_request_t> for_read_op;
   for (auto &&to_read: reads) {
     map<pg_shard_t, vector<pair<int, int>>> shards;
@@ -2389,6 +2593,9 @@ void ECBackend::objects_read_and_reconstruct(
       fast_read,
       &shards);
     ceph_assert(r == 0);
+    if (hedge > 0) {
+      get_hedge_shards(to_read.first, hedge, &shards, &hedge_shards);
+    }
 
     CallClientContexts *c = new CallClientContexts(
       to_read.first,
@@ -2406,12 +2613,16 @@ void ECBackend::objects_read_and_reconstruct(
     obj_want_to_read.insert(make_pair(to_read.first, want_to_read));
   }
 
+  if (!hedge_shards.empty()) {
+    get_parent()->get_logger()->inc(l_osd_ec_hedged_read);
+  }
   start_read_op(
     CEPH_MSG_PRIO_DEFAULT,
     obj_want_to_read,
     for_read_op,
     OpRequestRef(),
-    fast_read, false);
+    fast_read, false,
+    std::move(hedge_shards));
   return;
 }
 
@@ -2500,8 +2711,7 @@ int ECBackend::be_deep_scrub(
   dout(10) << __func__ << " " << poid << " pos " << pos << dendl;
   int r;
 
-  uint32_t fadvise_flags = CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
-                           CEPH_OSD_OP_FLAG_FADVISE_DONTNEED;
+  uint32_t fadvise_flags = be_get_deep_scrub_fadvise_flags();
 
   utime_t sleeptime;
   sleeptime.set_from_double(cct->_conf->osd_debug_deep_scrub_sleep);
@@ -2510,41 +2720,65 @@ int ECBackend::be_deep_scrub(
     sleeptime.sleep();
   }
 
-  if (pos.data_pos == 0) {
-    pos.data_hash = bufferhash(-1);
-  }
-
-  uint64_t stride = cct->_conf->osd_deep_scrub_stride;
-  if (stride % sinfo.get_chunk_size())
-    stride += sinfo.get_chunk_size() - (stride % sinfo.get_chunk_size());
-
-  bufferlist bl;
-  r = store->read(
-    ch,
-    ghobject_t(
-      poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-    pos.data_pos,
-    stride, bl,
-    fadvise_flags);
-  if (r < 0) {
-    dout(20) << __func__ << "  " << poid << " got "
-	     << r << " on read, read_error" << dendl;
-    o.read_error = true;
-    return 0;
-  }
-  if (bl.length() % sinfo.get_chunk_size()) {
-    dout(20) << __func__ << "  " << poid << " got "
-	     << r << " on read, not chunk size " << sinfo.get_chunk_size() << " aligned"
-	     << dendl;
-    o.read_error = true;
+  if (pos.data_done()) {
+    // skipped by an incremental deep scrub
+    o.omap_digest = -1;
+    o.omap_digest_present = true;
     return 0;
   }
-  if (r > 0) {
-    pos.data_hash << bl;
+
+  Scrub::DataDigest d;
+  r = be_get_read_ahead(poid, pos, &d);
+  if (r == -EAGAIN) {
+    return r;
   }
-  pos.data_pos += r;
-  if (r == (int)stride) {
-    return -EINPROGRESS;
+  if (r == 0) {
+    // the stride is a multiple of the chunk size, only the last read
+    // can be unaligned
+    if (d.r < 0 || d.length % sinfo.get_chunk_size()) {
+      dout(20) << __func__ << "  " << poid << " got "
+	       << d.r << " on read ahead of 0x" << std::hex << d.length
+	       << std::dec << " bytes, read_error" << dendl;
+      o.read_error = true;
+      return 0;
+    }
+    pos.data_hash = bufferhash(d.digest);
+    pos.data_pos = d.length;
+  } else {
+    if (pos.data_pos == 0) {
+      pos.data_hash = bufferhash(-1);
+    }
+
+    uint64_t stride = be_get_deep_scrub_stride();
+
+    bufferlist bl;
+    r = store->read(
+      ch,
+      ghobject_t(
+	poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+      pos.data_pos,
+      stride, bl,
+      fadvise_flags);
+    if (r < 0) {
+      dout(20) << __func__ << "  " << poid << " got "
+	       << r << " on read, read_error" << dendl;
+      o.read_error = true;
+      return 0;
+    }
+    if (bl.length() % sinfo.get_chunk_size()) {
+      dout(20) << __func__ << "  " << poid << " got "
+	       << r << " on read, not chunk size " << sinfo.get_chunk_size() << " aligned"
+	       << dendl;
+      o.read_error = true;
+      return 0;
+    }
+    if (r > 0) {
+      pos.data_hash << bl;
+    }
+    pos.data_pos += r;
+    if (r == (int)stride) {
+      return -EINPROGRESS;
+    }
   }
 
   ECUtil::HashInfoRef hinfo = get_hash_info(poid, false, &o.attrs);
@@ -372,6 +372,9 @@ public:
     // True if reading for recovery which could possibly reading only a subset
     // of the available shards.
     bool for_recovery;
+    // Shards read in addition to the minimum set (see the ec_read_hedge
+    // pool option), completion is checked as each shard comes in
+    std::set<pg_shard_t> hedge_shards;
 
     ZTracer::Trace trace;
 
@@ -393,9 +396,11 @@ public:
       bool for_recovery,
       OpRequestRef op,
       std::map<hobject_t, std::set<int>> &&_want_to_read,
-      std::map<hobject_t, read_request_t> &&_to_read)
+      std::map<hobject_t, read_request_t> &&_to_read,
+      std::set<pg_shard_t> &&_hedge_shards = {})
       : priority(priority), tid(tid), op(op), do_redundant_reads(do_redundant_reads),
-	for_recovery(for_recovery), want_to_read(std::move(_want_to_read)),
+	for_recovery(for_recovery), hedge_shards(std::move(_hedge_shards)),
+	want_to_read(std::move(_want_to_read)),
 	to_read(std::move(_to_read)) {
       for (auto &&hpair: to_read) {
 	auto &returned = complete[hpair.first].returned;
@@ -425,7 +430,8 @@ public:
     std::map<hobject_t, std::set<int>> &want_to_read,
     std::map<hobject_t, read_request_t> &to_read,
     OpRequestRef op,
-    bool do_redundant_reads, bool for_recovery);
+    bool do_redundant_reads, bool for_recovery,
+    std::set<pg_shard_t> &&hedge_shards = {});
 
   void do_read_op(ReadOp &rop);
   int send_all_remaining_reads(
@@ -474,15 +480,19 @@ public:
     bool requires_rmw() const { return !plan.to_read.empty(); }
     bool invalidates_cache() const { return plan.invalidates_cache; }
 
-    // must be true if requires_rmw(), must be false if invalidates_cache()
+    // must be true if requires_rmw() unless the op writes parity deltas,
+    // must be false if invalidates_cache()
     bool using_cache = true;
 
     /// In progress read state;
     std::map<hobject_t,extent_set> pending_read; // subset already being read
     std::map<hobject_t,extent_set> remote_read;  // subset we must read
     std::map<hobject_t,extent_map> remote_read_result;
+    /// old content of the shards in plan.delta_shards and of the coding shards
+    std::map<hobject_t,std::map<int, ceph::buffer::list>> delta_read_result;
     bool read_in_progress() const {
-      return !remote_read.empty() && remote_read_result.empty();
+      return !remote_read.empty() && remote_read_result.empty() &&
+	delta_read_result.empty();
     }
 
     /// In progress write state.
@@ -566,6 +576,27 @@ public:
   bool try_finish_rmw();
   void check_ops();
 
+  /**
+   * Parity delta writes
+   *
+   * A small overwrite which modifies only some of the data chunks of
+   * the stripes it touches reads those data chunks and the coding
+   * chunks, rather than enough chunks to decode the stripes, and
+   * updates the coding chunks from the difference between the old and
+   * new data (see ECTransaction::plan_parity_delta).  Such ops bypass
+   * the extent cache, so they are only started when no write in flight
+   * overlaps the stripes they read, and ops which need to read stripes
+   * they are changing wait for them to commit.
+   */
+  bool write_in_flight_overlaps(const Op &op, bool delta_only) const;
+  bool try_parity_delta(Op *op);
+  void read_parity_delta_shards(Op *op);
+  void handle_parity_delta_read(
+    Op *op,
+    const hobject_t &hoid,
+    read_result_t &res);
+  friend struct OnParityDeltaReadComplete;
+
   ceph::ErasureCodeInterfaceRef ec_impl;
 
 
@@ -651,6 +682,13 @@ public:
     std::map<pg_shard_t, std::vector<std::pair<int, int>>> *to_read   ///< [out] shards, corresponding subchunks to read
     ); ///< @return error code, 0 on success
 
+  void get_hedge_shards(
+    const hobject_t &hoid,     ///< [in] object
+    unsigned count,            ///< [in] number of shards to add
+    std::map<pg_shard_t, std::vector<std::pair<int, int>>> *to_read, ///< [in,out] shards to read
+    std::set<pg_shard_t> *hedge_shards ///< [out] shards added
+    );
+
   int get_remaining_shards(
     const hobject_t &hoid,
     const std::set<int> &avail,
@@ -675,6 +713,16 @@ public:
     ScrubMap &map,
     ScrubMapBuilder &pos,
     ScrubMap::object &o) override;
+  uint64_t be_get_deep_scrub_stride() const override {
+    uint64_t stride = cct->_conf->osd_deep_scrub_stride;
+    if (stride % sinfo.get_chunk_size())
+      stride += sinfo.get_chunk_size() - (stride % sinfo.get_chunk_size());
+    return stride;
+  }
+  uint32_t be_get_deep_scrub_fadvise_flags() const override {
+    return CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
+           CEPH_OSD_OP_FLAG_FADVISE_DONTNEED;
+  }
   uint64_t be_get_ondisk_size(uint64_t logical_size) override {
     return sinfo.logical_to_next_chunk_offset(logical_size);
   }
@@ -92,6 +92,113 @@ void encode_and_write(
   }
 }
 
+/*
+ * The stripes of offset~bl.length() as they were, with zeroes in place
+ * of the data chunks that are not modified.  Overlaying the write on
+ * top of it and taking the difference with the original gives the
+ * deltas of the modified chunks.
+ */
+bufferlist delta_base_stripes(
+  const ECUtil::stripe_info_t &sinfo,
+  const set<int> &shards,
+  const map<int, bufferlist> &chunks,
+  uint64_t length) {
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const int data_chunks = sinfo.get_stripe_width() / chunk_size;
+  bufferlist bl;
+  for (uint64_t off = 0; off < length; off += sinfo.get_stripe_width()) {
+    uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(off);
+    for (int i = 0; i < data_chunks; ++i) {
+      if (shards.count(i)) {
+	bufferlist chunk;
+	chunk.substr_of(chunks.at(i), chunk_off, chunk_size);
+	bl.claim_append(chunk);
+      } else {
+	bl.append_zero(chunk_size);
+      }
+    }
+  }
+  return bl;
+}
+
+void encode_delta_and_write(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const set<int> &shards,
+  const map<int, bufferlist> &old_chunks,
+  uint64_t offset,
+  bufferlist bl,
+  uint32_t flags,
+  extent_map &written,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  ceph_assert(sinfo.logical_offset_is_stripe_aligned(offset));
+  ceph_assert(sinfo.logical_offset_is_stripe_aligned(bl.length()));
+  ceph_assert(bl.length());
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(
+    offset);
+  const uint64_t chunk_len = sinfo.aligned_logical_offset_to_chunk_offset(
+    bl.length());
+
+  map<int, bufferlist> new_chunks;
+  map<int, bufferlist> deltas;
+  for (int i : shards) {
+    ceph_assert(old_chunks.at(i).length() == chunk_len);
+    bufferlist &chunk = new_chunks[i];
+    for (uint64_t off = 0; off < bl.length();
+	 off += sinfo.get_stripe_width()) {
+      bufferlist piece;
+      piece.substr_of(bl, off + i * chunk_size, chunk_size);
+      chunk.claim_append(piece);
+    }
+    int r = ecimpl->encode_delta(old_chunks.at(i), chunk, &deltas[i]);
+    ceph_assert(r == 0);
+  }
+
+  map<int, bufferlist> coding;
+  for (unsigned i = ecimpl->get_data_chunk_count();
+       i < ecimpl->get_chunk_count();
+       ++i) {
+    ceph_assert(old_chunks.at(i).length() == chunk_len);
+    bufferptr ptr(ceph::buffer::create_page_aligned(chunk_len));
+    old_chunks.at(i).begin().copy(chunk_len, ptr.c_str());
+    coding[i].push_back(std::move(ptr));
+  }
+  int r = ecimpl->apply_delta(deltas, &coding);
+  ceph_assert(r == 0);
+
+  // the content is only meaningful for the modified chunks, which is
+  // fine since ops writing parity deltas do not use the extent cache
+  written.insert(offset, bl.length(), bl);
+
+  ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		     << " " << offset << "~" << bl.length()
+		     << " data shards " << shards
+		     << dendl;
+
+  for (auto &&i : *transactions) {
+    bufferlist *enc_bl;
+    if (new_chunks.count(i.first)) {
+      enc_bl = &new_chunks[i.first];
+    } else if (coding.count(i.first)) {
+      enc_bl = &coding[i.first];
+    } else {
+      continue;
+    }
+    i.second.write(
+      coll_t(spg_t(pgid, i.first)),
+      ghobject_t(oid, ghobject_t::NO_GEN, i.first),
+      chunk_off,
+      enc_bl->length(),
+      *enc_bl,
+      flags);
+  }
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -105,12 +212,61 @@ bool ECTransaction::requires_overwrite(
       (op.truncate->first < prev_size)));
 }
 
+bool ECTransaction::plan_parity_delta(
+  const ECUtil::stripe_info_t &sinfo,
+  unsigned coding_chunks,
+  WritePlan *plan)
+{
+  using BufferUpdate = PGTransaction::ObjectOperation::BufferUpdate;
+  ceph_assert(plan->t);
+
+  // a plain overwrite of a single object, within one run of stripes
+  // which are all read
+  if (plan->to_read.size() != 1)
+    return false;
+  const hobject_t &oid = plan->to_read.begin()->first;
+  const extent_set &to_read = plan->to_read.begin()->second;
+  auto witer = plan->will_write.find(oid);
+  auto opiter = plan->t->op_map.find(oid);
+  if (oid.is_temp() ||
+      to_read.num_intervals() != 1 ||
+      witer == plan->will_write.end() ||
+      witer->second != to_read ||
+      opiter == plan->t->op_map.end())
+    return false;
+  const auto &op = opiter->second;
+  if (!op.is_none() || op.truncate || op.buffer_updates.empty())
+    return false;
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const unsigned data_chunks = sinfo.get_stripe_width() / chunk_size;
+  set<int> shards;
+  for (auto &&extent : op.buffer_updates) {
+    if (!boost::get<BufferUpdate::Write>(&extent.get_val()) &&
+	!boost::get<BufferUpdate::Zero>(&extent.get_val()))
+      return false;
+    uint64_t end = extent.get_off() + extent.get_len();
+    for (uint64_t off = extent.get_off();
+	 off < end && shards.size() < data_chunks;
+	 off = (off / chunk_size + 1) * chunk_size) {
+      shards.insert((off % sinfo.get_stripe_width()) / chunk_size);
+    }
+  }
+  // reading the coding chunks must not cost more than reading enough
+  // chunks to decode the stripes
+  if (shards.size() + coding_chunks > data_chunks)
+    return false;
+  plan->delta_shards[oid] = std::move(shards);
+  return true;
+}
+
 void ECTransaction::generate_transactions(
   WritePlan &plan,
   ErasureCodeInterfaceRef &ecimpl,
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const map<hobject_t,map<int,bufferlist>> &delta_extents,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -408,6 +564,18 @@ void ECTransaction::generate_transactions(
 	to_write = pextiter->second;
       }
 
+      const set<int> *delta_shards = nullptr;
+      auto dsiter = plan.delta_shards.find(oid);
+      if (dsiter != plan.delta_shards.end()) {
+	delta_shards = &(dsiter->second);
+	const extent_set &to_read = plan.to_read.at(oid);
+	uint64_t off = to_read.range_start();
+	uint64_t len = to_read.range_end() - off;
+	bufferlist bl = delta_base_stripes(
+	  sinfo, *delta_shards, delta_extents.at(oid), len);
+	to_write.insert(off, len, bl);
+      }
+
       vector<pair<uint64_t, uint64_t> > rollback_extents;
       const uint64_t orig_size = hinfo->get_total_logical_size(sinfo);
 
@@ -587,6 +755,22 @@ void ECTransaction::generate_transactions(
 	      restore_from);
 	  }
 	}
+	if (delta_shards) {
+	  encode_delta_and_write(
+	    pgid,
+	    oid,
+	    sinfo,
+	    ecimpl,
+	    *delta_shards,
+	    delta_extents.at(oid),
+	    extent.get_off(),
+	    extent.get_val(),
+	    fadvise_flags,
+	    written,
+	    transactions,
+	    dpp);
+	  continue;
+	}
 	encode_and_write(
 	  pgid,
 	  oid,
@@ -30,12 +30,30 @@ namespace ECTransaction {
     std::map<hobject_t,extent_set> will_write; // superset of to_read
 
     std::map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// objects overwritten with parity deltas -> data shards modified
+    std::map<hobject_t,std::set<int>> delta_shards;
   };
 
   bool requires_overwrite(
     uint64_t prev_size,
     const PGTransaction::ObjectOperation &op);
 
+  /**
+   * Switch the overwrite planned in plan to parity deltas if it
+   * modifies few enough data chunks of the stripes it has to read.
+   *
+   * On success, to_read is read from the modified data shards and the
+   * coding shards instead of being decoded, and only those shards are
+   * written.  The coding chunks are updated with
+   * ErasureCodeInterface::apply_delta, the caller must check that the
+   * plugin supports it.
+   */
+  bool plan_parity_delta(
+    const ECUtil::stripe_info_t &sinfo,
+    unsigned coding_chunks,
+    WritePlan *plan);
+
   template <typename F>
   WritePlan get_write_plan(
     const ECUtil::stripe_info_t &sinfo,
@@ -188,6 +206,7 @@ namespace ECTransaction {
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
     const std::map<hobject_t,extent_map> &partial_extents,
+    const std::map<hobject_t,std::map<int,ceph::buffer::list>> &delta_extents,
     std::vector<pg_log_entry_t> &entries,
     std::map<hobject_t,extent_map> *written,
     std::map<shard_id_t, ObjectStore::Transaction> *transactions,
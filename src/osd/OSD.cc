@@ -264,6 +264,7 @@ OSDService::OSDService(OSD *osd, ceph::async::io_context_pool& poolctx) :
   max_oldest_map(0),
   scrubs_local(0),
   scrubs_remote(0),
+  scrub_read_ahead_pool(cct),
   agent_valid_iterator(false),
   agent_ops(0),
   flush_mode_high_count(0),
@@ -541,6 +542,7 @@ void OSDService::init()
   mono_timer.resume();
 
   agent_thread.create("osd_srv_agent");
+  scrub_read_ahead_pool.start();
 
   if (cct->_conf->osd_recovery_delay_start)
     defer_recovery(cct->_conf->osd_recovery_delay_start);
@@ -2353,6 +2355,24 @@ int OSD::set_numa_affinity()
 	numa_node = -1;
       }
     }
+  } else if (store_node >= 0 &&
+	     g_conf().get_val<bool>("osd_numa_shard_affinity")) {
+    // the osd as a whole stays unpinned, but the op shards do most of
+    // their work against the store and its caches.
+    size_t cpu_set_size = 0;
+    cpu_set_t cpu_set;
+    int r = get_numa_node_cpu_set(store_node, &cpu_set_size, &cpu_set);
+    if (r >= 0) {
+      r = osd_op_tp.set_cpu_affinity(cpu_set_size, &cpu_set);
+    }
+    if (r < 0) {
+      derr << __func__ << " failed to set op shard affinity to numa node "
+	   << store_node << ": " << cpp_strerror(r) << dendl;
+    } else {
+      dout(1) << __func__ << " setting op shard affinity to storage numa node "
+	      << store_node << " cpus "
+	      << cpu_set_to_str_list(cpu_set_size, &cpu_set) << dendl;
+    }
   } else {
     dout(1) << __func__ << " not setting numa affinity" << dendl;
   }
@@ -4141,6 +4161,8 @@ int OSD::shutdown()
   osd_op_tp.stop();
   dout(10) << "op sharded tp stopped" << dendl;
 
+  service.scrub_read_ahead_pool.stop();
+
   dout(10) << "stopping agent" << dendl;
   service.agent_stop();
 
@@ -8657,6 +8679,48 @@ bool OSD::advance_pg(
   return ret;
 }
 
+void OSD::request_compression_dictionaries(const OSDMapRef& osdmap)
+{
+  std::vector<string> ids;
+  {
+    std::lock_guard l(compression_dicts_lock);
+    for (auto& [pool_id, pool] : osdmap->get_pools()) {
+      string id;
+      if (pool.opts.get(pool_opts_t::COMPRESSION_DICTIONARY, &id) &&
+	  compression_dicts_requested.insert(id).second) {
+	dout(10) << __func__ << " " << id << " of pool " << pool_id << dendl;
+	ids.push_back(id);
+      }
+    }
+  }
+  for (auto& id : ids) {
+    string cmd = "{\"prefix\": \"config-key get\", "
+      "\"key\": \"compression_dictionary/" + id + "\"}";
+    auto raw = std::make_shared<bufferlist>();
+    monc->start_mon_command(
+      {cmd}, {}, raw.get(), nullptr,
+      new LambdaContext([this, id, raw](int r) {
+	if (is_stopping()) {
+	  return;
+	}
+	char *end = nullptr;
+	uint32_t crc = strtoul(id.c_str(), &end, 16);
+	if (r == 0 && (*end || raw->crc32c(0) != crc)) {
+	  r = -EINVAL;
+	}
+	if (r < 0) {
+	  derr << "failed to get compression dictionary " << id << ": "
+	       << cpp_strerror(r) << dendl;
+	  // try again with the next map
+	  std::lock_guard l(compression_dicts_lock);
+	  compression_dicts_requested.erase(id);
+	  return;
+	}
+	store->set_compression_dictionary(crc, *raw);
+      }));
+  }
+}
+
 void OSD::consume_map()
 {
   ceph_assert(ceph_mutex_is_locked(osd_lock));
@@ -8692,6 +8756,8 @@ void OSD::consume_map()
   // prune sent_ready_to_merge
   service.prune_sent_ready_to_merge(osdmap);
 
+  request_compression_dictionaries(osdmap);
+
   // FIXME, maybe: We could race against an incoming peering message
   // that instantiates a merge PG after identify_merges() below and
   // never set up its peer to complete the merge.  An OSD restart
@@ -10458,8 +10524,10 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   if (sdata->scheduler->empty() &&
       (!is_smallest_thread_index || sdata->context_queue.empty())) {
     std::unique_lock wait_lock{sdata->sdata_wait_lock};
-    if (is_smallest_thread_index && !sdata->context_queue.empty()) {
-      // we raced with a context_queue addition, don't wait
+    if ((is_smallest_thread_index && !sdata->context_queue.empty()) ||
+	!sdata->scheduler->empty()) {
+      // we raced with a context_queue addition or with a lock free
+      // scheduler enqueue, don't wait
       wait_lock.unlock();
     } else if (!sdata->stop_waiting) {
       dout(20) << __func__ << " empty q, waiting" << dendl;
@@ -10779,7 +10847,10 @@ void OSD::ShardedOpWQ::_enqueue(OpSchedulerItem&& item) {
   assert (NULL != sdata);
 
   bool empty = true;
-  {
+  if (sdata->scheduler->is_enqueue_lock_free()) {
+    empty = sdata->scheduler->empty();
+    sdata->scheduler->enqueue(std::move(item));
+  } else {
     std::lock_guard l{sdata->shard_lock};
     empty = sdata->scheduler->empty();
     sdata->scheduler->enqueue(std::move(item));
@@ -39,6 +39,7 @@
 #include "Session.h"
 
 #include "osd/scheduler/OpScheduler.h"
+#include "osd/ScrubReadAhead.h"
 
 #include <atomic>
 #include <map>
@@ -351,6 +352,9 @@ public:
   void dec_scrubs_remote();
   void dump_scrub_reservations(ceph::Formatter *f);
 
+  /// reads and hashes object data ahead of deep scrubs
+  Scrub::ReadAheadPool scrub_read_ahead_pool;
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv,
 		      std::vector<pg_log_op_return_item_t> op_returns);
@@ -1709,6 +1713,12 @@ protected:
   void consume_map();
   void activate_map();
 
+  /// compression dictionaries asked of the mon, by id
+  ceph::mutex compression_dicts_lock =
+    ceph::make_mutex("OSD::compression_dicts_lock");
+  std::set<std::string> compression_dicts_requested;
+  void request_compression_dictionaries(const OSDMapRef& osdmap);
+
   // osd map cache (past osd maps)
   OSDMapRef get_map(epoch_t e) {
     return service.get_map(e);
@@ -378,6 +378,7 @@ PG::Scrubber::Scrubber()
    shallow_errors(0), deep_errors(0), fixed(0),
    must_scrub(false), must_deep_scrub(false), must_repair(false),
    need_auto(false), req_scrub(false), time_for_deep(false),
+   deep_incremental(false),
    auto_repair(false),
    check_repair(false),
    deep_scrub_on_error(false),
@@ -444,6 +445,27 @@ bool PG::requeue_scrub(bool high_priority)
   }
 }
 
+void PG::requeue_scrub_on_read_ahead(ScrubMapBuilder &pos)
+{
+  ceph_assert(pos.read_ahead);
+  OSDService *osds = osd;
+  spg_t pgid = get_pgid();
+  auto on_ready = new LambdaContext([osds, pgid](int r) {
+    PGRef pg = osds->osd->lookup_lock_pg(pgid);
+    if (pg == nullptr) {
+      return;
+    }
+    pg->requeue_scrub();
+    pg->unlock();
+  });
+  if (pos.read_ahead->wait(pos.ls[pos.pos], on_ready)) {
+    dout(20) << __func__ << ": waiting for " << pos.ls[pos.pos] << dendl;
+  } else {
+    delete on_ready;
+    requeue_scrub();
+  }
+}
+
 void PG::queue_recovery()
 {
   if (!is_primary() || !is_peered()) {
@@ -479,6 +501,7 @@ bool PG::queue_scrub()
   if (scrubber.must_deep_scrub) {
     state_set(PG_STATE_DEEP_SCRUB);
     scrubber.must_deep_scrub = false;
+    scrubber.deep_incremental = false;
   }
   if (scrubber.must_repair || scrubber.auto_repair) {
     state_set(PG_STATE_REPAIR);
@@ -1394,6 +1417,7 @@ bool PG::sched_scrub()
                                && get_pgbackend()->auto_repair_supported());
 
     scrubber.time_for_deep = false;
+    scrubber.deep_incremental = false;
     // Clear these in case user issues the scrub/repair command during
     // the scheduling of the scrub/repair (e.g. request reservation)
     scrubber.deep_scrub_on_error = false;
@@ -1444,6 +1468,13 @@ bool PG::sched_scrub()
             scrubber.deep_scrub_on_error = true;
           }
         }
+
+        // with no errors to look into, a periodic deep scrub only needs to
+        // read what was written since the previous one
+        scrubber.deep_incremental = scrubber.time_for_deep &&
+          !scrubber.need_auto && !has_deep_errors && !scrubber.auto_repair &&
+          info.history.last_deep_scrub != eversion_t() &&
+          cct->_conf.get_val<bool>("osd_deep_scrub_incremental");
       } else { // !allow_deep_scrub
         dout(20) << __func__ << ": nodeep_scrub set" << dendl;
         if (has_deep_errors) {
@@ -1932,6 +1963,9 @@ void PG::_request_scrub_map(
     allow_preemption,
     scrubber.priority,
     ops_blocked_by_scrub());
+  repscrubop->deep_since = scrubber.deep_since;
+  repscrubop->deep_sample_slot = scrubber.deep_sample_slot;
+  repscrubop->deep_sample_rate = scrubber.deep_sample_rate;
   // default priority, we want the rep scrub processed prior to any recovery
   // or client io messages (we are holding a lock!)
   osd->send_message_osd_cluster(
@@ -2340,6 +2374,11 @@ int PG::build_scrub_map_chunk(
   // start
   while (pos.empty()) {
     pos.deep = deep;
+    if (deep) {
+      pos.deep_since = scrubber.deep_since;
+      pos.deep_sample_slot = scrubber.deep_sample_slot;
+      pos.deep_sample_rate = scrubber.deep_sample_rate;
+    }
     map.valid_through = info.last_update;
 
     // objects
@@ -2364,7 +2403,7 @@ int PG::build_scrub_map_chunk(
   // scan objects
   while (!pos.done()) {
     int r = get_pgbackend()->be_scan_list(map, pos);
-    if (r == -EINPROGRESS) {
+    if (r == -EINPROGRESS || r == -EAGAIN) {
       return r;
     }
   }
@@ -2475,6 +2514,9 @@ void PG::replica_scrub(
   scrubber.end = msg->end;
   scrubber.max_end = msg->end;
   scrubber.deep = msg->deep;
+  scrubber.deep_since = msg->deep_since;
+  scrubber.deep_sample_slot = msg->deep_sample_slot;
+  scrubber.deep_sample_rate = msg->deep_sample_rate;
   scrubber.epoch_start = info.history.same_interval_since;
   if (msg->priority) {
     scrubber.priority = msg->priority;
@@ -2564,6 +2606,22 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
     ceph_assert(recovery_state.get_backfill_targets().empty());
 
     scrubber.deep = state_test(PG_STATE_DEEP_SCRUB);
+    if (scrubber.deep) {
+      scrubber.deep_start_version = info.last_update;
+      if (scrubber.deep_incremental && !state_test(PG_STATE_REPAIR)) {
+	scrubber.deep_since = info.history.last_deep_scrub;
+	scrubber.deep_sample_rate = cct->_conf.get_val<uint64_t>(
+	  "osd_deep_scrub_incremental_sample");
+	// the sample moves on with every deep scrub, so that each unchanged
+	// object is read once every deep_sample_rate deep scrubs
+	scrubber.deep_sample_slot = scrubber.deep_sample_rate ?
+	  info.history.deep_scrub_seq % scrubber.deep_sample_rate : 0;
+	dout(10) << "deep scrub is incremental since "
+		 << scrubber.deep_since << ", sampling slot "
+		 << scrubber.deep_sample_slot << " of "
+		 << scrubber.deep_sample_rate << dendl;
+      }
+    }
 
     dout(10) << "starting a new chunky scrub" << dendl;
   }
@@ -2894,6 +2952,11 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  done = true;
 	  break;
 	}
+	if (ret == -EAGAIN) {
+	  requeue_scrub_on_read_ahead(scrubber.primary_scrubmap_pos);
+	  done = true;
+	  break;
+	}
 	scrubber.state = PG::Scrubber::BUILD_MAP_DONE;
 	break;
 
@@ -2999,6 +3062,11 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  done = true;
 	  break;
 	}
+	if (ret == -EAGAIN) {
+	  requeue_scrub_on_read_ahead(scrubber.replica_scrubmap_pos);
+	  done = true;
+	  break;
+	}
 	// reply
 	{
 	  MOSDRepScrubMap *reply = new MOSDRepScrubMap(
@@ -3317,8 +3385,11 @@ void PG::scrub_finish()
 	history.last_scrub = recovery_state.get_info().last_update;
 	history.last_scrub_stamp = now;
 	if (scrubber.deep) {
-	  history.last_deep_scrub = recovery_state.get_info().last_update;
+	  // everything written before the scrub started was read, or
+	  // sampled by an incremental one
+	  history.last_deep_scrub = scrubber.deep_start_version;
 	  history.last_deep_scrub_stamp = now;
+	  ++history.deep_scrub_seq;
 	}
 
 	if (deep_scrub) {
@@ -3791,6 +3862,10 @@ void PG::Scrubber::dump(Formatter *f)
     f->dump_bool("need_auto", need_auto);
     f->dump_bool("req_scrub", req_scrub);
     f->dump_bool("time_for_deep", time_for_deep);
+    if (deep_since != eversion_t()) {
+      f->dump_stream("deep_since") << deep_since;
+      f->dump_unsigned("deep_sample_rate", deep_sample_rate);
+    }
     f->dump_bool("auto_repair", auto_repair);
     f->dump_bool("check_repair", check_repair);
     f->dump_bool("deep_scrub_on_error", deep_scrub_on_error);
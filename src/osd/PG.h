@@ -1038,6 +1038,8 @@ public:
     unsigned priority = 0;
 
     bool time_for_deep;
+    // this flag indicates that the periodic deep scrub may be incremental
+    bool deep_incremental;
     // this flag indicates whether we would like to do auto-repair of the PG or not
     bool auto_repair;
     // this flag indicates that we are scrubbing post repair to verify everything is fixed
@@ -1106,6 +1108,14 @@ public:
     std::unique_ptr<Scrub::Store> store;
     // deep scrub
     bool deep;
+    // incremental deep scrub: only read the data of the objects written
+    // since deep_since, and of the others that fall in deep_sample_slot
+    // of deep_sample_rate
+    eversion_t deep_since;
+    uint32_t deep_sample_slot = 0;
+    uint32_t deep_sample_rate = 0;
+    // last_update when the deep scrub started
+    eversion_t deep_start_version;
     int preempt_left;
     int preempt_divisor;
 
@@ -1159,6 +1169,7 @@ public:
       need_auto = false;
       req_scrub = false;
       time_for_deep = false;
+      deep_incremental = false;
       auto_repair = false;
       check_repair = false;
       deep_scrub_on_error = false;
@@ -1173,6 +1184,10 @@ public:
       fixed = 0;
       omap_stats = (const struct omap_stat_t){ 0 };
       deep = false;
+      deep_since = eversion_t();
+      deep_sample_slot = 0;
+      deep_sample_rate = 0;
+      deep_start_version = eversion_t();
       run_callbacks();
       inconsistent.clear();
       missing.clear();
@@ -1377,6 +1392,8 @@ protected:
   virtual void kick_snap_trim() = 0;
   virtual void snap_trimmer_scrub_complete() = 0;
   bool requeue_scrub(bool high_priority = false);
+  /// requeue the scrub once the object it scans is read ahead
+  void requeue_scrub_on_read_ahead(ScrubMapBuilder &pos);
   void queue_recovery();
   bool queue_scrub();
   unsigned get_scrub_priority();
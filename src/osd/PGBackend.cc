@@ -18,8 +18,10 @@
 
 #include "common/errno.h"
 #include "common/scrub_types.h"
+#include "crush/hash.h"
 #include "ReplicatedBackend.h"
 #include "ScrubStore.h"
+#include "ScrubReadAhead.h"
 #include "ECBackend.h"
 #include "PGBackend.h"
 #include "OSD.h"
@@ -634,6 +636,17 @@ int PGBackend::be_scan_list(
       o.attrs);
 
     if (pos.deep) {
+      if (pos.data_pos == 0 && pos.deep_since != eversion_t()) {
+	auto oi_attr = o.attrs.find(OI_ATTR);
+	if (be_skip_deep_scrub_data(
+	      poid, pos,
+	      oi_attr == o.attrs.end() ? nullptr : &oi_attr->second)) {
+	  dout(20) << __func__ << "  " << poid << " not written since "
+		   << pos.deep_since << ", skipping data" << dendl;
+	  pos.data_pos = -1;
+	}
+      }
+      be_queue_read_ahead(pos);
       r = be_deep_scrub(poid, map, pos, o);
     }
     dout(25) << __func__ << "  " << poid << dendl;
@@ -649,13 +662,96 @@ int PGBackend::be_scan_list(
     derr << __func__ << " got: " << cpp_strerror(r) << dendl;
     ceph_abort();
   }
-  if (r == -EINPROGRESS) {
-    return -EINPROGRESS;
+  if (r == -EINPROGRESS || r == -EAGAIN) {
+    return r;
   }
   pos.next_object();
   return 0;
 }
 
+void PGBackend::be_queue_read_ahead(ScrubMapBuilder &pos)
+{
+  uint64_t window = cct->_conf.get_val<uint64_t>(
+    "osd_scrub_read_ahead_objects");
+  if (!window) {
+    return;
+  }
+  if (!pos.read_ahead) {
+    pos.read_ahead = std::make_shared<Scrub::ReadAhead>(pos.pos);
+  }
+  auto &ra = pos.read_ahead;
+  // the data of the current object may already be read here
+  size_t first = pos.data_pos == 0 ? pos.pos : pos.pos + 1;
+  if (ra->next < first) {
+    ra->next = first;
+  }
+  auto pool = get_parent()->get_scrub_read_ahead_pool();
+  uint64_t stride = be_get_deep_scrub_stride();
+  uint32_t fadvise_flags = be_get_deep_scrub_fadvise_flags();
+  while (ra->next < pos.ls.size() && ra->next < pos.pos + window) {
+    const hobject_t &poid = pos.ls[ra->next];
+    ghobject_t goid(
+      poid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard);
+    if (pos.deep_since != eversion_t()) {
+      bufferptr oi_attr;
+      int r = store->getattr(ch, goid, OI_ATTR, oi_attr);
+      if (be_skip_deep_scrub_data(poid, pos, r < 0 ? nullptr : &oi_attr)) {
+	++ra->next;
+	continue;
+      }
+    }
+    if (!pool->queue(ra, store, ch, goid, stride, fadvise_flags)) {
+      break;
+    }
+    dout(20) << __func__ << " queued " << poid << dendl;
+    ++ra->next;
+  }
+}
+
+bool PGBackend::be_skip_deep_scrub_data(
+  const hobject_t &poid,
+  const ScrubMapBuilder &pos,
+  const bufferptr *oi_attr)
+{
+  if (pos.deep_since == eversion_t()) {
+    return false;
+  }
+  // objects of a PG share the low bits of their hash, so mix it before
+  // picking the slot
+  if (pos.deep_sample_rate &&
+      crush_hash32(CRUSH_HASH_RJENKINS1, poid.get_hash()) %
+      pos.deep_sample_rate == pos.deep_sample_slot) {
+    return false;
+  }
+  if (!oi_attr) {
+    // missing object info, read it all
+    return false;
+  }
+  bufferlist bl;
+  bl.push_back(*oi_attr);
+  object_info_t oi;
+  try {
+    auto p = bl.cbegin();
+    decode(oi, p);
+  } catch (...) {
+    return false;
+  }
+  return oi.version <= pos.deep_since;
+}
+
+int PGBackend::be_get_read_ahead(
+  const hobject_t &poid,
+  ScrubMapBuilder &pos,
+  Scrub::DataDigest *d)
+{
+  if (!pos.read_ahead || pos.data_pos != 0) {
+    return -ENOENT;
+  }
+  int r = pos.read_ahead->get(poid, d);
+  dout(20) << __func__ << " " << poid << " r " << r << dendl;
+  return r;
+}
+
 bool PGBackend::be_compare_scrub_objects(
   pg_shard_t auth_shard,
   const ScrubMap::object &auth,
@@ -1254,7 +1350,10 @@ void PGBackend::be_compare_scrubmaps(
           if (auth_object.digest_present) {
             data_digest = auth_object.digest;
 	    dout(20) << __func__ << " will update data digest on " << *k << dendl;
-          }
+          } else if (auth_oi.is_data_digest()) {
+	    // the data was skipped by an incremental deep scrub
+	    data_digest = auth_oi.data_digest;
+	  }
           if (auth_object.omap_digest_present) {
             omap_digest = auth_object.omap_digest;
 	    dout(20) << __func__ << " will update omap digest on " << *k << dendl;
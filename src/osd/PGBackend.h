@@ -29,6 +29,8 @@
 
 namespace Scrub {
   class Store;
+  class ReadAheadPool;
+  struct DataDigest;
 }
 struct shard_info_wrapper;
 struct inconsistent_obj_wrapper;
@@ -290,6 +292,8 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
 
      virtual PerfCounters *get_logger() = 0;
 
+     virtual Scrub::ReadAheadPool *get_scrub_read_ahead_pool() = 0;
+
      virtual ceph_tid_t get_tid() = 0;
 
      virtual OstreamTemp clog_error() = 0;
@@ -584,6 +588,18 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
    int be_scan_list(
      ScrubMap &map,
      ScrubMapBuilder &pos);
+   /// queue the data reads of the next objects of a deep scrub chunk
+   void be_queue_read_ahead(ScrubMapBuilder &pos);
+   /// true if an incremental deep scrub does not read the data of poid
+   static bool be_skip_deep_scrub_data(
+     const hobject_t &poid,
+     const ScrubMapBuilder &pos,
+     const ceph::buffer::ptr *oi_attr);
+   /// @return 0, -EAGAIN while poid is being read, -ENOENT if it was not
+   int be_get_read_ahead(
+     const hobject_t &poid,
+     ScrubMapBuilder &pos,
+     Scrub::DataDigest *d);
    bool be_compare_scrub_objects(
      pg_shard_t auth_shard,
      const ScrubMap::object &auth,
@@ -622,6 +638,11 @@ typedef std::shared_ptr<const OSDMap> OSDMapRef;
      ScrubMap &map,
      ScrubMapBuilder &pos,
      ScrubMap::object &o) = 0;
+   /// size of the data reads of be_deep_scrub
+   virtual uint64_t be_get_deep_scrub_stride() const {
+     return cct->_conf->osd_deep_scrub_stride;
+   }
+   virtual uint32_t be_get_deep_scrub_fadvise_flags() const = 0;
    void be_omap_checks(
      const std::map<pg_shard_t,ScrubMap*> &maps,
      const std::set<hobject_t> &master_set,
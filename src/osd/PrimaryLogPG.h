@@ -562,6 +562,10 @@ public:
 
   PerfCounters *get_logger() override;
 
+  Scrub::ReadAheadPool *get_scrub_read_ahead_pool() override {
+    return &osd->scrub_read_ahead_pool;
+  }
+
   ceph_tid_t get_tid() override { return osd->get_tid(); }
 
   OstreamTemp clog_error() override { return osd->clog->error(); }
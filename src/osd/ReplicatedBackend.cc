@@ -633,9 +633,7 @@ int ReplicatedBackend::be_deep_scrub(
 {
   dout(10) << __func__ << " " << poid << " pos " << pos << dendl;
   int r;
-  uint32_t fadvise_flags = CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
-                           CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
-                           CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE;
+  uint32_t fadvise_flags = be_get_deep_scrub_fadvise_flags();
 
   utime_t sleeptime;
   sleeptime.set_from_double(cct->_conf->osd_debug_deep_scrub_sleep);
@@ -645,6 +643,24 @@ int ReplicatedBackend::be_deep_scrub(
   }
 
   ceph_assert(poid == pos.ls[pos.pos]);
+  Scrub::DataDigest d;
+  r = be_get_read_ahead(poid, pos, &d);
+  if (r == -EAGAIN) {
+    return r;
+  }
+  if (r == 0) {
+    if (d.r < 0) {
+      dout(20) << __func__ << "  " << poid << " got "
+	       << d.r << " on read ahead, read_error" << dendl;
+      o.read_error = true;
+      return 0;
+    }
+    pos.data_pos = -1;
+    o.digest = d.digest;
+    o.digest_present = true;
+    dout(20) << __func__ << "  " << poid << " read ahead, digest 0x"
+	     << std::hex << o.digest << std::dec << dendl;
+  }
   if (!pos.data_done()) {
     if (pos.data_pos == 0) {
       pos.data_hash = bufferhash(-1);
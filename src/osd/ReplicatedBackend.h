@@ -432,6 +432,11 @@ private:
     ScrubMapBuilder &pos,
     ScrubMap::object &o) override;
   uint64_t be_get_ondisk_size(uint64_t logical_size) override { return logical_size; }
+  uint32_t be_get_deep_scrub_fadvise_flags() const override {
+    return CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL |
+           CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+           CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE;
+  }
 };
 
 #endif
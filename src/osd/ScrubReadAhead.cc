@@ -0,0 +1,138 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ScrubReadAhead.h"
+#include "include/Context.h"
+
+namespace Scrub {
+
+ReadAhead::~ReadAhead()
+{
+  delete on_ready;
+}
+
+void ReadAhead::queued(const hobject_t &oid)
+{
+  std::lock_guard l(lock);
+  digests[oid];
+}
+
+void ReadAhead::finish(const hobject_t &oid, const DataDigest &d)
+{
+  Context *c = nullptr;
+  {
+    std::lock_guard l(lock);
+    digests[oid] = d;
+    if (on_ready && waiting_on == oid) {
+      std::swap(c, on_ready);
+    }
+  }
+  if (c) {
+    c->complete(0);
+  }
+}
+
+int ReadAhead::get(const hobject_t &oid, DataDigest *d)
+{
+  std::lock_guard l(lock);
+  auto p = digests.find(oid);
+  if (p == digests.end()) {
+    return -ENOENT;
+  }
+  if (!p->second) {
+    return -EAGAIN;
+  }
+  *d = *p->second;
+  digests.erase(p);
+  return 0;
+}
+
+bool ReadAhead::wait(const hobject_t &oid, Context *c)
+{
+  std::lock_guard l(lock);
+  auto p = digests.find(oid);
+  if (p == digests.end() || p->second) {
+    return false;
+  }
+  // the scan may have been requeued by something else in the meantime
+  delete on_ready;
+  waiting_on = oid;
+  on_ready = c;
+  return true;
+}
+
+ReadAheadPool::ReadAheadPool(CephContext *cct)
+  : cct(cct),
+    tp(cct, "OSD::scrub_read_ahead_tp", "tp_scrub_ra",
+       cct->_conf.get_val<uint64_t>("osd_scrub_read_ahead_threads")),
+    wq("OSD::scrub_read_ahead_wq", ceph::timespan::zero(), &tp),
+    budget(cct, "osd_scrub_read_ahead",
+	   cct->_conf.get_val<Option::size_t>("osd_scrub_read_ahead_memory")),
+    enabled(cct->_conf.get_val<uint64_t>("osd_scrub_read_ahead_threads") > 0)
+{
+}
+
+void ReadAheadPool::start()
+{
+  if (enabled) {
+    tp.start();
+  }
+}
+
+void ReadAheadPool::stop()
+{
+  stopping = true;
+  if (enabled) {
+    wq.drain();
+    tp.stop();
+  }
+}
+
+bool ReadAheadPool::queue(
+  const ReadAheadRef &ra,
+  ObjectStore *store,
+  ObjectStore::CollectionHandle ch,
+  const ghobject_t &oid,
+  uint64_t stride,
+  uint32_t fadvise_flags)
+{
+  if (!enabled || stopping) {
+    return false;
+  }
+  uint64_t max = cct->_conf.get_val<Option::size_t>(
+    "osd_scrub_read_ahead_memory");
+  if (!max) {
+    return false;
+  }
+  if (budget.get_max() != (int64_t)max) {
+    budget.reset_max(max);
+  }
+  if (!budget.get_or_fail(stride)) {
+    return false;
+  }
+  ra->queued(oid.hobj);
+  wq.queue(new LambdaContext(
+    [this, ra, store, ch, oid, stride, fadvise_flags](int) mutable {
+      DataDigest d;
+      ceph::buffer::hash h(-1);
+      while (true) {
+	ceph::buffer::list bl;
+	int r = store->read(ch, oid, d.length, stride, bl, fadvise_flags);
+	if (r < 0) {
+	  d.r = r;
+	  break;
+	}
+	h << bl;
+	d.length += r;
+	if (r < (int)stride) {
+	  break;
+	}
+      }
+      d.digest = h.digest();
+      budget.put(stride);
+      ra->finish(oid.hobj, d);
+    }));
+  return true;
+}
+
+}
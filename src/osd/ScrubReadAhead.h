@@ -0,0 +1,100 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_SCRUB_READ_AHEAD_H
+#define CEPH_SCRUB_READ_AHEAD_H
+
+#include <map>
+#include <memory>
+#include <optional>
+
+#include "common/Throttle.h"
+#include "common/WorkQueue.h"
+#include "common/ceph_mutex.h"
+#include "common/hobject.h"
+#include "os/ObjectStore.h"
+
+class Context;
+
+namespace Scrub {
+
+/// the data digest of an object, as be_deep_scrub computes it
+struct DataDigest {
+  int r = 0;            ///< negative if a read failed
+  uint64_t length = 0;  ///< bytes read
+  uint32_t digest = 0;  ///< crc32c seeded with -1
+};
+
+/**
+ * The data digests of the objects of a deep scrub chunk that are read
+ * ahead of the scan.  One per ScrubMapBuilder, shared with the jobs
+ * reading its objects so that it outlives a scan which is reset while
+ * they are in flight.
+ */
+class ReadAhead {
+  ceph::mutex lock = ceph::make_mutex("Scrub::ReadAhead::lock");
+  /// objects queued, no value while they are being read
+  std::map<hobject_t, std::optional<DataDigest>> digests;
+  hobject_t waiting_on;
+  Context *on_ready = nullptr;
+
+public:
+  /// index in ScrubMapBuilder::ls of the next object to queue
+  size_t next = 0;
+
+  explicit ReadAhead(size_t next) : next(next) {}
+  ~ReadAhead();
+
+  void queued(const hobject_t &oid);
+  void finish(const hobject_t &oid, const DataDigest &d);
+
+  /**
+   * Take the digest of oid
+   *
+   * @return 0 with *d set, -EAGAIN while oid is being read, or -ENOENT
+   * if it was not queued
+   */
+  int get(const hobject_t &oid, DataDigest *d);
+
+  /// complete c once the digest of oid is ready, false if it already is
+  bool wait(const hobject_t &oid, Context *c);
+};
+using ReadAheadRef = std::shared_ptr<ReadAhead>;
+
+/**
+ * The threads reading and hashing the data of objects ahead of the
+ * deep scrubs of all the PGs of an OSD.  Every job holds a stride
+ * worth of the osd_scrub_read_ahead_memory budget while it runs.
+ */
+class ReadAheadPool {
+  CephContext *cct;
+  ThreadPool tp;
+  ContextWQ wq;
+  Throttle budget;
+  bool enabled;
+  std::atomic<bool> stopping = {false};
+
+public:
+  explicit ReadAheadPool(CephContext *cct);
+
+  void start();
+  void stop();
+
+  /**
+   * Queue the read of the data of oid for ra
+   *
+   * @return false if the pool is disabled or the memory budget is used
+   * up, the object must then be read by the scan
+   */
+  bool queue(
+    const ReadAheadRef &ra,
+    ObjectStore *store,
+    ObjectStore::CollectionHandle ch,
+    const ghobject_t &oid,
+    uint64_t stride,
+    uint32_t fadvise_flags);
+};
+
+}
+
+#endif
@@ -278,6 +278,13 @@ PerfCounters *build_osd_logger(CephContext *cct) {
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+  osd_plb.add_u64_counter(
+    l_osd_ec_hedged_read, "ec_hedged_read",
+    "Erasure coded reads sent to more shards than needed to decode");
+  osd_plb.add_u64_counter(
+    l_osd_ec_hedged_read_helped, "ec_hedged_read_helped",
+    "Hedged erasure coded reads completed before a shard of the minimum set replied");
+
   return osd_plb.create_perf_counters();
 }
  
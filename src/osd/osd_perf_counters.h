@@ -118,6 +118,9 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_ec_hedged_read,
+  l_osd_ec_hedged_read_helped,
+
   l_osd_last,
 };
 
@@ -1060,6 +1060,8 @@ public:
     TARGET_SIZE_RATIO,  // fraction of total cluster
     PG_AUTOSCALE_BIAS,
     READ_LEASE_INTERVAL,
+    COMPRESSION_DICTIONARY, // id of a dictionary in the config-key store
+    EC_READ_HEDGE,      // shards read beyond the minimum, ec only
   };
 
   enum type_t {
@@ -2688,6 +2690,7 @@ struct pg_history_t {
   utime_t last_scrub_stamp;
   utime_t last_deep_scrub_stamp;
   utime_t last_clean_scrub_stamp;
+  uint32_t deep_scrub_seq = 0;  ///< deep scrubs done; rotates the incremental sample
 
   /// upper bound on how long prior interval readable (relative to encode time)
   ceph::timespan prior_readable_until_ub = ceph::timespan::zero();
@@ -2710,6 +2713,7 @@ struct pg_history_t {
       l.last_scrub_stamp == r.last_scrub_stamp &&
       l.last_deep_scrub_stamp == r.last_deep_scrub_stamp &&
       l.last_clean_scrub_stamp == r.last_clean_scrub_stamp &&
+      l.deep_scrub_seq == r.deep_scrub_seq &&
       l.prior_readable_until_ub == r.prior_readable_until_ub;
   }
 
@@ -2790,6 +2794,10 @@ struct pg_history_t {
       last_clean_scrub_stamp = other.last_clean_scrub_stamp;
       modified = true;
     }
+    if (other.deep_scrub_seq > deep_scrub_seq) {
+      deep_scrub_seq = other.deep_scrub_seq;
+      modified = true;
+    }
     return modified;
   }
 
@@ -6014,6 +6022,10 @@ struct ScrubMap {
 WRITE_CLASS_ENCODER(ScrubMap::object)
 WRITE_CLASS_ENCODER(ScrubMap)
 
+namespace Scrub {
+  class ReadAhead;
+}
+
 struct ScrubMapBuilder {
   bool deep = false;
   std::vector<hobject_t> ls;
@@ -6024,6 +6036,10 @@ struct ScrubMapBuilder {
   ceph::buffer::hash data_hash, omap_hash;  ///< accumulatinng hash value
   uint64_t omap_keys = 0;
   uint64_t omap_bytes = 0;
+  std::shared_ptr<Scrub::ReadAhead> read_ahead;  ///< data digests of ls read ahead
+  eversion_t deep_since;          ///< if set, only read objects written since,
+  uint32_t deep_sample_slot = 0;  ///< or in this slot of deep_sample_rate
+  uint32_t deep_sample_rate = 0;
 
   bool empty() {
     return ls.empty();
@@ -6060,6 +6076,9 @@ struct ScrubMapBuilder {
     }
     if (pos.deep) {
       out << " deep";
+      if (pos.deep_since != eversion_t()) {
+	out << " since " << pos.deep_since;
+      }
     }
     if (pos.ret) {
       out << " ret " << pos.ret;
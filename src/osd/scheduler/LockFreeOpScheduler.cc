@@ -0,0 +1,188 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <cstdlib>
+#include <optional>
+#include <ostream>
+
+#include "osd/scheduler/LockFreeOpScheduler.h"
+#include "common/Formatter.h"
+#include "include/intarith.h"
+
+namespace ceph::osd::scheduler {
+
+LockFreeOpScheduler::LockFreeOpScheduler(CephContext *cct)
+  : cutoff(get_io_prio_cut(cct))
+{
+  for (auto &bits : non_empty) {
+    bits = 0;
+  }
+}
+
+LockFreeOpScheduler::~LockFreeOpScheduler()
+{
+  for (auto &prio : priorities) {
+    OpSchedulerItem *item;
+    while (prio.queue.pop(item)) {
+      delete item;
+    }
+  }
+}
+
+void LockFreeOpScheduler::enqueue(OpSchedulerItem &&item)
+{
+  unsigned p = get_priority(item);
+  auto &prio = priorities[p];
+  bool pushed = prio.queue.push(new OpSchedulerItem(std::move(item)));
+  ceph_assert(pushed);
+  // in this order, so that a dequeue which sees the op counted in total
+  // also finds its priority marked
+  ++prio.size;
+  mark_non_empty(p);
+  ++total;
+}
+
+void LockFreeOpScheduler::enqueue_front(OpSchedulerItem &&item)
+{
+  unsigned p = get_priority(item);
+  auto &prio = priorities[p];
+  prio.front.push_front(std::move(item));
+  ++prio.size;
+  mark_non_empty(p);
+  ++total;
+}
+
+unsigned LockFreeOpScheduler::find_highest(unsigned lo, unsigned hi) const
+{
+  unsigned p = hi;
+  while (p > lo) {
+    unsigned word = (p - 1) / BITS;
+    uint64_t bits = non_empty[word];
+    unsigned below = p - word * BITS;
+    if (below < BITS) {
+      bits &= (1ull << below) - 1;
+    }
+    if (bits) {
+      unsigned found = word * BITS + cbits(bits) - 1;
+      return found >= lo ? found : hi;
+    }
+    p = word * BITS;
+  }
+  return hi;
+}
+
+unsigned LockFreeOpScheduler::pick_weighted(unsigned hi) const
+{
+  // work on a snapshot, enqueues may mark more priorities meanwhile
+  std::array<uint64_t, NUM_PRIORITIES / BITS> marked;
+  unsigned total_prio = 0;
+  for (unsigned w = 0; w < marked.size(); ++w) {
+    marked[w] = non_empty[w];
+    if (hi <= w * BITS) {
+      marked[w] = 0;
+    } else if (hi < (w + 1) * BITS) {
+      marked[w] &= (1ull << (hi - w * BITS)) - 1;
+    }
+    for (uint64_t bits = marked[w]; bits; bits &= bits - 1) {
+      total_prio += w * BITS + ctz(bits) + 1;
+    }
+  }
+  if (total_prio == 0) {
+    return hi;
+  }
+  unsigned pick = rand() % total_prio;
+  for (unsigned w = 0; w < marked.size(); ++w) {
+    for (uint64_t bits = marked[w]; bits; bits &= bits - 1) {
+      unsigned p = w * BITS + ctz(bits);
+      if (pick <= p) {
+	return p;
+      }
+      pick -= p + 1;
+    }
+  }
+  ceph_abort_msg("picked past the total priority");
+}
+
+OpSchedulerItem LockFreeOpScheduler::pop(unsigned p)
+{
+  auto &prio = priorities[p];
+  std::optional<OpSchedulerItem> ret;
+  if (!prio.front.empty()) {
+    ret.emplace(std::move(prio.front.front()));
+    prio.front.pop_front();
+  } else {
+    // the size of prio is only bumped once an op is pushed
+    OpSchedulerItem *item = nullptr;
+    bool popped = prio.queue.pop(item);
+    ceph_assert(popped);
+    ret.emplace(std::move(*item));
+    delete item;
+  }
+  if (--prio.size == 0) {
+    non_empty[p / BITS].fetch_and(~(1ull << (p % BITS)));
+    // raced with an enqueue which marked it before we cleared it
+    if (prio.size > 0) {
+      mark_non_empty(p);
+    }
+  }
+  --total;
+  return std::move(*ret);
+}
+
+WorkItem LockFreeOpScheduler::dequeue()
+{
+  ceph_assert(!empty());
+  while (true) {
+    unsigned p = find_highest(cutoff, NUM_PRIORITIES);
+    if (p == NUM_PRIORITIES) {
+      p = pick_weighted(cutoff);
+      if (p == cutoff) {
+	continue;
+      }
+    }
+    if (priorities[p].size > 0) {
+      return pop(p);
+    }
+    // marked by an enqueue after its op was dequeued
+    non_empty[p / BITS].fetch_and(~(1ull << (p % BITS)));
+    if (priorities[p].size > 0) {
+      mark_non_empty(p);
+    }
+  }
+}
+
+void LockFreeOpScheduler::dump(ceph::Formatter &f) const
+{
+  f.dump_int("total", total);
+  f.open_array_section("high_queues");
+  for (unsigned p = NUM_PRIORITIES; p-- > 0; ) {
+    if (p == cutoff - 1) {
+      f.close_section();
+      f.open_array_section("queues");
+    }
+    uint64_t size = priorities[p].size;
+    if (size) {
+      f.open_object_section("subqueue");
+      f.dump_unsigned("priority", p);
+      f.dump_unsigned("size", size);
+      f.close_section();
+    }
+  }
+  f.close_section();
+}
+
+void LockFreeOpScheduler::print(std::ostream &out) const
+{
+  out << "LockFreeOpScheduler(cutoff=" << cutoff << ")";
+}
+
+}
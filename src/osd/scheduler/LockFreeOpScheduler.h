@@ -0,0 +1,95 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <ostream>
+
+#include <boost/lockfree/queue.hpp>
+
+#include "common/ceph_context.h"
+#include "osd/scheduler/OpScheduler.h"
+#include "osd/scheduler/OpSchedulerItem.h"
+
+namespace ceph::osd::scheduler {
+
+/**
+ * OpScheduler with a lock free multi-producer queue per priority
+ *
+ * Ops are enqueued without the OSDShard::shard_lock, so that the
+ * messenger threads do not contend on it with the shard's workers.
+ * enqueue_front and dequeue are only called by the workers and must
+ * still be serialized by the shard_lock.
+ *
+ * Like ClassedOpQueueScheduler<WeightedPriorityQueue>, ops with a
+ * priority at or above osd_op_queue_cut_off are dequeued in strict
+ * priority order, the others from a priority picked at random weighted
+ * by priority.  Ops of the same priority are dequeued in order.  Unlike
+ * WeightedPriorityQueue, the cost of the ops and their owner are not
+ * considered, and priorities are capped to CEPH_MSG_PRIO_HIGHEST.
+ */
+class LockFreeOpScheduler final : public OpScheduler {
+  static constexpr unsigned NUM_PRIORITIES = CEPH_MSG_PRIO_HIGHEST + 1;
+  static constexpr unsigned BITS = 64;
+
+  struct Priority {
+    /// ops enqueued
+    boost::lockfree::queue<OpSchedulerItem*> queue{0};
+    /// ops requeued with enqueue_front, under the shard_lock
+    std::deque<OpSchedulerItem> front;
+    std::atomic<uint64_t> size = {0};
+  };
+  std::array<Priority, NUM_PRIORITIES> priorities;
+  /// the priorities which may have ops, set after an enqueue bumps their size
+  std::array<std::atomic<uint64_t>, NUM_PRIORITIES / BITS> non_empty;
+  /// may briefly go negative, ops can be dequeued before they are counted
+  std::atomic<int64_t> total = {0};
+  const unsigned cutoff;
+
+  static unsigned get_priority(const OpSchedulerItem &item) {
+    return std::min(item.get_priority(), NUM_PRIORITIES - 1);
+  }
+  void mark_non_empty(unsigned p) {
+    non_empty[p / BITS].fetch_or(1ull << (p % BITS));
+  }
+  /// @return the highest priority in [lo, hi) with ops, or hi if none
+  unsigned find_highest(unsigned lo, unsigned hi) const;
+  /// pick a priority in [0, hi) with ops weighted by priority, or hi if none
+  unsigned pick_weighted(unsigned hi) const;
+  OpSchedulerItem pop(unsigned p);
+
+public:
+  explicit LockFreeOpScheduler(CephContext *cct);
+  ~LockFreeOpScheduler() final;
+
+  void enqueue(OpSchedulerItem &&item) final;
+  void enqueue_front(OpSchedulerItem &&item) final;
+
+  bool empty() const final {
+    return total <= 0;
+  }
+
+  WorkItem dequeue() final;
+
+  void dump(ceph::Formatter &f) const final;
+  void print(std::ostream &out) const final;
+
+  bool is_enqueue_lock_free() const final {
+    return true;
+  }
+};
+
+}
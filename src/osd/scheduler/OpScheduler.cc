@@ -17,10 +17,24 @@
 #include "osd/scheduler/OpScheduler.h"
 
 #include "common/WeightedPriorityQueue.h"
+#include "osd/scheduler/LockFreeOpScheduler.h"
 #include "osd/scheduler/mClockScheduler.h"
 
 namespace ceph::osd::scheduler {
 
+unsigned get_io_prio_cut(CephContext *cct)
+{
+  if (cct->_conf->osd_op_queue_cut_off == "debug_random") {
+    srand(time(NULL));
+    return (rand() % 2 < 1) ? CEPH_MSG_PRIO_HIGH : CEPH_MSG_PRIO_LOW;
+  } else if (cct->_conf->osd_op_queue_cut_off == "high") {
+    return CEPH_MSG_PRIO_HIGH;
+  } else {
+    // default / catch-all is 'low'
+    return CEPH_MSG_PRIO_LOW;
+  }
+}
+
 OpSchedulerRef make_scheduler(CephContext *cct)
 {
   const std::string *type = &cct->_conf->osd_op_queue;
@@ -42,6 +56,8 @@ OpSchedulerRef make_scheduler(CephContext *cct)
     );
   } else if (*type == "mclock_scheduler") {
     return std::make_unique<mClockScheduler>(cct);
+  } else if (*type == "lockfree_wpq") {
+    return std::make_unique<LockFreeOpScheduler>(cct);
   } else {
     ceph_assert("Invalid choice of wq" == 0);
   }
@@ -50,6 +50,12 @@ public:
   // Print human readable brief description with relevant parameters
   virtual void print(std::ostream &out) const = 0;
 
+  // Returns true iff enqueue may be called concurrently with the other
+  // methods, without holding the OSDShard::shard_lock
+  virtual bool is_enqueue_lock_free() const {
+    return false;
+  }
+
   // Destructor
   virtual ~OpScheduler() {};
 };
@@ -59,6 +65,9 @@ using OpSchedulerRef = std::unique_ptr<OpScheduler>;
 
 OpSchedulerRef make_scheduler(CephContext *cct);
 
+// Priority at and above which ops are dequeued in strict priority order
+unsigned get_io_prio_cut(CephContext *cct);
+
 /**
  * Implements OpScheduler in terms of OpQueue
  *
@@ -72,17 +81,6 @@ class ClassedOpQueueScheduler final : public OpScheduler {
   unsigned cutoff;
   T queue;
 
-  static unsigned int get_io_prio_cut(CephContext *cct) {
-    if (cct->_conf->osd_op_queue_cut_off == "debug_random") {
-      srand(time(NULL));
-      return (rand() % 2 < 1) ? CEPH_MSG_PRIO_HIGH : CEPH_MSG_PRIO_LOW;
-    } else if (cct->_conf->osd_op_queue_cut_off == "high") {
-      return CEPH_MSG_PRIO_HIGH;
-    } else {
-      // default / catch-all is 'low'
-      return CEPH_MSG_PRIO_LOW;
-    }
-  }
 public:
   template <typename... Args>
   ClassedOpQueueScheduler(CephContext *cct, Args&&... args) :
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <string.h>
+#include <vector>
 
 #include "include/types.h"
 #include "include/crc32c.h"
@@ -165,6 +166,55 @@ static uint32_t crc_check_table[] = {
 0xf8eafea1, 0xfe36fdae, 0xb4b546f1, 0x2e27ce89, 0xc1fde8a0, 0x99f2f157, 0xfde687a1, 0x40a75f50,
 0x6c653330, 0xf3e38821, 0xf4663e43, 0x2f7e801e, 0xfca360af, 0x53cd3c59, 0xd20da292, 0x812a0241 };
 
+TEST(Crc32c, Multi) {
+  unsigned char *a = (unsigned char *)malloc(4096 * 37);
+  for (unsigned i = 0; i < 4096 * 37; ++i)
+    a[i] = rand() & 0xff;
+  for (unsigned length : {1u, 7u, 8u, 13u, 512u, 4096u}) {
+    for (unsigned n : {1u, 3u, 4u, 5u, 16u, 37u}) {
+      std::vector<const unsigned char *> bufs(n);
+      for (unsigned i = 0; i < n; ++i)
+	bufs[i] = a + i * length + (i % 3);  // not all aligned
+      std::vector<uint32_t> out(n);
+      ceph_crc32c_multi(1234, bufs.data(), n, length, out.data());
+      for (unsigned i = 0; i < n; ++i)
+	ASSERT_EQ(ceph_crc32c(1234, bufs[i], length), out[i]);
+    }
+  }
+  free(a);
+}
+
+TEST(Crc32c, DISABLED_multi_performance) {
+  const unsigned len = 256 * 1024 * 1024;
+  unsigned char *a = (unsigned char *)malloc(len);
+  for (unsigned i = 0; i < len; i++)
+    a[i] = i & 0xff;
+  for (unsigned block : {512u, 4096u, 65536u}) {
+    unsigned n = len / block;
+    std::vector<const unsigned char *> bufs(n);
+    for (unsigned i = 0; i < n; ++i)
+      bufs[i] = a + i * block;
+    std::vector<uint32_t> serial(n), multi(n);
+
+    utime_t start = ceph_clock_now();
+    for (unsigned i = 0; i < n; ++i)
+      serial[i] = ceph_crc32c(-1, bufs[i], block);
+    utime_t end = ceph_clock_now();
+    float rate = (float)len / (float)(1024*1024) / (float)(end - start);
+    std::cout << "block " << block << " serial = " << rate << " MB/sec"
+	      << std::endl;
+
+    start = ceph_clock_now();
+    ceph_crc32c_multi(-1, bufs.data(), n, block, multi.data());
+    end = ceph_clock_now();
+    rate = (float)len / (float)(1024*1024) / (float)(end - start);
+    std::cout << "block " << block << " multi = " << rate << " MB/sec"
+	      << std::endl;
+    ASSERT_EQ(serial, multi);
+  }
+  free(a);
+}
+
 TEST(Crc32c, Range) {
   int len = sizeof(crc_check_table) / sizeof(crc_check_table[0]);
   unsigned char *b = (unsigned char *)malloc(len);
@@ -21,6 +21,7 @@
 #include "common/ceph_context.h"
 #include "common/config.h"
 #include "compressor/Compressor.h"
+#include "include/stringify.h"
 #include "compressor/CompressionPlugin.h"
 #include "global/global_context.h"
 #include "osd/OSDMap.h"
@@ -88,6 +89,54 @@ TEST_P(CompressorTest, small_round_trip)
        << " with " << GetParam() << std::endl;
 }
 
+TEST_P(CompressorTest, dictionary_round_trip)
+{
+  // many small json-ish records that share most of their structure
+  auto record = [](int i) {
+    bufferlist bl;
+    bl.append("{\"bucket\": \"photos\", \"owner\": \"user" + stringify(i % 7) +
+	      "\", \"size\": " + stringify(i * 37) +
+	      ", \"etag\": \"" + stringify(i * 7919) +
+	      "\", \"storage_class\": \"STANDARD\", \"tags\": []}");
+    return bl;
+  };
+  std::vector<bufferlist> samples;
+  for (int i = 0; i < 1000; ++i) {
+    samples.push_back(record(i));
+  }
+  bufferlist raw;
+  int r = compressor->train_dictionary(samples, 4096, &raw);
+  if (r == -EOPNOTSUPP) {
+    return;
+  }
+  ASSERT_EQ(0, r);
+  auto dict = compressor->load_dictionary(raw);
+  ASSERT_TRUE(dict);
+
+  bufferlist orig = record(12345);
+  bufferlist plain, with_dict;
+  boost::optional<int32_t> plain_message, dict_message;
+  ASSERT_EQ(0, compressor->compress(orig, plain, plain_message));
+  ASSERT_EQ(0, compressor->compress_with_dictionary(orig, with_dict,
+						    dict_message, dict));
+  cout << "orig " << orig.length() << " compressed " << plain.length()
+       << " with dictionary " << with_dict.length() << std::endl;
+  ASSERT_LT(with_dict.length(), plain.length());
+  ASSERT_FALSE(compressor->get_dictionary_id(plain_message));
+  auto id = compressor->get_dictionary_id(dict_message);
+  ASSERT_TRUE(id);
+  ASSERT_EQ(dict->id, *id);
+
+  bufferlist decompressed;
+  auto p = with_dict.cbegin();
+  ASSERT_EQ(0, compressor->decompress_with_dictionary(
+	      p, with_dict.length(), decompressed, dict_message, dict));
+  ASSERT_TRUE(decompressed.contents_equal(orig));
+  // without the dictionary it must fail rather than return garbage
+  decompressed.clear();
+  ASSERT_NE(0, compressor->decompress(with_dict, decompressed, dict_message));
+}
+
 TEST_P(CompressorTest, big_round_trip_repeated)
 {
   unsigned len = 1048576 * 4;
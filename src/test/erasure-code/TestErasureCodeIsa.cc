@@ -874,6 +874,61 @@ TEST_F(IsaErasureCodeTest, isa_xor_codec)
   EXPECT_EQ(5, cnt_cf);
 }
 
+TEST_F(IsaErasureCodeTest, parity_delta)
+{
+  // vandermonde, cauchy and the (4,1) xor codec
+  const struct {
+    int matrix;
+    const char *m;
+  } codecs[] = {
+    { ErasureCodeIsaDefault::kVandermonde, "2" },
+    { ErasureCodeIsaDefault::kCauchy, "3" },
+    { ErasureCodeIsaDefault::kVandermonde, "1" },
+  };
+  for (auto &codec : codecs) {
+    ErasureCodeIsaDefault Isa(tcache, codec.matrix);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = codec.m;
+    EXPECT_EQ(0, Isa.init(profile, &cerr));
+    EXPECT_TRUE(Isa.supports_parity_delta());
+
+    const int k = 4;
+    const int m = atoi(codec.m);
+    bufferlist in;
+    for (unsigned i = 0; i < 4096; i++)
+      in.append((char)(i * 7));
+    set<int> want_to_encode;
+    for (int i = 0; i < k + m; i++)
+      want_to_encode.insert(i);
+    map<int, bufferlist> encoded;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, in, &encoded));
+    unsigned length = encoded[0].length();
+
+    // modify part of data chunk 2 and encode the result from scratch
+    bufferptr p(buffer::create_page_aligned(length));
+    encoded[2].begin().copy(length, p.c_str());
+    for (unsigned j = 100; j < 200; j++)
+      p[j] ^= 0xa5;
+    bufferlist modified;
+    modified.push_back(p);
+    bufferlist in2;
+    for (int i = 0; i < k; i++)
+      in2.append(i == 2 ? modified : encoded[i]);
+    map<int, bufferlist> reencoded;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, in2, &reencoded));
+
+    map<int, bufferlist> deltas;
+    EXPECT_EQ(0, Isa.encode_delta(encoded[2], modified, &deltas[2]));
+    map<int, bufferlist> coding;
+    for (int i = k; i < k + m; i++)
+      coding[i].append(encoded[i].c_str(), length);
+    EXPECT_EQ(0, Isa.apply_delta(deltas, &coding));
+    for (int i = k; i < k + m; i++)
+      EXPECT_TRUE(coding[i].contents_equal(reencoded[i]));
+  }
+}
+
 TEST_F(IsaErasureCodeTest, create_rule)
 {
   std::unique_ptr<CrushWrapper> c = std::make_unique<CrushWrapper>();
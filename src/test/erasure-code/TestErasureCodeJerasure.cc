@@ -227,6 +227,60 @@ TYPED_TEST(ErasureCodeTest, minimum_to_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, parity_delta)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+
+  bufferlist in;
+  for (unsigned i = 0; i < 4096; i++)
+    in.append((char)(i * 7));
+  set<int> want_to_encode = { 0, 1, 2, 3, 4, 5 };
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded));
+  unsigned length = encoded[0].length();
+
+  // modify part of data chunks 1 and 3 and encode the result from scratch
+  map<int, bufferlist> modified;
+  for (int i : { 1, 3 }) {
+    bufferptr p(buffer::create_page_aligned(length));
+    encoded[i].begin().copy(length, p.c_str());
+    for (unsigned j = 16; j < 48; j++)
+      p[j] ^= 0x5a + i;
+    modified[i].push_back(p);
+  }
+  bufferlist in2;
+  for (int i = 0; i < 4; i++)
+    in2.append(modified.count(i) ? modified[i] : encoded[i]);
+  map<int, bufferlist> reencoded;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, in2, &reencoded));
+  EXPECT_EQ(length, reencoded[0].length());
+
+  map<int, bufferlist> deltas;
+  for (auto &&i : modified) {
+    EXPECT_EQ(0, jerasure.encode_delta(encoded[i.first], i.second,
+				       &deltas[i.first]));
+  }
+  map<int, bufferlist> coding;
+  for (int i = 4; i < 6; i++)
+    coding[i].append(encoded[i].c_str(), length);
+  if (!jerasure.supports_parity_delta()) {
+    EXPECT_EQ(-EOPNOTSUPP, jerasure.apply_delta(deltas, &coding));
+    return;
+  }
+  EXPECT_EQ(0, jerasure.apply_delta(deltas, &coding));
+  for (int i = 4; i < 6; i++)
+    EXPECT_TRUE(coding[i].contents_equal(reencoded[i]));
+
+  // all coding chunks must be given
+  coding.erase(5);
+  EXPECT_EQ(-EINVAL, jerasure.apply_delta(deltas, &coding));
+}
+
 TEST(ErasureCodeTest, encode)
 {
   ErasureCodeJerasureReedSolomonVandermonde jerasure;
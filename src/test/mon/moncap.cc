@@ -262,6 +262,12 @@ TEST(MonCap, ProfileOSD) {
                              true, true, {}));
   ASSERT_TRUE(cap.is_capable(NULL, name, "", "config-key delete", ca, true,
                              true, true, {}));
+
+  ca["key"] = "compression_dictionary/1234abcd";
+  ASSERT_TRUE(cap.is_capable(NULL, name, "", "config-key get", ca, true, true,
+                             true, {}));
+  ASSERT_FALSE(cap.is_capable(NULL, name, "", "config-key set", ca, true, true,
+                              true, {}));
 }
 
 TEST(MonCap, CommandRegEx) {
@@ -245,6 +245,36 @@ TEST_P(RoundTripTest, Reuse) {
   }
 }
 
+TEST_P(RoundTripTest, PeekFirstSegment) {
+  const auto& m = std::get<1>(GetParam());
+  auto tx_frame = TestFrame::Encode(m_header, m_front, m_middle, m_data);
+  auto onwire_bl = tx_frame.get_buffer(m_tx_frame_asm);
+
+  bufferlist preamble_bl;
+  onwire_bl.splice(0, m_rx_frame_asm.get_preamble_onwire_len(), &preamble_bl);
+  m_rx_frame_asm.disassemble_preamble(preamble_bl);
+  bufferlist segment_bl;
+  uint32_t onwire_len = m_rx_frame_asm.get_segment_onwire_len(0);
+  if (onwire_len > 0) {
+    onwire_bl.splice(0, onwire_len, &segment_bl);
+  }
+
+  // too long
+  char buf[64];
+  EXPECT_FALSE(m_rx_frame_asm.peek_first_segment(
+      preamble_bl, segment_bl, m_header.length() + 1, buf));
+
+  uint32_t len = std::min<uint32_t>(m_header.length(), sizeof(buf));
+  if (m.is_secure && (!m.is_rev1 || len > FRAME_PREAMBLE_INLINE_SIZE)) {
+    EXPECT_FALSE(m_rx_frame_asm.peek_first_segment(
+        preamble_bl, segment_bl, len, buf));
+    return;
+  }
+  ASSERT_TRUE(m_rx_frame_asm.peek_first_segment(
+      preamble_bl, segment_bl, len, buf));
+  EXPECT_EQ(std::string(len, 'H'), std::string(buf, len));
+}
+
 static const round_trip_instance_t round_trip_instances[] = {
   // first segment is empty
   { 0,   0,   0,   0, 1, {{32,  0,  17,   0,   0,  0},
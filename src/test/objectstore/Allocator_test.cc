@@ -483,4 +483,4 @@ TEST_P(AllocTest, test_alloc_contiguous)
 INSTANTIATE_TEST_SUITE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap", "avl", "hybrid"));
+  ::testing::Values("stupid", "bitmap", "avl", "hybrid", "sizeclass"));
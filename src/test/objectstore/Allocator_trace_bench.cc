@@ -0,0 +1,234 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Allocator trace replay benchmark.
+ *
+ * Replays the same allocation trace against each allocator and reports
+ * how fragmented the resulting layout is and how much CPU it took.  The
+ * trace is either generated (an RBD-like mix of full object writes,
+ * small overwrites and deletes on a mostly full device) or loaded from
+ * the file named by ALLOC_TRACE, one op per line:
+ *
+ *   a <id> <bytes>    allocate bytes and remember the extents as <id>
+ *   f <id>            release everything remembered as <id>
+ */
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <boost/scoped_ptr.hpp>
+#include <boost/random/uniform_int.hpp>
+#include <gtest/gtest.h>
+
+#include "common/ceph_time.h"
+#include "include/Context.h"
+#include "include/intarith.h"
+#include "os/bluestore/Allocator.h"
+
+typedef boost::mt11213b gen_type;
+
+struct trace_op_t {
+  bool alloc;
+  uint64_t id;
+  uint64_t length;
+};
+typedef std::vector<trace_op_t> trace_t;
+
+static const uint64_t _1m = 1024 * 1024;
+static const uint64_t _1G = 1024 * 1024 * 1024;
+
+static const uint64_t capacity = 64 * _1G;
+static const uint64_t alloc_unit = 4096;
+static const uint64_t max_alloc_size = 0;
+
+static bool verbose = getenv("VERBOSE") != nullptr;
+
+/*
+ * Objects of 4M are written in full, then receive 4K-64K overwrites
+ * (each a new allocation that supersedes an older one of the same
+ * object) and are eventually deleted.  The device is kept between 70%
+ * and 90% full so that releases and allocations interleave the way they
+ * do on a long running OSD.
+ */
+static trace_t generate_trace(gen_type& rng, uint64_t ops)
+{
+  trace_t trace;
+  const uint64_t object_size = 4 * _1m;
+  const uint64_t high_mark = capacity / 10 * 9;
+  const uint64_t low_mark = capacity / 10 * 7;
+  boost::uniform_int<> op_dist(0, 99);
+  boost::uniform_int<> small_dist(1, 16);
+
+  // object -> ids of its live allocations and their lengths
+  std::map<uint64_t, std::map<uint64_t, uint64_t>> objects;
+  uint64_t next_object = 0;
+  uint64_t next_id = 0;
+  uint64_t used = 0;
+  bool draining = false;
+
+  auto remove_object = [&](std::map<uint64_t,
+			   std::map<uint64_t, uint64_t>>::iterator p) {
+    for (auto& [id, length] : p->second) {
+      trace.push_back({false, id, length});
+      used -= length;
+    }
+    objects.erase(p);
+  };
+  auto random_object = [&]() {
+    auto p = objects.lower_bound(rng() % next_object);
+    return p == objects.end() ? objects.begin() : p;
+  };
+
+  while (trace.size() < ops) {
+    if (used >= high_mark) {
+      draining = true;
+    } else if (used <= low_mark) {
+      draining = false;
+    }
+    unsigned op = op_dist(rng);
+    if (objects.empty() || (!draining && op < 30)) {
+      auto id = next_id++;
+      objects[next_object++][id] = object_size;
+      trace.push_back({true, id, object_size});
+      used += object_size;
+    } else if (draining && op < 40) {
+      remove_object(random_object());
+    } else {
+      auto p = random_object();
+      auto length = small_dist(rng) * alloc_unit;
+      auto id = next_id++;
+      trace.push_back({true, id, length});
+      used += length;
+      // the overwrite supersedes an older small allocation now and then
+      if (p->second.size() > 1 && op % 2) {
+	auto q = std::next(p->second.begin(), 1 + rng() % (p->second.size() - 1));
+	trace.push_back({false, q->first, q->second});
+	used -= q->second;
+	p->second.erase(q);
+      }
+      p->second[id] = length;
+    }
+  }
+  return trace;
+}
+
+static bool load_trace(const char* fn, trace_t* trace)
+{
+  std::ifstream in(fn);
+  if (!in) {
+    return false;
+  }
+  std::string op;
+  uint64_t id;
+  while (in >> op >> id) {
+    if (op == "a") {
+      uint64_t length;
+      in >> length;
+      trace->push_back({true, id, p2roundup(length, alloc_unit)});
+    } else if (op == "f") {
+      trace->push_back({false, id, 0});
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+struct replay_result_t {
+  uint64_t allocs = 0;
+  uint64_t extents = 0;
+  uint64_t failed = 0;
+  double frag = 0;
+  double frag_score = 0;
+  double seconds = 0;
+};
+
+static std::map<std::string, replay_result_t> results_per_allocator;
+
+class AllocTraceTest : public ::testing::TestWithParam<const char*> {
+protected:
+  static trace_t trace;
+
+public:
+  static void SetUpTestCase() {
+    const char* fn = getenv("ALLOC_TRACE");
+    if (fn) {
+      ASSERT_TRUE(load_trace(fn, &trace)) << "can't parse " << fn;
+    } else {
+      gen_type rng(0);
+      trace = generate_trace(rng, 2000000);
+    }
+    std::cout << "trace ops=" << trace.size() << std::endl;
+  }
+  static void TearDownTestCase() {
+    std::cout << "Summary: " << std::endl;
+    for (auto& [name, r] : results_per_allocator) {
+      std::cout << name
+		<< "    extents/alloc=" << double(r.extents) / std::max<uint64_t>(r.allocs, 1)
+		<< " failed=" << r.failed
+		<< " frag=" << r.frag
+		<< " frag.score=" << r.frag_score
+		<< " time=" << r.seconds * 1000 << "ms" << std::endl;
+    }
+    trace.clear();
+  }
+};
+
+trace_t AllocTraceTest::trace;
+
+TEST_P(AllocTraceTest, replay)
+{
+  std::string name = GetParam();
+  boost::scoped_ptr<Allocator> alloc(
+    Allocator::create(g_ceph_context, name, capacity, alloc_unit));
+  ASSERT_TRUE(alloc);
+  alloc->init_add_free(0, capacity);
+
+  std::unordered_map<uint64_t, PExtentVector> live;
+  replay_result_t& r = results_per_allocator[name];
+  r = replay_result_t();
+
+  auto start = ceph::mono_clock::now();
+  for (auto& op : trace) {
+    if (op.alloc) {
+      PExtentVector extents;
+      int64_t got = alloc->allocate(op.length, alloc_unit, max_alloc_size, 0,
+				    &extents);
+      if (got < (int64_t)op.length) {
+	++r.failed;
+	if (got > 0) {
+	  alloc->release(extents);
+	}
+	continue;
+      }
+      ++r.allocs;
+      r.extents += extents.size();
+      live[op.id] = std::move(extents);
+    } else {
+      auto p = live.find(op.id);
+      if (p != live.end()) {
+	alloc->release(p->second);
+	live.erase(p);
+      }
+    }
+  }
+  r.seconds = std::chrono::duration<double>(
+    ceph::mono_clock::now() - start).count();
+  r.frag = alloc->get_fragmentation();
+  r.frag_score = alloc->get_fragmentation_score();
+  if (verbose) {
+    std::cout << name << " live=" << live.size()
+	      << " free=" << alloc->get_free() / _1m << "MB" << std::endl;
+  }
+
+  for (auto& [id, extents] : live) {
+    alloc->release(extents);
+  }
+  ASSERT_EQ(capacity, alloc->get_free());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+  Allocator,
+  AllocTraceTest,
+  ::testing::Values("stupid", "bitmap", "avl", "hybrid", "sizeclass"));
@@ -1109,6 +1109,58 @@ TEST_P(StoreTest, CompressionTest) {
   doCompressionTest();
 }
 
+TEST_P(StoreTest, CompressionThreadsTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_compression_threads", "4");
+  SetVal(g_conf(), "bluestore_compression_algorithm", "snappy");
+  SetVal(g_conf(), "bluestore_compression_mode", "force");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  store->umount();
+  ASSERT_EQ(store->mount(), 0);
+  doCompressionTest();
+
+  // a write of many blobs has the pool compress some of them; the writer
+  // helps with its own batch, so retry until a worker got one
+  const PerfCounters* logger = store->get_perf_counters();
+  coll_t cid(spg_t(pg_t(0, 777), shard_id_t::NO_SHARD));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  bufferlist bl;
+  bl.append(std::string(4 << 20, 'c'));
+  unsigned written = 0;
+  while (written < 32 &&
+         logger->get(l_bluestore_compress_offloaded_count) == 0) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(written),
+                                        CEPH_NOSNAP)));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+    ++written;
+  }
+  ASSERT_GT(logger->get(l_bluestore_compress_offloaded_count), 0u);
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < written; ++i) {
+      t.remove(cid, ghobject_t(hobject_t(sobject_t("obj" + stringify(i),
+                                                   CEPH_NOSNAP))));
+    }
+    t.remove_collection(cid);
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  ch.reset();
+
+  SetVal(g_conf(), "bluestore_compression_threads", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  store->umount();
+  ASSERT_EQ(store->mount(), 0);
+}
+
 TEST_P(StoreTest, SimpleObjectTest) {
   int r;
   coll_t cid;
@@ -5519,6 +5571,148 @@ TEST_P(StoreTest, OMapIterator) {
   }
 }
 
+TEST_P(StoreTest, OMapGetBatch) {
+  coll_t cid;
+  ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  SetVal(g_conf(), "bluestore_omap_delete_range_threshold", "1");
+  g_conf().apply_changes(nullptr);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.touch(cid, hoid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  map<string, bufferlist> attrs;
+  {
+    for (int i = 0; i < 100; i++) {
+      bufferlist bl;
+      bl.append(stringify(i));
+      attrs[(i % 2 ? "b-" : "a-") + stringify(1000 + i)] = bl;
+    }
+    bufferlist header;
+    header.append("header");
+    ObjectStore::Transaction t;
+    t.omap_setheader(cid, hoid, header);
+    t.omap_setkeys(cid, hoid, attrs);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // page through everything
+  {
+    map<string, bufferlist> got;
+    string start_after;
+    bool more = true;
+    unsigned calls = 0;
+    while (more) {
+      map<string, bufferlist> out;
+      r = store->omap_get_batch(ch, hoid, start_after, "", 7,
+				std::numeric_limits<uint64_t>::max(),
+				&out, &more);
+      ASSERT_EQ(r, 0);
+      ASSERT_LE(out.size(), 7u);
+      ASSERT_TRUE(more || out.size() < 7 || got.size() + out.size() == 100);
+      if (out.empty()) {
+	break;
+      }
+      start_after = out.rbegin()->first;
+      got.insert(out.begin(), out.end());
+      ++calls;
+    }
+    ASSERT_EQ(15u, calls);
+    ASSERT_EQ(attrs.size(), got.size());
+    for (auto& [key, value] : attrs) {
+      ASSERT_TRUE(got.count(key));
+      ASSERT_TRUE(bl_eq(value, got[key]));
+    }
+  }
+  // prefix filter, starting before and inside the prefix
+  {
+    map<string, bufferlist> out;
+    bool more;
+    r = store->omap_get_batch(ch, hoid, "", "b-", 1000,
+			      std::numeric_limits<uint64_t>::max(),
+			      &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_FALSE(more);
+    ASSERT_EQ(50u, out.size());
+    ASSERT_EQ("b-1001", out.begin()->first);
+    out.clear();
+    r = store->omap_get_batch(ch, hoid, "b-1011", "b-", 2,
+			      std::numeric_limits<uint64_t>::max(),
+			      &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_TRUE(more);
+    ASSERT_EQ(2u, out.size());
+    ASSERT_EQ("b-1013", out.begin()->first);
+    out.clear();
+    r = store->omap_get_batch(ch, hoid, "", "c-", 1000,
+			      std::numeric_limits<uint64_t>::max(),
+			      &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_FALSE(more);
+    ASSERT_TRUE(out.empty());
+  }
+  // byte limit: stop once at least max_bytes have been returned
+  {
+    map<string, bufferlist> out;
+    bool more;
+    r = store->omap_get_batch(ch, hoid, "", "", 1000, 1, &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_TRUE(more);
+    ASSERT_EQ(1u, out.size());
+  }
+  // range removal and clear go through range tombstones now
+  {
+    ObjectStore::Transaction t;
+    t.omap_rmkeyrange(cid, hoid, "a-", "b-");
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    map<string, bufferlist> out;
+    bool more;
+    r = store->omap_get_batch(ch, hoid, "", "", 1000,
+			      std::numeric_limits<uint64_t>::max(),
+			      &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(50u, out.size());
+    ASSERT_EQ("b-1001", out.begin()->first);
+    bufferlist header;
+    r = store->omap_get_header(ch, hoid, &header);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(string("header"), header.to_str());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.omap_clear(cid, hoid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    map<string, bufferlist> out;
+    bool more;
+    r = store->omap_get_batch(ch, hoid, "", "", 1000,
+			      std::numeric_limits<uint64_t>::max(),
+			      &out, &more);
+    ASSERT_EQ(r, 0);
+    ASSERT_TRUE(out.empty());
+  }
+  {
+    map<string, bufferlist> out;
+    bool more;
+    r = store->omap_get_batch(ch, ghobject_t(hobject_t("nope", "", CEPH_NOSNAP, 0, 0, "")),
+			      "", "", 1000, 1000, &out, &more);
+    ASSERT_EQ(r, -ENOENT);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, XattrTest) {
   coll_t cid;
   ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
@@ -7245,6 +7439,150 @@ TEST_P(StoreTestSpecificAUSize, DeferredOnBigOverwrite) {
 }
 
 
+TEST_P(StoreTestSpecificAUSize, BluestoreKVSyncPipeline) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // read at mount, so set before it
+  SetVal(g_conf(), "bluestore_kv_sync_pipeline", "true");
+  SetVal(g_conf(), "bluestore_kv_finalize_threads", "4");
+  // have the pipeline drain for a new nid_max/blobid_max over and over
+  SetVal(g_conf(), "bluestore_nid_prealloc", "8");
+  SetVal(g_conf(), "bluestore_blobid_prealloc", "8");
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "true");
+  size_t block_size = 4096;
+  StartDeferred(block_size);
+
+  const unsigned num_colls = 8;
+  const unsigned num_objs = 16;
+  const unsigned num_rounds = 8;
+  int r;
+  vector<coll_t> cids;
+  vector<ObjectStore::CollectionHandle> chs;
+  for (unsigned c = 0; c < num_colls; ++c) {
+    coll_t cid(spg_t(pg_t(c, 77), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    cids.push_back(cid);
+    chs.push_back(ch);
+  }
+  auto obj = [](unsigned c, unsigned i) {
+    return ghobject_t(hobject_t(
+      sobject_t("obj." + stringify(c) + "." + stringify(i), CEPH_NOSNAP)));
+  };
+  auto data = [&](unsigned round, unsigned c, unsigned i) {
+    bufferlist bl;
+    bl.append(string(block_size, 'a' + (round + c + i) % 26));
+    return bl;
+  };
+
+  // every collection gets new objects and small overwrites, which go
+  // deferred, in flight across all the finalize shards at once
+  const PerfCounters* logger = store->get_perf_counters();
+  for (unsigned round = 0; round < num_rounds; ++round) {
+    std::list<C_SaferCond> commits;
+    for (unsigned c = 0; c < num_colls; ++c) {
+      for (unsigned i = 0; i < num_objs; ++i) {
+	ObjectStore::Transaction t;
+	if (round == 0) {
+	  bufferlist bl;
+	  bl.append(string(block_size * 16, 'z'));
+	  t.write(cids[c], obj(c, i), 0, bl.length(), bl);
+	}
+	auto bl = data(round, c, i);
+	t.write(cids[c], obj(c, i), block_size * round, bl.length(), bl);
+	t.register_on_commit(&commits.emplace_back());
+	store->queue_transaction(chs[c], std::move(t));
+      }
+    }
+    for (auto& c : commits) {
+      c.wait();
+    }
+  }
+  ASSERT_GT(logger->get(l_bluestore_write_deferred), 0u);
+
+  // remove half of the collections while the others keep writing, so
+  // that several shards queue collections for reaping
+  {
+    std::list<C_SaferCond> commits;
+    for (unsigned c = 0; c < num_colls; ++c) {
+      ObjectStore::Transaction t;
+      if (c % 2) {
+	for (unsigned i = 0; i < num_objs; ++i) {
+	  t.remove(cids[c], obj(c, i));
+	}
+	t.remove_collection(cids[c]);
+      } else {
+	for (unsigned i = 0; i < num_objs; ++i) {
+	  auto bl = data(num_rounds, c, i);
+	  t.write(cids[c], obj(c, i), block_size * num_rounds, bl.length(), bl);
+	}
+      }
+      t.register_on_commit(&commits.emplace_back());
+      store->queue_transaction(chs[c], std::move(t));
+    }
+    for (auto& c : commits) {
+      c.wait();
+    }
+  }
+
+  auto verify = [&]() {
+    for (unsigned c = 0; c < num_colls; ++c) {
+      if (c % 2) {
+	ASSERT_FALSE(store->collection_exists(cids[c]));
+	continue;
+      }
+      for (unsigned i = 0; i < num_objs; ++i) {
+	bufferlist expected, bl;
+	for (unsigned round = 0; round <= num_rounds; ++round) {
+	  expected.append(data(round, c, i));
+	}
+	expected.append(string(block_size * (16 - num_rounds - 1), 'z'));
+	r = store->read(chs[c], obj(c, i), 0, block_size * 16, bl);
+	ASSERT_EQ(r, (int)block_size * 16);
+	ASSERT_TRUE(bl_eq(expected, bl));
+      }
+    }
+  };
+  verify();
+
+  // the umount fsck catches nids or blob ids handed out twice, and the
+  // remount checks that the max they were taken from was made durable
+  for (auto& ch : chs) {
+    ch.reset();
+  }
+  CloseAndReopen();
+  for (unsigned c = 0; c < num_colls; c += 2) {
+    chs[c] = store->open_collection(cids[c]);
+  }
+  verify();
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < num_objs; ++i) {
+      auto bl = data(0, 0, i);
+      t.write(cids[0], obj(num_colls, i), 0, bl.length(), bl);
+    }
+    r = queue_transaction(store, chs[0], std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned c = 0; c < num_colls; c += 2) {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < num_objs; ++i) {
+      t.remove(cids[c], obj(c, i));
+      if (c == 0) {
+	t.remove(cids[c], obj(num_colls, i));
+      }
+    }
+    t.remove_collection(cids[c]);
+    r = queue_transaction(store, chs[c], std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTestSpecificAUSize, DeferredDifferentChunks) {
 
   if (string(GetParam()) != "bluestore")
@@ -8262,6 +8600,88 @@ TEST_P(StoreTest, BluestoreRepairGlobalStatsFixOnMount)
   bstore->mount();
 }
 
+TEST_P(StoreTest, BluestoreDefrag)
+{
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_defrag_interval", "0");
+  SetVal(g_conf(), "bluestore_defrag_min_fragments", "2");
+  SetVal(g_conf(), "bluestore_defrag_fragments_per_mb", "2");
+  SetVal(g_conf(), "bluestore_defrag_blobs_per_mb", "0");
+  g_conf().apply_changes(nullptr);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  const uint64_t pool = 555;
+  coll_t cid(spg_t(pg_t(0, pool), shard_id_t::NO_SHARD));
+  ghobject_t hoid = make_object("Object 1", pool);
+  ghobject_t hoid2 = make_object("Object 2", pool);
+  const size_t chunk = 65536;
+  const size_t repeats = 16;
+  bufferlist data, data2;
+  int r;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // interleave the writes so neither object ends up contiguous on disk
+  for (size_t i = 0; i < repeats; ++i) {
+    bufferlist bl, bl2;
+    bl.append(std::string(chunk, 'a' + i));
+    bl2.append(std::string(chunk, 'A' + i));
+    data.append(bl);
+    data2.append(bl2);
+    {
+      ObjectStore::Transaction t;
+      t.write(cid, hoid, i * chunk, bl.length(), bl);
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    {
+      ObjectStore::Transaction t;
+      t.write(cid, hoid2, i * chunk, bl2.length(), bl2);
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  }
+
+  ASSERT_EQ(1, bstore->defrag_object(ch, hoid));
+  // nothing left to do
+  ASSERT_EQ(0, bstore->defrag_object(ch, hoid));
+  ASSERT_EQ(-ENOENT, bstore->defrag_object(ch, make_object("Object 3", pool)));
+
+  // a quarter of the object at a time
+  SetVal(g_conf(), "bluestore_defrag_max_bytes",
+	 stringify(chunk * repeats / 4).c_str());
+  g_conf().apply_changes(nullptr);
+  for (size_t i = 0; i < 4; ++i) {
+    ASSERT_EQ(1, bstore->defrag_object(ch, hoid2));
+  }
+  ASSERT_EQ(0, bstore->defrag_object(ch, hoid2));
+  {
+    bufferlist bl;
+    r = store->read(ch, hoid, 0, data.length(), bl);
+    ASSERT_EQ(r, (int)data.length());
+    ASSERT_TRUE(bl_eq(data, bl));
+    bl.clear();
+    r = store->read(ch, hoid2, 0, data2.length(), bl);
+    ASSERT_EQ(r, (int)data2.length());
+    ASSERT_TRUE(bl_eq(data2, bl));
+  }
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+  {
+    bufferlist bl;
+    ch = store->open_collection(cid);
+    r = store->read(ch, hoid, 0, data.length(), bl);
+    ASSERT_EQ(r, (int)data.length());
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+}
+
 TEST_P(StoreTest, BluestoreStatistics) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -8461,6 +8881,153 @@ TEST_P(StoreTest, SpuriousReadErrorTest) {
   }
 }
 
+TEST_P(StoreTest, BluestoreDeepFsckThreads) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  const unsigned num_objects = 64;
+  bufferlist bl;
+  bl.append(std::string(0x3000, 'a'));
+  for (unsigned i = 0; i < num_objects; ++i) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  bstore->umount();
+
+  SetVal(g_conf(), "bluestore_fsck_deep_read_threads", "4");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(bstore->fsck(true), 0);
+
+  // every object's read-back fails; all of them must be counted
+  SetVal(g_conf(), "bluestore_retry_disk_reads", "0");
+  SetVal(g_conf(), "bluestore_debug_inject_csum_err_probability", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(bstore->fsck(true), (int)num_objects);
+  SetVal(g_conf(), "bluestore_fsck_deep_read_threads", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(bstore->fsck(true), (int)num_objects);
+
+  SetVal(g_conf(), "bluestore_debug_inject_csum_err_probability", "0");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  ASSERT_EQ(bstore->fsck(true), 0);
+  bstore->mount();
+}
+
+TEST_P(StoreTest, BluestoreFsckFreelistThreads) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl;
+    bl.append(std::string(0x30000, 'a'));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  bstore->umount();
+
+  // the freelist check splits the device between threads; what it finds
+  // must not depend on how many there are
+  auto fsck_with_threads = [&](int expected) {
+    for (auto n : {"1", "0", "3", "64"}) {
+      SetVal(g_conf(), "bluestore_fsck_freelist_threads", n);
+      g_ceph_context->_conf.apply_changes(nullptr);
+      ASSERT_EQ(bstore->fsck(false), expected) << n << " threads";
+    }
+  };
+  fsck_with_threads(0);
+
+  bstore->mount();
+  bstore->inject_leaked(0x30000);
+  bstore->umount();
+  fsck_with_threads(1);
+  ASSERT_EQ(bstore->repair(false), 0);
+  fsck_with_threads(0);
+
+  bstore->mount();
+  bstore->inject_false_free(cid, hoid);
+  bstore->umount();
+  SetVal(g_conf(), "bluestore_fsck_freelist_threads", "1");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  int false_free_errors = bstore->fsck(false);
+  ASSERT_GT(false_free_errors, 0);
+  fsck_with_threads(false_free_errors);
+  ASSERT_EQ(bstore->repair(false), 0);
+  fsck_with_threads(0);
+
+  SetVal(g_conf(), "bluestore_fsck_freelist_threads", "4");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  bstore->mount();
+}
+
+TEST_P(StoreTest, BluestoreAllocSnapshot) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  bl.append(std::string(0x10000, 'a'));
+  for (unsigned i = 0; i < 32; ++i) {
+    ObjectStore::Transaction t;
+    ghobject_t hoid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+    // leave holes so the free space is fragmented
+    t.write(cid, hoid, 0, bl.length(), bl);
+    if (i % 2) {
+      t.zero(cid, hoid, 0x4000, 0x4000);
+    }
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+
+  SetVal(g_conf(), "bluestore_alloc_snapshot", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  bstore->umount();
+  bstore->mount();
+  store_statfs_t from_snapshot;
+  ASSERT_EQ(store->statfs(&from_snapshot), 0);
+  bstore->umount();
+
+  // a snapshot is consumed by the mount that follows it
+  SetVal(g_conf(), "bluestore_alloc_snapshot", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  bstore->mount();
+  store_statfs_t from_freelist;
+  ASSERT_EQ(store->statfs(&from_freelist), 0);
+  ASSERT_EQ(from_snapshot.available, from_freelist.available);
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
 TEST_P(StoreTest, mergeRegionTest) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -8728,6 +9295,78 @@ void doManySetAttr(ObjectStore* store,
   test_obj.shutdown();
 }
 
+TEST_P(StoreTestSpecificAUSize, BluestoreFastTier) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  SetVal(g_conf(), "bluestore_block_db_create", "true");
+  SetVal(g_conf(), "bluestore_block_db_size", "1073741824");
+  SetVal(g_conf(), "bluestore_fast_tier_size", "67108864");
+  SetVal(g_conf(), "bluestore_fast_tier_promote_reads", "2");
+  // no deferred writes, the overwrite below goes to new space
+  SetVal(g_conf(), "bluestore_debug_enforce_settings", "ssd");
+  g_conf().apply_changes(nullptr);
+
+  StartDeferred(4096);
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+  const PerfCounters* logger = bstore->get_fast_tier_perf_counters();
+  ASSERT_TRUE(logger);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  auto write = [&](char c) {
+    bufferlist bl;
+    bl.append(std::string(16384, c));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl,
+	    CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+    return queue_transaction(store, ch, std::move(t));
+  };
+  // bypass the buffer cache so every read goes to a device
+  auto read_until_hit = [&](char c) {
+    uint64_t hits = logger->get(l_bluestore_tier_hit);
+    for (int i = 0; i < 500; ++i) {
+      bufferlist bl;
+      ASSERT_EQ(16384, store->read(ch, hoid, 0, 16384, bl,
+				   CEPH_OSD_OP_FLAG_FADVISE_DONTNEED));
+      ASSERT_EQ(std::string(16384, c), bl.to_str());
+      if (logger->get(l_bluestore_tier_hit) > hits) {
+	return;
+      }
+      usleep(10000);
+    }
+    FAIL() << "never read from the fast tier";
+  };
+
+  ASSERT_EQ(write('a'), 0);
+  read_until_hit('a');
+  ASSERT_GT(logger->get(l_bluestore_tier_promote), 0u);
+
+  // overwritten data must not be served from the tier
+  ASSERT_EQ(write('b'), 0);
+  read_until_hit('b');
+  ASSERT_GT(logger->get(l_bluestore_tier_invalidate), 0u);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  bstore->mount();
+}
+
 TEST_P(StoreTestSpecificAUSize, SpilloverTest) {
   if (string(GetParam()) != "bluestore")
     return;
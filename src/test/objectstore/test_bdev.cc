@@ -13,6 +13,10 @@
 #include "common/errno.h"
 
 #include "blk/BlockDevice.h"
+#if defined(HAVE_LIBURING) && defined(__x86_64__)
+#include "common/ceph_time.h"
+#include "blk/kernel/io_uring.h"
+#endif
 
 class TempBdev {
 public:
@@ -89,6 +93,72 @@ TEST(KernelDevice, Ticket45337) {
   b->close();
 }
 
+#if defined(HAVE_LIBURING) && defined(__x86_64__)
+TEST(ioring_queue_t, HipriWait) {
+  if (!ioring_queue_t::supported()) {
+    GTEST_SKIP() << "io_uring is not supported";
+  }
+  const unsigned block_size = 4096;
+  TempBdev bdev{ 1048576 };
+  int fd = ::open(bdev.path.c_str(), O_RDWR | O_DIRECT);
+  if (fd < 0) {
+    GTEST_SKIP() << "no O_DIRECT on " << bdev.path;
+  }
+
+  // polling for a while first, and blocking right away
+  for (unsigned spin_us : { 1000u, 0u }) {
+    ioring_queue_t q(16, true, spin_us, false, 0, 0);
+    std::vector<int> fds = { fd };
+    int r = q.init(fds);
+    if (r < 0) {
+      ::close(fd);
+      GTEST_SKIP() << "no IOPOLL ring: " << cpp_strerror(r);
+    }
+    aio_t *paio[16];
+
+    // nothing in flight: sleep until the timeout rather than poll
+    struct timespec cpu_start, cpu_end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+    auto start = ceph::mono_clock::now();
+    ASSERT_EQ(0, q.get_next_completed(200, paio, 16));
+    auto elapsed = ceph::mono_clock::now() - start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+    ASSERT_GE(elapsed, std::chrono::milliseconds(200));
+    uint64_t cpu_ns = (cpu_end.tv_sec - cpu_start.tv_sec) * 1000000000ull +
+      cpu_end.tv_nsec - cpu_start.tv_nsec;
+    ASSERT_LT(cpu_ns, 50000000ull);
+
+    // an io in flight is reaped whether it is found polling or waiting
+    std::list<aio_t> aios;
+    aios.emplace_back(nullptr, fd);
+    auto& aio = aios.back();
+    bufferlist bl;
+    bl.append(ceph::buffer::create_page_aligned(block_size));
+    bl.c_str()[0] = 'a' + spin_us % 26;
+    bl.prepare_iov(&aio.iov);
+    aio.bl.claim_append(bl);
+    aio.pwritev(0, block_size);
+    int retries = 0;
+    ASSERT_EQ(1, q.submit_batch(aios.begin(), aios.end(), 1, nullptr,
+				&retries));
+    r = 0;
+    for (unsigned i = 0; i < 100 && r == 0; ++i) {
+      r = q.get_next_completed(100, paio, 16);
+    }
+    ASSERT_EQ(1, r);
+    ASSERT_EQ(&aio, paio[0]);
+    if (aio.rval == -EOPNOTSUPP) {
+      q.shutdown();
+      ::close(fd);
+      GTEST_SKIP() << "no polled io on " << bdev.path;
+    }
+    ASSERT_EQ((long)block_size, aio.rval);
+    q.shutdown();
+  }
+  ::close(fd);
+}
+#endif
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
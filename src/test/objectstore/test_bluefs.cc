@@ -169,6 +169,78 @@ TEST(BlueFS, small_appends) {
   fs.umount();
 }
 
+TEST(BlueFS, read_ahead) {
+  uint64_t size = 1048576 * 128;
+  TempBdev bdev{size};
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_read_ahead_depth", "4");
+  conf.SetVal("bluefs_read_ahead_max_window", "262144");
+  conf.SetVal("bluefs_max_prefetch", "65536");
+  conf.ApplyChanges();
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false, 1048576));
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  const uint64_t file_size = 16 * 1048576 + 123;
+  {
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.mkdir("dir"));
+    ASSERT_EQ(0, fs.open_for_write("dir", "file", &h, false));
+    for (uint64_t i = 0; i < file_size; i += sizeof(uint64_t)) {
+      h->append((const char*)&i, std::min<uint64_t>(sizeof(i), file_size - i));
+    }
+    fs.fsync(h);
+    fs.close_writer(h);
+  }
+  auto verify = [](uint64_t off, const char *p, size_t len) {
+    for (size_t i = 0; i < len; ++i, ++off) {
+      uint64_t v = p2align(off, (uint64_t)sizeof(uint64_t));
+      if (p[i] != ((const char*)&v)[off - v]) {
+	return false;
+      }
+    }
+    return true;
+  };
+  {
+    // sequential reader
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("dir", "file", &h, false));
+    char buf[5000];
+    uint64_t off = 0;
+    while (off < file_size) {
+      int64_t r = fs.read(h, off, sizeof(buf), nullptr, buf);
+      ASSERT_GT(r, 0);
+      ASSERT_TRUE(verify(off, buf, r));
+      off += r;
+    }
+    ASSERT_EQ(file_size, off);
+    // jump backwards; read-ahead is dropped and restarted
+    ASSERT_EQ((int64_t)sizeof(buf), fs.read(h, 4096, sizeof(buf), nullptr, buf));
+    ASSERT_TRUE(verify(4096, buf, sizeof(buf)));
+    delete h;
+  }
+  {
+    // random reader driven by prefetch hints
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("dir", "file", &h, true));
+    char buf[8192];
+    for (uint64_t off = 1048576; off < 4 * 1048576; off += sizeof(buf)) {
+      if (off % 262144 == 0) {
+	fs.prefetch(h, off, 262144);
+      }
+      ASSERT_EQ((int64_t)sizeof(buf),
+		fs.read_random(h, off, sizeof(buf), buf));
+      ASSERT_TRUE(verify(off, buf, sizeof(buf)));
+    }
+    // stop in the middle of outstanding read-ahead
+    fs.prefetch(h, 8 * 1048576, 1048576);
+    delete h;
+  }
+  fs.umount();
+}
+
 TEST(BlueFS, very_large_write) {
   // we'll write a ~5G file, so allocate more than that for the whole fs
   uint64_t size = 1048576 * 1024 * 8ull;
@@ -628,6 +700,54 @@ TEST(BlueFS, test_compaction_async) {
   fs.umount();
 }
 
+TEST(BlueFS, test_compaction_incremental) {
+  uint64_t size = 1048576 * 128;
+  TempBdev bdev{size};
+  ConfSaver conf(g_ceph_context->_conf);
+  conf.SetVal("bluefs_alloc_size", "65536");
+  conf.SetVal("bluefs_compact_log_sync", "false");
+  conf.SetVal("bluefs_compact_log_incremental", "true");
+  conf.ApplyChanges();
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false, 1048576));
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.maybe_verify_layout({ BlueFS::BDEV_DB, false, false }));
+  {
+    writes_done = false;
+    std::vector<std::thread> write_threads;
+    uint64_t effective_size = size - (32 * 1048576); // leaving the last 32 MB for log compaction
+    uint64_t per_thread_bytes = (effective_size/(NUM_WRITERS));
+    for (int i=0; i<NUM_WRITERS; i++) {
+      write_threads.push_back(std::thread(write_data, std::ref(fs), per_thread_bytes));
+    }
+
+    std::vector<std::thread> sync_threads;
+    for (int i=0; i<NUM_SYNC_THREADS; i++) {
+      sync_threads.push_back(std::thread(sync_fs, std::ref(fs)));
+    }
+    // compact while writers keep appending to the log
+    std::thread compact_thread([&fs] {
+      while (!writes_done) {
+	fs.compact_log();
+	usleep(1000);
+      }
+    });
+
+    join_all(write_threads);
+    writes_done = true;
+    join_all(sync_threads);
+    compact_thread.join();
+    fs.compact_log();
+  }
+  fs.umount();
+  // the switched log must replay
+  ASSERT_EQ(0, fs.mount());
+  fs.umount();
+}
+
 TEST(BlueFS, test_replay) {
   uint64_t size = 1048576 * 128;
   TempBdev bdev{size};
@@ -13,6 +13,7 @@
 #include "global/global_context.h"
 
 #include <sstream>
+#include <thread>
 
 #define _STR(x) #x
 #define STRINGIFY(x) _STR(x)
@@ -334,6 +335,140 @@ TEST(bluestore_blob_t, csum_bench)
   }
 }
 
+template<class Alg>
+static void csum_serial(size_t csum_block_size, const bufferlist& bl,
+			typename Alg::value_t *pv)
+{
+  typename Alg::state_t state;
+  Alg::init(&state);
+  auto p = bl.begin();
+  for (size_t blocks = bl.length() / csum_block_size; blocks; --blocks) {
+    *pv++ = Alg::calc(state, -1, csum_block_size, p);
+  }
+  Alg::fini(&state);
+}
+
+template<class Alg>
+static void csum_batch_check(const bufferlist& bl, bool bench)
+{
+  const size_t csum_block_size = 4096;
+  size_t blocks = bl.length() / csum_block_size;
+  bufferptr serial(blocks * sizeof(typename Alg::value_t));
+  bufferptr batched(blocks * sizeof(typename Alg::value_t));
+  int count = bench ? 64 : 1;
+
+  auto start = ceph::mono_clock::now();
+  for (int i = 0; i < count; ++i) {
+    csum_serial<Alg>(csum_block_size,  bl,
+      reinterpret_cast<typename Alg::value_t*>(serial.c_str()));
+  }
+  auto mid = ceph::mono_clock::now();
+  for (int i = 0; i < count; ++i) {
+    Checksummer::calculate<Alg>(csum_block_size, 0, bl.length(), bl, &batched);
+  }
+  auto end = ceph::mono_clock::now();
+  ASSERT_EQ(0, memcmp(serial.c_str(), batched.c_str(), serial.length()));
+  ASSERT_EQ(-1, Checksummer::verify<Alg>(csum_block_size, 0, bl.length(), bl,
+					 batched));
+  if (bench) {
+    double mb = (double)count * bl.length() / 1000000.0;
+    cout << "  serial " << mb / ceph::to_seconds<double>(mid - start)
+	 << " MB/sec, batched " << mb / ceph::to_seconds<double>(end - mid)
+	 << " MB/sec" << std::endl;
+  }
+}
+
+TEST(Checksummer, batch)
+{
+  // blocks spread over buffers of awkward sizes, so that some of them
+  // straddle two buffers and some batches are cut short
+  bufferlist bl;
+  for (size_t len : {4096, 10000, 1, 4095, 16384, 77, 40000}) {
+    bufferptr bp(len);
+    for (size_t i = 0; i < len; ++i)
+      bp.c_str()[i] = rand();
+    bl.append(bp);
+  }
+  bl.splice(bl.length() / 4096 * 4096, bl.length() % 4096);
+  csum_batch_check<Checksummer::crc32c>(bl, false);
+  csum_batch_check<Checksummer::crc32c_16>(bl, false);
+  csum_batch_check<Checksummer::crc32c_8>(bl, false);
+  csum_batch_check<Checksummer::xxhash32>(bl, false);
+  csum_batch_check<Checksummer::xxhash64>(bl, false);
+
+  // a corrupted block is reported at its own offset
+  bufferptr csum(bl.length() / 4096 * sizeof(Checksummer::crc32c::value_t));
+  Checksummer::calculate<Checksummer::crc32c>(4096, 0, bl.length(), bl, &csum);
+  bufferlist bad;
+  bad.append(bl);
+  bad.rebuild();
+  bad.c_str()[4096 * 5 + 10] ^= 1;
+  uint64_t bad_csum;
+  ASSERT_EQ(4096 * 5, Checksummer::verify<Checksummer::crc32c>(
+	      4096, 0, bad.length(), bad, csum, &bad_csum));
+}
+
+TEST(Checksummer, DISABLED_batch_bench)
+{
+  bufferlist bl;
+  bufferptr bp(10485760);
+  for (char *a = bp.c_str(); a < bp.c_str() + bp.length(); ++a)
+    *a = (unsigned long)a & 0xff;
+  bl.append(bp);
+  cout << "crc32c" << std::endl;
+  csum_batch_check<Checksummer::crc32c>(bl, true);
+  cout << "xxhash32" << std::endl;
+  csum_batch_check<Checksummer::xxhash32>(bl, true);
+  cout << "xxhash64" << std::endl;
+  csum_batch_check<Checksummer::xxhash64>(bl, true);
+}
+
+TEST(CompressionEstimator, learn)
+{
+  using CE = BlueStore::CompressionEstimator;
+  // rgw multipart tails share their head's class
+  ASSERT_EQ(CE::classify("foo.jpg", 0, 0x10000),
+	    CE::classify("foo.jpg.2~a5mF_3", 0, 0x10000));
+
+  CE e;
+  unsigned cls = CE::classify("movie.mp4", 0, 0x10000);
+  ASSERT_TRUE(e.should_try(cls, 4));
+  for (int i = 0; i < 64; ++i) {
+    e.record(cls, false);
+  }
+  // only probes get through now
+  unsigned tried = 0;
+  for (int i = 0; i < 16; ++i) {
+    tried += e.should_try(cls, 4);
+  }
+  ASSERT_EQ(4u, tried);
+  ASSERT_FALSE(e.should_try(cls, 0));
+  // a few successful probes bring it back
+  for (int i = 0; i < 4; ++i) {
+    e.record(cls, true);
+  }
+  ASSERT_TRUE(e.should_try(cls, 0));
+}
+
+TEST(CompressionEstimator, sample_entropy)
+{
+  bufferlist text, noise;
+  for (unsigned i = 0; i < 0x10000 / 32; ++i) {
+    text.append("the quick brown fox jumps over ");
+    text.append(' ');
+  }
+  bufferptr bp(0x10000);
+  for (unsigned i = 0; i < bp.length(); ++i) {
+    bp.c_str()[i] = rand();
+  }
+  noise.append(bp);
+  double t = BlueStore::CompressionEstimator::sample_entropy(text);
+  double n = BlueStore::CompressionEstimator::sample_entropy(noise);
+  cout << "text " << t << " noise " << n << std::endl;
+  ASSERT_LT(t, 5.0);
+  ASSERT_GT(n, 7.6);
+}
+
 TEST(Blob, put_ref)
 {
   {
@@ -906,6 +1041,70 @@ TEST(bluestore_blob_t, prune_tail)
   ASSERT_FALSE(a.can_prune_tail());
 }
 
+TEST(bluestore_deferred_transaction_t, coalesce)
+{
+  auto add = [](bluestore_deferred_transaction_t& t,
+		std::vector<std::pair<uint64_t, std::string>> exts) {
+    t.ops.push_back(bluestore_deferred_op_t());
+    auto& op = t.ops.back();
+    op.op = bluestore_deferred_op_t::OP_WRITE;
+    for (auto& [offset, data] : exts) {
+      op.extents.emplace_back(bluestore_pextent_t(offset, data.size()));
+      op.data.append(data);
+    }
+  };
+  {
+    bluestore_deferred_transaction_t t;
+    add(t, {{0x1000, std::string(0x1000, 'a')}});
+    ASSERT_EQ(0u, t.coalesce());
+    ASSERT_EQ(1u, t.ops.size());
+  }
+  {
+    // adjacent writes are joined
+    bluestore_deferred_transaction_t t;
+    add(t, {{0x1000, std::string(0x1000, 'a')}});
+    add(t, {{0x2000, std::string(0x1000, 'b')},
+	    {0x8000, std::string(0x1000, 'c')}});
+    ASSERT_EQ(0u, t.coalesce());
+    ASSERT_EQ(1u, t.ops.size());
+    auto& op = t.ops.front();
+    ASSERT_EQ(2u, op.extents.size());
+    ASSERT_EQ(bluestore_pextent_t(0x1000, 0x2000), op.extents[0]);
+    ASSERT_EQ(bluestore_pextent_t(0x8000, 0x1000), op.extents[1]);
+    ASSERT_EQ(std::string(0x1000, 'a') + std::string(0x1000, 'b') +
+	      std::string(0x1000, 'c'), op.data.to_str());
+  }
+  {
+    // later writes win; overlapped bytes are dropped
+    bluestore_deferred_transaction_t t;
+    add(t, {{0x0, std::string(0x3000, 'a')}});
+    add(t, {{0x1000, std::string(0x800, 'b')}});
+    add(t, {{0x2800, std::string(0x1000, 'c')}});
+    add(t, {{0x0, std::string(0x800, 'd')}});
+    ASSERT_EQ(0x800u + 0x800u + 0x800u, t.coalesce());
+    ASSERT_EQ(1u, t.ops.size());
+    auto& op = t.ops.front();
+    ASSERT_EQ(1u, op.extents.size());
+    ASSERT_EQ(bluestore_pextent_t(0x0, 0x3800), op.extents[0]);
+    ASSERT_EQ(std::string(0x800, 'd') + std::string(0x800, 'a') +
+	      std::string(0x800, 'b') + std::string(0x1000, 'a') +
+	      std::string(0x1000, 'c'), op.data.to_str());
+  }
+  {
+    // a write covering several earlier ones
+    bluestore_deferred_transaction_t t;
+    add(t, {{0x1000, std::string(0x1000, 'a')},
+	    {0x3000, std::string(0x1000, 'b')}});
+    add(t, {{0x800, std::string(0x3000, 'c')}});
+    ASSERT_EQ(0x1000u + 0x800u, t.coalesce());
+    auto& op = t.ops.front();
+    ASSERT_EQ(1u, op.extents.size());
+    ASSERT_EQ(bluestore_pextent_t(0x800, 0x3800), op.extents[0]);
+    ASSERT_EQ(std::string(0x3000, 'c') + std::string(0x800, 'b'),
+	      op.data.to_str());
+  }
+}
+
 TEST(Blob, split)
 {
   BlueStore store(g_ceph_context, "", 4096);
@@ -1204,6 +1403,196 @@ TEST(ExtentMap, compress_extent_map)
   ASSERT_EQ(6u, em.extent_map.size());
 }
 
+TEST(OnodeCacheShard, clock_scan_resistance)
+{
+  PerfCountersBuilder b(g_ceph_context, "onode_cache_test",
+                        l_bluestore_first, l_bluestore_last);
+  b.add_u64_counter(l_bluestore_onode_hits, "onode_hits", "");
+  b.add_u64_counter(l_bluestore_onode_misses, "onode_misses", "");
+  std::unique_ptr<PerfCounters> logger(b.create_perf_counters());
+
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+    g_ceph_context, "clock", logger.get());
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "lru", NULL);
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+  oc->set_max(8);
+
+  auto make_oid = [](int i) {
+    return ghobject_t(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+  };
+  auto add = [&](int i) {
+    BlueStore::OnodeRef o(new BlueStore::Onode(coll.get(), make_oid(i), ""));
+    coll->onode_map.add(make_oid(i), o);
+  };
+
+  // a working set that keeps being referenced ...
+  for (int i = 0; i < 4; ++i) {
+    add(i);
+    ASSERT_TRUE(coll->onode_map.lookup(make_oid(i)));
+  }
+  {
+    // ... and an onode in use, which must never be evicted
+    BlueStore::OnodeRef in_use(
+      new BlueStore::Onode(coll.get(), make_oid(1000), ""));
+    coll->onode_map.add(make_oid(1000), in_use);
+
+    // a one-pass scan over many more objects than the cache holds
+    for (int i = 0; i < 64; ++i) {
+      add(100 + i);
+      if (i % 8 == 7) {
+	for (int j = 0; j < 4; ++j) {
+	  ASSERT_TRUE(coll->onode_map.lookup(make_oid(j)));
+	}
+      }
+      ASSERT_LE(oc->_get_num(), 9u);
+    }
+    ASSERT_TRUE(coll->onode_map.lookup(make_oid(1000)));
+  }
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(coll->onode_map.lookup(make_oid(i)));
+  }
+  ASSERT_FALSE(coll->onode_map.lookup(make_oid(100)));
+
+  oc->flush();
+  ASSERT_TRUE(oc->empty());
+}
+
+TEST(OnodeCacheShard, clock_lookup_without_shard_lock)
+{
+  PerfCountersBuilder b(g_ceph_context, "onode_cache_test",
+                        l_bluestore_first, l_bluestore_last);
+  b.add_u64_counter(l_bluestore_onode_hits, "onode_hits", "");
+  b.add_u64_counter(l_bluestore_onode_misses, "onode_misses", "");
+  std::unique_ptr<PerfCounters> logger(b.create_perf_counters());
+
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+    g_ceph_context, "clock", logger.get());
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "lru", NULL);
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+  oc->set_max(16);
+
+  auto make_oid = [](int i) {
+    return ghobject_t(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+  };
+  auto add = [&](int i) {
+    BlueStore::OnodeRef o(new BlueStore::Onode(coll.get(), make_oid(i), ""));
+    coll->onode_map.add(make_oid(i), o);
+  };
+
+  add(0);
+  {
+    // a hit must not wait for a holder of the shard lock
+    std::lock_guard l(oc->lock);
+    bool found = false;
+    std::thread t([&] {
+      found = (bool)coll->onode_map.lookup(make_oid(0));
+    });
+    t.join();
+    ASSERT_TRUE(found);
+  }
+
+  // hits racing eviction only ever see live onodes for the right oid
+  std::atomic<bool> stop = false;
+  std::atomic<uint64_t> bad = 0;
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&, r] {
+      for (unsigned i = r; !stop; ++i) {
+	auto oid = make_oid(i % 64);
+	BlueStore::OnodeRef o = coll->onode_map.lookup(oid);
+	if (o && (o->oid != oid || o->nref < 2)) {
+	  ++bad;
+	}
+      }
+    });
+  }
+  for (int i = 0; i < 20000; ++i) {
+    add(i % 64);
+  }
+  stop = true;
+  for (auto& t : readers) {
+    t.join();
+  }
+  ASSERT_EQ(0u, bad);
+
+  oc->flush();
+  ASSERT_TRUE(oc->empty());
+}
+
+TEST(BufferSpace, lockless_read)
+{
+  PerfCountersBuilder b(g_ceph_context, "buffer_cache_test",
+                        l_bluestore_first, l_bluestore_last);
+  b.add_u64_counter(l_bluestore_buffer_hit_bytes, "buffer_hit_bytes", "");
+  b.add_u64_counter(l_bluestore_buffer_miss_bytes, "buffer_miss_bytes", "");
+  b.add_u64_counter(l_bluestore_buffer_lockless_hit_bytes,
+                    "buffer_lockless_hit_bytes", "");
+  std::unique_ptr<PerfCounters> logger(b.create_perf_counters());
+
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "lru", logger.get());
+  bc->lockless_read = true;
+  bc->set_max(1 << 20);
+
+  BlueStore::BufferSpace bs;
+  bufferlist a, c;
+  a.append(std::string(0x1000, 'a'));
+  c.append(std::string(0x1000, 'c'));
+  bs.did_read(bc, 0, a);
+  bs.did_read(bc, 0x1000, c);
+
+  BlueStore::ready_regions_t res;
+  interval_set<uint32_t> res_intervals;
+
+  // first read takes the lock and publishes a snapshot
+  bs.read(bc, 0x800, 0x1000, res, res_intervals);
+  ASSERT_EQ(0x1000u, res_intervals.size());
+  ASSERT_EQ(0u, logger->get(l_bluestore_buffer_lockless_hit_bytes));
+  ASSERT_TRUE(std::atomic_load(&bs.snapshot));
+
+  // the next one is served from the snapshot
+  bs.read(bc, 0x800, 0x1000, res, res_intervals);
+  ASSERT_EQ(0x1000u, res_intervals.size());
+  ASSERT_EQ(0x1000u, logger->get(l_bluestore_buffer_lockless_hit_bytes));
+  bufferlist got;
+  for (auto& r : res) {
+    got.append(r.second);
+  }
+  ASSERT_EQ(std::string(0x800, 'a') + std::string(0x800, 'c'),
+            got.to_str());
+
+  // a partial hit falls back to the locked path
+  bs.read(bc, 0x1800, 0x1000, res, res_intervals);
+  ASSERT_EQ(0x800u, res_intervals.size());
+  ASSERT_EQ(0x1000u, logger->get(l_bluestore_buffer_lockless_hit_bytes));
+
+  // a write unpublishes the snapshot, and readers see the new data
+  bufferlist w;
+  w.append(std::string(0x1000, 'w'));
+  bs.write(bc, 1, 0, w, 0);
+  ASSERT_FALSE(std::atomic_load(&bs.snapshot));
+  bs.read(bc, 0, 0x1000, res, res_intervals);
+  bs.read(bc, 0, 0x1000, res, res_intervals);
+  ASSERT_EQ(0x2000u, logger->get(l_bluestore_buffer_lockless_hit_bytes));
+  ASSERT_EQ(std::string(0x1000, 'w'), res.begin()->second.to_str());
+
+  // so does a discard
+  bs.discard(bc, 0x1000, 0x1000);
+  ASSERT_FALSE(std::atomic_load(&bs.snapshot));
+  bs.read(bc, 0x1000, 0x1000, res, res_intervals);
+  ASSERT_EQ(0u, res_intervals.size());
+
+  {
+    std::lock_guard l(bc->lock);
+    bs._clear(bc);
+  }
+  delete bc;
+}
+
 TEST(GarbageCollector, BasicTest)
 {
   BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
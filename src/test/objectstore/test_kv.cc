@@ -606,6 +606,49 @@ TEST_P(KVTest, RocksDB_estimate_size_column_family) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBPerCFCache) {
+  if(string(GetParam()) != "rocksdb")
+    GTEST_SKIP();
+
+  g_ceph_context->_conf.set_val("rocksdb_cache_per_cf", "true");
+  g_ceph_context->_conf.apply_changes(nullptr);
+  std::string cfs("O(3) m");
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  auto caches = db->get_cf_priority_caches();
+  ASSERT_EQ(2u, caches.size());
+  ASSERT_EQ(1u, caches.count("O"));
+  ASSERT_EQ(1u, caches.count("m"));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append(string(1000, '1'));
+    for (int i = 0; i < 1000; i++) {
+      t->set("O", stringify(i), v);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+    db->compact();
+  }
+  // only onodes are being read; their cache must earn the larger share
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < 1000; i++) {
+      bufferlist v;
+      ASSERT_EQ(0, db->get("O", stringify(i), &v));
+    }
+    db->set_cache_ratios(1.0);
+  }
+  EXPECT_GT(caches["O"]->get_cache_ratio(), caches["m"]->get_cache_ratio());
+  double total = db->get_priority_cache()->get_cache_ratio();
+  for (auto& [name, c] : caches) {
+    EXPECT_GT(c->get_cache_ratio(), 0);
+    total += c->get_cache_ratio();
+  }
+  EXPECT_NEAR(1.0, total, 0.0001);
+  fini();
+  g_ceph_context->_conf.set_val("rocksdb_cache_per_cf", "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+}
+
 TEST_P(KVTest, RocksDB_parse_sharding_def) {
   if(string(GetParam()) != "rocksdb")
     GTEST_SKIP();
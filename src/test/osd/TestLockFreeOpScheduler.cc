@@ -0,0 +1,207 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+
+#include <list>
+#include <map>
+#include <set>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/common_init.h"
+
+#include "osd/scheduler/LockFreeOpScheduler.h"
+#include "osd/scheduler/OpSchedulerItem.h"
+
+using namespace ceph::osd::scheduler;
+
+int main(int argc, char **argv) {
+  std::vector<const char*> args(argv, argv+argc);
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  g_ceph_context->_conf.set_val_or_die("osd_op_queue_cut_off", "high");
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
+
+
+class LockFreeOpSchedulerTest : public testing::Test {
+public:
+  LockFreeOpScheduler q;
+
+  uint64_t client1;
+  uint64_t client2;
+
+  LockFreeOpSchedulerTest() :
+    q(g_ceph_context),
+    client1(1001),
+    client2(9999)
+  {}
+
+  struct MockItem : public PGOpQueueable {
+    MockItem() : PGOpQueueable(spg_t()) {}
+
+    op_type_t get_op_type() const final {
+      return op_type_t::client_op; // not used
+    }
+
+    ostream &print(ostream &rhs) const final { return rhs; }
+
+    std::optional<OpRequestRef> maybe_get_op() const final {
+      return std::nullopt;
+    }
+
+    op_scheduler_class get_scheduler_class() const final {
+      return op_scheduler_class::client;
+    }
+
+    void run(OSD *osd, OSDShard *sdata, PGRef& pg, ThreadPool::TPHandle &handle) final {}
+  };
+};
+
+OpSchedulerItem create_item(epoch_t e, uint64_t owner, unsigned priority)
+{
+  return OpSchedulerItem(
+    std::make_unique<LockFreeOpSchedulerTest::MockItem>(),
+    12, priority,
+    utime_t(), owner, e);
+}
+
+OpSchedulerItem get_item(WorkItem item)
+{
+  return std::move(std::get<OpSchedulerItem>(item));
+}
+
+TEST_F(LockFreeOpSchedulerTest, TestEmpty) {
+  ASSERT_TRUE(q.empty());
+
+  q.enqueue(create_item(100, client1, 63));
+  q.enqueue(create_item(102, client1, 63));
+  q.enqueue(create_item(104, client1, 63));
+
+  ASSERT_FALSE(q.empty());
+
+  std::list<OpSchedulerItem> reqs;
+
+  reqs.push_back(get_item(q.dequeue()));
+  reqs.push_back(get_item(q.dequeue()));
+
+  ASSERT_FALSE(q.empty());
+
+  for (auto &&i : reqs) {
+    q.enqueue_front(std::move(i));
+  }
+  reqs.clear();
+
+  ASSERT_FALSE(q.empty());
+
+  // requeued at the front, last first
+  ASSERT_EQ(102u, get_item(q.dequeue()).get_map_epoch());
+  ASSERT_EQ(100u, get_item(q.dequeue()).get_map_epoch());
+  ASSERT_EQ(104u, get_item(q.dequeue()).get_map_epoch());
+
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(LockFreeOpSchedulerTest, TestOrderedEnqueueDequeue) {
+  for (epoch_t e = 100; e < 105; ++e) {
+    q.enqueue(create_item(e, client1, 63));
+  }
+  for (epoch_t e = 100; e < 105; ++e) {
+    auto r = get_item(q.dequeue());
+    ASSERT_EQ(e, r.get_map_epoch());
+  }
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(LockFreeOpSchedulerTest, TestBelowCutoff) {
+  // no strict ops at all, every dequeue picks a weighted priority
+  const unsigned NUM = 100;
+  const std::vector<unsigned> prios = {0, 3, 10, 63, 64, 127};
+  for (unsigned i = 0; i < NUM; ++i) {
+    for (auto p : prios) {
+      q.enqueue(create_item(i, p, p));
+    }
+  }
+
+  std::map<uint64_t, epoch_t> next;
+  for (unsigned i = 0; i < NUM * prios.size(); ++i) {
+    ASSERT_FALSE(q.empty());
+    auto r = get_item(q.dequeue());
+    ASSERT_EQ(next[r.get_owner()], r.get_map_epoch());
+    ++next[r.get_owner()];
+  }
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(LockFreeOpSchedulerTest, TestStrict) {
+  q.enqueue(create_item(1, client1, 63));
+  q.enqueue(create_item(2, client1, CEPH_MSG_PRIO_HIGH));
+  q.enqueue(create_item(3, client2, 3));
+  q.enqueue(create_item(4, client2, CEPH_MSG_PRIO_HIGHEST));
+  q.enqueue(create_item(5, client1, CEPH_MSG_PRIO_HIGH));
+
+  // strict items first, highest priority first
+  ASSERT_EQ(4u, get_item(q.dequeue()).get_map_epoch());
+  ASSERT_EQ(2u, get_item(q.dequeue()).get_map_epoch());
+  ASSERT_EQ(5u, get_item(q.dequeue()).get_map_epoch());
+
+  std::set<epoch_t> rest;
+  rest.insert(get_item(q.dequeue()).get_map_epoch());
+  rest.insert(get_item(q.dequeue()).get_map_epoch());
+  ASSERT_EQ(std::set<epoch_t>({1, 3}), rest);
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(LockFreeOpSchedulerTest, TestWeighted) {
+  const unsigned NUM = 1000;
+  for (unsigned i = 0; i < NUM; ++i) {
+    q.enqueue(create_item(i, client1, 63));
+    q.enqueue(create_item(i, client2, 3));
+  }
+
+  // the low priority ops are not starved, nor do they go first
+  unsigned low = 0;
+  for (unsigned i = 0; i < NUM; ++i) {
+    if (get_item(q.dequeue()).get_owner() == client2) {
+      ++low;
+    }
+  }
+  ASSERT_LT(0u, low);
+  ASSERT_GT(NUM / 4, low);
+}
+
+TEST_F(LockFreeOpSchedulerTest, TestConcurrentEnqueue) {
+  const unsigned PRODUCERS = 4;
+  const unsigned NUM = 10000;
+  std::vector<std::thread> producers;
+  for (unsigned p = 0; p < PRODUCERS; ++p) {
+    producers.emplace_back([this, p] {
+      for (unsigned i = 0; i < NUM; ++i) {
+	q.enqueue(create_item(i, p, 63));
+      }
+    });
+  }
+
+  // the ops of each producer come out in order
+  std::vector<epoch_t> next(PRODUCERS, 0);
+  unsigned dequeued = 0;
+  while (dequeued < PRODUCERS * NUM) {
+    if (q.empty()) {
+      std::this_thread::yield();
+      continue;
+    }
+    auto r = get_item(q.dequeue());
+    ASSERT_EQ(next[r.get_owner()], r.get_map_epoch());
+    ++next[r.get_owner()];
+    ++dequeued;
+  }
+  for (auto &t : producers) {
+    t.join();
+  }
+  ASSERT_TRUE(q.empty());
+}
@@ -24,6 +24,7 @@
 #include <gtest/gtest.h>
 #include "common/async/context_pool.h"
 #include "osd/OSD.h"
+#include "osd/PGBackend.h"
 #include "os/ObjectStore.h"
 #include "mon/MonClient.h"
 #include "common/ceph_argparse.h"
@@ -195,6 +196,140 @@ TEST(TestOSDScrub, scrub_time_permit) {
   ASSERT_FALSE(ret);
 }
 
+TEST(TestOSDScrub, read_ahead) {
+  hobject_t a(object_t("a"), "", CEPH_NOSNAP, 1, 0, "");
+  hobject_t b(object_t("b"), "", CEPH_NOSNAP, 2, 0, "");
+  Scrub::ReadAhead ra(0);
+  Scrub::DataDigest d;
+
+  ASSERT_EQ(-ENOENT, ra.get(a, &d));
+  ra.queued(a);
+  ra.queued(b);
+  ASSERT_EQ(-EAGAIN, ra.get(a, &d));
+
+  // not waiting for a digest which is ready or was never queued
+  int woken = 0;
+  auto on_ready = [&woken] {
+    return new LambdaContext([&woken](int) { ++woken; });
+  };
+  Context *c = on_ready();
+  ASSERT_FALSE(ra.wait(hobject_t(object_t("c"), "", CEPH_NOSNAP, 3, 0, ""), c));
+  delete c;
+
+  ASSERT_TRUE(ra.wait(a, on_ready()));
+  // waiting again replaces the first context, which is never completed
+  ASSERT_TRUE(ra.wait(a, on_ready()));
+  Scrub::DataDigest bd;
+  bd.length = 10;
+  ra.finish(b, bd);
+  ASSERT_EQ(0, woken);
+  Scrub::DataDigest ad;
+  ad.length = 4096;
+  ad.digest = 0x1234;
+  ra.finish(a, ad);
+  ASSERT_EQ(1, woken);
+
+  ASSERT_EQ(0, ra.get(a, &d));
+  ASSERT_EQ(4096u, d.length);
+  ASSERT_EQ(0x1234u, d.digest);
+  ASSERT_EQ(-ENOENT, ra.get(a, &d));
+  c = on_ready();
+  ASSERT_FALSE(ra.wait(b, c));
+  delete c;
+  ASSERT_EQ(0, ra.get(b, &d));
+  ASSERT_EQ(10u, d.length);
+}
+
+static bufferptr encode_oi(const hobject_t &hoid, eversion_t version)
+{
+  object_info_t oi(hoid);
+  oi.version = version;
+  bufferlist bl;
+  encode(oi, bl, CEPH_FEATURES_ALL);
+  return bufferptr(bl.c_str(), bl.length());
+}
+
+TEST(TestOSDScrub, skip_deep_scrub_data_since) {
+  hobject_t hoid(object_t("a"), "", CEPH_NOSNAP, 0x1234, 1, "");
+  bufferptr older = encode_oi(hoid, eversion_t(5, 9));
+  bufferptr same = encode_oi(hoid, eversion_t(5, 10));
+  bufferptr newer = encode_oi(hoid, eversion_t(5, 11));
+  bufferptr next_epoch = encode_oi(hoid, eversion_t(6, 1));
+  ScrubMapBuilder pos;
+  pos.deep = true;
+
+  // a full deep scrub reads everything
+  ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &older));
+
+  pos.deep_since = eversion_t(5, 10);
+  ASSERT_TRUE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &older));
+  ASSERT_TRUE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &same));
+  ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &newer));
+  ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &next_epoch));
+}
+
+TEST(TestOSDScrub, skip_deep_scrub_data_bad_oi) {
+  hobject_t hoid(object_t("a"), "", CEPH_NOSNAP, 0x1234, 1, "");
+  ScrubMapBuilder pos;
+  pos.deep = true;
+  pos.deep_since = eversion_t(5, 10);
+
+  // without a usable object info the data is always read
+  ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, nullptr));
+  bufferptr oi = encode_oi(hoid, eversion_t(5, 9));
+  bufferptr truncated(oi.c_str(), oi.length() / 2);
+  ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &truncated));
+  bufferptr garbage(oi.length());
+  memset(garbage.c_str(), 0xff, garbage.length());
+  ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &garbage));
+}
+
+TEST(TestOSDScrub, skip_deep_scrub_data_sample) {
+  // the objects of one PG of a pool with pg_num 64
+  std::vector<hobject_t> objects;
+  for (unsigned i = 0; i < 1000; ++i) {
+    objects.emplace_back(object_t("obj" + std::to_string(i)), "", CEPH_NOSNAP,
+			 (i << 6) | 5, 1, "");
+  }
+  ScrubMapBuilder pos;
+  pos.deep = true;
+  pos.deep_since = eversion_t(5, 10);
+
+  pos.deep_sample_rate = 0;
+  for (auto &hoid : objects) {
+    bufferptr oi = encode_oi(hoid, eversion_t(5, 1));
+    ASSERT_TRUE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &oi));
+  }
+  pos.deep_sample_rate = 1;
+  for (auto &hoid : objects) {
+    bufferptr oi = encode_oi(hoid, eversion_t(5, 1));
+    ASSERT_FALSE(PGBackend::be_skip_deep_scrub_data(hoid, pos, &oi));
+  }
+
+  // rate consecutive deep scrubs read every unchanged object exactly once
+  for (uint32_t rate : {8u, 10u}) {
+    pos.deep_sample_rate = rate;
+    std::vector<unsigned> reads(objects.size());
+    for (uint32_t seq = 0; seq < rate; ++seq) {
+      pos.deep_sample_slot = seq % rate;
+      unsigned read = 0;
+      for (unsigned i = 0; i < objects.size(); ++i) {
+	bufferptr oi = encode_oi(objects[i], eversion_t(5, 1));
+	if (!PGBackend::be_skip_deep_scrub_data(objects[i], pos, &oi)) {
+	  ++reads[i];
+	  ++read;
+	}
+      }
+      // and spread the reads over them
+      ASSERT_GT(read, objects.size() / rate / 2) << "rate " << rate;
+      ASSERT_LT(read, objects.size() / rate * 2) << "rate " << rate;
+    }
+    for (unsigned i = 0; i < objects.size(); ++i) {
+      ASSERT_EQ(1u, reads[i]) << objects[i] << " rate " << rate;
+    }
+  }
+}
+
 // Local Variables:
 // compile-command: "cd ../.. ; make unittest_osdscrub ; ./unittest_osdscrub --log-to-stderr=true  --debug-osd=20 # --gtest_filter=*.* "
 // End:
@@ -0,0 +1,134 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+/*
+ * Enqueue/dequeue throughput of the OSD op schedulers, with producers
+ * standing in for the messenger threads and consumers for the workers
+ * of one OSD shard.  As in OSD::ShardedOpWQ, the consumers serialize
+ * on a shard lock, which the producers take too unless the scheduler
+ * enqueues lock free.
+ */
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "include/types.h"
+#include "common/ceph_argparse.h"
+#include "common/ceph_mutex.h"
+#include "common/Clock.h"
+#include "common/WeightedPriorityQueue.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "osd/scheduler/LockFreeOpScheduler.h"
+#include "osd/scheduler/OpScheduler.h"
+#include "osd/scheduler/OpSchedulerItem.h"
+
+using namespace ceph::osd::scheduler;
+
+struct BenchItem : public PGOpQueueable {
+  BenchItem() : PGOpQueueable(spg_t()) {}
+
+  op_type_t get_op_type() const final {
+    return op_type_t::client_op;
+  }
+  std::ostream &print(std::ostream &rhs) const final { return rhs; }
+  op_scheduler_class get_scheduler_class() const final {
+    return op_scheduler_class::client;
+  }
+  void run(OSD *osd, OSDShard *sdata, PGRef& pg,
+	   ThreadPool::TPHandle &handle) final {}
+};
+
+void run(const std::string &name, OpScheduler *q,
+	 unsigned producers, unsigned consumers, unsigned num)
+{
+  ceph::mutex shard_lock = ceph::make_mutex("bench_op_scheduler::shard_lock");
+  std::atomic<uint64_t> dequeued = {0};
+  const uint64_t total = (uint64_t)producers * num;
+
+  utime_t start = ceph_clock_now();
+  std::vector<std::thread> threads;
+  for (unsigned p = 0; p < producers; ++p) {
+    threads.emplace_back([&, p] {
+      for (unsigned i = 0; i < num; ++i) {
+	// mostly client ops, some of them strict
+	unsigned priority = i % 16 ? 63 : CEPH_MSG_PRIO_HIGH;
+	OpSchedulerItem item(std::make_unique<BenchItem>(), 4096, priority,
+			     utime_t(), p, i);
+	if (q->is_enqueue_lock_free()) {
+	  q->enqueue(std::move(item));
+	} else {
+	  std::lock_guard l{shard_lock};
+	  q->enqueue(std::move(item));
+	}
+      }
+    });
+  }
+  for (unsigned c = 0; c < consumers; ++c) {
+    threads.emplace_back([&] {
+      while (dequeued < total) {
+	std::unique_lock l{shard_lock};
+	if (q->empty()) {
+	  l.unlock();
+	  std::this_thread::yield();
+	  continue;
+	}
+	auto item = q->dequeue();
+	l.unlock();
+	++dequeued;
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+  utime_t dur = ceph_clock_now() - start;
+
+  std::cout << name << ": " << total << " ops in " << dur << " s, "
+	    << (uint64_t)(total / (double)dur) << " ops/s" << std::endl;
+}
+
+void usage(const char *name) {
+  std::cout << name << " <producers> <consumers> <ops>\n"
+	    << "\t producers: the number of threads enqueueing.\n"
+	    << "\t consumers: the number of threads dequeueing.\n"
+	    << "\t ops: the number of ops per producer.\n";
+}
+
+int main(int argc, const char **argv)
+{
+  if (argc < 4) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  unsigned producers = atoi(argv[1]);
+  unsigned consumers = atoi(argv[2]);
+  unsigned num = atoi(argv[3]);
+
+  std::vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  std::cout << producers << " producers, " << consumers << " consumers, "
+	    << num << " ops per producer" << std::endl;
+
+  {
+    ClassedOpQueueScheduler<WeightedPriorityQueue<OpSchedulerItem, client>> q(
+      g_ceph_context,
+      g_conf()->osd_op_pq_max_tokens_per_priority,
+      g_conf()->osd_op_pq_min_cost);
+    run("wpq", &q, producers, consumers, num);
+  }
+  {
+    LockFreeOpScheduler q(g_ceph_context);
+    run("lockfree_wpq", &q, producers, consumers, num);
+  }
+  return 0;
+}
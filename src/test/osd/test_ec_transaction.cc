@@ -122,3 +122,62 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+TEST(ectransaction, parity_delta)
+{
+  hobject_t h;
+  // k=4, 4096 bytes chunks, m=2
+  ECUtil::stripe_info_t sinfo(4, 16384);
+  const unsigned m = 2;
+  auto overwrite = [&](uint64_t off, uint64_t len) {
+    PGTransactionUPtr t(new PGTransaction);
+    bufferlist a;
+    a.append_zero(len);
+    t->write(h, off, a.length(), a, 0);
+    return ECTransaction::get_write_plan(
+      sinfo,
+      std::move(t),
+      [&](const hobject_t &i) {
+	ECUtil::HashInfoRef ref(new ECUtil::HashInfo(1));
+	ref->set_projected_total_logical_size(sinfo, 1048576);
+	return ref;
+      },
+      &dpp);
+  };
+
+  {
+    // within data chunk 1 of the second stripe
+    auto plan = overwrite(16384 + 4096 + 512, 1024);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_TRUE(ECTransaction::plan_parity_delta(sinfo, m, &plan));
+    ASSERT_EQ(std::set<int>({1}), plan.delta_shards[h]);
+  }
+  {
+    // the end of data chunk 3 and the start of data chunk 0 of the next
+    // stripe
+    auto plan = overwrite(16384 + 12288 + 2048, 4096);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_TRUE(ECTransaction::plan_parity_delta(sinfo, m, &plan));
+    ASSERT_EQ(std::set<int>({0, 3}), plan.delta_shards[h]);
+  }
+  {
+    // three data chunks, reading them and the coding chunks costs more
+    // than decoding the stripe
+    auto plan = overwrite(16384 + 4096, 12288 - 512);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_FALSE(ECTransaction::plan_parity_delta(sinfo, m, &plan));
+    ASSERT_TRUE(plan.delta_shards.empty());
+  }
+  {
+    // head and tail stripes around a full one are not contiguous
+    auto plan = overwrite(4096, 32768);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_FALSE(ECTransaction::plan_parity_delta(sinfo, m, &plan));
+  }
+  {
+    // full stripe, nothing to read
+    auto plan = overwrite(16384, 16384);
+    ASSERT_EQ(0u, plan.to_read.size());
+    ASSERT_FALSE(ECTransaction::plan_parity_delta(sinfo, m, &plan));
+  }
+}
@@ -1,7 +1,11 @@
+#include <map>
+#include <sched.h>
+
 #include "gtest/gtest.h"
 
 #include "common/WorkQueue.h"
 #include "common/ceph_argparse.h"
+#include "common/numa.h"
 
 TEST(WorkQueue, StartStop)
 {
@@ -53,3 +57,81 @@ TEST(WorkQueue, Resize)
   sleep(1);
   tp.stop();
 }
+
+#ifdef HAVE_SCHED
+struct AffinityWQ : public ShardedThreadPool::ShardedWQ<int> {
+  ceph::mutex lock = ceph::make_mutex("AffinityWQ::lock");
+  std::map<uint32_t, cpu_set_t> seen;  ///< cpus of each shard thread
+
+  explicit AffinityWQ(ShardedThreadPool *tp)
+    : ShardedWQ(ceph::make_timespan(60), ceph::make_timespan(0), tp) {}
+
+  void _process(uint32_t thread_index, ceph::heartbeat_handle_d *hb) override {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    sched_getaffinity(0, sizeof(cpus), &cpus);
+    {
+      std::lock_guard l(lock);
+      seen[thread_index] = cpus;
+    }
+    usleep(1000);
+  }
+  void _enqueue(int&&) override {}
+  void _enqueue_front(int&&) override {}
+  void return_waiting_threads() override {}
+  void stop_return_waiting_threads() override {}
+  bool is_shard_empty(uint32_t thread_index) override {
+    return true;
+  }
+};
+
+TEST(WorkQueue, ShardedAffinity)
+{
+  const uint32_t num_threads = 4;
+  ShardedThreadPool tp(g_ceph_context, "baz", "tp_baz", num_threads);
+  AffinityWQ wq(&tp);
+
+  // the cpus of numa node 0, or a single cpu we may run on
+  size_t cpu_set_size = 0;
+  cpu_set_t cpus;
+  if (get_numa_node_cpu_set(0, &cpu_set_size, &cpus) < 0) {
+    cpu_set_t mine;
+    CPU_ZERO(&mine);
+    ASSERT_EQ(0, sched_getaffinity(0, sizeof(mine), &mine));
+    CPU_ZERO(&cpus);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &mine)) {
+	CPU_SET(cpu, &cpus);
+	break;
+      }
+    }
+    cpu_set_size = sizeof(cpus);
+  }
+
+  // nothing to pin before the threads run
+  ASSERT_EQ(-EAGAIN, tp.set_cpu_affinity(cpu_set_size, &cpus));
+
+  tp.start();
+  int r;
+  while ((r = tp.set_cpu_affinity(cpu_set_size, &cpus)) == -EAGAIN) {
+    usleep(1000);
+  }
+  ASSERT_EQ(0, r);
+
+  // every shard thread ends up on the same node; a thread may still
+  // report the cpus it saw just before it was pinned
+  unsigned pinned = 0;
+  for (unsigned i = 0; i < 10000 && pinned < num_threads; ++i) {
+    usleep(1000);
+    std::lock_guard l(wq.lock);
+    pinned = 0;
+    for (auto& [index, seen] : wq.seen) {
+      if (CPU_EQUAL(&cpus, &seen)) {
+	++pinned;
+      }
+    }
+  }
+  ASSERT_EQ(num_threads, pinned);
+  tp.stop();
+}
+#endif
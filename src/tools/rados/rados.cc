@@ -33,6 +33,7 @@
 #include "common/Formatter.h"
 #include "common/obj_bencher.h"
 #include "common/TextTable.h"
+#include "compressor/Compressor.h"
 #include "include/stringify.h"
 #include "mds/inode_backtrace.h"
 #include "include/random.h"
@@ -125,6 +126,12 @@ void usage(ostream& out)
 "   listwatchers <obj-name>          list the watchers of this object\n"
 "   set-alloc-hint <obj-name> <expected-object-size> <expected-write-size>\n"
 "                                    set allocation hint for an object\n"
+"   train-compression-dictionary [outfile] [--max-objects n]\n"
+"                                    train a zstd dictionary on (default 1000)\n"
+"                                    objects, store it at config-key\n"
+"                                    compression_dictionary/<id> and set <id>\n"
+"                                    as the pool's compression_dictionary, or\n"
+"                                    save it to outfile\n"
 "   set-redirect <object A> --target-pool <caspool> <target object A> [--with-reference]\n"
 "                                    set redirect target\n"
 "   set-chunk <object A> <offset> <length> --target-pool <caspool> <target object A> <taget-offset> [--with-reference]\n"
@@ -463,6 +470,77 @@ static int dump_data(std::string const &filename, bufferlist const &data)
 }
 
 
+static int do_train_compression_dictionary(Rados& rados, IoCtx& io_ctx,
+					   const char *pool_name,
+					   const char *outfile,
+					   unsigned max_objects)
+{
+  // small objects are what dictionaries help with; only sample the start
+  // of large ones
+  const unsigned sample_size = 16384;
+  const unsigned dict_size = 65536;
+
+  CompressorRef c = Compressor::create(g_ceph_context, "zstd");
+  if (!c) {
+    cerr << "zstd compressor is not available" << std::endl;
+    return -ENOENT;
+  }
+  std::vector<bufferlist> samples;
+  try {
+    for (auto i = io_ctx.nobjects_begin(); i != io_ctx.nobjects_end() &&
+	   samples.size() < max_objects; ++i) {
+      io_ctx.locator_set_key(i->get_locator());
+      io_ctx.set_namespace(i->get_nspace());
+      bufferlist bl;
+      int r = io_ctx.read(i->get_oid(), bl, sample_size, 0);
+      if (r > 0) {
+	samples.push_back(std::move(bl));
+      }
+    }
+  } catch (const std::exception& e) {
+    cerr << e.what() << std::endl;
+    return -EIO;
+  }
+  bufferlist raw;
+  int r = c->train_dictionary(samples, dict_size, &raw);
+  if (r < 0) {
+    cerr << "failed to train a dictionary on " << samples.size()
+	 << " objects: " << cpp_strerror(r) << std::endl;
+    return r;
+  }
+  // the pool option only names the dictionary, by the crc32c of its bytes
+  char id[9];
+  snprintf(id, sizeof(id), "%08x", raw.crc32c(0));
+  cerr << "trained a " << raw.length() << " byte dictionary " << id
+       << " on " << samples.size() << " objects" << std::endl;
+
+  if (outfile) {
+    r = raw.write_file(outfile);
+    if (r < 0) {
+      cerr << "error writing " << outfile << ": " << cpp_strerror(r)
+	   << std::endl;
+    }
+    return r;
+  }
+  string cmd = "{\"prefix\": \"config-key set\", "
+    "\"key\": \"compression_dictionary/" + string(id) + "\"}";
+  bufferlist outbl;
+  string outs;
+  r = rados.mon_command(cmd, raw, &outbl, &outs);
+  if (r < 0) {
+    cerr << "failed to store the dictionary: " << outs << std::endl;
+    return r;
+  }
+  cmd = "{\"prefix\": \"osd pool set\", \"pool\": \"" +
+    string(pool_name) + "\", \"var\": \"compression_dictionary\", " +
+    "\"val\": \"" + string(id) + "\"}";
+  r = rados.mon_command(cmd, {}, &outbl, &outs);
+  if (r < 0) {
+    cerr << "failed to set compression_dictionary: " << outs << std::endl;
+  }
+  return r;
+}
+
 static int do_get(IoCtx& io_ctx, const char *objname, const char *outfile, unsigned op_size, [[maybe_unused]] const bool use_striper)
 {
   string oid(objname);
@@ -3336,6 +3414,17 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
            << cpp_strerror(ret) << std::endl;
       return 1;
     }
+  } else if (strcmp(nargs[0], "train-compression-dictionary") == 0) {
+    if (!pool_name) {
+      usage(cerr);
+      return 1;
+    }
+    ret = do_train_compression_dictionary(
+      rados, io_ctx, pool_name, nargs.size() > 1 ? nargs[1] : nullptr,
+      max_objects ? max_objects : 1000);
+    if (ret < 0) {
+      return 1;
+    }
   } else if (strcmp(nargs[0], "load-gen") == 0) {
     if (!pool_name) {
       cerr << "error: must specify pool" << std::endl;